@@ -0,0 +1,214 @@
+#include "Benchmark.h"
+#include "Kr/KrAllocator.h"
+#include "Kr/KrAtomic.h"
+#include "Kr/KrBasic.h"
+#include "Kr/KrThread.h"
+
+#include <stdio.h>
+
+//
+// The default (malloc) allocator against the thread caching allocator: alloc/free pairs, bursts freed in
+// order, Array growth, independent threads and blocks allocated on one thread and freed on another.
+//
+
+static constexpr int BENCH_ALLOC_ROUNDS     = 16;
+static constexpr int BENCH_ALLOC_BURST      = 1024;
+static constexpr int BENCH_ALLOC_ITERATIONS = 256; // bursts per round
+static constexpr int BENCH_ALLOC_THREADS    = 4;
+static constexpr int BENCH_ALLOC_RING       = 1024;
+
+struct Bench_Alloc_Ring {
+	void *volatile   slots[BENCH_ALLOC_RING];
+	int32_t volatile head;
+	int32_t volatile tail;
+};
+
+struct Bench_Alloc_Thread {
+	Memory_Allocator  allocator;
+	Bench_Alloc_Ring *ring;
+	uint64_t          ops;
+};
+
+// Keeps the compiler from dropping the allocations
+static volatile uintptr_t BenchAllocSink;
+
+static inline size_t Bench_AllocSize(uint32_t *state, size_t max) {
+	*state = *state * 1664525u + 1013904223u;
+	return 16 + (*state >> 8) % max;
+}
+
+static uint64_t Bench_AllocPairs(Memory_Allocator allocator) {
+	uint32_t state = 7;
+	for (int iter = 0; iter < BENCH_ALLOC_ITERATIONS; ++iter) {
+		for (int index = 0; index < BENCH_ALLOC_BURST; ++index) {
+			size_t size = Bench_AllocSize(&state, 512);
+			void * ptr  = MemoryAllocate(size, allocator);
+			BenchAllocSink = (uintptr_t)ptr;
+			MemoryFree(ptr, size, allocator);
+		}
+	}
+	return (uint64_t)BENCH_ALLOC_ITERATIONS * BENCH_ALLOC_BURST;
+}
+
+static uint64_t Bench_AllocBursts(Memory_Allocator allocator) {
+	void * ptrs[BENCH_ALLOC_BURST];
+	size_t sizes[BENCH_ALLOC_BURST];
+
+	uint32_t state = 11;
+	for (int iter = 0; iter < BENCH_ALLOC_ITERATIONS; ++iter) {
+		for (int index = 0; index < BENCH_ALLOC_BURST; ++index) {
+			sizes[index] = Bench_AllocSize(&state, 2048);
+			ptrs[index]  = MemoryAllocate(sizes[index], allocator);
+			*(uint8_t *)ptrs[index] = (uint8_t)index;
+		}
+		for (int index = 0; index < BENCH_ALLOC_BURST; ++index)
+			MemoryFree(ptrs[index], sizes[index], allocator);
+	}
+	return (uint64_t)BENCH_ALLOC_ITERATIONS * BENCH_ALLOC_BURST;
+}
+
+static uint64_t Bench_AllocArrays(Memory_Allocator allocator) {
+	uint64_t ops = 0;
+	for (int iter = 0; iter < BENCH_ALLOC_ITERATIONS / 4; ++iter) {
+		Array<int> arrays[16];
+		for (Array<int> &array : arrays) {
+			array.allocator = allocator;
+			for (int value = 0; value < 4096; ++value)
+				array.Add(value);
+			ops += 1;
+		}
+		for (Array<int> &array : arrays)
+			Free(&array);
+	}
+	return ops;
+}
+
+static int Bench_AllocThreadProc(void *arg) {
+	Bench_Alloc_Thread *thread = (Bench_Alloc_Thread *)arg;
+	thread->ops = Bench_AllocBursts(thread->allocator);
+	return 0;
+}
+
+static int Bench_AllocProducerProc(void *arg) {
+	Bench_Alloc_Thread *thread = (Bench_Alloc_Thread *)arg;
+	Bench_Alloc_Ring *  ring   = thread->ring;
+
+	uint32_t state = 13;
+	int32_t  count = BENCH_ALLOC_ITERATIONS * BENCH_ALLOC_BURST;
+	for (int32_t index = 0; index < count; ++index) {
+		void *ptr = MemoryAllocate(Bench_AllocSize(&state, 512), thread->allocator);
+		while (index - AtomicLoad(&ring->tail) >= BENCH_ALLOC_RING)
+			Thread_Yield();
+		ring->slots[index % BENCH_ALLOC_RING] = ptr;
+		AtomicStore(&ring->head, index + 1);
+	}
+	thread->ops = count;
+	return 0;
+}
+
+static int Bench_AllocConsumerProc(void *arg) {
+	Bench_Alloc_Thread *thread = (Bench_Alloc_Thread *)arg;
+	Bench_Alloc_Ring *  ring   = thread->ring;
+
+	int32_t count = BENCH_ALLOC_ITERATIONS * BENCH_ALLOC_BURST;
+	for (int32_t index = 0; index < count; ++index) {
+		while (AtomicLoad(&ring->head) == index)
+			Thread_Yield();
+		MemoryFree(ring->slots[index % BENCH_ALLOC_RING], 0, thread->allocator);
+		AtomicStore(&ring->tail, index + 1);
+	}
+	return 0;
+}
+
+static void Bench_AllocJoin(Thread **threads, int count) {
+	for (int index = 0; index < count; ++index) {
+		Thread_Wait(threads[index], -1);
+		Thread_Destroy(threads[index]);
+	}
+}
+
+static uint64_t Bench_AllocThreads(Memory_Allocator allocator) {
+	Thread_Context_Params params = ThreadContextDefaultParams;
+	params.allocator             = allocator;
+	params.logger                = ThreadContext.logger;
+
+	Bench_Alloc_Thread args[BENCH_ALLOC_THREADS];
+	Thread *           threads[BENCH_ALLOC_THREADS];
+	for (int index = 0; index < BENCH_ALLOC_THREADS; ++index) {
+		args[index].allocator = allocator;
+		args[index].ring      = nullptr;
+		args[index].ops       = 0;
+		threads[index]        = Thread_Create(Bench_AllocThreadProc, &args[index], 0, params);
+	}
+	Bench_AllocJoin(threads, BENCH_ALLOC_THREADS);
+
+	uint64_t ops = 0;
+	for (const Bench_Alloc_Thread &arg : args)
+		ops += arg.ops;
+	return ops;
+}
+
+static uint64_t Bench_AllocCrossThread(Memory_Allocator allocator) {
+	Thread_Context_Params params = ThreadContextDefaultParams;
+	params.allocator             = allocator;
+	params.logger                = ThreadContext.logger;
+
+	static Bench_Alloc_Ring ring;
+	ring.head = 0;
+	ring.tail = 0;
+
+	Bench_Alloc_Thread producer = { allocator, &ring, 0 };
+	Bench_Alloc_Thread consumer = { allocator, &ring, 0 };
+
+	Thread *threads[2];
+	threads[0] = Thread_Create(Bench_AllocProducerProc, &producer, 0, params);
+	threads[1] = Thread_Create(Bench_AllocConsumerProc, &consumer, 0, params);
+	Bench_AllocJoin(threads, 2);
+
+	return producer.ops;
+}
+
+typedef uint64_t(*Bench_Alloc_Proc)(Memory_Allocator allocator);
+
+struct Bench_Alloc_Case {
+	const char *     name;
+	Bench_Alloc_Proc proc;
+	int              rounds;
+};
+
+static void Bench_AllocRun(const Bench_Alloc_Case &test, const char *name, Memory_Allocator allocator) {
+	uint64_t samples[BENCH_ALLOC_ROUNDS];
+	uint64_t ops = 0;
+
+	for (int round = 0; round < test.rounds; ++round) {
+		uint64_t start = MonotonicNanosecs();
+		ops = test.proc(allocator);
+		samples[round] = MonotonicNanosecs() - start;
+	}
+
+	double p50 = (double)Bench_Percentile(samples, test.rounds, 50.0) / (double)ops;
+	double min = (double)samples[0] / (double)ops;
+
+	printf("%-13s %-8s p50 %8.1f ns/op   min %8.1f ns/op\n", test.name, name, p50, min);
+}
+
+void Bench_Allocator() {
+	const Bench_Alloc_Case cases[] = {
+		{ "pairs",        Bench_AllocPairs,       BENCH_ALLOC_ROUNDS },
+		{ "bursts",       Bench_AllocBursts,      BENCH_ALLOC_ROUNDS },
+		{ "arrays",       Bench_AllocArrays,      BENCH_ALLOC_ROUNDS },
+		{ "threads",      Bench_AllocThreads,     BENCH_ALLOC_ROUNDS / 2 },
+		{ "cross-thread", Bench_AllocCrossThread, BENCH_ALLOC_ROUNDS / 2 },
+	};
+
+	for (const Bench_Alloc_Case &test : cases) {
+		Bench_AllocRun(test, "default", ThreadContextDefaultParams.allocator);
+		Bench_AllocRun(test, "caching", CachingAllocator());
+	}
+
+	Caching_Allocator_Stats stats;
+	CachingAllocatorGetStats(&stats);
+	printf("caching: %lld spans, %lld large (%lld reused, %lld live), depot %lld batches, %lld refills, %lld releases\n",
+		(long long)stats.small_spans, (long long)stats.large_total, (long long)stats.large_reused, (long long)stats.large_live,
+		(long long)stats.depot_batches, (long long)stats.depot_refills, (long long)stats.depot_releases);
+}
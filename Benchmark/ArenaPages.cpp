@@ -0,0 +1,206 @@
+#include "Benchmark.h"
+#include "Json.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#if PLATFORM_WINDOWS == 1
+#define PSAPI_VERSION 2
+#include <Windows.h>
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#endif
+
+//
+// JsonParse of a large GUILD_CREATE like document into a 512 MB arena, with regular and huge pages and
+// with the committed memory prefaulted. The first parse runs on fresh memory, the following ones reuse it
+// after MemoryArenaReset as the gateway loop does. Then a burst followed by small reset cycles, with and
+// without MEMORY_ARENA_DECOMMIT: the commit left after the resets and what the cycles cost.
+//
+
+static constexpr int       BENCH_ARENA_WARM_ROUNDS = 8;
+static constexpr ptrdiff_t BENCH_ARENA_MEMBERS     = 60000;
+static constexpr ptrdiff_t BENCH_ARENA_CHANNELS    = 500;
+static constexpr size_t    BENCH_ARENA_SIZE        = MegaBytes(512);
+static constexpr size_t    BENCH_ARENA_BURST       = MegaBytes(200);
+static constexpr size_t    BENCH_ARENA_CYCLE       = MegaBytes(1);
+static constexpr int       BENCH_ARENA_CYCLES      = 60;
+
+struct Bench_Arena_Case {
+	const char *name;
+	uint32_t    flags;
+	size_t      commit; // committed when the arena is allocated
+};
+
+static uint64_t Bench_PageFaults() {
+#if PLATFORM_WINDOWS == 1
+	PROCESS_MEMORY_COUNTERS counters;
+	if (GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+		return counters.PageFaultCount;
+	return 0;
+#else
+	rusage usage;
+	getrusage(RUSAGE_SELF, &usage);
+	return (uint64_t)usage.ru_minflt + (uint64_t)usage.ru_majflt;
+#endif
+}
+
+static ptrdiff_t Bench_Append(uint8_t *buffer, ptrdiff_t pos, ptrdiff_t cap, const char *fmt, ...) {
+	va_list args;
+	va_start(args, fmt);
+	int written = vsnprintf((char *)buffer + pos, cap - pos, fmt, args);
+	va_end(args);
+	return pos + written;
+}
+
+static String Bench_GuildCreate(Memory_Arena *arena) {
+	ptrdiff_t cap    = MegaBytes(64);
+	uint8_t * buffer = (uint8_t *)PushSize(arena, cap);
+	ptrdiff_t pos    = 0;
+
+	pos = Bench_Append(buffer, pos, cap, "{\"t\":\"GUILD_CREATE\",\"s\":2,\"op\":0,\"d\":{\"id\":\"81384788765712384\",\"name\":\"Bench\",\"member_count\":%td,\"channels\":[", BENCH_ARENA_MEMBERS);
+
+	for (ptrdiff_t index = 0; index < BENCH_ARENA_CHANNELS; ++index) {
+		pos = Bench_Append(buffer, pos, cap,
+			"%s{\"id\":\"%td\",\"type\":0,\"name\":\"channel-%td\",\"position\":%td,\"topic\":null,\"nsfw\":false,"
+			"\"permission_overwrites\":[{\"id\":\"%td\",\"type\":0,\"allow\":\"1024\",\"deny\":\"0\"}]}",
+			index ? "," : "", 41771983423143937 + index, index, index, 41771983423143937 + index);
+	}
+
+	pos = Bench_Append(buffer, pos, cap, "],\"members\":[");
+
+	for (ptrdiff_t index = 0; index < BENCH_ARENA_MEMBERS; ++index) {
+		pos = Bench_Append(buffer, pos, cap,
+			"%s{\"user\":{\"id\":\"%td\",\"username\":\"member%td\",\"discriminator\":\"%04td\",\"avatar\":\"8342729096ea3675442027381ff50dfe\","
+			"\"bot\":false,\"public_flags\":64},\"nick\":null,\"roles\":[\"%td\",\"%td\"],\"joined_at\":\"2015-04-26T06:26:56.936000+00:00\","
+			"\"deaf\":false,\"mute\":false,\"pending\":false}",
+			index ? "," : "", 80351110224678912 + index, index, index % 10000, 41771983423143936 + index % 7, 41771983423143936 + index % 13);
+	}
+
+	pos = Bench_Append(buffer, pos, cap, "]}}");
+
+	Assert(pos < cap);
+	return String(buffer, pos);
+}
+
+static void Bench_ArenaRun(const Bench_Arena_Case &test, const String document) {
+	uint64_t faults = Bench_PageFaults();
+	uint64_t start  = MonotonicNanosecs();
+
+	Memory_Arena *arena = MemoryArenaAllocate(BENCH_ARENA_SIZE, test.commit, test.flags);
+	if (!arena) {
+		printf("%-16s allocation failed\n", test.name);
+		return;
+	}
+
+	uint64_t create_ns     = MonotonicNanosecs() - start;
+	uint64_t create_faults = Bench_PageFaults() - faults;
+
+	// As in the gateway loop, everything allocated while parsing comes from the arena
+	Memory_Allocator allocator = ThreadContext.allocator;
+	ThreadContext.allocator    = MemoryArenaAllocator(arena);
+
+	Json json;
+
+	faults = Bench_PageFaults();
+	start  = MonotonicNanosecs();
+	bool parsed = JsonParse(document, &json, MemoryArenaAllocator(arena));
+	uint64_t cold_ns     = MonotonicNanosecs() - start;
+	uint64_t cold_faults = Bench_PageFaults() - faults;
+	size_t   used        = MemoryArenaUsedSize(arena);
+
+	uint64_t samples[BENCH_ARENA_WARM_ROUNDS];
+
+	faults = Bench_PageFaults();
+	for (int round = 0; round < BENCH_ARENA_WARM_ROUNDS; ++round) {
+		MemoryArenaReset(arena);
+		start = MonotonicNanosecs();
+		parsed &= JsonParse(document, &json, MemoryArenaAllocator(arena));
+		samples[round] = MonotonicNanosecs() - start;
+	}
+	uint64_t warm_faults = Bench_PageFaults() - faults;
+
+	ThreadContext.allocator = allocator;
+
+	uint32_t flags = MemoryArenaGetFlags(arena);
+	MemoryArenaFree(arena);
+
+	double megabytes = (double)document.length / (double)MegaBytes(1);
+	double cold      = megabytes / ((double)cold_ns / 1e9);
+	double warm      = megabytes / ((double)Bench_Percentile(samples, BENCH_ARENA_WARM_ROUNDS, 50.0) / 1e9);
+
+	const char *pages = (flags & MEMORY_ARENA_HUGETLB) ? "hugetlb" : (flags & MEMORY_ARENA_HUGE_PAGES) ? "thp" : "4k";
+
+	printf("%-16s %-7s create %7.1f ms %7llu faults   cold %7.1f MB/s %7llu faults   warm %7.1f MB/s %5llu faults   %zu MB used%s\n",
+		test.name, pages, (double)create_ns / 1e6, (unsigned long long)create_faults,
+		cold, (unsigned long long)cold_faults, warm, (unsigned long long)warm_faults,
+		used / MegaBytes(1), parsed ? "" : "   parse failed");
+}
+
+static double Bench_CommittedMB(Memory_Arena *arena) {
+	return (double)MemoryArenaGetUsage(arena).committed / (double)MegaBytes(1);
+}
+
+// The memory is written so that it is resident, as the parsed documents are
+static void Bench_ArenaDecommit(const char *name, uint32_t flags) {
+	Memory_Arena *arena = MemoryArenaAllocate(BENCH_ARENA_SIZE, MemoryArenaCommitSize, flags);
+	if (!arena) {
+		printf("%-16s allocation failed\n", name);
+		return;
+	}
+
+	memset(PushSize(arena, BENCH_ARENA_BURST), 1, BENCH_ARENA_BURST);
+	double burst = Bench_CommittedMB(arena);
+	MemoryArenaReset(arena);
+
+	double   after[3] = {};
+	uint64_t samples[BENCH_ARENA_CYCLES];
+	uint64_t faults   = Bench_PageFaults();
+
+	for (int cycle = 0; cycle < BENCH_ARENA_CYCLES; ++cycle) {
+		uint64_t start = MonotonicNanosecs();
+		memset(PushSize(arena, BENCH_ARENA_CYCLE), 1, BENCH_ARENA_CYCLE);
+		MemoryArenaReset(arena);
+		samples[cycle] = MonotonicNanosecs() - start;
+
+		if (cycle + 1 == 10) after[0] = Bench_CommittedMB(arena);
+		if (cycle + 1 == 30) after[1] = Bench_CommittedMB(arena);
+		if (cycle + 1 == 60) after[2] = Bench_CommittedMB(arena);
+	}
+
+	faults = Bench_PageFaults() - faults;
+
+	Memory_Arena_Usage usage = MemoryArenaGetUsage(arena);
+	MemoryArenaFree(arena);
+
+	double p50 = (double)Bench_Percentile(samples, BENCH_ARENA_CYCLES, 50.0) / 1e3;
+	double max = (double)Bench_Percentile(samples, BENCH_ARENA_CYCLES, 100.0) / 1e3;
+
+	printf("%-16s burst %5.1f MB committed, after 10/30/60 resets %6.1f %6.1f %6.1f MB   %3llu decommits   cycle p50 %7.1f us max %7.1f us   %5llu faults\n",
+		name, burst, after[0], after[1], after[2], (unsigned long long)usage.decommits, p50, max, (unsigned long long)faults);
+}
+
+void Bench_ArenaPages() {
+	Memory_Arena *arena = MemoryArenaAllocate(MegaBytes(128));
+	if (!arena) return;
+
+	String document = Bench_GuildCreate(arena);
+	printf("document %.1f MB, %td members\n", (double)document.length / (double)MegaBytes(1), BENCH_ARENA_MEMBERS);
+
+	const Bench_Arena_Case cases[] = {
+		{ "regular",          MEMORY_ARENA_DEFAULT,                              MemoryArenaCommitSize },
+		{ "regular+prefault", MEMORY_ARENA_PREFAULT,                             MegaBytes(256) },
+		{ "huge",             MEMORY_ARENA_HUGE_PAGES,                           MemoryArenaCommitSize },
+		{ "huge+prefault",    MEMORY_ARENA_HUGE_PAGES | MEMORY_ARENA_PREFAULT,   MegaBytes(256) },
+		{ "hugetlb",          MEMORY_ARENA_HUGETLB,                              MemoryArenaCommitSize },
+	};
+
+	for (const Bench_Arena_Case &test : cases)
+		Bench_ArenaRun(test, document);
+
+	MemoryArenaFree(arena);
+
+	Bench_ArenaDecommit("burst", MEMORY_ARENA_DEFAULT);
+	Bench_ArenaDecommit("burst+decommit", MEMORY_ARENA_DECOMMIT);
+}
@@ -0,0 +1,40 @@
+#pragma once
+#include "Kr/KrCommon.h"
+
+typedef void(*Bench_Proc)();
+
+struct Bench_Entry {
+	const char *name;
+	Bench_Proc  proc;
+};
+
+// Sorts the samples, 'percentile' is in the range [0, 100]
+uint64_t Bench_Percentile(uint64_t *samples, ptrdiff_t count, double percentile);
+
+struct Bench_Allocation_Counter {
+	Memory_Allocator parent;
+	int64_t          count;
+};
+
+// Counts the allocations and reallocations made through it, the memory comes from the counter's parent
+Memory_Allocator Bench_CountingAllocator(Bench_Allocation_Counter *counter);
+
+void Bench_HttpServer();
+void Bench_HttpClientPlain();
+void Bench_HttpClientTls();
+void Bench_HttpClientAsync();
+void Bench_HttpCache();
+void Bench_HttpDownload();
+void Bench_DiscordMessage();
+void Bench_HttpBuild();
+void Bench_ArenaPages();
+void Bench_Allocator();
+void Bench_HashTable();
+void Bench_Jobs();
+void Bench_Locks();
+void Bench_Log();
+void Bench_Strings();
+void Bench_Format();
+void Bench_WebsocketFrames();
+void Bench_Cache();
+void Bench_Profile();
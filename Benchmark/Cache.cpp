@@ -0,0 +1,143 @@
+#include "Benchmark.h"
+#include "Kr/KrCache.h"
+#include "Kr/KrThread.h"
+
+#include <math.h>
+#include <stdio.h>
+
+//
+// Read-through use of the cache, what a bot does with channels and users: look the snowflake up and put it
+// on a miss, as if it had been fetched. The ids are drawn with a Zipf like skew (a few channels get most of
+// the traffic) from 64K of them, with the cache holding from 1/64 of them to all of them. Then the same
+// with threads sharing the cache, against a Hash_Table behind one spin lock that never evicts.
+//
+
+static constexpr ptrdiff_t BENCH_CACHE_KEYS       = 1 << 16;
+static constexpr ptrdiff_t BENCH_CACHE_DRAWS      = 1 << 20;
+static constexpr ptrdiff_t BENCH_CACHE_OPERATIONS = 1 << 21;
+static constexpr int       BENCH_CACHE_THREADS    = 4;
+
+struct Bench_Channel {
+	uint64_t guild_id;
+	uint64_t last_message_id;
+	uint64_t permissions;
+	int32_t  position;
+	int32_t  flags;
+};
+
+struct Bench_Cache_Thread {
+	Cache<uint64_t, Bench_Channel> *              cache;
+	Hash_Table<uint64_t, Bench_Channel> *         table;
+	Atomic_Guard *                                guard;
+	const uint64_t *                              draws;
+	ptrdiff_t                                     offset;
+	int64_t                                       hits;
+};
+
+static Bench_Channel Bench_CacheFetch(uint64_t id) {
+	return { id >> 22, id + 1, id * 31, (int32_t)(id & 63), 0 };
+}
+
+static int Bench_CacheThreadProc(void *arg) {
+	Bench_Cache_Thread *thread = (Bench_Cache_Thread *)arg;
+
+	for (ptrdiff_t index = 0; index < BENCH_CACHE_OPERATIONS; ++index) {
+		uint64_t      id = thread->draws[(thread->offset + index) & (BENCH_CACHE_DRAWS - 1)];
+		Bench_Channel channel;
+
+		if (thread->cache) {
+			if (thread->cache->Find(id, &channel)) {
+				thread->hits += 1;
+			} else {
+				thread->cache->Put(id, Bench_CacheFetch(id));
+			}
+		} else {
+			SpinLock(thread->guard);
+			Bench_Channel *found = thread->table->Find(id);
+			if (found) {
+				channel = *found;
+				thread->hits += 1;
+			} else {
+				thread->table->Put(id, Bench_CacheFetch(id));
+			}
+			SpinUnlock(thread->guard);
+		}
+	}
+
+	return 0;
+}
+
+static void Bench_CacheRun(const char *name, int count, Cache<uint64_t, Bench_Channel> *cache, Hash_Table<uint64_t, Bench_Channel> *table,
+	const uint64_t *draws) {
+	Atomic_Guard       guard = {};
+	Bench_Cache_Thread threads[BENCH_CACHE_THREADS];
+	Thread *           handles[BENCH_CACHE_THREADS];
+
+	uint64_t start = MonotonicNanosecs();
+	for (int index = 0; index < count; ++index) {
+		threads[index] = { cache, table, &guard, draws, index * (BENCH_CACHE_DRAWS / BENCH_CACHE_THREADS), 0 };
+		handles[index] = Thread_Create(Bench_CacheThreadProc, &threads[index]);
+	}
+
+	int64_t hits = 0;
+	for (int index = 0; index < count; ++index) {
+		Thread_Wait(handles[index], -1);
+		Thread_Destroy(handles[index]);
+		hits += threads[index].hits;
+	}
+	double nanosecs = (double)(MonotonicNanosecs() - start);
+
+	double operations = (double)BENCH_CACHE_OPERATIONS * count;
+	printf("%-10s %d threads  %6.1f ns/op  %6.2f M ops/s  hit rate %5.1f%%", name, count, nanosecs / operations,
+		operations / nanosecs * 1e3, 100.0 * (double)hits / operations);
+
+	if (cache) {
+		Cache_Stats stats;
+		cache->GetStats(&stats);
+		printf("  evictions %lld, entries %lld", (long long)stats.evictions, (long long)stats.entries);
+	}
+	printf("\n");
+}
+
+void Bench_Cache() {
+	uint64_t *ids   = (uint64_t *)MemoryAllocate(sizeof(uint64_t) * BENCH_CACHE_KEYS);
+	uint64_t *draws = (uint64_t *)MemoryAllocate(sizeof(uint64_t) * BENCH_CACHE_DRAWS);
+	if (!ids || !draws) return;
+
+	// Snowflakes of the last few years, the rank of a draw is about 1/x distributed
+	uint64_t state = 0x853c49e6748fea9b;
+	for (ptrdiff_t index = 0; index < BENCH_CACHE_KEYS; ++index) {
+		state      = HashU64(state + index);
+		ids[index] = 900000000000000000ull + state % 400000000000000000ull;
+	}
+	for (ptrdiff_t index = 0; index < BENCH_CACHE_DRAWS; ++index) {
+		state          = HashU64(state + index);
+		double    unit = (double)(state >> 11) / (double)(1ull << 53);
+		ptrdiff_t rank = (ptrdiff_t)pow((double)(BENCH_CACHE_KEYS + 1), unit) - 1;
+		draws[index]   = ids[Clamp((ptrdiff_t)0, BENCH_CACHE_KEYS - 1, rank)];
+	}
+
+	for (ptrdiff_t fraction = 64; fraction >= 1; fraction /= 4) {
+		Cache<uint64_t, Bench_Channel> cache;
+		if (!cache.Create({ BENCH_CACHE_KEYS / fraction, 0, 0, 16 })) break;
+
+		char name[32];
+		snprintf(name, sizeof(name), "clock 1/%td", fraction);
+		Bench_CacheRun(name, 1, &cache, nullptr, draws);
+		cache.Destroy();
+	}
+
+	for (int count = 1; count <= BENCH_CACHE_THREADS; count *= 4) {
+		Cache<uint64_t, Bench_Channel> cache;
+		if (!cache.Create({ BENCH_CACHE_KEYS / 4, 0, 0, 16 })) break;
+		Bench_CacheRun("clock 1/4", count, &cache, nullptr, draws);
+		cache.Destroy();
+
+		Hash_Table<uint64_t, Bench_Channel> table;
+		Bench_CacheRun("table", count, nullptr, &table, draws);
+		Free(&table);
+	}
+
+	MemoryFree(draws, sizeof(uint64_t) * BENCH_CACHE_DRAWS);
+	MemoryFree(ids, sizeof(uint64_t) * BENCH_CACHE_KEYS);
+}
@@ -0,0 +1,122 @@
+#include "Benchmark.h"
+#include "Discord.h"
+
+#include <stdio.h>
+
+//
+// Discord::DeserializeMessage of recorded MESSAGE_CREATE payloads with the allocations counted, as the
+// gateway reads them: from an arena that is reset after each event. The JSON is parsed once, only the
+// deserialization is measured.
+//
+
+static constexpr int BENCH_MESSAGE_ROUNDS     = 7;
+static constexpr int BENCH_MESSAGE_ITERATIONS = 20000;
+
+// Text from a user of the guild, with the member and nothing else
+static const char BenchMessageText[] = R"({
+	"type": 0, "tts": false, "timestamp": "2022-03-14T09:26:53.589000+00:00", "pinned": false,
+	"nonce": "952849318410125312", "mentions": [], "mention_roles": [], "mention_everyone": false,
+	"member": {
+		"roles": ["941392361286823987", "941392523610562582"], "premium_since": null, "pending": false,
+		"nick": null, "mute": false, "joined_at": "2022-02-10T16:55:19.514000+00:00", "flags": 0,
+		"deaf": false, "communication_disabled_until": null, "avatar": null
+	},
+	"id": "952849320087744552", "flags": 0, "embeds": [], "edited_timestamp": null,
+	"content": "has anyone tried the new build yet?", "components": [], "channel_id": "941392361911771176",
+	"author": {
+		"username": "tomato", "public_flags": 0, "id": "402115403291820032", "discriminator": "0",
+		"avatar_decoration": null, "avatar": "8342729096ea3675442027381ff50dfe"
+	},
+	"attachments": [], "guild_id": "941392361286823986"
+})";
+
+// A reply with a mention, a role mention, an embed with a field and an attachment
+static const char BenchMessageRich[] = R"({
+	"type": 19, "tts": false, "timestamp": "2022-03-14T09:27:41.121000+00:00", "pinned": false,
+	"nonce": "952849517521305600",
+	"mentions": [{
+		"username": "tomato", "public_flags": 0, "id": "402115403291820032", "discriminator": "0",
+		"avatar_decoration": null, "avatar": "8342729096ea3675442027381ff50dfe",
+		"member": {
+			"roles": ["941392361286823987"], "premium_since": null, "pending": false, "nick": null,
+			"mute": false, "joined_at": "2022-02-10T16:55:19.514000+00:00", "flags": 0, "deaf": false,
+			"communication_disabled_until": null, "avatar": null
+		}
+	}],
+	"mention_roles": ["941392523610562582"], "mention_everyone": false,
+	"member": {
+		"roles": ["941392361286823987", "941392523610562582"], "premium_since": null, "pending": false,
+		"nick": "builder", "mute": false, "joined_at": "2022-02-10T17:02:44.207000+00:00", "flags": 0,
+		"deaf": false, "communication_disabled_until": null, "avatar": null
+	},
+	"id": "952849519899480114", "flags": 0,
+	"embeds": [{
+		"type": "rich", "title": "Build 1432", "description": "Nightly build finished", "color": 5763719,
+		"url": "https://example.com/builds/1432", "timestamp": "2022-03-14T09:27:40.000000+00:00",
+		"footer": { "text": "ci" },
+		"fields": [{ "name": "Duration", "value": "14m 32s", "inline": true }]
+	}],
+	"edited_timestamp": null, "content": "<@402115403291820032> yes, <@&941392523610562582> log attached",
+	"components": [], "channel_id": "941392361911771176",
+	"author": {
+		"username": "builder", "public_flags": 0, "id": "402115403291820099", "discriminator": "0",
+		"avatar_decoration": null, "avatar": null
+	},
+	"attachments": [{
+		"width": null, "url": "https://cdn.discordapp.com/attachments/941392361911771176/952849519630999582/build.log",
+		"size": 48213, "proxy_url": "https://media.discordapp.net/attachments/941392361911771176/952849519630999582/build.log",
+		"id": "952849519630999582", "height": null, "filename": "build.log", "content_type": "text/plain; charset=utf-8"
+	}],
+	"message_reference": { "message_id": "952849320087744552", "guild_id": "941392361286823986", "channel_id": "941392361911771176" },
+	"guild_id": "941392361286823986"
+})";
+
+static void Bench_MessageRun(const char *name, String payload) {
+	Memory_Arena *arena = MemoryArenaAllocate(MegaBytes(64));
+	if (!arena) return;
+
+	Json json;
+	if (!JsonParse(payload, &json, MemoryArenaAllocator(arena))) {
+		printf("%-6s parse failed\n", name);
+		MemoryArenaFree(arena);
+		return;
+	}
+
+	size_t base = MemoryArenaUsedSize(arena);
+
+	Bench_Allocation_Counter counter;
+	counter.parent = MemoryArenaAllocator(arena);
+	counter.count  = 0;
+
+	Memory_Allocator allocator = ThreadContext.allocator;
+	ThreadContext.allocator    = Bench_CountingAllocator(&counter);
+
+	uint64_t samples[BENCH_MESSAGE_ROUNDS];
+	size_t   used = 0;
+
+	for (int round = 0; round < BENCH_MESSAGE_ROUNDS; ++round) {
+		uint64_t start = MonotonicNanosecs();
+		for (int index = 0; index < BENCH_MESSAGE_ITERATIONS; ++index) {
+			// Everything the message allocates is given back with the event, as the gateway resets its scratch
+			MemoryArenaSetPos(arena, base);
+			Discord::Message message;
+			Discord::DeserializeMessage(json, &message);
+			used = MemoryArenaUsedSize(arena) - base;
+		}
+		samples[round] = MonotonicNanosecs() - start;
+	}
+
+	ThreadContext.allocator = allocator;
+	MemoryArenaFree(arena);
+
+	int64_t messages = (int64_t)BENCH_MESSAGE_ROUNDS * BENCH_MESSAGE_ITERATIONS;
+	double  ns       = (double)Bench_Percentile(samples, BENCH_MESSAGE_ROUNDS, 50.0) / (double)BENCH_MESSAGE_ITERATIONS;
+
+	printf("%-6s %5td bytes of JSON   %8.1f ns/message   %5.2f allocations/message   %5zu bytes/message   sizeof(Message) %zu\n",
+		name, payload.length, ns, (double)counter.count / (double)messages, used, sizeof(Discord::Message));
+}
+
+void Bench_DiscordMessage() {
+	Bench_MessageRun("text", String(BenchMessageText, sizeof(BenchMessageText) - 1));
+	Bench_MessageRun("rich", String(BenchMessageRich, sizeof(BenchMessageRich) - 1));
+}
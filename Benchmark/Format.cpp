@@ -0,0 +1,125 @@
+#include "Benchmark.h"
+#include "Kr/KrString.h"
+#include "Kr/KrBasic.h"
+
+#include <stdio.h>
+
+//
+// FmtStr (vsnprintf twice) against Fmt on what the Discord client builds for every request: an endpoint with
+// two snowflakes, the authorization header and a query parameter. Then the number conversions of Jsonify,
+// snprintf against FmtU64, FmtI64 and FmtF32, over a spread of values.
+//
+
+static constexpr int       BENCH_FMT_ROUNDS     = 9;
+static constexpr ptrdiff_t BENCH_FMT_ITERATIONS = 1 << 18;
+static constexpr int       BENCH_FMT_VALUES     = 1024;
+
+static volatile ptrdiff_t BenchFmtSink;
+
+enum Bench_Fmt_Op {
+	BENCH_FMT_ENDPOINT,
+	BENCH_FMT_AUTHORIZATION,
+	BENCH_FMT_QUERY,
+	BENCH_FMT_ID,
+	BENCH_FMT_INT,
+	BENCH_FMT_FLOAT,
+};
+
+struct Bench_Fmt_Values {
+	uint64_t ids[BENCH_FMT_VALUES];
+	int      ints[BENCH_FMT_VALUES];
+	float    floats[BENCH_FMT_VALUES];
+};
+
+static ptrdiff_t Bench_FmtRun(Bench_Fmt_Op op, bool old, Memory_Arena *arena, const Bench_Fmt_Values *values, ptrdiff_t index) {
+	uint64_t id    = values->ids[index % BENCH_FMT_VALUES];
+	String   token = "MTA5ODc2NTQzMjEwOTg3NjU0.GaBcDe.x1y2z3w4v5u6t7s8r9q0p1o2n3m4l5k6j7i8h9";
+
+	switch (op) {
+		case BENCH_FMT_ENDPOINT: {
+			uint64_t message = values->ids[(index + 1) % BENCH_FMT_VALUES];
+			if (old) return FmtStr(arena, "/channels/%zu/messages/%zu", id, message).length;
+			return Fmt(arena, "/channels/{}/messages/{}", id, message).length;
+		}
+
+		case BENCH_FMT_AUTHORIZATION: {
+			if (old) return FmtStr(arena, "Bot " StrFmt, StrArg(token)).length;
+			return Fmt(arena, "Bot {}", token).length;
+		}
+
+		case BENCH_FMT_QUERY: {
+			int limit = values->ints[index % BENCH_FMT_VALUES];
+			if (old) return FmtStr(arena, "%d", limit).length;
+			return Fmt(arena, "{}", limit).length;
+		}
+
+		case BENCH_FMT_ID: {
+			uint8_t buff[100];
+			if (old) return snprintf((char *)buff, sizeof(buff), "%zu", id);
+			return FmtU64(buff, id);
+		}
+
+		case BENCH_FMT_INT: {
+			uint8_t buff[100];
+			int     number = values->ints[index % BENCH_FMT_VALUES];
+			if (old) return snprintf((char *)buff, sizeof(buff), "%d", number);
+			return FmtI64(buff, number);
+		}
+
+		case BENCH_FMT_FLOAT: {
+			uint8_t buff[100];
+			float   number = values->floats[index % BENCH_FMT_VALUES];
+			if (old) return snprintf((char *)buff, sizeof(buff), "%f", number);
+			return FmtF32(buff, number);
+		}
+	}
+	return 0;
+}
+
+static double Bench_FmtTime(Bench_Fmt_Op op, bool old, Memory_Arena *arena, const Bench_Fmt_Values *values) {
+	uint64_t samples[BENCH_FMT_ROUNDS];
+
+	for (int round = 0; round < BENCH_FMT_ROUNDS; ++round) {
+		uint64_t start = MonotonicNanosecs();
+		for (ptrdiff_t index = 0; index < BENCH_FMT_ITERATIONS; ++index) {
+			auto temp    = BeginTemporaryMemory(arena);
+			BenchFmtSink = Bench_FmtRun(op, old, arena, values, index);
+			EndTemporaryMemory(&temp);
+		}
+		samples[round] = MonotonicNanosecs() - start;
+	}
+
+	return (double)Bench_Percentile(samples, BENCH_FMT_ROUNDS, 50.0) / (double)BENCH_FMT_ITERATIONS;
+}
+
+static void Bench_FmtCase(const char *name, const char *old_name, const char *new_name, Bench_Fmt_Op op,
+	Memory_Arena *arena, const Bench_Fmt_Values *values) {
+	double old  = Bench_FmtTime(op, true, arena, values);
+	double fast = Bench_FmtTime(op, false, arena, values);
+	printf("%-14s %-9s %7.1f ns  %-7s %7.1f ns  %5.1fx\n", name, old_name, old, new_name, fast, old / fast);
+}
+
+void Bench_Format() {
+	Memory_Arena *arena = MemoryArenaAllocate(MegaBytes(1));
+	if (!arena) return;
+
+	Bench_Fmt_Values *values = PushType(arena, Bench_Fmt_Values);
+
+	// Snowflakes of the last few years, limits and counts from 1 to 5 digits, floats around the ones of embeds
+	uint64_t state = 0x9e3779b97f4a7c15;
+	for (int index = 0; index < BENCH_FMT_VALUES; ++index) {
+		state                 = HashU64(state + index);
+		values->ids[index]    = 900000000000000000ull + state % 400000000000000000ull;
+		values->ints[index]   = (int)(state >> 40) % (index % 5 == 0 ? 100000 : 100) - (index & 7 ? 0 : 50);
+		values->floats[index] = (float)(state >> 40) / (float)(1 << 14) - 512.0f;
+	}
+
+	Bench_FmtCase("endpoint", "FmtStr", "Fmt", BENCH_FMT_ENDPOINT, arena, values);
+	Bench_FmtCase("authorization", "FmtStr", "Fmt", BENCH_FMT_AUTHORIZATION, arena, values);
+	Bench_FmtCase("query", "FmtStr", "Fmt", BENCH_FMT_QUERY, arena, values);
+	Bench_FmtCase("id", "snprintf", "FmtU64", BENCH_FMT_ID, arena, values);
+	Bench_FmtCase("int", "snprintf", "FmtI64", BENCH_FMT_INT, arena, values);
+	Bench_FmtCase("float", "snprintf", "FmtF32", BENCH_FMT_FLOAT, arena, values);
+
+	MemoryArenaFree(arena);
+}
@@ -0,0 +1,137 @@
+#include "Benchmark.h"
+#include "Discord.h"
+
+#include <stdio.h>
+
+//
+// Hash_Table insert, lookup of present keys and lookup of missing keys from 4 to 1M entries, with snowflake
+// keys (as the Discord state caches) and String keys. Lookups go in a shuffled order so that the larger
+// tables do not stay in the cache by accident.
+//
+
+static constexpr int       BENCH_HASH_ROUNDS     = 9;
+static constexpr ptrdiff_t BENCH_HASH_MAX_COUNT  = 1 << 20;
+static constexpr ptrdiff_t BENCH_HASH_MIN_OPS    = 1 << 21; // per sample, small tables repeat the operation
+
+static const ptrdiff_t BenchHashCounts[] = { 4, 64, 1024, 16384, 262144, BENCH_HASH_MAX_COUNT };
+
+// Keeps the compiler from dropping the lookups
+static volatile uintptr_t BenchHashSink;
+
+struct Bench_Hash_Result {
+	double insert;
+	double lookup;
+	double miss;
+};
+
+static inline uint32_t Bench_HashRandom(uint64_t *state) {
+	*state = *state * 6364136223846793005ull + 1442695040888963407ull;
+	return (uint32_t)(*state >> 33);
+}
+
+static void Bench_HashShuffle(ptrdiff_t *order, ptrdiff_t count, uint64_t *state) {
+	for (ptrdiff_t index = 0; index < count; ++index)
+		order[index] = index;
+	for (ptrdiff_t index = count - 1; index > 0; --index) {
+		ptrdiff_t other = Bench_HashRandom(state) % (index + 1);
+		ptrdiff_t temp  = order[index];
+		order[index]   = order[other];
+		order[other]   = temp;
+	}
+}
+
+// Ids as Discord creates them: milliseconds since the Discord epoch, worker and process ids, an increment
+static Discord::Snowflake Bench_HashSnowflake(ptrdiff_t index, uint64_t *state) {
+	uint64_t millis = 41771983423ull + (uint64_t)index * 37 + (Bench_HashRandom(state) % 29);
+	uint64_t worker = Bench_HashRandom(state) & 0x3ff;
+	return Discord::Snowflake((millis << 22) | (worker << 12) | ((uint64_t)index & 0xfff));
+}
+
+static String Bench_HashName(Memory_Arena *arena, ptrdiff_t index, const char *prefix) {
+	char *    buffer = (char *)PushSize(arena, 32);
+	ptrdiff_t length = snprintf(buffer, 32, "%s-%lld", prefix, (long long)(index * 2654435761ll % 100000007));
+	return String((uint8_t *)buffer, length);
+}
+
+template <typename K, typename Table>
+static Bench_Hash_Result Bench_HashRun(const K *keys, const K *missing, const ptrdiff_t *order, ptrdiff_t count) {
+	ptrdiff_t repeat = Maximum((ptrdiff_t)1, BENCH_HASH_MIN_OPS / count);
+	double    ops    = (double)(repeat * count);
+
+	uint64_t insert[BENCH_HASH_ROUNDS];
+	uint64_t lookup[BENCH_HASH_ROUNDS];
+	uint64_t miss[BENCH_HASH_ROUNDS];
+
+	for (int round = 0; round < BENCH_HASH_ROUNDS; ++round) {
+		uint64_t elapsed = 0;
+		Table    table;
+
+		for (ptrdiff_t iter = 0; iter < repeat; ++iter) {
+			Free(&table);
+			uint64_t start = MonotonicNanosecs();
+			for (ptrdiff_t index = 0; index < count; ++index)
+				table.Put(keys[index], (int)index);
+			elapsed += MonotonicNanosecs() - start;
+		}
+		insert[round] = elapsed;
+
+		uintptr_t sink  = 0;
+		uint64_t  start = MonotonicNanosecs();
+		for (ptrdiff_t iter = 0; iter < repeat; ++iter) {
+			for (ptrdiff_t index = 0; index < count; ++index)
+				sink += *table.Find(keys[order[index]]);
+		}
+		lookup[round] = MonotonicNanosecs() - start;
+
+		start = MonotonicNanosecs();
+		for (ptrdiff_t iter = 0; iter < repeat; ++iter) {
+			for (ptrdiff_t index = 0; index < count; ++index)
+				sink += table.Find(missing[order[index]]) != nullptr;
+		}
+		miss[round] = MonotonicNanosecs() - start;
+
+		BenchHashSink = sink;
+		Free(&table);
+	}
+
+	Bench_Hash_Result result;
+	result.insert = (double)Bench_Percentile(insert, BENCH_HASH_ROUNDS, 50.0) / ops;
+	result.lookup = (double)Bench_Percentile(lookup, BENCH_HASH_ROUNDS, 50.0) / ops;
+	result.miss   = (double)Bench_Percentile(miss, BENCH_HASH_ROUNDS, 50.0) / ops;
+	return result;
+}
+
+static void Bench_HashPrint(const char *name, ptrdiff_t count, const Bench_Hash_Result &result) {
+	printf("%-9s %8td   insert %6.1f ns   lookup %6.1f ns   miss %6.1f ns\n", name, count, result.insert, result.lookup, result.miss);
+}
+
+void Bench_HashTable() {
+	Memory_Arena *arena = MemoryArenaAllocate(MegaBytes(256));
+	if (!arena) return;
+
+	Discord::Snowflake *snowflakes = PushArray(arena, Discord::Snowflake, BENCH_HASH_MAX_COUNT);
+	Discord::Snowflake *absent     = PushArray(arena, Discord::Snowflake, BENCH_HASH_MAX_COUNT);
+	String *            names      = PushArray(arena, String, BENCH_HASH_MAX_COUNT);
+	String *            unknown    = PushArray(arena, String, BENCH_HASH_MAX_COUNT);
+	ptrdiff_t *         order      = PushArray(arena, ptrdiff_t, BENCH_HASH_MAX_COUNT);
+
+	uint64_t state = 0x853c49e6748fea9bull;
+	for (ptrdiff_t index = 0; index < BENCH_HASH_MAX_COUNT; ++index) {
+		snowflakes[index] = Bench_HashSnowflake(index, &state);
+		absent[index]     = Discord::Snowflake(snowflakes[index].value ^ (1ull << 63));
+		names[index]      = Bench_HashName(arena, index, "member");
+		unknown[index]    = Bench_HashName(arena, index, "absent");
+	}
+
+	for (ptrdiff_t count : BenchHashCounts) {
+		Bench_HashShuffle(order, count, &state);
+		Bench_HashPrint("snowflake", count, Bench_HashRun<Discord::Snowflake, Hash_Table<Discord::Snowflake, int>>(snowflakes, absent, order, count));
+	}
+
+	for (ptrdiff_t count : BenchHashCounts) {
+		Bench_HashShuffle(order, count, &state);
+		Bench_HashPrint("string", count, Bench_HashRun<String, Hash_Table<String, int>>(names, unknown, order, count));
+	}
+
+	MemoryArenaFree(arena);
+}
@@ -0,0 +1,108 @@
+#include "Benchmark.h"
+#include "Http.h"
+
+#include <stdio.h>
+
+//
+// Cost of initializing and serializing a REST request header, with every header set on the request
+// versus the static headers written from a Http_Request_Template. No socket is involved.
+//
+
+static constexpr int BENCH_BUILD_ROUNDS     = 32;
+static constexpr int BENCH_BUILD_ITERATIONS = 20000;
+
+struct Bench_Build_Case {
+	const char *name;
+	String      method;
+	String      endpoint;
+	String      content_type;
+	String      body;
+	int         params;
+};
+
+static const String BenchHost          = "discord.com";
+static const String BenchUserAgent     = "DiscordBot (https://github.com/ashishzero/Katachi, 0.1.0)";
+static const String BenchAuthorization = "Bot MTk4NjIyNDgzNDcxOTI1MjQ4.Cl2FMQ.ZnCjm1XVW7vRze4b7Cq4se7kKWs";
+
+// Keeps the compiler from dropping the built headers
+static volatile ptrdiff_t BenchBuildSink;
+
+static void Bench_BuildParams(Http_Query_Params *params, int count) {
+	params->count = 0;
+	for (int index = 0; index < count; ++index)
+		Http_QueryParamSet(params, "limit", "100");
+}
+
+static ptrdiff_t Bench_BuildHeaders(Http_Request *req, const Bench_Build_Case &test, const Http_Query_Params &params, uint8_t *buffer) {
+	Http_InitRequest(req);
+	Http_SetHeader(req, HTTP_HEADER_HOST, BenchHost);
+	Http_SetHeader(req, HTTP_HEADER_CONNECTION, "keep-alive");
+	Http_SetHeader(req, HTTP_HEADER_USER_AGENT, BenchUserAgent);
+	Http_SetHeader(req, HTTP_HEADER_AUTHORIZATION, BenchAuthorization);
+	Http_SetContent(req, test.content_type, test.body);
+	return Http_BuildRequest(test.method, test.endpoint, &params, *req, buffer, HTTP_STREAM_CHUNK_SIZE);
+}
+
+static ptrdiff_t Bench_BuildPrepared(Http_Request *req, const Http_Request_Template *prepared, const Bench_Build_Case &test, const Http_Query_Params &params, uint8_t *buffer) {
+	Http_InitRequest(req, prepared);
+	Http_SetContent(req, test.content_type, test.body);
+	return Http_BuildRequest(test.method, test.endpoint, &params, *req, buffer, HTTP_STREAM_CHUNK_SIZE);
+}
+
+static void Bench_BuildRun(const Bench_Build_Case &test, const Http_Request_Template *prepared) {
+	// Requests are large, so they are kept out of the stack
+	static Http_Request req;
+	static uint8_t      buffer[HTTP_STREAM_CHUNK_SIZE];
+
+	Http_Query_Params params;
+	Bench_BuildParams(&params, test.params);
+
+	uint64_t  samples[BENCH_BUILD_ROUNDS];
+	ptrdiff_t length = 0;
+
+	for (int round = 0; round < BENCH_BUILD_ROUNDS; ++round) {
+		uint64_t start = MonotonicNanosecs();
+		for (int index = 0; index < BENCH_BUILD_ITERATIONS; ++index) {
+			if (prepared)
+				length = Bench_BuildPrepared(&req, prepared, test, params, buffer);
+			else
+				length = Bench_BuildHeaders(&req, test, params, buffer);
+			BenchBuildSink = length;
+		}
+		samples[round] = MonotonicNanosecs() - start;
+	}
+
+	double p50 = (double)Bench_Percentile(samples, BENCH_BUILD_ROUNDS, 50.0) / (double)BENCH_BUILD_ITERATIONS;
+	double min = (double)samples[0] / (double)BENCH_BUILD_ITERATIONS;
+
+	printf("%-12s %-9s %4td bytes   p50 %7.1f ns/req   min %7.1f ns/req\n",
+		test.name, prepared ? "prepared" : "headers", length, p50, min);
+}
+
+void Bench_HttpBuild() {
+	Http_Request req;
+	Http_InitRequest(&req);
+	Http_SetHeader(&req, HTTP_HEADER_HOST, BenchHost);
+	Http_SetHeader(&req, HTTP_HEADER_CONNECTION, "keep-alive");
+	Http_SetHeader(&req, HTTP_HEADER_USER_AGENT, BenchUserAgent);
+	Http_SetHeader(&req, HTTP_HEADER_AUTHORIZATION, BenchAuthorization);
+
+	// The template is large, so it is kept out of the stack
+	static Http_Request_Template prepared;
+	if (!Http_PrepareTemplate(&prepared, req))
+		return;
+
+	const String message = "{\"content\":\"Hello, World!\",\"tts\":false}";
+
+	const Bench_Build_Case cases[] = {
+		{ "get",         "GET",   "/api/v10/channels/1234567890/messages", "",                 "",      0 },
+		{ "get-params",  "GET",   "/api/v10/channels/1234567890/messages", "",                 "",      2 },
+		{ "post-json",   "POST",  "/api/v10/channels/1234567890/messages", "application/json", message, 0 },
+		{ "patch-json",  "PATCH", "/api/v10/guilds/1234567890/members/42", "application/json", message, 0 },
+	};
+
+	for (const Bench_Build_Case &test : cases) {
+		Bench_BuildRun(test, nullptr);
+		Bench_BuildRun(test, &prepared);
+	}
+}
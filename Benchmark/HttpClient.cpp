@@ -0,0 +1,994 @@
+#include "Benchmark.h"
+#include "Http.h"
+#include "Kr/KrThread.h"
+#include "Kr/KrAtomic.h"
+#include "Kr/KrString.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#include <openssl/ssl.h>
+#include <openssl/pem.h>
+#include <openssl/x509.h>
+
+//
+// Http_CustomMethod against an in-process loopback server, over plain TCP and TLS. The server sends
+// canned responses selected by the endpoint "/<size>/<cl|chunked>/<headers>[/<delay ms>[/<mode>]]",
+// every case of a transport is sent over the same kept-alive connection. Then Http_Submit, Http_Cancel
+// and deadlines of the asynchronous client, with the connections served in parallel, the response
+// cache of Http_Get and the Range requests of Http_Download.
+//
+
+static constexpr int       BENCH_MOCK_CHUNK_SIZE      = KiloBytes(16);
+static constexpr int       BENCH_MOCK_STAGE_SIZE      = KiloBytes(64);
+static constexpr int       BENCH_MOCK_MAX_CONNECTIONS = 64;
+static constexpr int       BENCH_WARMUP_REQUESTS      = 4;
+static constexpr ptrdiff_t BENCH_MAX_BODY_SIZE        = MegaBytes(50);
+
+static uint8_t BenchPattern[BENCH_MOCK_CHUNK_SIZE];
+
+struct Bench_Mock_Server;
+
+struct Bench_Mock_Connection {
+	Bench_Mock_Server *server;
+	Thread *           thread;
+	int32_t            done;
+	Net_Socket *       socket;
+	SSL *              ssl;
+	uint8_t            stage[BENCH_MOCK_STAGE_SIZE];
+	ptrdiff_t          staged;
+};
+
+struct Bench_Mock_Server {
+	Net_Socket *           listener;
+	SSL_CTX *              tls;      // null for plain connections
+	Thread *               thread;
+	int                    port;
+	int32_t                running;
+	int64_t                body_bytes; // sent in all responses
+	Bench_Mock_Connection *connections[BENCH_MOCK_MAX_CONNECTIONS];
+};
+
+static int Bench_MockRead(Bench_Mock_Connection *conn, uint8_t *buffer, int length) {
+	if (conn->ssl)
+		return SSL_read(conn->ssl, buffer, length);
+	return Net_Receive(conn->socket, buffer, length);
+}
+
+static bool Bench_MockWrite(Bench_Mock_Connection *conn, const uint8_t *buffer, ptrdiff_t length) {
+	while (length) {
+		int chunk   = (int)Minimum(length, (ptrdiff_t)INT32_MAX);
+		int written = conn->ssl ? SSL_write(conn->ssl, buffer, chunk) : Net_Send(conn->socket, (void *)buffer, chunk);
+		if (written <= 0)
+			return false;
+		buffer += written;
+		length -= written;
+	}
+	return true;
+}
+
+// Small writes are staged so that a small response leaves in a single write
+static bool Bench_MockPush(Bench_Mock_Connection *conn, const uint8_t *buffer, ptrdiff_t length) {
+	if (conn->staged + length > BENCH_MOCK_STAGE_SIZE) {
+		if (!Bench_MockWrite(conn, conn->stage, conn->staged))
+			return false;
+		conn->staged = 0;
+		if (length > BENCH_MOCK_STAGE_SIZE)
+			return Bench_MockWrite(conn, buffer, length);
+	}
+	memcpy(conn->stage + conn->staged, buffer, length);
+	conn->staged += length;
+	return true;
+}
+
+static bool Bench_MockFlush(Bench_Mock_Connection *conn) {
+	bool result  = Bench_MockWrite(conn, conn->stage, conn->staged);
+	conn->staged = 0;
+	return result;
+}
+
+// Parses "Range: bytes=<first>-<last>" of the request
+static bool Bench_MockRange(String request, ptrdiff_t *first, ptrdiff_t *last) {
+	ptrdiff_t pos = StrFindICase(request, "\r\nRange:");
+	if (pos < 0)
+		return false;
+
+	String value    = SubStr(request, pos + 8);
+	ptrdiff_t eol   = StrFind(value, "\r\n");
+	value           = StrTrim(eol >= 0 ? SubStr(value, 0, eol) : value);
+	ptrdiff_t dash  = StrFindChar(value, '-');
+	if (!StrStartsWithICase(value, "bytes=") || dash < 0)
+		return false;
+
+	return ParseInt(SubStr(value, 6, dash - 6), first) && ParseInt(SubStr(value, dash + 1), last) && *first <= *last;
+}
+
+// Modes of the endpoint for the cache: "fresh" responses may be served from the cache for a minute, "stale"
+// ones are revalidated every time and "nostore" ones are never stored. The first two carry an ETag that a
+// matching If-None-Match gets a 304 for, with the Content-Length of the body that is not sent.
+// Modes for Range requests: "range" sends the requested bytes in a 206, "half" fails the ranges that start
+// in the second half of the body with a 404, "norange" ignores the Range and sends the whole body, and
+// "mismatch" sends a byte more than the Content-Range it declares. The body is the pattern repeated, so any
+// range of it can be checked.
+static bool Bench_MockRespond(Bench_Mock_Connection *conn, String endpoint, String request) {
+	ptrdiff_t size    = 0;
+	ptrdiff_t headers = 0;
+	ptrdiff_t delay   = 0;
+	bool      chunked = false;
+	String    mode;
+
+	Str_Tokenizer tokenizer;
+	StrTokenizerInit(&tokenizer, endpoint);
+	for (int index = 0; StrTokenize(&tokenizer, "/"); ++index) {
+		if (index == 0) ParseInt(tokenizer.token, &size);
+		else if (index == 1) chunked = tokenizer.token == "chunked";
+		else if (index == 2) ParseInt(tokenizer.token, &headers);
+		else if (index == 3) ParseInt(tokenizer.token, &delay);
+		else if (index == 4) mode = tokenizer.token;
+	}
+
+	// Cut short by a stop, so that slow responses left to a closed connection are not waited on
+	for (ptrdiff_t waited = 0; waited < delay && AtomicLoad(&conn->server->running); waited += 10)
+		Thread_Sleep((int)Minimum(delay - waited, (ptrdiff_t)10));
+
+	char header[HTTP_MAX_HEADER_SIZE];
+	int  length = 0;
+
+	ptrdiff_t first = 0;
+	ptrdiff_t body  = size;
+
+	if (mode == "fresh" || mode == "stale") {
+		const char *control = mode == "fresh" ? "max-age=60" : "no-cache";
+		if (StrFindICase(request, "If-None-Match:") >= 0 && StrFind(request, "\"v1\"") >= 0) {
+			length = snprintf(header, sizeof(header), "HTTP/1.1 304 Not Modified\r\nCache-Control: %s\r\nETag: \"v1\"\r\n"
+				"Content-Length: %td\r\n\r\n", control, size);
+			return Bench_MockPush(conn, (uint8_t *)header, length) && Bench_MockFlush(conn);
+		}
+		length = snprintf(header, sizeof(header), "HTTP/1.1 200 OK\r\nCache-Control: %s\r\nETag: \"v1\"\r\n", control);
+	} else if (mode == "nostore") {
+		length = snprintf(header, sizeof(header), "HTTP/1.1 200 OK\r\nCache-Control: no-store\r\nETag: \"v1\"\r\n");
+	} else if (mode == "range" || mode == "half" || mode == "mismatch") {
+		ptrdiff_t last;
+		if (!Bench_MockRange(request, &first, &last) || last >= size) {
+			length = snprintf(header, sizeof(header), "HTTP/1.1 416 Range Not Satisfiable\r\nContent-Range: bytes */%td\r\n"
+				"Content-Length: 0\r\n\r\n", size);
+			return Bench_MockPush(conn, (uint8_t *)header, length) && Bench_MockFlush(conn);
+		}
+		if (mode == "half" && first >= size / 2) {
+			length = snprintf(header, sizeof(header), "HTTP/1.1 404 Not Found\r\nContent-Length: 0\r\n\r\n");
+			return Bench_MockPush(conn, (uint8_t *)header, length) && Bench_MockFlush(conn);
+		}
+		length = snprintf(header, sizeof(header), "HTTP/1.1 206 Partial Content\r\nETag: \"v1\"\r\nContent-Range: bytes %td-%td/%td\r\n",
+			first, last, size);
+		body = last - first + 1 + (mode == "mismatch");
+	} else if (mode == "norange") {
+		length = snprintf(header, sizeof(header), "HTTP/1.1 200 OK\r\nETag: \"v1\"\r\n");
+	} else {
+		length = snprintf(header, sizeof(header), "HTTP/1.1 200 OK\r\n");
+	}
+
+	length += snprintf(header + length, sizeof(header) - length, "Content-Type: application/octet-stream\r\n");
+	for (ptrdiff_t index = 0; index < headers; ++index)
+		length += snprintf(header + length, sizeof(header) - length, "X-Bench-%td: value-%td\r\n", index, index);
+	if (chunked)
+		length += snprintf(header + length, sizeof(header) - length, "Transfer-Encoding: chunked\r\n\r\n");
+	else
+		length += snprintf(header + length, sizeof(header) - length, "Content-Length: %td\r\n\r\n", body);
+
+	if (!Bench_MockPush(conn, (uint8_t *)header, length))
+		return false;
+
+	for (ptrdiff_t sent = 0; sent < body;) {
+		ptrdiff_t offset = (first + sent) % BENCH_MOCK_CHUNK_SIZE;
+		ptrdiff_t count  = Minimum(body - sent, (ptrdiff_t)BENCH_MOCK_CHUNK_SIZE - offset);
+		if (chunked) {
+			char chunk[32];
+			int  chunk_len = snprintf(chunk, sizeof(chunk), "%tx\r\n", count);
+			if (!Bench_MockPush(conn, (uint8_t *)chunk, chunk_len))
+				return false;
+		}
+		if (!Bench_MockPush(conn, BenchPattern + offset, count))
+			return false;
+		if (chunked && !Bench_MockPush(conn, (uint8_t *)"\r\n", 2))
+			return false;
+		sent += count;
+	}
+
+	AtomicAdd(&conn->server->body_bytes, (int64_t)body);
+
+	if (chunked && !Bench_MockPush(conn, (uint8_t *)"0\r\n\r\n", 5))
+		return false;
+
+	return Bench_MockFlush(conn);
+}
+
+static void Bench_MockServe(Bench_Mock_Server *server, Bench_Mock_Connection *conn) {
+	uint8_t   request[HTTP_MAX_HEADER_SIZE];
+	ptrdiff_t received = 0;
+
+	while (AtomicLoad(&server->running)) {
+		int read = Bench_MockRead(conn, request + received, (int)(sizeof(request) - received));
+		if (read <= 0)
+			return;
+		received += read;
+
+		// Requests of the benchmark have no body
+		while (true) {
+			ptrdiff_t end = StrFind(String(request, received), "\r\n\r\n");
+			if (end < 0) {
+				if (received == sizeof(request))
+					return;
+				break;
+			}
+
+			String line     = String(request, StrFind(String(request, received), "\r\n"));
+			ptrdiff_t first = StrFindChar(line, ' ');
+			ptrdiff_t last  = StrFindChar(line, ' ', first + 1);
+			if (first < 0 || last < 0)
+				return;
+
+			if (!Bench_MockRespond(conn, SubStr(line, first + 1, last - first - 1), String(request, end)))
+				return;
+
+			received -= end + 4;
+			memmove(request, request + end + 4, received);
+		}
+	}
+}
+
+static int Bench_MockConnectionProc(void *arg) {
+	Bench_Mock_Connection *conn = (Bench_Mock_Connection *)arg;
+
+	if (conn->server->tls) {
+		conn->ssl = SSL_new(conn->server->tls);
+		SSL_set_fd(conn->ssl, Net_GetSocketDescriptor(conn->socket));
+		if (SSL_accept(conn->ssl) == 1)
+			Bench_MockServe(conn->server, conn);
+		SSL_shutdown(conn->ssl);
+		SSL_free(conn->ssl);
+	} else {
+		Bench_MockServe(conn->server, conn);
+	}
+
+	AtomicStore(&conn->done, 1);
+	return 0;
+}
+
+// The socket is closed here and not by the connection's thread, which a stop may still be shutting down
+static void Bench_MockRelease(Bench_Mock_Connection *conn) {
+	Thread_Wait(conn->thread, -1);
+	Thread_Destroy(conn->thread);
+	Net_CloseConnection(conn->socket);
+	MemoryFree(conn, sizeof(Bench_Mock_Connection));
+}
+
+// Each connection is served by its own thread
+static int Bench_MockThreadProc(void *arg) {
+	Bench_Mock_Server *server = (Bench_Mock_Server *)arg;
+
+	while (AtomicLoad(&server->running)) {
+		Net_Socket *socket = Net_Accept(server->listener);
+		if (!socket)
+			continue;
+
+		int slot = -1;
+		for (int index = 0; index < BENCH_MOCK_MAX_CONNECTIONS; ++index) {
+			Bench_Mock_Connection *conn = server->connections[index];
+			if (conn && AtomicLoad(&conn->done)) {
+				Bench_MockRelease(conn);
+				server->connections[index] = nullptr;
+			}
+			if (!server->connections[index] && slot < 0)
+				slot = index;
+		}
+
+		Bench_Mock_Connection *conn = slot >= 0 ? (Bench_Mock_Connection *)MemoryAllocate(sizeof(Bench_Mock_Connection)) : nullptr;
+		if (!conn) {
+			Net_CloseConnection(socket);
+			continue;
+		}
+
+		Net_SetSocketBlockingMode(socket, true);
+		Net_SetSocketNoDelay(socket, true);
+
+		conn->server = server;
+		conn->done   = 0;
+		conn->socket = socket;
+		conn->ssl    = nullptr;
+		conn->staged = 0;
+		conn->thread = Thread_Create(Bench_MockConnectionProc, conn);
+		if (!conn->thread) {
+			Net_CloseConnection(socket);
+			MemoryFree(conn, sizeof(Bench_Mock_Connection));
+			continue;
+		}
+
+		server->connections[slot] = conn;
+	}
+
+	for (Bench_Mock_Connection *conn : server->connections) {
+		if (!conn) continue;
+		Net_Shutdown(conn->socket);
+		Bench_MockRelease(conn);
+	}
+
+	return 0;
+}
+
+// Self-signed certificate for 127.0.0.1, trusted by the client through Net_AddTrustedCertificate
+static SSL_CTX *Bench_CreateTlsContext() {
+	EVP_PKEY *    key  = nullptr;
+	EVP_PKEY_CTX *kctx = EVP_PKEY_CTX_new_id(EVP_PKEY_EC, nullptr);
+	if (!kctx) return nullptr;
+	Defer{ EVP_PKEY_CTX_free(kctx); };
+
+	if (EVP_PKEY_keygen_init(kctx) <= 0 || EVP_PKEY_CTX_set_ec_paramgen_curve_nid(kctx, NID_X9_62_prime256v1) <= 0 ||
+		EVP_PKEY_keygen(kctx, &key) <= 0)
+		return nullptr;
+	Defer{ EVP_PKEY_free(key); };
+
+	X509 *cert = X509_new();
+	if (!cert) return nullptr;
+	Defer{ X509_free(cert); };
+
+	X509_set_version(cert, 2);
+	ASN1_INTEGER_set(X509_get_serialNumber(cert), 1);
+	X509_gmtime_adj(X509_getm_notBefore(cert), -3600);
+	X509_gmtime_adj(X509_getm_notAfter(cert), 86400);
+	X509_set_pubkey(cert, key);
+
+	X509_NAME *name = X509_get_subject_name(cert);
+	X509_NAME_add_entry_by_txt(name, "CN", MBSTRING_ASC, (const uint8_t *)"127.0.0.1", -1, -1, 0);
+	X509_set_issuer_name(cert, name);
+
+	if (!X509_sign(cert, key, EVP_sha256()))
+		return nullptr;
+
+	BIO *bio = BIO_new(BIO_s_mem());
+	if (!bio) return nullptr;
+	Defer{ BIO_free(bio); };
+
+	char *pem        = nullptr;
+	long  pem_length = 0;
+	if (!PEM_write_bio_X509(bio, cert) || (pem_length = BIO_get_mem_data(bio, &pem)) <= 0)
+		return nullptr;
+
+	if (!Net_AddTrustedCertificate(String((uint8_t *)pem, pem_length)))
+		return nullptr;
+
+	SSL_CTX *tls = SSL_CTX_new(TLS_server_method());
+	if (!tls) return nullptr;
+
+	if (SSL_CTX_use_certificate(tls, cert) != 1 || SSL_CTX_use_PrivateKey(tls, key) != 1) {
+		SSL_CTX_free(tls);
+		return nullptr;
+	}
+
+	return tls;
+}
+
+static bool Bench_StartMock(Bench_Mock_Server *server, bool tls) {
+	memset(server, 0, sizeof(*server));
+
+	if (tls) {
+		server->tls = Bench_CreateTlsContext();
+		if (!server->tls) {
+			LogErrorEx("Bench", "Creating the TLS context failed");
+			return false;
+		}
+	}
+
+	server->listener = Net_Listen("127.0.0.1", "0", NET_SOCKET_TCP, 16);
+	if (!server->listener) {
+		if (server->tls) SSL_CTX_free(server->tls);
+		return false;
+	}
+
+	Net_SetSocketBlockingMode(server->listener, true);
+
+	server->port    = Net_GetPort(server->listener);
+	server->running = 1;
+	server->thread  = Thread_Create(Bench_MockThreadProc, server);
+	return true;
+}
+
+static void Bench_StopMock(Bench_Mock_Server *server) {
+	AtomicStore(&server->running, 0);
+
+	// Wakes the blocked accept
+	char port[16];
+	snprintf(port, sizeof(port), "%d", server->port);
+	Net_Socket *wake = Net_OpenConnection("127.0.0.1", String(port, strlen(port)), NET_SOCKET_TCP);
+	if (wake) Net_CloseConnection(wake);
+
+	Thread_Wait(server->thread, -1);
+	Thread_Destroy(server->thread);
+	Net_CloseConnection(server->listener);
+	if (server->tls) SSL_CTX_free(server->tls);
+}
+
+//
+//
+//
+
+enum Bench_Overload {
+	BENCH_OVERLOAD_ARENA,
+	BENCH_OVERLOAD_BUFFER,
+	BENCH_OVERLOAD_WRITER,
+};
+
+static const char *BenchOverloadNames[] = { "arena", "buffer", "writer" };
+
+struct Bench_Client_Case {
+	Bench_Overload overload;
+	ptrdiff_t      size;
+	bool           chunked;
+	int            headers;
+	int            requests;
+};
+
+struct Bench_Client_State {
+	Http *        http;
+	Memory_Arena *arena;
+	uint8_t *     buffer;
+	uint64_t *    samples;
+	Bench_Allocation_Counter counter;
+};
+
+static void Bench_DiscardWriterProc(Http_Header &header, uint8_t *buffer, ptrdiff_t length, void *context) {
+	*(ptrdiff_t *)context += length;
+}
+
+static bool Bench_ClientRequest(Bench_Client_State *state, const Bench_Client_Case &test, String endpoint, const Http_Request &req, Http_Response *res) {
+	ptrdiff_t received = 0;
+	bool      ok       = false;
+
+	switch (test.overload) {
+		case BENCH_OVERLOAD_ARENA: {
+			MemoryArenaReset(state->arena);
+			ok       = Http_CustomMethod(state->http, "GET", endpoint, req, res, state->arena);
+			received = res->body.length;
+		} break;
+
+		case BENCH_OVERLOAD_BUFFER: {
+			ok       = Http_CustomMethod(state->http, "GET", endpoint, req, res, state->buffer, BENCH_MAX_BODY_SIZE);
+			received = res->body.length;
+		} break;
+
+		case BENCH_OVERLOAD_WRITER: {
+			Http_Writer writer = { Bench_DiscardWriterProc, &received };
+			ok = Http_CustomMethod(state->http, "GET", endpoint, req, res, writer);
+		} break;
+	}
+
+	if (ok && res->status.code == 200 && received == test.size)
+		return true;
+
+	// The rest of a failed response would be read by the next request
+	Http_Reconnect(state->http);
+	return false;
+}
+
+static void Bench_FormatSize(char *buffer, int length, ptrdiff_t size) {
+	if (size >= MegaBytes(1))
+		snprintf(buffer, length, "%td MB", size / MegaBytes(1));
+	else if (size >= KiloBytes(1))
+		snprintf(buffer, length, "%td KB", size / KiloBytes(1));
+	else
+		snprintf(buffer, length, "%td B", size);
+}
+
+static void Bench_ClientRun(Bench_Client_State *state, const char *transport, const Bench_Client_Case &test) {
+	char endpoint_buffer[64];
+	int  endpoint_len = snprintf(endpoint_buffer, sizeof(endpoint_buffer), "/%td/%s/%d", test.size, test.chunked ? "chunked" : "cl", test.headers);
+	String endpoint(endpoint_buffer, endpoint_len);
+
+	Http_Request req;
+	Http_InitRequest(&req);
+	Http_SetHost(&req, state->http);
+	Http_SetHeader(&req, HTTP_HEADER_CONNECTION, "keep-alive");
+
+	// Responses are large, so they are kept out of the stack
+	static Http_Response res;
+
+	ptrdiff_t failed = 0;
+	for (int index = 0; index < BENCH_WARMUP_REQUESTS; ++index)
+		failed += !Bench_ClientRequest(state, test, endpoint, req, &res);
+
+	// Allocations of this thread are counted while the requests run
+	Memory_Allocator allocator = ThreadContext.allocator;
+	state->counter.parent      = allocator;
+	state->counter.count       = 0;
+	ThreadContext.allocator    = Bench_CountingAllocator(&state->counter);
+
+	ptrdiff_t count = 0;
+	uint64_t  start = MonotonicNanosecs();
+
+	for (int index = 0; index < test.requests; ++index) {
+		uint64_t begin = MonotonicNanosecs();
+		bool     ok    = Bench_ClientRequest(state, test, endpoint, req, &res);
+		uint64_t end   = MonotonicNanosecs();
+
+		if (ok)
+			state->samples[count++] = end - begin;
+		else
+			failed += 1;
+	}
+
+	uint64_t elapsed = MonotonicNanosecs() - start;
+
+	ThreadContext.allocator = allocator;
+
+	double seconds = (double)elapsed / 1e9;
+	double mbps    = (double)count * (double)test.size / (double)MegaBytes(1) / seconds;
+	double p50     = (double)Bench_Percentile(state->samples, count, 50.0) / 1000.0;
+	double p99     = (double)Bench_Percentile(state->samples, count, 99.0) / 1000.0;
+	double allocs  = (double)state->counter.count / (double)Maximum(test.requests, 1);
+
+	char size[32];
+	Bench_FormatSize(size, sizeof(size), test.size);
+
+	printf("%-5s %-6s %-7s %6s %2d hdr %9.0f req/s %8.1f MB/s   p50 %9.1f us   p99 %9.1f us   %5.2f allocs/req   failed %td\n",
+		transport, BenchOverloadNames[test.overload], test.chunked ? "chunked" : "length", size, test.headers,
+		(double)count / seconds, mbps, p50, p99, allocs, failed);
+}
+
+static int Bench_RequestCount(ptrdiff_t size) {
+	if (size <= KiloBytes(1)) return 5000;
+	if (size <= KiloBytes(64)) return 2000;
+	if (size <= MegaBytes(1)) return 200;
+	return 6;
+}
+
+static void Bench_HttpClient(bool tls) {
+	const char *transport = tls ? "tls" : "plain";
+
+	for (int index = 0; index < BENCH_MOCK_CHUNK_SIZE; ++index)
+		BenchPattern[index] = (uint8_t)('a' + index % 26);
+
+	Bench_Mock_Server server;
+	if (!Bench_StartMock(&server, tls))
+		return;
+
+	char port[16];
+	snprintf(port, sizeof(port), "%d", server.port);
+
+	Bench_Client_State state = {};
+	state.http = Http_Connect("127.0.0.1", String(port, strlen(port)), tls ? HTTPS_CONNECTION : HTTP_CONNECTION, ThreadContext.allocator);
+	if (!state.http) {
+		Bench_StopMock(&server);
+		return;
+	}
+
+	state.arena   = MemoryArenaAllocate(BENCH_MAX_BODY_SIZE + MegaBytes(1));
+	state.buffer  = (uint8_t *)MemoryAllocate(BENCH_MAX_BODY_SIZE);
+	state.samples = (uint64_t *)MemoryAllocate(sizeof(uint64_t) * Bench_RequestCount(0));
+
+	const ptrdiff_t sizes[] = { 100, KiloBytes(16), MegaBytes(1), BENCH_MAX_BODY_SIZE };
+
+	for (ptrdiff_t size : sizes) {
+		for (int chunked = 0; chunked < 2; ++chunked) {
+			for (int overload = 0; overload < (int)ArrayCount(BenchOverloadNames); ++overload) {
+				Bench_Client_Case test = { (Bench_Overload)overload, size, chunked != 0, 4, Bench_RequestCount(size) };
+				Bench_ClientRun(&state, transport, test);
+			}
+		}
+	}
+
+	// Header parsing dominates small responses
+	const int header_counts[] = { 0, 16, 48 };
+	for (int headers : header_counts) {
+		Bench_Client_Case test = { BENCH_OVERLOAD_BUFFER, 100, false, headers, Bench_RequestCount(100) };
+		Bench_ClientRun(&state, transport, test);
+	}
+
+	MemoryFree(state.samples, sizeof(uint64_t) * Bench_RequestCount(0));
+	MemoryFree(state.buffer, BENCH_MAX_BODY_SIZE);
+	MemoryArenaFree(state.arena);
+
+	Http_Disconnect(state.http);
+	Bench_StopMock(&server);
+}
+
+void Bench_HttpClientPlain() {
+	Bench_HttpClient(false);
+}
+
+void Bench_HttpClientTls() {
+	Bench_HttpClient(true);
+}
+
+//
+//
+//
+
+static constexpr int BENCH_ASYNC_REQUESTS = 2000;
+static constexpr int BENCH_ASYNC_BUSY     = 200;   // round trips next to a busy connection
+static constexpr int BENCH_ASYNC_ROUNDS   = 20;
+static constexpr int BENCH_ASYNC_SLOW_MS  = 500;   // response delay of the requests that are cancelled or time out
+static constexpr int BENCH_ASYNC_BUSY_MS  = 10000; // response delay of the busy connection, outlasts its round trips
+static constexpr int BENCH_ASYNC_LIMIT_MS = 20;    // deadline of the requests that time out
+
+static Http_Task *Bench_AsyncSubmit(Http_Client *client, String endpoint, Http_Response *res, uint64_t deadline = 0) {
+	Http_Request req;
+	Http_InitRequest(&req);
+	Http_SetHost(&req, client);
+	Http_SetHeader(&req, HTTP_HEADER_CONNECTION, "keep-alive");
+	req.deadline = deadline;
+
+	Http_Async_Request request;
+	request.method   = "GET";
+	request.endpoint = endpoint;
+	request.req      = &req;
+	request.res      = res;
+	return Http_Submit(client, request);
+}
+
+static void Bench_AsyncPrint(const char *name, uint64_t *samples, int count, int failed) {
+	double p50 = (double)Bench_Percentile(samples, count, 50.0) / 1000.0;
+	double p99 = (double)Bench_Percentile(samples, count, 99.0) / 1000.0;
+	double max = (double)Bench_Percentile(samples, count, 100.0) / 1000.0;
+	printf("%-28s p50 %9.1f us   p99 %9.1f us   max %9.1f us   failed %d\n", name, p50, p99, max, failed);
+}
+
+// Submit to completion of small requests, one at a time
+static void Bench_AsyncRoundTrips(Http_Client *client, const char *name, int requests, uint64_t *samples) {
+	static Http_Response res;
+
+	int count  = 0;
+	int failed = 0;
+
+	for (int index = 0; index < requests + BENCH_WARMUP_REQUESTS; ++index) {
+		uint64_t   begin     = MonotonicNanosecs();
+		Http_Task *task      = Bench_AsyncSubmit(client, "/100/cl/0", &res);
+		Http_Task *completed = task ? Http_PollCompletion(client, -1) : nullptr;
+		uint64_t   end       = MonotonicNanosecs();
+
+		bool ok = completed == task && Http_GetResult(task) == HTTP_OK && res.status.code == 200;
+		if (completed) Http_ReleaseTask(completed);
+		if (task) Http_ReleaseTask(task);
+
+		if (index < BENCH_WARMUP_REQUESTS) continue;
+		if (ok)
+			samples[count++] = end - begin;
+		else
+			failed += 1;
+	}
+
+	Bench_AsyncPrint(name, samples, count, failed);
+}
+
+static void Bench_AsyncCancels(Http_Client *client, uint64_t *samples) {
+	static Http_Response res;
+
+	char endpoint[32];
+	int  length = snprintf(endpoint, sizeof(endpoint), "/100/cl/0/%d", BENCH_ASYNC_SLOW_MS);
+
+	int count  = 0;
+	int failed = 0;
+
+	for (int round = 0; round < BENCH_ASYNC_ROUNDS; ++round) {
+		Http_Task *task = Bench_AsyncSubmit(client, String(endpoint, length), &res);
+		if (!task) {
+			failed += 1;
+			continue;
+		}
+
+		// Lets the request reach the server
+		Thread_Sleep(2);
+
+		uint64_t begin = MonotonicNanosecs();
+		Http_Cancel(task);
+		Http_Task *completed = Http_PollCompletion(client, -1);
+		uint64_t   end       = MonotonicNanosecs();
+
+		if (completed == task && Http_GetResult(task) == HTTP_E_CANCELLED)
+			samples[count++] = end - begin;
+		else
+			failed += 1;
+
+		if (completed) Http_ReleaseTask(completed);
+		Http_ReleaseTask(task);
+	}
+
+	Bench_AsyncPrint("cancel to completion", samples, count, failed);
+}
+
+// How long after the deadline the timed out task completes
+static void Bench_AsyncDeadlines(Http_Client *client, uint64_t *samples) {
+	static Http_Response res;
+
+	char endpoint[32];
+	int  length = snprintf(endpoint, sizeof(endpoint), "/100/cl/0/%d", BENCH_ASYNC_SLOW_MS);
+
+	int count  = 0;
+	int failed = 0;
+
+	for (int round = 0; round < BENCH_ASYNC_ROUNDS; ++round) {
+		uint64_t   deadline = MonotonicMillisecs() + BENCH_ASYNC_LIMIT_MS;
+		Http_Task *task     = Bench_AsyncSubmit(client, String(endpoint, length), &res, deadline);
+		if (!task) {
+			failed += 1;
+			continue;
+		}
+
+		Http_Task *completed = Http_PollCompletion(client, -1);
+		uint64_t   end       = MonotonicNanosecs();
+
+		if (completed == task && Http_GetResult(task) == HTTP_E_TIMED_OUT && res.timeout == HTTP_PHASE_HEADER)
+			samples[count++] = end - Minimum(end, deadline * 1000000);
+		else
+			failed += 1;
+
+		if (completed) Http_ReleaseTask(completed);
+		Http_ReleaseTask(task);
+	}
+
+	Bench_AsyncPrint("deadline overshoot", samples, count, failed);
+}
+
+void Bench_HttpClientAsync() {
+	Bench_Mock_Server server;
+	if (!Bench_StartMock(&server, false))
+		return;
+
+	char host[32];
+	snprintf(host, sizeof(host), "http://127.0.0.1:%d", server.port);
+
+	Http_Client *client = Http_CreateClient(String(host, strlen(host)), HTTP_CONNECTION, 4);
+	if (!client) {
+		Bench_StopMock(&server);
+		return;
+	}
+
+	uint64_t *samples = (uint64_t *)MemoryAllocate(sizeof(uint64_t) * BENCH_ASYNC_REQUESTS);
+
+	Bench_AsyncRoundTrips(client, "round trip", BENCH_ASYNC_REQUESTS, samples);
+
+	// Another connection waits on a slow response while the round trips run
+	static Http_Response slow_res;
+	char slow[32];
+	int  slow_length = snprintf(slow, sizeof(slow), "/100/cl/0/%d", BENCH_ASYNC_BUSY_MS);
+	Http_Task *busy  = Bench_AsyncSubmit(client, String(slow, slow_length), &slow_res);
+
+	Bench_AsyncRoundTrips(client, "round trip, one conn busy", BENCH_ASYNC_BUSY, samples);
+
+	if (busy) {
+		Http_Cancel(busy);
+		Http_Task *completed = Http_PollCompletion(client, -1);
+		if (completed) Http_ReleaseTask(completed);
+		Http_ReleaseTask(busy);
+	}
+
+	Bench_AsyncCancels(client, samples);
+	Bench_AsyncDeadlines(client, samples);
+
+	MemoryFree(samples, sizeof(uint64_t) * BENCH_ASYNC_REQUESTS);
+
+	Http_DestroyClient(client);
+	Bench_StopMock(&server);
+}
+
+//
+//
+//
+
+static constexpr int       BENCH_CACHE_REQUESTS = 1000;
+static constexpr ptrdiff_t BENCH_CACHE_BODY     = KiloBytes(16);
+static constexpr ptrdiff_t BENCH_CACHE_MEMORY   = MegaBytes(1);
+static constexpr int       BENCH_CACHE_KEYS     = 100; // of BENCH_CACHE_BODY, more than BENCH_CACHE_MEMORY holds
+
+struct Bench_Cache_State {
+	Http *        http;
+	Http_Cache *  cache;
+	Memory_Arena *arena;
+	uint64_t *    samples;
+};
+
+static bool Bench_CacheGet(Bench_Cache_State *state, String endpoint) {
+	static Http_Response res;
+
+	Http_Request req;
+	Http_InitRequest(&req);
+	Http_SetHost(&req, state->http);
+	Http_SetHeader(&req, HTTP_HEADER_CONNECTION, "keep-alive");
+	// A 304 read as if it had a body would wait here for bytes that never come
+	req.deadline = MonotonicMillisecs() + 2000;
+
+	MemoryArenaReset(state->arena);
+	bool ok = Http_Get(state->http, state->cache, endpoint, req, &res, state->arena);
+	if (ok && res.status.code == 200 && res.body.length == BENCH_CACHE_BODY)
+		return true;
+
+	Http_Reconnect(state->http);
+	return false;
+}
+
+// Requests the endpoint over and over after a first request that fills the cache
+static void Bench_CacheRun(Bench_Cache_State *state, const char *name, const char *mode) {
+	char endpoint[64];
+	int  length = snprintf(endpoint, sizeof(endpoint), "/%td/cl/0/0/%s", BENCH_CACHE_BODY, mode);
+
+	Http_ClearCache(state->cache);
+	Bench_CacheGet(state, String(endpoint, length));
+
+	Http_Cache_Stats before = Http_GetCacheStats(state->cache);
+
+	int count  = 0;
+	int failed = 0;
+	for (int index = 0; index < BENCH_CACHE_REQUESTS; ++index) {
+		uint64_t begin = MonotonicNanosecs();
+		bool     ok    = Bench_CacheGet(state, String(endpoint, length));
+		uint64_t end   = MonotonicNanosecs();
+
+		if (ok)
+			state->samples[count++] = end - begin;
+		else
+			failed += 1;
+	}
+
+	Http_Cache_Stats after = Http_GetCacheStats(state->cache);
+
+	double p50 = (double)Bench_Percentile(state->samples, count, 50.0) / 1000.0;
+	double p99 = (double)Bench_Percentile(state->samples, count, 99.0) / 1000.0;
+
+	printf("%-12s p50 %8.1f us   p99 %8.1f us   hits %4lld   revalidated %4lld   misses %4lld   %td entries   failed %d\n",
+		name, p50, p99, (long long)(after.hits - before.hits), (long long)(after.revalidations - before.revalidations),
+		(long long)(after.misses - before.misses), after.entries, failed);
+}
+
+// Fills the cache past its memory with fresh responses, then requests the newest and the oldest again
+static void Bench_CacheEviction(Bench_Cache_State *state) {
+	auto endpoint = [](char *buffer, int length, int key) -> String {
+		return String(buffer, snprintf(buffer, length, "/%td/cl/0/0/fresh/%d", BENCH_CACHE_BODY, key));
+	};
+
+	char buffer[64];
+	int  failed = 0;
+
+	Http_ClearCache(state->cache);
+	Http_Cache_Stats before = Http_GetCacheStats(state->cache);
+
+	for (int key = 0; key < BENCH_CACHE_KEYS; ++key)
+		failed += !Bench_CacheGet(state, endpoint(buffer, sizeof(buffer), key));
+
+	Http_Cache_Stats filled = Http_GetCacheStats(state->cache);
+
+	failed += !Bench_CacheGet(state, endpoint(buffer, sizeof(buffer), BENCH_CACHE_KEYS - 1));
+	Http_Cache_Stats newest = Http_GetCacheStats(state->cache);
+
+	failed += !Bench_CacheGet(state, endpoint(buffer, sizeof(buffer), 0));
+	Http_Cache_Stats oldest = Http_GetCacheStats(state->cache);
+
+	printf("%-12s %d keys   %lld evictions   %td entries in %td KB   newest %s   oldest %s   failed %d\n", "lru eviction",
+		BENCH_CACHE_KEYS, (long long)(filled.evictions - before.evictions), filled.entries, filled.memory / KiloBytes(1),
+		newest.hits > filled.hits ? "hit" : "miss", oldest.misses > newest.misses ? "miss" : "hit", failed);
+}
+
+void Bench_HttpCache() {
+	for (int index = 0; index < BENCH_MOCK_CHUNK_SIZE; ++index)
+		BenchPattern[index] = (uint8_t)('a' + index % 26);
+
+	Bench_Mock_Server server;
+	if (!Bench_StartMock(&server, false))
+		return;
+
+	char port[16];
+	snprintf(port, sizeof(port), "%d", server.port);
+
+	Bench_Cache_State state = {};
+	state.http = Http_Connect("127.0.0.1", String(port, strlen(port)), HTTP_CONNECTION, ThreadContext.allocator);
+	if (!state.http) {
+		Bench_StopMock(&server);
+		return;
+	}
+
+	state.cache   = Http_CreateCache(BENCH_CACHE_MEMORY);
+	state.arena   = MemoryArenaAllocate(MegaBytes(1));
+	state.samples = (uint64_t *)MemoryAllocate(sizeof(uint64_t) * BENCH_CACHE_REQUESTS);
+
+	Bench_CacheRun(&state, "fresh hit", "fresh");
+	Bench_CacheRun(&state, "revalidated", "stale");
+	Bench_CacheRun(&state, "no-store", "nostore");
+	Bench_CacheEviction(&state);
+
+	MemoryFree(state.samples, sizeof(uint64_t) * BENCH_CACHE_REQUESTS);
+	MemoryArenaFree(state.arena);
+	Http_DestroyCache(state.cache);
+
+	Http_Disconnect(state.http);
+	Bench_StopMock(&server);
+}
+
+//
+//
+//
+
+static constexpr ptrdiff_t BENCH_DOWNLOAD_SIZE    = MegaBytes(32) + 12345; // the last segment is partial
+static constexpr ptrdiff_t BENCH_DOWNLOAD_SEGMENT = MegaBytes(1);
+
+static const char BenchDownloadPath[] = "Bench_Download.bin";
+
+// Compares the file with the pattern the mock server sends
+static bool Bench_DownloadVerify(ptrdiff_t size) {
+	FILE *file = fopen(BenchDownloadPath, "rb");
+	if (!file) return false;
+	Defer{ fclose(file); };
+
+	static uint8_t buffer[BENCH_MOCK_CHUNK_SIZE];
+
+	ptrdiff_t offset = 0;
+	while (true) {
+		size_t read = fread(buffer, 1, sizeof(buffer), file);
+		if (!read) break;
+		if (memcmp(buffer, BenchPattern, read) != 0)
+			return false;
+		offset += read;
+	}
+
+	return offset == size;
+}
+
+static bool Bench_DownloadPartExists() {
+	char path[64];
+	snprintf(path, sizeof(path), "%s.part", BenchDownloadPath);
+	FILE *file = fopen(path, "rb");
+	if (file) fclose(file);
+	return file != nullptr;
+}
+
+// Downloads the endpoint of the mode, 'expected' tells whether Http_Download should succeed
+static void Bench_DownloadRun(Bench_Mock_Server *server, const char *name, const char *mode, bool expected) {
+	char url[128];
+	int  length = snprintf(url, sizeof(url), "http://127.0.0.1:%d/%td/cl/0/0/%s", server->port, BENCH_DOWNLOAD_SIZE, mode);
+
+	Http_Download_Spec spec;
+	spec.segment = BENCH_DOWNLOAD_SEGMENT;
+
+	int64_t  served = AtomicLoad(&server->body_bytes);
+	uint64_t start  = MonotonicNanosecs();
+	bool     ok     = Http_Download(String(url, length), BenchDownloadPath, spec);
+	double   ms     = (double)(MonotonicNanosecs() - start) / 1e6;
+	served          = AtomicLoad(&server->body_bytes) - served;
+
+	// A failed download keeps its journal for the next attempt
+	const char *file = ok ? (Bench_DownloadVerify(BENCH_DOWNLOAD_SIZE) ? "intact" : "corrupt") :
+		(Bench_DownloadPartExists() ? "journal kept" : "no journal");
+
+	printf("%-16s %-9s %s   %8.1f ms   %7.1f MB/s   %6.1f MB served   %s\n", name, ok ? "completed" : "failed",
+		ok == expected ? "(expected)  " : "(unexpected)", ms, ok ? (double)BENCH_DOWNLOAD_SIZE / ms / 1e3 : 0.0,
+		(double)served / (double)MegaBytes(1), file);
+}
+
+void Bench_HttpDownload() {
+	for (int index = 0; index < BENCH_MOCK_CHUNK_SIZE; ++index)
+		BenchPattern[index] = (uint8_t)('a' + index % 26);
+
+	Bench_Mock_Server server;
+	if (!Bench_StartMock(&server, false))
+		return;
+
+	char part[64];
+	snprintf(part, sizeof(part), "%s.part", BenchDownloadPath);
+
+	remove(BenchDownloadPath);
+	remove(part);
+
+	Bench_DownloadRun(&server, "ranged", "range", true);
+
+	// The first half is kept by the failed attempt, the resumed download only asks for the rest
+	remove(BenchDownloadPath);
+	Bench_DownloadRun(&server, "first half", "half", false);
+	Bench_DownloadRun(&server, "resumed", "range", true);
+
+	remove(BenchDownloadPath);
+	Bench_DownloadRun(&server, "ignores range", "norange", true);
+
+	remove(BenchDownloadPath);
+	Bench_DownloadRun(&server, "length mismatch", "mismatch", false);
+
+	remove(BenchDownloadPath);
+	remove(part);
+
+	Bench_StopMock(&server);
+}
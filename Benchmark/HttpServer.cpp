@@ -0,0 +1,163 @@
+#include "Benchmark.h"
+#include "Http.h"
+#include "Network.h"
+#include "Kr/KrThread.h"
+
+#include <stdio.h>
+#include <string.h>
+
+//
+// Loopback load against Http_StartServer, every client thread keeps one connection alive. The last run
+// is made while other connections have asked for a large body and read none of it, the workers keep
+// serving the rest while the output of those waits on the socket.
+//
+
+static constexpr int       BENCH_SERVER_WORKERS      = 4;
+static constexpr int       BENCH_CLIENT_THREADS      = 8;
+static constexpr int       BENCH_REQUESTS_PER_CLIENT = 20000;
+static constexpr int       BENCH_STALLED_CLIENTS     = 2 * BENCH_SERVER_WORKERS;
+static constexpr ptrdiff_t BENCH_STALLED_BODY_SIZE   = MegaBytes(4);
+
+static void Bench_ServerHandler(const Http_Server_Request &request, Http_Response *res, Memory_Arena *arena, void *context) {
+	if (request.endpoint == "/large") {
+		uint8_t *body = (uint8_t *)PushSize(arena, BENCH_STALLED_BODY_SIZE);
+		memset(body, 'x', BENCH_STALLED_BODY_SIZE);
+		Http_SetContent(res, "text/plain", Buffer(body, BENCH_STALLED_BODY_SIZE));
+	} else if (request.method == "POST") {
+		Http_SetContent(res, "application/json", Buffer("{\"type\":1}"));
+	} else {
+		Http_SetContent(res, "text/plain", Buffer("ok"));
+	}
+}
+
+struct Bench_Client {
+	int       port;
+	String    method;
+	Buffer    body;
+	uint64_t *samples;
+	ptrdiff_t count;
+	ptrdiff_t failed;
+};
+
+static int Bench_ClientThreadProc(void *arg) {
+	Bench_Client *client = (Bench_Client *)arg;
+
+	char port[16];
+	snprintf(port, sizeof(port), "%d", client->port);
+
+	Http *http = Http_Connect("127.0.0.1", String(port, strlen(port)), HTTP_CONNECTION, ThreadContext.allocator);
+	if (!http) {
+		client->failed = BENCH_REQUESTS_PER_CLIENT;
+		return 1;
+	}
+
+	Http_Request req;
+	Http_InitRequest(&req);
+	Http_SetHost(&req, http);
+	Http_SetHeader(&req, HTTP_HEADER_CONNECTION, "keep-alive");
+	if (client->body.length)
+		Http_SetContent(&req, "application/json", client->body);
+
+	Http_Response res;
+	uint8_t       buffer[256];
+
+	for (int index = 0; index < BENCH_REQUESTS_PER_CLIENT; ++index) {
+		uint64_t start = MonotonicNanosecs();
+		bool ok = Http_CustomMethod(http, client->method, "/bench", req, &res, buffer, sizeof(buffer));
+		uint64_t end = MonotonicNanosecs();
+
+		if (ok && res.status.code == 200)
+			client->samples[client->count++] = end - start;
+		else
+			client->failed += 1;
+	}
+
+	Http_Disconnect(http);
+	return 0;
+}
+
+static void Bench_Run(const char *name, int port, String method, Buffer body) {
+	Bench_Client clients[BENCH_CLIENT_THREADS];
+	Thread *     threads[BENCH_CLIENT_THREADS];
+
+	ptrdiff_t samples_size = sizeof(uint64_t) * BENCH_REQUESTS_PER_CLIENT * BENCH_CLIENT_THREADS;
+	uint64_t *samples      = (uint64_t *)MemoryAllocate(samples_size);
+
+	uint64_t start = MonotonicNanosecs();
+
+	for (int index = 0; index < BENCH_CLIENT_THREADS; ++index) {
+		Bench_Client *client = &clients[index];
+		client->port    = port;
+		client->method  = method;
+		client->body    = body;
+		client->samples = samples + index * BENCH_REQUESTS_PER_CLIENT;
+		client->count   = 0;
+		client->failed  = 0;
+		threads[index]  = Thread_Create(Bench_ClientThreadProc, client);
+	}
+
+	for (int index = 0; index < BENCH_CLIENT_THREADS; ++index) {
+		Thread_Wait(threads[index], -1);
+		Thread_Destroy(threads[index]);
+	}
+
+	uint64_t elapsed = MonotonicNanosecs() - start;
+
+	// Samples of the clients are packed together before sorting
+	ptrdiff_t count  = 0;
+	ptrdiff_t failed = 0;
+	for (int index = 0; index < BENCH_CLIENT_THREADS; ++index) {
+		memmove(samples + count, clients[index].samples, sizeof(uint64_t) * clients[index].count);
+		count  += clients[index].count;
+		failed += clients[index].failed;
+	}
+
+	double seconds = (double)elapsed / 1e9;
+	double p50     = (double)Bench_Percentile(samples, count, 50.0) / 1000.0;
+	double p99     = (double)Bench_Percentile(samples, count, 99.0) / 1000.0;
+
+	printf("%-24s %10.0f req/s   p50 %8.1f us   p99 %8.1f us   failed %td\n", name, (double)count / seconds, p50, p99, failed);
+
+	MemoryFree(samples, samples_size);
+}
+
+void Bench_HttpServer() {
+	Http_Server_Spec spec;
+	spec.node    = "127.0.0.1";
+	spec.port    = "0";
+	spec.workers = BENCH_SERVER_WORKERS;
+
+	Http_Handler handler;
+	handler.proc = Bench_ServerHandler;
+
+	Http_Server *server = Http_StartServer(spec, handler);
+	if (!server) return;
+
+	int port = Http_GetServerPort(server);
+
+	const char webhook[] = "{\"type\":1,\"id\":\"1000000000000000000\",\"application_id\":\"1000000000000000001\",\"token\":\"aW50ZXJhY3Rpb24gdG9rZW4\"}";
+
+	Bench_Run("GET keep-alive", port, "GET", Buffer());
+	Bench_Run("POST webhook", port, "POST", Buffer((uint8_t *)webhook, sizeof(webhook) - 1));
+
+	char service[16];
+	snprintf(service, sizeof(service), "%d", port);
+
+	Net_Socket *stalled[BENCH_STALLED_CLIENTS] = {};
+	char        large[] = "GET /large HTTP/1.1\r\nHost: 127.0.0.1\r\n\r\n";
+
+	for (int index = 0; index < BENCH_STALLED_CLIENTS; ++index) {
+		stalled[index] = Net_OpenConnection("127.0.0.1", String(service, strlen(service)), NET_SOCKET_TCP);
+		if (stalled[index])
+			Net_SendBlocked(stalled[index], large, (int)strlen(large));
+	}
+
+	Bench_Run("GET beside stalled reads", port, "GET", Buffer());
+
+	for (int index = 0; index < BENCH_STALLED_CLIENTS; ++index) {
+		if (stalled[index])
+			Net_CloseConnection(stalled[index]);
+	}
+
+	Http_StopServer(server);
+}
@@ -0,0 +1,152 @@
+#include "Benchmark.h"
+#include "Kr/KrAtomic.h"
+#include "Kr/KrBasic.h"
+#include "Kr/KrJobs.h"
+#include "Kr/KrThread.h"
+
+#include <stdio.h>
+#include <time.h>
+
+//
+// Scheduling overhead per job (empty jobs pushed from one thread, parallel for with a grain of one and
+// recursive fork-join), scaling of a parallel for that hashes a buffer from one thread up to one per
+// processor, and the processor time the pool takes while it has nothing to do.
+//
+
+static constexpr int       BENCH_JOBS_ROUNDS  = 8;
+static constexpr ptrdiff_t BENCH_JOBS_EMPTY   = 1 << 18;
+static constexpr ptrdiff_t BENCH_JOBS_RANGE   = 1 << 20;
+static constexpr int       BENCH_JOBS_FORK    = 22;
+static constexpr size_t    BENCH_JOBS_BUFFER  = MegaBytes(64);
+static constexpr ptrdiff_t BENCH_JOBS_CHUNK   = KiloBytes(16);
+static constexpr int       BENCH_JOBS_IDLE_MS = 500;
+
+struct Bench_Jobs_Fork {
+	int     depth;
+	int64_t leaves;
+};
+
+struct Bench_Jobs_Hash {
+	const uint8_t *  buffer;
+	int64_t volatile result;
+};
+
+static void Bench_JobsEmpty(void *arg) {}
+
+static void Bench_JobsEmptyRange(void *arg, ptrdiff_t begin, ptrdiff_t end) {}
+
+static void Bench_JobsFork(void *arg) {
+	Bench_Jobs_Fork *fork = (Bench_Jobs_Fork *)arg;
+	if (fork->depth == 0) {
+		fork->leaves = 1;
+		return;
+	}
+
+	Bench_Jobs_Fork left  = { fork->depth - 1, 0 };
+	Bench_Jobs_Fork right = { fork->depth - 1, 0 };
+
+	Job_Counter counter = {};
+	Jobs_Run(Bench_JobsFork, &left, &counter);
+	Bench_JobsFork(&right);
+	Jobs_Wait(&counter);
+
+	fork->leaves = left.leaves + right.leaves;
+}
+
+static void Bench_JobsHashRange(void *arg, ptrdiff_t begin, ptrdiff_t end) {
+	Bench_Jobs_Hash *hash = (Bench_Jobs_Hash *)arg;
+	uint64_t result = 0;
+	for (ptrdiff_t chunk = begin; chunk < end; ++chunk)
+		result ^= HashBytes(hash->buffer + chunk * BENCH_JOBS_CHUNK, BENCH_JOBS_CHUNK, chunk);
+	AtomicAdd(&hash->result, (int64_t)result);
+}
+
+static uint64_t Bench_JobsMedian(uint64_t *samples) {
+	return Bench_Percentile(samples, BENCH_JOBS_ROUNDS, 50.0);
+}
+
+static bool Bench_JobsStart(int32_t workers) {
+	Job_System_Spec spec = JobSystemDefaultSpec;
+	spec.workers         = workers;
+	spec.params.logger   = ThreadContext.logger;
+	return Jobs_Initialize(spec);
+}
+
+static void Bench_JobsOverhead() {
+	uint64_t samples[BENCH_JOBS_ROUNDS];
+
+	for (int round = 0; round < BENCH_JOBS_ROUNDS; ++round) {
+		Job_Counter counter = {};
+		uint64_t    start   = MonotonicNanosecs();
+		for (ptrdiff_t index = 0; index < BENCH_JOBS_EMPTY; ++index)
+			Jobs_Run(Bench_JobsEmpty, nullptr, &counter);
+		Jobs_Wait(&counter);
+		samples[round] = MonotonicNanosecs() - start;
+	}
+	printf("empty jobs        %8.1f ns/job\n", (double)Bench_JobsMedian(samples) / (double)BENCH_JOBS_EMPTY);
+
+	for (int round = 0; round < BENCH_JOBS_ROUNDS; ++round) {
+		uint64_t start = MonotonicNanosecs();
+		Jobs_ParallelFor(BENCH_JOBS_RANGE, 1, Bench_JobsEmptyRange, nullptr);
+		samples[round] = MonotonicNanosecs() - start;
+	}
+	printf("parallel for      %8.1f ns/element (grain 1)\n", (double)Bench_JobsMedian(samples) / (double)BENCH_JOBS_RANGE);
+
+	int64_t leaves = 0;
+	for (int round = 0; round < BENCH_JOBS_ROUNDS; ++round) {
+		Bench_Jobs_Fork fork = { BENCH_JOBS_FORK, 0 };
+		uint64_t start = MonotonicNanosecs();
+		Bench_JobsFork(&fork);
+		samples[round] = MonotonicNanosecs() - start;
+		leaves = fork.leaves;
+	}
+	printf("fork-join         %8.1f ns/job (%lld leaves)\n", (double)Bench_JobsMedian(samples) / (double)leaves, (long long)leaves);
+}
+
+static double Bench_JobsHash(const uint8_t *buffer) {
+	uint64_t samples[BENCH_JOBS_ROUNDS];
+	ptrdiff_t chunks = BENCH_JOBS_BUFFER / BENCH_JOBS_CHUNK;
+
+	for (int round = 0; round < BENCH_JOBS_ROUNDS; ++round) {
+		Bench_Jobs_Hash hash = { buffer, 0 };
+		uint64_t start = MonotonicNanosecs();
+		Jobs_ParallelFor(chunks, 4, Bench_JobsHashRange, &hash);
+		samples[round] = MonotonicNanosecs() - start;
+	}
+
+	return (double)BENCH_JOBS_BUFFER / (double)MegaBytes(1) / ((double)Bench_JobsMedian(samples) / 1e9);
+}
+
+void Bench_Jobs() {
+	uint32_t processors = Thread_ProcessorCount();
+	printf("%u processors\n", processors);
+
+	if (!Bench_JobsStart(-1)) return;
+	Bench_JobsOverhead();
+
+	clock_t cpu = clock();
+	Thread_Sleep(BENCH_JOBS_IDLE_MS);
+	double idle = (double)(clock() - cpu) / (double)CLOCKS_PER_SEC * 1000.0;
+	printf("idle              %8.1f ms of processor time in %d ms\n", idle, BENCH_JOBS_IDLE_MS);
+
+	Jobs_Shutdown();
+
+	uint8_t *buffer = (uint8_t *)MemoryAllocate(BENCH_JOBS_BUFFER);
+	if (!buffer) return;
+	for (size_t index = 0; index < BENCH_JOBS_BUFFER; ++index)
+		buffer[index] = (uint8_t)(index * 31 + (index >> 12));
+
+	double single = 0;
+	for (uint32_t threads = 1;; threads = Minimum(threads * 2, processors)) {
+		if (!Bench_JobsStart((int32_t)threads - 1)) break;
+		double throughput = Bench_JobsHash(buffer);
+		Jobs_Shutdown();
+
+		if (threads == 1) single = throughput;
+		printf("hash %3u threads  %8.1f MB/s   %5.2fx\n", threads, throughput, throughput / single);
+
+		if (threads == processors) break;
+	}
+
+	MemoryFree(buffer, BENCH_JOBS_BUFFER);
+}
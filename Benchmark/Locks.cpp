@@ -0,0 +1,182 @@
+#include "Benchmark.h"
+#include "Kr/KrAtomic.h"
+#include "Kr/KrThread.h"
+
+#include <stdio.h>
+#include <string.h>
+
+//
+// Threads taking the same lock around a short critical section for a fixed time: the plain compare exchange
+// loop SpinLock used to be, the test and test and set SpinLock, TicketLock and RW_Lock with only writers and
+// with one write in eight. Reports the operations per second of all threads and the least and most any one
+// thread got done, and the same for a shared counter with sequentially consistent and relaxed increments.
+//
+
+static constexpr int BENCH_LOCK_MILLISECS = 200;
+static constexpr int BENCH_LOCK_MAX       = 16;
+
+enum Bench_Lock_Kind {
+	BENCH_LOCK_CAS,
+	BENCH_LOCK_TTAS,
+	BENCH_LOCK_TICKET,
+	BENCH_LOCK_RW_WRITE,
+	BENCH_LOCK_RW_READ,
+	BENCH_LOCK_ADD,
+	BENCH_LOCK_ADD_RELAXED,
+};
+
+struct Bench_Lock_Shared {
+	Bench_Lock_Kind  kind;
+	int32_t volatile running;
+	int32_t volatile ready;
+
+	alignas(64) Atomic_Guard guard;
+	alignas(64) Ticket_Lock  ticket;
+	alignas(64) RW_Lock      rw;
+	alignas(64) int64_t volatile counter;
+	uint64_t         data[8]; // touched inside the critical section
+};
+
+struct Bench_Lock_Thread {
+	Bench_Lock_Shared *shared;
+	uint32_t           index;
+	uint64_t           ops;
+};
+
+static inline void Bench_LockCasAcquire(Atomic_Guard *guard) {
+	while (AtomicCmpExg(&guard->value, 1, 0) == 1)
+		;
+}
+
+static inline void Bench_LockWork(Bench_Lock_Shared *shared) {
+	for (uint64_t &value : shared->data)
+		value += 1;
+}
+
+static int Bench_LockThreadProc(void *arg) {
+	Bench_Lock_Thread *thread = (Bench_Lock_Thread *)arg;
+	Bench_Lock_Shared *shared = thread->shared;
+
+	AtomicInc(&shared->ready);
+	while (AtomicLoadAcquire(&shared->running) == 0)
+		AtomicPause();
+
+	uint64_t ops = 0;
+	while (AtomicLoadRelaxed(&shared->running) == 1) {
+		switch (shared->kind) {
+			case BENCH_LOCK_CAS:
+				Bench_LockCasAcquire(&shared->guard);
+				Bench_LockWork(shared);
+				AtomicStore(&shared->guard.value, 0);
+				break;
+
+			case BENCH_LOCK_TTAS:
+				SpinLock(&shared->guard);
+				Bench_LockWork(shared);
+				SpinUnlock(&shared->guard);
+				break;
+
+			case BENCH_LOCK_TICKET:
+				TicketLock(&shared->ticket);
+				Bench_LockWork(shared);
+				TicketUnlock(&shared->ticket);
+				break;
+
+			case BENCH_LOCK_RW_WRITE:
+				WriteLock(&shared->rw);
+				Bench_LockWork(shared);
+				WriteUnlock(&shared->rw);
+				break;
+
+			case BENCH_LOCK_RW_READ:
+				if ((ops & 7) == thread->index % 8) {
+					WriteLock(&shared->rw);
+					Bench_LockWork(shared);
+					WriteUnlock(&shared->rw);
+				} else {
+					ReadLock(&shared->rw);
+					(void)*(uint64_t volatile *)&shared->data[0];
+					ReadUnlock(&shared->rw);
+				}
+				break;
+
+			case BENCH_LOCK_ADD:
+				AtomicInc(&shared->counter);
+				break;
+
+			case BENCH_LOCK_ADD_RELAXED:
+				AtomicAddRelaxed(&shared->counter, 1);
+				break;
+		}
+		ops += 1;
+	}
+
+	thread->ops = ops;
+	return 0;
+}
+
+static void Bench_LockRun(const char *name, Bench_Lock_Kind kind, uint32_t count) {
+	static Bench_Lock_Shared shared;
+	memset((void *)&shared, 0, sizeof(shared));
+	shared.kind = kind;
+
+	Bench_Lock_Thread threads[BENCH_LOCK_MAX];
+	Thread *          handles[BENCH_LOCK_MAX];
+
+	for (uint32_t index = 0; index < count; ++index) {
+		threads[index] = { &shared, index, 0 };
+		handles[index] = Thread_Create(Bench_LockThreadProc, &threads[index]);
+	}
+
+	while ((uint32_t)AtomicLoad(&shared.ready) != count)
+		Thread_Yield();
+
+	uint64_t start = MonotonicNanosecs();
+	AtomicStore(&shared.running, 1);
+	Thread_Sleep(BENCH_LOCK_MILLISECS);
+	AtomicStore(&shared.running, 2);
+
+	for (uint32_t index = 0; index < count; ++index) {
+		Thread_Wait(handles[index], -1);
+		Thread_Destroy(handles[index]);
+	}
+	double seconds = (double)(MonotonicNanosecs() - start) / 1e9;
+
+	uint64_t total = 0, least = UINT64_MAX, most = 0;
+	for (uint32_t index = 0; index < count; ++index) {
+		total += threads[index].ops;
+		least  = Minimum(least, threads[index].ops);
+		most   = Maximum(most, threads[index].ops);
+	}
+
+	printf("%-12s %2u threads  %8.2f Mops/s  %7.1f ns/op   thread min %5.1f%% max %5.1f%% of the mean\n",
+		name, count, (double)total / seconds / 1e6, seconds * 1e9 / (double)total,
+		100.0 * (double)least * count / (double)total, 100.0 * (double)most * count / (double)total);
+}
+
+void Bench_Locks() {
+	struct Bench_Lock_Case {
+		const char *    name;
+		Bench_Lock_Kind kind;
+	};
+
+	const Bench_Lock_Case cases[] = {
+		{ "cas",         BENCH_LOCK_CAS },
+		{ "ttas",        BENCH_LOCK_TTAS },
+		{ "ticket",      BENCH_LOCK_TICKET },
+		{ "rw-write",    BENCH_LOCK_RW_WRITE },
+		{ "rw-read",     BENCH_LOCK_RW_READ },
+		{ "add",         BENCH_LOCK_ADD },
+		{ "add-relaxed", BENCH_LOCK_ADD_RELAXED },
+	};
+
+	uint32_t processors = Thread_ProcessorCount();
+	printf("%u processors\n", processors);
+
+	const uint32_t counts[] = { 1, 2, 4, Minimum(Maximum(processors, 8u), (uint32_t)BENCH_LOCK_MAX) };
+
+	for (const Bench_Lock_Case &test : cases) {
+		for (uint32_t count : counts)
+			Bench_LockRun(test.name, test.kind, count);
+	}
+}
@@ -0,0 +1,109 @@
+#include "Benchmark.h"
+#include "Kr/KrLog.h"
+#include "Kr/KrThread.h"
+
+#include <stdio.h>
+
+//
+// Time a LogInfoEx call takes on the thread that logs, formatting and writing on the spot (vfprintf and a
+// flush per line, what a terminal does) against the asynchronous logger, both into the null device. Lines
+// are like the ones of a failed REST request dump: a header name and value given as "%.*s" strings.
+//
+
+static constexpr int BENCH_LOG_LINES   = 1 << 16;
+static constexpr int BENCH_LOG_THREADS = 4;
+
+static FILE *BenchLogNull;
+
+static void Bench_LogSyncProc(void *context, Log_Level level, const char *source, const char *fmt, va_list args) {
+	fprintf(BenchLogNull, "[%s] ", source);
+	vfprintf(BenchLogNull, fmt, args);
+	fprintf(BenchLogNull, "\n");
+	fflush(BenchLogNull);
+}
+
+struct Bench_Log_Thread {
+	Logger    logger;
+	uint64_t *samples;
+};
+
+static int Bench_LogThreadProc(void *arg) {
+	Bench_Log_Thread *thread = (Bench_Log_Thread *)arg;
+	ThreadContextSetLogger(thread->logger);
+
+	String name  = "x-ratelimit-reset-after";
+	String value = "0.412";
+
+	for (int index = 0; index < BENCH_LOG_LINES; ++index) {
+		uint64_t start = MonotonicNanosecs();
+		LogInfoEx("Http", "> " StrFmt ": " StrFmt " (%d)", StrArg(name), StrArg(value), index);
+		thread->samples[index] = MonotonicNanosecs() - start;
+	}
+
+	return 0;
+}
+
+static void Bench_LogRun(const char *name, Logger logger, int count) {
+	Bench_Log_Thread threads[BENCH_LOG_THREADS];
+	Thread *         handles[BENCH_LOG_THREADS];
+
+	uint64_t *samples = (uint64_t *)MemoryAllocate(sizeof(uint64_t) * BENCH_LOG_LINES * count);
+	if (!samples) return;
+
+	uint64_t start = MonotonicNanosecs();
+	for (int index = 0; index < count; ++index) {
+		threads[index] = { logger, samples + index * BENCH_LOG_LINES };
+		handles[index] = Thread_Create(Bench_LogThreadProc, &threads[index]);
+	}
+	for (int index = 0; index < count; ++index) {
+		Thread_Wait(handles[index], -1);
+		Thread_Destroy(handles[index]);
+	}
+	double seconds = (double)(MonotonicNanosecs() - start) / 1e9;
+
+	ptrdiff_t total = (ptrdiff_t)BENCH_LOG_LINES * count;
+	uint64_t  p50   = Bench_Percentile(samples, total, 50.0);
+	uint64_t  p99   = Bench_Percentile(samples, total, 99.0);
+	uint64_t  p999  = Bench_Percentile(samples, total, 99.9);
+
+	printf("%-6s %d threads  p50 %6llu ns  p99 %7llu ns  p99.9 %8llu ns  %6.2f M lines/s\n", name, count,
+		(unsigned long long)p50, (unsigned long long)p99, (unsigned long long)p999, (double)total / seconds / 1e6);
+
+	MemoryFree(samples, sizeof(uint64_t) * BENCH_LOG_LINES * count);
+}
+
+void Bench_Log() {
+#if PLATFORM_WINDOWS == 1
+	const char *null_device = "NUL";
+#else
+	const char *null_device = "/dev/null";
+#endif
+
+	BenchLogNull = fopen(null_device, "wb");
+	if (!BenchLogNull) return;
+
+	for (int count = 1; count <= BENCH_LOG_THREADS; count *= 4)
+		Bench_LogRun("sync", { Bench_LogSyncProc, nullptr }, count);
+
+	Async_Log_Spec spec = AsyncLogDefaultSpec;
+	spec.context        = BenchLogNull;
+
+	for (int count = 1; count <= BENCH_LOG_THREADS; count *= 4) {
+		if (!AsyncLog_Start(spec)) break;
+		Bench_LogRun("async", AsyncLog_Logger(), count);
+		AsyncLog_Stop();
+	}
+
+	for (int count = 1; count <= BENCH_LOG_THREADS; count *= 4) {
+		spec.overflow = LOG_OVERFLOW_BLOCK;
+		if (!AsyncLog_Start(spec)) break;
+		Bench_LogRun("block", AsyncLog_Logger(), count);
+		AsyncLog_Stop();
+	}
+
+	Async_Log_Stats stats;
+	AsyncLog_GetStats(&stats);
+	printf("async  written %lld, dropped %lld, blocked %lld times\n", (long long)stats.written, (long long)stats.dropped, (long long)stats.blocked);
+
+	fclose(BenchLogNull);
+}
@@ -0,0 +1,85 @@
+#include "Benchmark.h"
+#include "Network.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+//
+// Usage: Benchmark [names...], runs every benchmark when no name is given
+//
+
+static const Bench_Entry Benchmarks[] = {
+	{ "http-server",       Bench_HttpServer },
+	{ "http-client",       Bench_HttpClientPlain },
+	{ "http-client-tls",   Bench_HttpClientTls },
+	{ "http-client-async", Bench_HttpClientAsync },
+	{ "http-cache",        Bench_HttpCache },
+	{ "http-download",     Bench_HttpDownload },
+	{ "discord-message",   Bench_DiscordMessage },
+	{ "http-build",        Bench_HttpBuild },
+	{ "arena-pages",       Bench_ArenaPages },
+	{ "allocator",         Bench_Allocator },
+	{ "hash-table",        Bench_HashTable },
+	{ "jobs",              Bench_Jobs },
+	{ "locks",             Bench_Locks },
+	{ "log",               Bench_Log },
+	{ "strings",           Bench_Strings },
+	{ "format",            Bench_Format },
+	{ "websocket",         Bench_WebsocketFrames },
+	{ "cache",             Bench_Cache },
+	{ "profile",           Bench_Profile },
+};
+
+static int CompareSamples(const void *a, const void *b) {
+	uint64_t x = *(const uint64_t *)a;
+	uint64_t y = *(const uint64_t *)b;
+	return (x > y) - (x < y);
+}
+
+uint64_t Bench_Percentile(uint64_t *samples, ptrdiff_t count, double percentile) {
+	if (!count) return 0;
+	qsort(samples, count, sizeof(uint64_t), CompareSamples);
+	ptrdiff_t index = (ptrdiff_t)((percentile / 100.0) * (double)(count - 1) + 0.5);
+	return samples[Clamp((ptrdiff_t)0, count - 1, index)];
+}
+
+static void *Bench_CountingAllocatorProc(Allocation_Kind kind, void *mem, size_t prev_size, size_t new_size, void *context) {
+	Bench_Allocation_Counter *counter = (Bench_Allocation_Counter *)context;
+	if (kind != ALLOCATION_KIND_FREE)
+		counter->count += 1;
+	return counter->parent.proc(kind, mem, prev_size, new_size, counter->parent.context);
+}
+
+Memory_Allocator Bench_CountingAllocator(Bench_Allocation_Counter *counter) {
+	return { Bench_CountingAllocatorProc, counter };
+}
+
+static void LogProcedure(void *context, Log_Level level, const char *source, const char *fmt, va_list args) {
+	if (level == LOG_LEVEL_INFO) return;
+	fprintf(stderr, "[%s] ", source);
+	vfprintf(stderr, fmt, args);
+	fprintf(stderr, "\n");
+}
+
+int main(int argc, char **argv) {
+	InitThreadContext(MegaBytes(64));
+	ThreadContextSetLogger({ LogProcedure, nullptr });
+
+	if (!Net_Initialize())
+		return 1;
+
+	for (const Bench_Entry &entry : Benchmarks) {
+		bool run = argc <= 1;
+		for (int index = 1; index < argc && !run; ++index)
+			run = strcmp(argv[index], entry.name) == 0;
+		if (!run) continue;
+
+		printf("== %s\n", entry.name);
+		entry.proc();
+	}
+
+	Net_Shutdown();
+
+	return 0;
+}
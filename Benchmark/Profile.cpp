@@ -0,0 +1,97 @@
+// The zones are measured whether the build has them or not
+#define PROFILE_INSTRUMENTATION
+
+#include "Benchmark.h"
+#include "Kr/KrBasic.h"
+#include "Kr/KrProfile.h"
+#include "Kr/KrThread.h"
+
+#include <stdio.h>
+
+//
+// What a ProfileZone adds to the code it times: a loop with a small body (a few hash steps, about what a
+// short handler does between zones) run bare, with a zone in it before Profile_Start, and with the zone
+// recording, on one thread and on several. Then the time it takes to write the full rings as a Chrome trace.
+//
+
+static constexpr int       BENCH_PROFILE_ROUNDS     = 7;
+static constexpr ptrdiff_t BENCH_PROFILE_ITERATIONS = 1 << 20;
+static constexpr int       BENCH_PROFILE_THREADS    = 4;
+
+enum Bench_Profile_Mode { BENCH_PROFILE_BARE, BENCH_PROFILE_ZONE };
+
+struct Bench_Profile_Thread {
+	Bench_Profile_Mode mode;
+	uint64_t           result;
+};
+
+static int Bench_ProfileThreadProc(void *arg) {
+	Bench_Profile_Thread *thread = (Bench_Profile_Thread *)arg;
+
+	uint64_t state = 0x9e3779b97f4a7c15;
+	for (ptrdiff_t index = 0; index < BENCH_PROFILE_ITERATIONS; ++index) {
+		if (thread->mode == BENCH_PROFILE_ZONE) {
+			ProfileZone("Bench_ProfileZone");
+			state = HashU64(HashU64(state + index));
+		} else {
+			state = HashU64(HashU64(state + index));
+		}
+	}
+
+	thread->result = state;
+	return 0;
+}
+
+static double Bench_ProfileRun(Bench_Profile_Mode mode, int count) {
+	uint64_t samples[BENCH_PROFILE_ROUNDS];
+
+	for (int round = 0; round < BENCH_PROFILE_ROUNDS; ++round) {
+		Bench_Profile_Thread threads[BENCH_PROFILE_THREADS];
+		Thread *             handles[BENCH_PROFILE_THREADS];
+
+		uint64_t start = MonotonicNanosecs();
+		for (int index = 0; index < count; ++index) {
+			threads[index] = { mode, 0 };
+			handles[index] = Thread_Create(Bench_ProfileThreadProc, &threads[index]);
+		}
+		for (int index = 0; index < count; ++index) {
+			Thread_Wait(handles[index], -1);
+			Thread_Destroy(handles[index]);
+		}
+		samples[round] = MonotonicNanosecs() - start;
+	}
+
+	return (double)Bench_Percentile(samples, BENCH_PROFILE_ROUNDS, 50.0) / (double)(BENCH_PROFILE_ITERATIONS * count);
+}
+
+void Bench_Profile() {
+#if PLATFORM_WINDOWS == 1
+	const char *null_device = "NUL";
+#else
+	const char *null_device = "/dev/null";
+#endif
+
+	for (int count = 1; count <= BENCH_PROFILE_THREADS; count *= 4) {
+		double bare    = Bench_ProfileRun(BENCH_PROFILE_BARE, count);
+		double stopped = Bench_ProfileRun(BENCH_PROFILE_ZONE, count);
+
+		if (!Profile_Start()) return;
+		double recording = Bench_ProfileRun(BENCH_PROFILE_ZONE, count);
+
+		Profile_Stats stats;
+		Profile_GetStats(&stats);
+
+		uint64_t start = MonotonicNanosecs();
+		Profile_WriteChromeTrace(null_device);
+		double write_ms = (double)(MonotonicNanosecs() - start) / 1e6;
+
+		// Every thread filled its ring, the tracks of the threads that are gone are kept up to 'max_retired'
+		int64_t kept = stats.threads * Minimum((int64_t)ProfileDefaultSpec.ring_size, (int64_t)BENCH_PROFILE_ITERATIONS);
+		Profile_Stop();
+
+		printf("%d threads  bare %5.2f ns  zone stopped %5.2f ns (+%5.2f)  zone recording %5.2f ns (+%5.2f)\n", count,
+			bare, stopped, stopped - bare, recording, recording - bare);
+		printf("%d threads  trace of %lld zones (%lld tracks) written in %.1f ms, %.1f M zones/s\n", count,
+			(long long)kept, (long long)stats.threads, write_ms, (double)kept / write_ms / 1e3);
+	}
+}
@@ -0,0 +1,173 @@
+#include "Benchmark.h"
+#include "Kr/KrString.h"
+
+#include <stdio.h>
+
+//
+// The byte loops KrString had for StrFind, StrFindICase, StrFindChar, StrMatchICase and StrTrim against the
+// vectorized ones, on a short haystack (a header line, a bot command) and a long one (a 64 KB body). The key
+// is at the end so that the whole haystack is searched.
+//
+
+static constexpr int       BENCH_STR_ROUNDS = 9;
+static constexpr ptrdiff_t BENCH_STR_LONG   = KiloBytes(64);
+
+static ptrdiff_t Bench_StrCompareICaseNaive(String a, String b) {
+	ptrdiff_t count = (ptrdiff_t)Minimum(a.length, b.length);
+	for (ptrdiff_t index = 0; index < count; ++index) {
+		if (a.data[index] != b.data[index] && a.data[index] + 32 != b.data[index] && a.data[index] != b.data[index] + 32) {
+			return a.data[index] - b.data[index];
+		}
+	}
+	return 0;
+}
+
+static ptrdiff_t Bench_StrFindNaive(String str, const String key, ptrdiff_t pos = 0) {
+	str = SubStr(str, pos);
+	while (str.length >= key.length) {
+		if (StrCompare(String(str.data, key.length), key) == 0) {
+			return pos;
+		}
+		pos += 1;
+		str = StrRemovePrefix(str, 1);
+	}
+	return -1;
+}
+
+static ptrdiff_t Bench_StrFindICaseNaive(String str, const String key, ptrdiff_t pos = 0) {
+	str = SubStr(str, pos);
+	while (str.length >= key.length) {
+		if (Bench_StrCompareICaseNaive(String(str.data, key.length), key) == 0) {
+			return pos;
+		}
+		pos += 1;
+		str = StrRemovePrefix(str, 1);
+	}
+	return -1;
+}
+
+static ptrdiff_t Bench_StrFindCharNaive(String str, uint8_t key, ptrdiff_t pos = 0) {
+	ptrdiff_t index = Clamp(0, str.length - 1, pos);
+	if (index >= 0) {
+		for (; index < str.length; ++index)
+			if (str.data[index] == key)
+				return index;
+	}
+	return -1;
+}
+
+static bool Bench_StrMatchICaseNaive(String a, String b) {
+	if (a.length != b.length)
+		return false;
+	return Bench_StrCompareICaseNaive(a, b) == 0;
+}
+
+static bool Bench_IsSpaceNaive(uint32_t ch) {
+	return ch == ' ' || ch == '\f' || ch == '\n' || ch == '\r' || ch == '\t' || ch == '\v';
+}
+
+static String Bench_StrTrimNaive(String str) {
+	ptrdiff_t trim = 0;
+	for (ptrdiff_t index = 0; index < str.length; ++index) {
+		if (Bench_IsSpaceNaive(str.data[index]))
+			trim += 1;
+		else
+			break;
+	}
+	str.data += trim;
+	str.length -= trim;
+	for (ptrdiff_t index = str.length - 1; index >= 0; --index) {
+		if (Bench_IsSpaceNaive(str.data[index]))
+			str.length -= 1;
+		else
+			break;
+	}
+	return str;
+}
+
+//
+//
+//
+
+enum Bench_Str_Op {
+	BENCH_STR_FIND,
+	BENCH_STR_FIND_ICASE,
+	BENCH_STR_FIND_CHAR,
+	BENCH_STR_MATCH_ICASE,
+	BENCH_STR_TRIM,
+};
+
+static volatile ptrdiff_t BenchStrSink;
+
+static ptrdiff_t Bench_StrRun(Bench_Str_Op op, bool naive, String haystack, String key, String other) {
+	switch (op) {
+		case BENCH_STR_FIND:        return naive ? Bench_StrFindNaive(haystack, key) : StrFind(haystack, key);
+		case BENCH_STR_FIND_ICASE:  return naive ? Bench_StrFindICaseNaive(haystack, key) : StrFindICase(haystack, key);
+		case BENCH_STR_FIND_CHAR:   return naive ? Bench_StrFindCharNaive(haystack, key.data[0]) : StrFindChar(haystack, key.data[0]);
+		case BENCH_STR_MATCH_ICASE: return naive ? Bench_StrMatchICaseNaive(haystack, other) : StrMatchICase(haystack, other);
+		case BENCH_STR_TRIM:        return naive ? Bench_StrTrimNaive(haystack).length : StrTrim(haystack).length;
+	}
+	return 0;
+}
+
+static double Bench_StrTime(Bench_Str_Op op, bool naive, String haystack, String key, String other) {
+	ptrdiff_t iterations = Maximum((ptrdiff_t)1, (ptrdiff_t)MegaBytes(16) / Maximum(haystack.length, (ptrdiff_t)1));
+	uint64_t  samples[BENCH_STR_ROUNDS];
+
+	for (int round = 0; round < BENCH_STR_ROUNDS; ++round) {
+		uint64_t start = MonotonicNanosecs();
+		for (ptrdiff_t index = 0; index < iterations; ++index)
+			BenchStrSink = Bench_StrRun(op, naive, haystack, key, other);
+		samples[round] = MonotonicNanosecs() - start;
+	}
+
+	return (double)Bench_Percentile(samples, BENCH_STR_ROUNDS, 50.0) / (double)iterations;
+}
+
+static void Bench_StrCase(const char *name, Bench_Str_Op op, String haystack, String key, String other) {
+	double naive = Bench_StrTime(op, true, haystack, key, other);
+	double fast  = Bench_StrTime(op, false, haystack, key, other);
+	printf("%-13s %6td bytes  naive %10.1f ns  new %9.1f ns  %6.1fx  (%6.2f GB/s)\n", name, haystack.length,
+		naive, fast, naive / fast, (double)haystack.length / fast);
+}
+
+void Bench_Strings() {
+	uint8_t *long_text  = (uint8_t *)MemoryAllocate(BENCH_STR_LONG);
+	uint8_t *long_upper = (uint8_t *)MemoryAllocate(BENCH_STR_LONG);
+	uint8_t *long_space = (uint8_t *)MemoryAllocate(BENCH_STR_LONG);
+	if (!long_text || !long_upper || !long_space) return;
+
+	// Json-ish text without the keys in it
+	const char pattern[] = "{\"id\":\"1029384756\",\"type\":0,\"content\":\"hello there, general\",\"tts\":false},";
+	for (ptrdiff_t index = 0; index < BENCH_STR_LONG; ++index) {
+		long_text[index]  = (uint8_t)pattern[index % (sizeof(pattern) - 1)];
+		long_upper[index] = (uint8_t)((long_text[index] >= 'a' && long_text[index] <= 'z') ? long_text[index] - 32 : long_text[index]);
+		long_space[index] = (uint8_t)" \t\r\n"[index & 3];
+	}
+	memcpy(long_text + BENCH_STR_LONG - 12, "\"nonce\":\"x\"}", 12);
+	memcpy(long_upper + BENCH_STR_LONG - 12, "\"NONCE\":\"X\"}", 12);
+	long_text[BENCH_STR_LONG - 13]  = '!';
+	long_space[BENCH_STR_LONG / 2]  = 'x';
+
+	String short_header = "X-RateLimit-Reset-After: 0.412";
+	String short_upper  = "X-RATELIMIT-RESET-AFTER: 0.412";
+	String short_cmd    = "  !ping the bot please, it is nonce  ";
+	String long_str     = String(long_text, BENCH_STR_LONG);
+	String long_up      = String(long_upper, BENCH_STR_LONG);
+	String long_sp      = String(long_space, BENCH_STR_LONG);
+
+	Bench_StrCase("find", BENCH_STR_FIND, short_cmd, "nonce", {});
+	Bench_StrCase("find", BENCH_STR_FIND, long_str, "\"nonce\"", {});
+	Bench_StrCase("find-icase", BENCH_STR_FIND_ICASE, short_header, "after", {});
+	Bench_StrCase("find-icase", BENCH_STR_FIND_ICASE, long_str, "\"NONCE\"", {});
+	Bench_StrCase("find-char", BENCH_STR_FIND_CHAR, short_header, ".", {});
+	Bench_StrCase("find-char", BENCH_STR_FIND_CHAR, long_str, "!", {});
+	Bench_StrCase("match-icase", BENCH_STR_MATCH_ICASE, short_header, {}, short_upper);
+	Bench_StrCase("match-icase", BENCH_STR_MATCH_ICASE, long_str, {}, long_up);
+	Bench_StrCase("trim", BENCH_STR_TRIM, short_cmd, {}, {});
+	Bench_StrCase("trim", BENCH_STR_TRIM, long_sp, {}, {});
+
+	MemoryFree(long_space, BENCH_STR_LONG);
+	MemoryFree(long_upper, BENCH_STR_LONG);
+	MemoryFree(long_text, BENCH_STR_LONG);
+}
@@ -0,0 +1,243 @@
+#include "Benchmark.h"
+#include "Kr/KrBasic.h"
+
+#include <stdio.h>
+
+//
+// Websocket frame parsing the way the reader did it, over a circular buffer that copies the headers out and the
+// payloads into the serial buffer before they are given to the queue, against parsing in place over the mirrored
+// Ring_Buffer and copying the payload once, into the queue. The frames are the sizes of gateway events, most
+// are a few hundred bytes with some large ones, received in reads of a TCP segment and of a full socket buffer.
+//
+
+static constexpr int       BENCH_WS_ROUNDS      = 7;
+static constexpr ptrdiff_t BENCH_WS_BUFFER_SIZE = KiloBytes(16);
+static constexpr ptrdiff_t BENCH_WS_STREAM_SIZE = MegaBytes(8);
+
+struct Bench_Ws_Parser {
+	int       state; // 0: header, 1: length, 2: payload
+	int       length_size;
+	ptrdiff_t length;
+	ptrdiff_t parsed;
+};
+
+struct Bench_Ws_Output {
+	uint8_t * node;
+	ptrdiff_t frames;
+	ptrdiff_t bytes;
+};
+
+static void Bench_WsDeliver(Bench_Ws_Output *out, const uint8_t *payload, ptrdiff_t length) {
+	memcpy(out->node, payload, length);
+	out->frames += 1;
+	out->bytes += length;
+}
+
+static void Bench_WsParseHeader(Bench_Ws_Parser *parser, const uint8_t *header) {
+	ptrdiff_t length    = header[1] & 0x7f;
+	parser->length_size = length == 126 ? 2 : length == 127 ? 8 : 0;
+	parser->length      = length <= 125 ? length : 0;
+	parser->state       = parser->length_size ? 1 : 2;
+}
+
+static void Bench_WsParseLength(Bench_Ws_Parser *parser, const uint8_t *length) {
+	for (int index = 0; index < parser->length_size; ++index)
+		parser->length = (parser->length << 8) | length[index];
+	parser->state = 2;
+}
+
+//
+// What Websocket_Read_Stream was, with Websocket_StreamRead
+//
+
+struct Bench_Ws_Circular {
+	uint8_t * buffer;
+	ptrdiff_t start;
+	ptrdiff_t stop;
+	uint8_t * serialized;
+};
+
+static ptrdiff_t Bench_WsCircularReadable(Bench_Ws_Circular *stream) {
+	if (stream->stop >= stream->start)
+		return stream->stop - stream->start;
+	return BENCH_WS_BUFFER_SIZE - stream->start + stream->stop;
+}
+
+static ptrdiff_t Bench_WsCircularRead(Bench_Ws_Circular *stream, uint8_t *buff, ptrdiff_t size) {
+	ptrdiff_t read = 0;
+	if (stream->start > stream->stop) {
+		ptrdiff_t read_size = Minimum(size, BENCH_WS_BUFFER_SIZE - stream->start);
+		memcpy(buff, stream->buffer + stream->start, read_size);
+		read += read_size;
+		stream->start = (stream->start + read_size) & (BENCH_WS_BUFFER_SIZE - 1);
+	}
+	if (read != size) {
+		ptrdiff_t read_size = Minimum(size - read, stream->stop - stream->start);
+		memcpy(buff + read, stream->buffer + stream->start, read_size);
+		read += read_size;
+		stream->start = (stream->start + read_size) & (BENCH_WS_BUFFER_SIZE - 1);
+	}
+	return read;
+}
+
+static ptrdiff_t Bench_WsCircularReceive(Bench_Ws_Circular *stream, const uint8_t *src, ptrdiff_t size) {
+	ptrdiff_t received = 0;
+	while (received < size) {
+		ptrdiff_t read_size;
+		if (stream->stop >= stream->start)
+			read_size = BENCH_WS_BUFFER_SIZE - stream->stop - (stream->start == 0);
+		else
+			read_size = stream->start - stream->stop - 1;
+		read_size = Minimum(read_size, size - received);
+		if (!read_size) break;
+		memcpy(stream->buffer + stream->stop, src + received, read_size);
+		stream->stop = (stream->stop + read_size) & (BENCH_WS_BUFFER_SIZE - 1);
+		received += read_size;
+	}
+	return received;
+}
+
+static void Bench_WsCircularParse(Bench_Ws_Circular *stream, Bench_Ws_Parser *parser, Bench_Ws_Output *out) {
+	uint8_t scratch[8];
+	while (true) {
+		if (parser->state == 0) {
+			if (Bench_WsCircularReadable(stream) < 2) return;
+			Bench_WsCircularRead(stream, scratch, 2);
+			Bench_WsParseHeader(parser, scratch);
+		}
+		if (parser->state == 1) {
+			if (Bench_WsCircularReadable(stream) < parser->length_size) return;
+			Bench_WsCircularRead(stream, scratch, parser->length_size);
+			Bench_WsParseLength(parser, scratch);
+		}
+		if (parser->state == 2) {
+			parser->parsed += Bench_WsCircularRead(stream, stream->serialized + parser->parsed, parser->length - parser->parsed);
+			if (parser->parsed != parser->length) return;
+			Bench_WsDeliver(out, stream->serialized, parser->length);
+			memset(parser, 0, sizeof(*parser));
+		}
+	}
+}
+
+//
+// Websocket_ParseFrame over Ring_Buffer
+//
+
+static ptrdiff_t Bench_WsRingReceive(Ring_Buffer *ring, const uint8_t *src, ptrdiff_t size) {
+	ptrdiff_t read = Minimum(size, RingBuffer_WritableSize(ring));
+	memcpy(RingBuffer_WritePointer(ring), src, read);
+	RingBuffer_Commit(ring, read);
+	return read;
+}
+
+static void Bench_WsRingParse(Ring_Buffer *ring, Bench_Ws_Parser *parser, Bench_Ws_Output *out) {
+	while (true) {
+		if (parser->state == 0) {
+			if (RingBuffer_ReadableSize(ring) < 2) return;
+			Bench_WsParseHeader(parser, RingBuffer_ReadPointer(ring));
+			RingBuffer_Consume(ring, 2);
+		}
+		if (parser->state == 1) {
+			if (RingBuffer_ReadableSize(ring) < parser->length_size) return;
+			Bench_WsParseLength(parser, RingBuffer_ReadPointer(ring));
+			RingBuffer_Consume(ring, parser->length_size);
+		}
+		if (parser->state == 2) {
+			if (RingBuffer_ReadableSize(ring) < parser->length) return;
+			Bench_WsDeliver(out, RingBuffer_ReadPointer(ring), parser->length);
+			RingBuffer_Consume(ring, parser->length);
+			memset(parser, 0, sizeof(*parser));
+		}
+	}
+}
+
+//
+//
+//
+
+static ptrdiff_t Bench_WsBuildStream(uint8_t *stream, ptrdiff_t capacity) {
+	uint64_t  state  = 0x2545f4914f6cdd1d;
+	ptrdiff_t length = 0;
+
+	while (true) {
+		state = HashU64(state);
+
+		// 3 in 4 events are small (presence, typing, message create), the rest up to 12 KB (guild and member chunks)
+		ptrdiff_t payload = (state & 3) ? 64 + (ptrdiff_t)((state >> 8) % 700) : 1024 + (ptrdiff_t)((state >> 8) % KiloBytes(11));
+		ptrdiff_t header  = payload <= 125 ? 2 : 4;
+		if (length + header + payload > capacity) break;
+
+		stream[length + 0] = 0x81;
+		if (payload <= 125) {
+			stream[length + 1] = (uint8_t)payload;
+		} else {
+			stream[length + 1] = 126;
+			stream[length + 2] = (uint8_t)(payload >> 8);
+			stream[length + 3] = (uint8_t)(payload >> 0);
+		}
+		memset(stream + length + header, 'a' + (int)(state % 26), payload);
+		length += header + payload;
+	}
+
+	return length;
+}
+
+static void Bench_WsRun(const char *name, bool ring_parse, const uint8_t *stream, ptrdiff_t stream_size, ptrdiff_t read_size) {
+	uint8_t *buffer     = (uint8_t *)MemoryAllocate(BENCH_WS_BUFFER_SIZE);
+	uint8_t *serialized = (uint8_t *)MemoryAllocate(BENCH_WS_BUFFER_SIZE);
+	uint8_t *node       = (uint8_t *)MemoryAllocate(BENCH_WS_BUFFER_SIZE);
+
+	Ring_Buffer ring;
+	if (!buffer || !serialized || !node || !RingBuffer_Create(&ring, BENCH_WS_BUFFER_SIZE)) {
+		printf("%-8s failed to allocate\n", name);
+		return;
+	}
+
+	uint64_t        samples[BENCH_WS_ROUNDS];
+	Bench_Ws_Output out = {};
+
+	for (int round = 0; round < BENCH_WS_ROUNDS; ++round) {
+		Bench_Ws_Circular circular = { buffer, 0, 0, serialized };
+		Bench_Ws_Parser   parser   = {};
+
+		ring.read = ring.write = 0;
+		out = { node, 0, 0 };
+
+		uint64_t start = MonotonicNanosecs();
+		for (ptrdiff_t offset = 0; offset < stream_size;) {
+			ptrdiff_t size = Minimum(read_size, stream_size - offset);
+			if (ring_parse) {
+				offset += Bench_WsRingReceive(&ring, stream + offset, size);
+				Bench_WsRingParse(&ring, &parser, &out);
+			} else {
+				offset += Bench_WsCircularReceive(&circular, stream + offset, size);
+				Bench_WsCircularParse(&circular, &parser, &out);
+			}
+		}
+		samples[round] = MonotonicNanosecs() - start;
+	}
+
+	double nanosecs = (double)Bench_Percentile(samples, BENCH_WS_ROUNDS, 50.0);
+	printf("%-8s reads of %5td  %8.1f ns/frame  %7.1f MB/s  (%td frames, %td MB)\n", name, read_size,
+		nanosecs / (double)out.frames, (double)out.bytes / nanosecs * 1e3, out.frames, out.bytes >> 20);
+
+	RingBuffer_Destroy(&ring);
+	MemoryFree(node, BENCH_WS_BUFFER_SIZE);
+	MemoryFree(serialized, BENCH_WS_BUFFER_SIZE);
+	MemoryFree(buffer, BENCH_WS_BUFFER_SIZE);
+}
+
+void Bench_WebsocketFrames() {
+	uint8_t *stream = (uint8_t *)MemoryAllocate(BENCH_WS_STREAM_SIZE);
+	if (!stream) return;
+
+	ptrdiff_t stream_size = Bench_WsBuildStream(stream, BENCH_WS_STREAM_SIZE);
+
+	const ptrdiff_t read_sizes[] = { 1448, BENCH_WS_BUFFER_SIZE };
+	for (ptrdiff_t read_size : read_sizes) {
+		Bench_WsRun("circular", false, stream, stream_size, read_size);
+		Bench_WsRun("ring", true, stream, stream_size, read_size);
+	}
+
+	MemoryFree(stream, BENCH_WS_STREAM_SIZE);
+}
@@ -2,6 +2,8 @@
 
 #include "Kr/KrString.h"
 #include "Kr/KrThread.h"
+#include "Kr/KrLog.h"
+#include "Kr/KrProfile.h"
 
 #include "Websocket.h"
 #include "Json.h"
@@ -1522,7 +1524,7 @@ static void Discord_Deserialize(const Json_Object &obj, Discord::Message *messag
 	Json_Array mentions = JsonGetArray(obj, "mentions");
 	message->mentions.Resize(mentions.count);
 	for (ptrdiff_t index = 0; index < message->mentions.count; ++index) {
-		Discord_Deserialize(JsonGetObject(mentions[0]), &message->mentions[index]);
+		Discord_Deserialize(JsonGetObject(mentions[index]), &message->mentions[index]);
 	}
 
 	Json_Array mention_roles = JsonGetArray(obj, "mention_roles");
@@ -1534,25 +1536,25 @@ static void Discord_Deserialize(const Json_Object &obj, Discord::Message *messag
 	Json_Array mention_channels = JsonGetArray(obj, "mention_channels");
 	message->mention_channels.Resize(mention_channels.count);
 	for (ptrdiff_t index = 0; index < message->mention_channels.count; ++index) {
-		Discord_Deserialize(JsonGetObject(mention_channels[0]), &message->mention_channels[index]);
+		Discord_Deserialize(JsonGetObject(mention_channels[index]), &message->mention_channels[index]);
 	}
 
 	Json_Array attachments = JsonGetArray(obj, "attachments");
 	message->attachments.Resize(attachments.count);
 	for (ptrdiff_t index = 0; index < message->attachments.count; ++index) {
-		Discord_Deserialize(JsonGetObject(attachments[0]), &message->attachments[index]);
+		Discord_Deserialize(JsonGetObject(attachments[index]), &message->attachments[index]);
 	}
 
 	Json_Array embeds = JsonGetArray(obj, "embeds");
 	message->embeds.Resize(embeds.count);
 	for (ptrdiff_t index = 0; index < message->embeds.count; ++index) {
-		Discord_Deserialize(JsonGetObject(embeds[0]), &message->embeds[index]);
+		Discord_Deserialize(JsonGetObject(embeds[index]), &message->embeds[index]);
 	}
 
 	Json_Array reactions = JsonGetArray(obj, "reactions");
 	message->reactions.Resize(reactions.count);
 	for (ptrdiff_t index = 0; index < message->reactions.count; ++index) {
-		Discord_Deserialize(JsonGetObject(reactions[0]), &message->reactions[index]);
+		Discord_Deserialize(JsonGetObject(reactions[index]), &message->reactions[index]);
 	}
 
 	message->nonce = JsonGetString(obj, "nonce");
@@ -1627,8 +1629,7 @@ static void Discord_Deserialize(const Json_Object &obj, Discord::Message *messag
 
 static void Discord_Deserialize(const Json_Object &obj, Discord::InteractionData::ResolvedData *data) {
 	Json_Object users = JsonGetObject(obj, "users");
-	data->users.Resize(users.p2allocated);
-	data->users.storage.Reserve(users.storage.count);
+	data->users.Reserve(users.count);
 	for (auto &user_map : users) {
 		Discord::Snowflake id = Discord_ParseId(user_map.key);
 		Discord::User user;
@@ -1637,8 +1638,7 @@ static void Discord_Deserialize(const Json_Object &obj, Discord::InteractionData
 	}
 
 	Json_Object members = JsonGetObject(obj, "members");
-	data->members.Resize(members.p2allocated);
-	data->members.storage.Reserve(members.storage.count);
+	data->members.Reserve(members.count);
 	for (auto &member_map : members) {
 		Discord::Snowflake id = Discord_ParseId(member_map.key);
 		Discord::GuildMember member;
@@ -1647,8 +1647,7 @@ static void Discord_Deserialize(const Json_Object &obj, Discord::InteractionData
 	}
 
 	Json_Object roles = JsonGetObject(obj, "roles");
-	data->roles.Resize(roles.p2allocated);
-	data->roles.storage.Reserve(roles.storage.count);
+	data->roles.Reserve(roles.count);
 	for (auto &role_map : roles) {
 		Discord::Snowflake id = Discord_ParseId(role_map.key);
 		Discord::Role role;
@@ -1657,8 +1656,7 @@ static void Discord_Deserialize(const Json_Object &obj, Discord::InteractionData
 	}
 
 	Json_Object channels = JsonGetObject(obj, "channels");
-	data->channels.Resize(channels.p2allocated);
-	data->channels.storage.Reserve(channels.storage.count);
+	data->channels.Reserve(channels.count);
 	for (auto &channel_map : channels) {
 		Discord::Snowflake id = Discord_ParseId(channel_map.key);
 		Discord::Channel channel;
@@ -1667,8 +1665,7 @@ static void Discord_Deserialize(const Json_Object &obj, Discord::InteractionData
 	}
 
 	Json_Object messages = JsonGetObject(obj, "messages");
-	data->messages.Resize(messages.p2allocated);
-	data->messages.storage.Reserve(messages.storage.count);
+	data->messages.Reserve(messages.count);
 	for (auto &message_map : messages) {
 		Discord::Snowflake id = Discord_ParseId(message_map.key);
 		Discord::Message message;
@@ -1677,8 +1674,7 @@ static void Discord_Deserialize(const Json_Object &obj, Discord::InteractionData
 	}
 
 	Json_Object attachments = JsonGetObject(obj, "attachments");
-	data->attachments.Resize(attachments.p2allocated);
-	data->attachments.storage.Reserve(attachments.storage.count);
+	data->attachments.Reserve(attachments.count);
 	for (auto &attachment_map : attachments) {
 		Discord::Snowflake id = Discord_ParseId(attachment_map.key);
 		Discord::Attachment attachment;
@@ -1992,11 +1988,11 @@ static bool Discord_ConnectToGatewayBot(String token, Memory_Arena *arena, Disco
 	auto temp = BeginTemporaryMemory(arena);
 	Defer{ EndTemporaryMemory(&temp); };
 
-	String authorization = FmtStr(arena, "Bot " StrFmt, StrArg(token));
+	String authorization = Fmt(arena, "Bot {}", token);
 
 	Http *http = Http_Connect("https://discord.com", HTTPS_CONNECTION, MemoryArenaAllocator(arena));
 	if (!http)
-		return nullptr;
+		return false;
 
 	Http_Request req;
 	Http_InitRequest(&req);
@@ -2004,12 +2000,12 @@ static bool Discord_ConnectToGatewayBot(String token, Memory_Arena *arena, Disco
 	Http_SetHeader(&req, HTTP_HEADER_AUTHORIZATION, authorization);
 	Http_SetHeader(&req, HTTP_HEADER_USER_AGENT, Discord::UserAgent);
 
-	String endpoint = FmtStr(arena, StrFmt "/gateway/bot", StrArg(Discord::BaseHttpUrl));
+	String endpoint = Fmt(arena, "{}/gateway/bot", Discord::BaseHttpUrl);
 
 	Http_Response res;
 	if (!Http_Get(http, endpoint, req, &res, arena)) {
 		Http_Disconnect(http);
-		return nullptr;
+		return false;
 	}
 
 	Json json;
@@ -2054,7 +2050,7 @@ static Websocket *Discord_ConnectToGateway(String token, Memory_Arena *scratch,
 	Http_SetHost(&req, http);
 	Http_SetHeader(&req, HTTP_HEADER_USER_AGENT, Discord::UserAgent);
 
-	String endpoint = FmtStr(scratch, StrFmt "/gateway", StrArg(Discord::BaseHttpUrl));
+	String endpoint = Fmt(scratch, "{}/gateway", Discord::BaseHttpUrl);
 
 	Http_Response res;
 	if (!Http_Get(http, endpoint, req, &res, scratch)) {
@@ -2082,7 +2078,7 @@ static Websocket *Discord_ConnectToGateway(String token, Memory_Arena *scratch,
 
 	String url = JsonGetString(obj, "url");
 
-	String authorization = FmtStr(scratch, "Bot " StrFmt, StrArg(token));
+	String authorization = Fmt(scratch, "Bot {}", token);
 
 	Websocket_Header headers;
 	Websocket_InitHeader(&headers);
@@ -2106,6 +2102,8 @@ struct Discord_ShardThread {
 
 static int Discord_ShardThreadProc(void *arg) {
 	Discord_ShardThread *shard = (Discord_ShardThread *)arg;
+	AsyncLog_SetThreadName("Shard %d", shard->spec.shards[0]);
+	Profile_SetThreadName("Shard %d", shard->spec.shards[0]);
 	Discord::Login(shard->token, shard->intents, shard->onevent, shard->presence, shard->spec);
 	return 0;
 }
@@ -2163,6 +2161,38 @@ static inline bool Discord_Delete(Discord::Client *client, const String api_endp
 	return Discord_CustomMethod(client, "DELETE", api_endpoint, content_type, body, res);
 }
 
+static bool Discord_CustomMethod(Discord::Client *client, const String method, const String api_endpoint, Http_Multipart *multipart, Json *res);
+
+static inline bool Discord_Post(Discord::Client *client, const String api_endpoint, Http_Multipart *multipart, Json *res) {
+	return Discord_CustomMethod(client, "POST", api_endpoint, multipart, res);
+}
+
+static inline bool Discord_Patch(Discord::Client *client, const String api_endpoint, Http_Multipart *multipart, Json *res) {
+	return Discord_CustomMethod(client, "PATCH", api_endpoint, multipart, res);
+}
+
+// Attachments with a path are streamed from the file when the request is sent
+static bool Discord_BuildMultipart(Http_Multipart *multipart, String payload_json, const Array<Discord::FileAttachment> &attachments) {
+	if (!Http_MultipartData(multipart, payload_json, "application/json", "name=\"payload_json\""))
+		return false;
+
+	uint8_t buffer[4096];
+
+	for (int id = 0; id < (int)attachments.count; ++id) {
+		const auto &attachment = attachments[id];
+		int len = snprintf((char *)buffer, sizeof(buffer), "name=\"files[%d]\"; filename=\"" StrFmt "\"", id, StrArg(attachment.filename));
+		String content_disposition(buffer, len);
+
+		bool added = attachment.path.length ?
+			Http_MultipartFile(multipart, attachment.path, attachment.content_type, content_disposition) :
+			Http_MultipartData(multipart, attachment.content, attachment.content_type, content_disposition);
+		if (!added)
+			return false;
+	}
+
+	return Http_MultipartEnd(multipart);
+}
+
 //
 //
 //
@@ -2174,8 +2204,11 @@ namespace Discord {
 		Heartbeat        heartbeat;
 
 		Http *           http = nullptr;
+		Http_Cache *     cache = nullptr;
 		String           authorization;
 
+		Http_Request_Template headers; // prepared on connecting, shared by every REST request
+
 		EventHandler     onevent;
 
 		Memory_Arena *   scratch   = nullptr;
@@ -2287,8 +2320,13 @@ namespace Discord {
 		websocket_spec.write_size = spec.write_size;
 		websocket_spec.queue_size = spec.queue_size;
 
-		Memory_Arena *arena = MemoryArenaAllocate(spec.scratch_size);
-		Defer{ if (arena) MemoryArenaFree(arena); };
+		Memory_Arena *arena = MemoryArenaAllocate(spec.scratch_size, MemoryArenaCommitSize, spec.scratch_flags);
+		Defer{
+			if (arena) {
+				MemoryArenaDumpStats(arena, "Discord scratch");
+				MemoryArenaFree(arena);
+			}
+		};
 
 		if (!arena) {
 			LogErrorEx("Discord", "Memory allocation failed");
@@ -2311,6 +2349,9 @@ namespace Discord {
 
 		client.authorization = FmtStr(client.allocator, "Bot " StrFmt, StrArg(client.identify.token));
 
+		if (spec.cache_size)
+			client.cache = Http_CreateCache(spec.cache_size, spec.allocator);
+
 		ThreadContext.allocator = MemoryArenaAllocator(arena);
 
 		Discord_SetupEventHandlers(&client.onevent);
@@ -2366,6 +2407,9 @@ namespace Discord {
 			Websocket_Disconnect(client.websocket);
 			client.websocket = nullptr;
 		}
+
+		if (client.cache)
+			Http_DestroyCache(client.cache);
 	}
 
 	void LoginSharded(const String token, int32_t intents, EventHandler onevent, PresenceUpdate *presence, int32_t shard_count, const ShardSpec &specs) {
@@ -2469,13 +2513,33 @@ namespace Discord {
 		return { client->identify.shard[0], client->identify.shard[1] };
 	}
 
+	Http_Cache_Stats GetHttpCacheStats(Client *client) {
+		if (client->cache)
+			return Http_GetCacheStats(client->cache);
+		return Http_Cache_Stats{};
+	}
+
+	const Memory_Arena_Stats *GetScratchStats(Client *client) {
+		return MemoryArenaStats(client->scratch);
+	}
+
+	Memory_Arena_Usage GetScratchUsage(Client *client) {
+		return MemoryArenaGetUsage(client->scratch);
+	}
+
+	void DeserializeMessage(const Json &data, Message *message) {
+		Discord_Deserialize(JsonGetObject(data), message);
+	}
+
 	void Initialize() {
 		Net_Initialize();
 		srand((unsigned int)time(0));
 	}
 
 	Channel *GetChannel(Client *client, Snowflake channel_id) {
-		String endpoint = FmtStr(client->scratch, "/channels/%zu", channel_id);
+		MemoryArenaCheckpointScope(client->scratch, __FUNCTION__);
+
+		String endpoint = Fmt(client->scratch, "/channels/{}", channel_id.value);
 
 		Json res;
 		if (Discord_Get(client, endpoint, "application/json", String(), &res)) {
@@ -2488,6 +2552,8 @@ namespace Discord {
 	}
 
 	Channel *ModifyChannel(Client *client, Snowflake channel_id, const ChannelPatch &patch) {
+		MemoryArenaCheckpointScope(client->scratch, __FUNCTION__);
+
 		Jsonify j(client->scratch);
 
 		j.BeginObject();
@@ -2546,7 +2612,7 @@ namespace Discord {
 
 		j.EndObject();
 
-		String endpoint = FmtStr(client->scratch, "/channels/%zu", channel_id);
+		String endpoint = Fmt(client->scratch, "/channels/{}", channel_id.value);
 		String body     = Jsonify_BuildString(&j);
 
 		Json res;
@@ -2560,7 +2626,9 @@ namespace Discord {
 	}
 
 	Channel *DeleteChannel(Client *client, Snowflake channel_id) {
-		String endpoint = FmtStr(client->scratch, "/channels/%zu", channel_id);
+		MemoryArenaCheckpointScope(client->scratch, __FUNCTION__);
+
+		String endpoint = Fmt(client->scratch, "/channels/{}", channel_id.value);
 
 		Json res;
 		if (Discord_Delete(client, endpoint, "application/json", String(), &res)) {
@@ -2573,17 +2641,19 @@ namespace Discord {
 	}
 
 	Array_View<Message> GetChannelMessages(Client *client, Snowflake channel_id, int limit, Snowflake around, Snowflake before, Snowflake after) {
-		String endpoint = FmtStr(client->scratch, "/channels/%zu/messages", channel_id);
+		MemoryArenaCheckpointScope(client->scratch, __FUNCTION__);
+
+		String endpoint = Fmt(client->scratch, "/channels/{}/messages", channel_id.value);
 
 		Http_Query_Params params;
 		if (limit > 0)
-			Http_QueryParamSet(&params, "limit", FmtStr(client->scratch, "%d", limit));
+			Http_QueryParamSet(&params, "limit", Fmt(client->scratch, "{}", limit));
 		if (around)
-			Http_QueryParamSet(&params, "limit", FmtStr(client->scratch, "%zu", around.value));
+			Http_QueryParamSet(&params, "limit", Fmt(client->scratch, "{}", around.value));
 		else if (before)
-			Http_QueryParamSet(&params, "limit", FmtStr(client->scratch, "%zu", before.value));
+			Http_QueryParamSet(&params, "limit", Fmt(client->scratch, "{}", before.value));
 		else if (after)
-			Http_QueryParamSet(&params, "limit", FmtStr(client->scratch, "%zu", after.value));
+			Http_QueryParamSet(&params, "limit", Fmt(client->scratch, "{}", after.value));
 
 		Json res;
 		if (Discord_Get(client, endpoint, params, "application/json", String(), &res)) {
@@ -2599,7 +2669,9 @@ namespace Discord {
 	}
 
 	Message *GetChannelMessage(Client *client, Snowflake channel_id, Snowflake message_id) {
-		String endpoint = FmtStr(client->scratch, "/channels/%zu/messages/%zu", channel_id, message_id);
+		MemoryArenaCheckpointScope(client->scratch, __FUNCTION__);
+
+		String endpoint = Fmt(client->scratch, "/channels/{}/messages/{}", channel_id.value, message_id.value);
 
 		Json res;
 		if (Discord_Get(client, endpoint, "application/json", String(), &res)) {
@@ -2612,6 +2684,8 @@ namespace Discord {
 	}
 
 	Message *CreateMessage(Client *client, Snowflake channel_id, const MessagePost &msg) {
+		MemoryArenaCheckpointScope(client->scratch, __FUNCTION__);
+
 		Jsonify j(client->scratch);
 
 		j.BeginObject();
@@ -2676,38 +2750,22 @@ namespace Discord {
 
 		String payload_json = Jsonify_BuildString(&j);
 
-		String body;
-		String content_type;
-
-		uint8_t buffer[4096];
-		int     len = 0;
+		Http_Multipart multipart;
 
-		if (!msg.attachments.count) {
-			body = payload_json;
-			content_type = "application/json";
-		} else {
-			Http_Multipart multipart = Http_MultipartBegin(client->scratch);
-			if (!Http_MultipartData(&multipart, payload_json, "application/json", "name=\"payload_json\""))
+		if (msg.attachments.count) {
+			multipart = Http_MultipartBegin(client->scratch);
+			if (!Discord_BuildMultipart(&multipart, payload_json, msg.attachments))
 				return nullptr;
-			for (int id = 0; id < (int)msg.attachments.count; ++id) {
-				const auto &attachment = msg.attachments[id];
-				len = snprintf((char *)buffer, sizeof(buffer), "name=\"files[%d]\"; filename=\"" StrFmt "\"", id, StrArg(attachment.filename));
-				String content_disposition(buffer, len);
-				if (!Http_MultipartData(&multipart, attachment.content, attachment.content_type, content_disposition))
-					return nullptr;
-			}
-
-			body = Http_MultipartEnd(&multipart);
-			
-			String boundary = String(multipart.boundary, HTTP_MULTIPART_LENGTH);
-			len = snprintf((char *)buffer, sizeof(buffer), "multipart/form-data; boundary=" StrFmt, StrArg(boundary));
-			content_type = String(buffer, len);
 		}
 
-		String endpoint = FmtStr(client->scratch, "/channels/%zu/messages", channel_id.value);
+		String endpoint = Fmt(client->scratch, "/channels/{}/messages", channel_id.value);
 
 		Json res;
-		if (Discord_Post(client, endpoint, content_type, body, &res)) {
+		bool sent = msg.attachments.count ?
+			Discord_Post(client, endpoint, &multipart, &res) :
+			Discord_Post(client, endpoint, "application/json", payload_json, &res);
+
+		if (sent) {
 			Message *message = new Message;
 			if (message)
 				Discord_Deserialize(JsonGetObject(res), message);
@@ -2717,7 +2775,9 @@ namespace Discord {
 	}
 
 	Message *CrossPost(Client *client, Snowflake channel_id, Snowflake message_id) {
-		String endpoint = FmtStr(client->scratch, "/channels/%zu/messages/%zu/crosspost", channel_id, message_id);
+		MemoryArenaCheckpointScope(client->scratch, __FUNCTION__);
+
+		String endpoint = Fmt(client->scratch, "/channels/{}/messages/{}/crosspost", channel_id.value, message_id.value);
 
 		Json res;
 		if (Discord_Post(client, endpoint, "application/json", String(), &res)) {
@@ -2731,7 +2791,9 @@ namespace Discord {
 	}
 
 	bool CreateReaction(Client *client, Snowflake channel_id, Snowflake message_id, String emoji) {
-		String endpoint = FmtStr(client->scratch, "/channels/%zu/messages/%zu/reactions/%.*s/@me", channel_id, message_id, StrArg(emoji));
+		MemoryArenaCheckpointScope(client->scratch, __FUNCTION__);
+
+		String endpoint = Fmt(client->scratch, "/channels/{}/messages/{}/reactions/{}/@me", channel_id.value, message_id.value, emoji);
 
 		Json res;
 		if (Discord_Put(client, endpoint, "application/json", String(), &res)) {
@@ -2741,7 +2803,9 @@ namespace Discord {
 	}
 
 	bool DeleteReaction(Client *client, Snowflake channel_id, Snowflake message_id, String emoji) {
-		String endpoint = FmtStr(client->scratch, "/channels/%zu/messages/%zu/reactions/%.*s/@me", channel_id, message_id, StrArg(emoji));
+		MemoryArenaCheckpointScope(client->scratch, __FUNCTION__);
+
+		String endpoint = Fmt(client->scratch, "/channels/{}/messages/{}/reactions/{}/@me", channel_id.value, message_id.value, emoji);
 
 		Json res;
 		if (Discord_Delete(client, endpoint, "application/json", String(), &res)) {
@@ -2751,7 +2815,9 @@ namespace Discord {
 	}
 
 	bool DeleteUserReaction(Client *client, Snowflake channel_id, Snowflake message_id, String emoji, Snowflake user_id) {
-		String endpoint = FmtStr(client->scratch, "/channels/%zu/messages/%zu/reactions/%.*s/%zu", channel_id, message_id, StrArg(emoji), user_id);
+		MemoryArenaCheckpointScope(client->scratch, __FUNCTION__);
+
+		String endpoint = Fmt(client->scratch, "/channels/{}/messages/{}/reactions/{}/{}", channel_id.value, message_id.value, emoji, user_id.value);
 
 		Json res;
 		if (Discord_Delete(client, endpoint, "application/json", String(), &res)) {
@@ -2761,13 +2827,15 @@ namespace Discord {
 	}
 
 	Array_View<User> GetReactions(Client *client, Snowflake channel_id, Snowflake message_id, String emoji, int32_t after, int32_t limit) {
-		String endpoint = FmtStr(client->scratch, "/channels/%zu/messages/%zu/reactions/%.*s", channel_id, message_id, StrArg(emoji));
+		MemoryArenaCheckpointScope(client->scratch, __FUNCTION__);
+
+		String endpoint = Fmt(client->scratch, "/channels/{}/messages/{}/reactions/{}", channel_id.value, message_id.value, emoji);
 
 		Http_Query_Params params;
 		if (after >= 0)
-			Http_QueryParamSet(&params, "after", FmtStr(client->scratch, "%d", after));
+			Http_QueryParamSet(&params, "after", Fmt(client->scratch, "{}", after));
 		if (limit >= 0)
-			Http_QueryParamSet(&params, "limit", FmtStr(client->scratch, "%d", limit));
+			Http_QueryParamSet(&params, "limit", Fmt(client->scratch, "{}", limit));
 
 		Json res;
 		if (Discord_Get(client, endpoint, "application/json", String(), &res)) {
@@ -2784,7 +2852,9 @@ namespace Discord {
 	}
 
 	bool DeleteAllReactions(Client *client, Snowflake channel_id, Snowflake message_id) {
-		String endpoint = FmtStr(client->scratch, "/channels/%zu/messages/%zu/reactions", channel_id, message_id);
+		MemoryArenaCheckpointScope(client->scratch, __FUNCTION__);
+
+		String endpoint = Fmt(client->scratch, "/channels/{}/messages/{}/reactions", channel_id.value, message_id.value);
 
 		Json res;
 		if (Discord_Delete(client, endpoint, "application/json", String(), &res)) {
@@ -2794,7 +2864,9 @@ namespace Discord {
 	}
 
 	bool DeleteAllReactionsForEmoji(Client *client, Snowflake channel_id, Snowflake message_id, String emoji) {
-		String endpoint = FmtStr(client->scratch, "/channels/%zu/messages/%zu/reactions/%.*s", channel_id, message_id, StrArg(emoji));
+		MemoryArenaCheckpointScope(client->scratch, __FUNCTION__);
+
+		String endpoint = Fmt(client->scratch, "/channels/{}/messages/{}/reactions/{}", channel_id.value, message_id.value, emoji);
 
 		Json res;
 		if (Discord_Delete(client, endpoint, "application/json", String(), &res)) {
@@ -2804,6 +2876,8 @@ namespace Discord {
 	}
 
 	Message *EditMessage(Client *client, Snowflake channel_id, Snowflake message_id, const MessagePatch &msg) {
+		MemoryArenaCheckpointScope(client->scratch, __FUNCTION__);
+
 		Jsonify j(client->scratch);
 
 		j.BeginObject();
@@ -2850,38 +2924,22 @@ namespace Discord {
 
 		String payload_json = Jsonify_BuildString(&j);
 
-		String body;
-		String content_type;
+		Http_Multipart multipart;
 
-		uint8_t buffer[4096];
-		int     len = 0;
-
-		if (!msg.attachments.count) {
-			body = payload_json;
-			content_type = "application/json";
-		} else {
-			Http_Multipart multipart = Http_MultipartBegin(client->scratch);
-			if (!Http_MultipartData(&multipart, payload_json, "application/json", "name=\"payload_json\""))
+		if (msg.attachments.count) {
+			multipart = Http_MultipartBegin(client->scratch);
+			if (!Discord_BuildMultipart(&multipart, payload_json, msg.attachments))
 				return nullptr;
-			for (int id = 0; id < (int)msg.attachments.count; ++id) {
-				const auto &attachment = msg.attachments[id];
-				len = snprintf((char *)buffer, sizeof(buffer), "name=\"files[%d]\"; filename=\"" StrFmt "\"", id, StrArg(attachment.filename));
-				String content_disposition(buffer, len);
-				if (!Http_MultipartData(&multipart, attachment.content, attachment.content_type, content_disposition))
-					return nullptr;
-			}
-
-			body = Http_MultipartEnd(&multipart);
-
-			String boundary = String(multipart.boundary, HTTP_MULTIPART_LENGTH);
-			len = snprintf((char *)buffer, sizeof(buffer), "multipart/form-data; boundary=" StrFmt, StrArg(boundary));
-			content_type = String(buffer, len);
 		}
 
-		String endpoint = FmtStr(client->scratch, "/channels/%zu/messages/%zu", channel_id, message_id);
+		String endpoint = Fmt(client->scratch, "/channels/{}/messages/{}", channel_id.value, message_id.value);
 
 		Json res;
-		if (Discord_Patch(client, endpoint, content_type, body, &res)) {
+		bool sent = msg.attachments.count ?
+			Discord_Patch(client, endpoint, &multipart, &res) :
+			Discord_Patch(client, endpoint, "application/json", payload_json, &res);
+
+		if (sent) {
 			Message *message = new Message;
 			if (message)
 				Discord_Deserialize(JsonGetObject(res), message);
@@ -2891,7 +2949,9 @@ namespace Discord {
 	}
 
 	bool DeleteMessage(Client *client, Snowflake channel_id, Snowflake message_id) {
-		String endpoint = FmtStr(client->scratch, "/channels/%zu/messages/%zu", channel_id, message_id);
+		MemoryArenaCheckpointScope(client->scratch, __FUNCTION__);
+
+		String endpoint = Fmt(client->scratch, "/channels/{}/messages/{}", channel_id.value, message_id.value);
 
 		Json res;
 		if (Discord_Delete(client, endpoint, "application/json", String(), &res)) {
@@ -2901,7 +2961,9 @@ namespace Discord {
 	}
 
 	bool BulkDeleteMessages(Client *client, Snowflake channel_id, Array_View<Snowflake> messages_ids) {
-		String endpoint = FmtStr(client->scratch, "/channels/%zu/messages/bulk-delete", channel_id);
+		MemoryArenaCheckpointScope(client->scratch, __FUNCTION__);
+
+		String endpoint = Fmt(client->scratch, "/channels/{}/messages/bulk-delete", channel_id.value);
 
 		Jsonify j(client->scratch);
 		j.BeginObject();
@@ -2924,7 +2986,9 @@ namespace Discord {
 	}
 
 	bool EditChannelPermissions(Client *client, Snowflake channel_id, Snowflake overwrite_id, Permission allow, Permission deny, OverwriteType type) {
-		String endpoint = FmtStr(client->scratch, "/channels/%zu/permissions/%zu", channel_id, overwrite_id);
+		MemoryArenaCheckpointScope(client->scratch, __FUNCTION__);
+
+		String endpoint = Fmt(client->scratch, "/channels/{}/permissions/{}", channel_id.value, overwrite_id.value);
 
 		Jsonify j(client->scratch);
 		j.BeginObject();
@@ -2943,7 +3007,9 @@ namespace Discord {
 	}
 
 	Array_View<Invite> GetChannelInvites(Client *client, Snowflake channel_id) {
-		String endpoint = FmtStr(client->scratch, "/channels/%zu/invites", channel_id);
+		MemoryArenaCheckpointScope(client->scratch, __FUNCTION__);
+
+		String endpoint = Fmt(client->scratch, "/channels/{}/invites", channel_id.value);
 
 		Json res;
 		if (Discord_Get(client, endpoint, "application/json", String(), &res)) {
@@ -2959,7 +3025,9 @@ namespace Discord {
 	}
 
 	Invite *CreateChannelInvite(Client *client, Snowflake channel_id, const InvitePost &invite) {
-		String endpoint = FmtStr(client->scratch, "/channels/%zu/invites", channel_id);
+		MemoryArenaCheckpointScope(client->scratch, __FUNCTION__);
+
+		String endpoint = Fmt(client->scratch, "/channels/{}/invites", channel_id.value);
 
 		Jsonify j(client->scratch);
 		j.BeginObject();
@@ -2986,7 +3054,9 @@ namespace Discord {
 	}
 
 	bool DeleteChannelPermission(Client *client, Snowflake channel_id, Snowflake overwrite_id) {
-		String endpoint = FmtStr(client->scratch, "/channels/%zu/permissions/%zu", channel_id, overwrite_id);
+		MemoryArenaCheckpointScope(client->scratch, __FUNCTION__);
+
+		String endpoint = Fmt(client->scratch, "/channels/{}/permissions/{}", channel_id.value, overwrite_id.value);
 
 		Json res;
 		if (Discord_Delete(client, endpoint, "application/json", String(), &res)) {
@@ -2996,7 +3066,9 @@ namespace Discord {
 	}
 
 	FollowedChannel *FollowNewsChannel(Client *client, Snowflake channel_id, Snowflake webhook_id) {
-		String endpoint = FmtStr(client->scratch, "/channels/%zu/followers", channel_id);
+		MemoryArenaCheckpointScope(client->scratch, __FUNCTION__);
+
+		String endpoint = Fmt(client->scratch, "/channels/{}/followers", channel_id.value);
 
 		Jsonify j(client->scratch);
 		j.BeginObject();
@@ -3016,7 +3088,9 @@ namespace Discord {
 	}
 
 	bool TriggerTypingIndicator(Client *client, Snowflake channel_id) {
-		String endpoint = FmtStr(client->scratch, "/channels/%zu/typing", channel_id);
+		MemoryArenaCheckpointScope(client->scratch, __FUNCTION__);
+
+		String endpoint = Fmt(client->scratch, "/channels/{}/typing", channel_id.value);
 
 		Json res;
 		if (Discord_Post(client, endpoint, "application/json", String(), &res)) {
@@ -3026,7 +3100,9 @@ namespace Discord {
 	}
 
 	Array_View<Message> GetPinnedMessage(Client *client, Snowflake channel_id) {
-		String endpoint = FmtStr(client->scratch, "/channels/%zu/pins", channel_id);
+		MemoryArenaCheckpointScope(client->scratch, __FUNCTION__);
+
+		String endpoint = Fmt(client->scratch, "/channels/{}/pins", channel_id.value);
 
 		Json res;
 		if (Discord_Get(client, endpoint, "application/json", String(), &res)) {
@@ -3041,7 +3117,9 @@ namespace Discord {
 	}
 
 	bool PinMessage(Client *client, Snowflake channel_id, Snowflake message_id) {
-		String endpoint = FmtStr(client->scratch, "/channels/%zu/pins/%zu", channel_id, message_id);
+		MemoryArenaCheckpointScope(client->scratch, __FUNCTION__);
+
+		String endpoint = Fmt(client->scratch, "/channels/{}/pins/{}", channel_id.value, message_id.value);
 
 		Json res;
 		if (Discord_Put(client, endpoint, "application/json", String(), &res)) {
@@ -3051,7 +3129,9 @@ namespace Discord {
 	}
 
 	bool UnpinMessage(Client *client, Snowflake channel_id, Snowflake message_id) {
-		String endpoint = FmtStr(client->scratch, "/channels/%zu/pins/%zu", channel_id, message_id);
+		MemoryArenaCheckpointScope(client->scratch, __FUNCTION__);
+
+		String endpoint = Fmt(client->scratch, "/channels/{}/pins/{}", channel_id.value, message_id.value);
 
 		Json res;
 		if (Discord_Delete(client, endpoint, "application/json", String(), &res)) {
@@ -3061,7 +3141,9 @@ namespace Discord {
 	}
 
 	bool GroupDMAddRecipient(Client *client, Snowflake channel_id, Snowflake user_id, String access_token, String nick) {
-		String endpoint = FmtStr(client->scratch, "/channels/%zu/recipients/%zu", channel_id, user_id);
+		MemoryArenaCheckpointScope(client->scratch, __FUNCTION__);
+
+		String endpoint = Fmt(client->scratch, "/channels/{}/recipients/{}", channel_id.value, user_id.value);
 
 		Jsonify j(client->scratch);
 		j.BeginObject();
@@ -3079,7 +3161,9 @@ namespace Discord {
 	}
 
 	bool GroupDMRemoveRecipient(Client *client, Snowflake channel_id, Snowflake user_id) {
-		String endpoint = FmtStr(client->scratch, "/channels/%zu/recipients/%zu", channel_id, user_id);
+		MemoryArenaCheckpointScope(client->scratch, __FUNCTION__);
+
+		String endpoint = Fmt(client->scratch, "/channels/{}/recipients/{}", channel_id.value, user_id.value);
 
 		Json res;
 		if (Discord_Delete(client, endpoint, "application/json", String(), &res)) {
@@ -3089,7 +3173,9 @@ namespace Discord {
 	}
 
 	Channel *StartThreadFromMessage(Client *client, Snowflake channel_id, Snowflake message_id, String name, int32_t auto_archive_duration, int32_t rate_limit_per_user) {
-		String endpoint = FmtStr(client->scratch, "/channels/%zu/messages/%zu/threads", channel_id, message_id);
+		MemoryArenaCheckpointScope(client->scratch, __FUNCTION__);
+
+		String endpoint = Fmt(client->scratch, "/channels/{}/messages/{}/threads", channel_id.value, message_id.value);
 
 		Jsonify j(client->scratch);
 		j.BeginObject();
@@ -3115,7 +3201,9 @@ namespace Discord {
 	}
 
 	Channel *StartThreadWithoutMessage(Client *client, Snowflake channel_id, String name, int32_t auto_archive_duration, ChannelType type, bool invitable, int32_t rate_limit_per_user) {
-		String endpoint = FmtStr(client->scratch, "/channels/%zu/threads", channel_id);
+		MemoryArenaCheckpointScope(client->scratch, __FUNCTION__);
+
+		String endpoint = Fmt(client->scratch, "/channels/{}/threads", channel_id.value);
 
 		Jsonify j(client->scratch);
 		j.BeginObject();
@@ -3143,6 +3231,8 @@ namespace Discord {
 	}
 
 	StartForumThreadInfo *StartThreadInForumChannel(Client *client, Snowflake channel_id, String name, const ForumThreadMessageParams &msg, int32_t auto_archive_duration, int32_t rate_limit_per_user) {
+		MemoryArenaCheckpointScope(client->scratch, __FUNCTION__);
+
 		Jsonify j(client->scratch);
 
 		j.BeginObject();
@@ -3212,38 +3302,22 @@ namespace Discord {
 
 		String payload_json = Jsonify_BuildString(&j);
 
-		String body;
-		String content_type;
-
-		uint8_t buffer[4096];
-		int     len = 0;
+		Http_Multipart multipart;
 
-		if (!msg.attachments.count) {
-			body = payload_json;
-			content_type = "application/json";
-		} else {
-			Http_Multipart multipart = Http_MultipartBegin(client->scratch);
-			if (!Http_MultipartData(&multipart, payload_json, "application/json", "name=\"payload_json\""))
+		if (msg.attachments.count) {
+			multipart = Http_MultipartBegin(client->scratch);
+			if (!Discord_BuildMultipart(&multipart, payload_json, msg.attachments))
 				return nullptr;
-			for (int id = 0; id < (int)msg.attachments.count; ++id) {
-				const auto &attachment = msg.attachments[id];
-				len = snprintf((char *)buffer, sizeof(buffer), "name=\"files[%d]\"; filename=\"" StrFmt "\"", id, StrArg(attachment.filename));
-				String content_disposition(buffer, len);
-				if (!Http_MultipartData(&multipart, attachment.content, attachment.content_type, content_disposition))
-					return nullptr;
-			}
-
-			body = Http_MultipartEnd(&multipart);
-
-			String boundary = String(multipart.boundary, HTTP_MULTIPART_LENGTH);
-			len = snprintf((char *)buffer, sizeof(buffer), "multipart/form-data; boundary=" StrFmt, StrArg(boundary));
-			content_type = String(buffer, len);
 		}
 
-		String endpoint = FmtStr(client->scratch, "/channels/%zu/threads", channel_id);
+		String endpoint = Fmt(client->scratch, "/channels/{}/threads", channel_id.value);
 
 		Json res;
-		if (Discord_Post(client, endpoint, content_type, body, &res)) {
+		bool sent = msg.attachments.count ?
+			Discord_Post(client, endpoint, &multipart, &res) :
+			Discord_Post(client, endpoint, "application/json", payload_json, &res);
+
+		if (sent) {
 			StartForumThreadInfo *thread = new StartForumThreadInfo;
 			if (thread) {
 				Json_Object obj = JsonGetObject(res);
@@ -3257,7 +3331,9 @@ namespace Discord {
 	}
 
 	bool JoinThread(Client *client, Snowflake channel_id) {
-		String endpoint = FmtStr(client->scratch, "/channels/%zu/thread-members/@me", channel_id);
+		MemoryArenaCheckpointScope(client->scratch, __FUNCTION__);
+
+		String endpoint = Fmt(client->scratch, "/channels/{}/thread-members/@me", channel_id.value);
 
 		Json res;
 		if (Discord_Put(client, endpoint, "application/json", String(), &res)) {
@@ -3267,7 +3343,9 @@ namespace Discord {
 	}
 
 	bool AddThreadMember(Client *client, Snowflake channel_id, Snowflake user_id) {
-		String endpoint = FmtStr(client->scratch, "/channels/%zu/thread-members/%zu", channel_id, user_id);
+		MemoryArenaCheckpointScope(client->scratch, __FUNCTION__);
+
+		String endpoint = Fmt(client->scratch, "/channels/{}/thread-members/{}", channel_id.value, user_id.value);
 
 		Json res;
 		if (Discord_Put(client, endpoint, "application/json", String(), &res)) {
@@ -3277,7 +3355,9 @@ namespace Discord {
 	}
 
 	bool LeaveThread(Client *client, Snowflake channel_id) {
-		String endpoint = FmtStr(client->scratch, "/channels/%zu/thread-members/@me", channel_id);
+		MemoryArenaCheckpointScope(client->scratch, __FUNCTION__);
+
+		String endpoint = Fmt(client->scratch, "/channels/{}/thread-members/@me", channel_id.value);
 
 		Json res;
 		if (Discord_Delete(client, endpoint, "application/json", String(), &res)) {
@@ -3287,7 +3367,9 @@ namespace Discord {
 	}
 
 	bool RemoveThreadMember(Client *client, Snowflake channel_id, Snowflake user_id) {
-		String endpoint = FmtStr(client->scratch, "/channels/%zu/thread-members/%zu", channel_id, user_id);
+		MemoryArenaCheckpointScope(client->scratch, __FUNCTION__);
+
+		String endpoint = Fmt(client->scratch, "/channels/{}/thread-members/{}", channel_id.value, user_id.value);
 
 		Json res;
 		if (Discord_Delete(client, endpoint, "application/json", String(), &res)) {
@@ -3297,7 +3379,9 @@ namespace Discord {
 	}
 
 	ThreadMember *GetThreadMember(Client *client, Snowflake channel_id, Snowflake user_id) {
-		String endpoint = FmtStr(client->scratch, "/channels/%zu/thread-members/%zu", channel_id, user_id);
+		MemoryArenaCheckpointScope(client->scratch, __FUNCTION__);
+
+		String endpoint = Fmt(client->scratch, "/channels/{}/thread-members/{}", channel_id.value, user_id.value);
 
 		Json res;
 		if (Discord_Get(client, endpoint, "application/json", String(), &res)) {
@@ -3311,7 +3395,9 @@ namespace Discord {
 	}
 
 	Array_View<ThreadMember> ListThreadMembers(Client *client, Snowflake channel_id) {
-		String endpoint = FmtStr(client->scratch, "/channels/%zu/thread-members", channel_id);
+		MemoryArenaCheckpointScope(client->scratch, __FUNCTION__);
+
+		String endpoint = Fmt(client->scratch, "/channels/{}/thread-members", channel_id.value);
 
 		Json res;
 		if (Discord_Get(client, endpoint, "application/json", String(), &res)) {
@@ -3327,7 +3413,9 @@ namespace Discord {
 	}
 
 	ThreadsInfo *ListPublicArchivedThreads(Client *client, Snowflake channel_id, Timestamp before, int32_t limit) {
-		String endpoint = FmtStr(client->scratch, "/channels/%zu/threads/archived/public", channel_id);
+		MemoryArenaCheckpointScope(client->scratch, __FUNCTION__);
+
+		String endpoint = Fmt(client->scratch, "/channels/{}/threads/archived/public", channel_id.value);
 
 		uint8_t buffer[32];
 
@@ -3338,7 +3426,7 @@ namespace Discord {
 		}
 
 		if (limit)
-			Http_QueryParamSet(&params, "limit", FmtStr(client->scratch, "%d", limit));
+			Http_QueryParamSet(&params, "limit", Fmt(client->scratch, "{}", limit));
 
 		Json res;
 		if (Discord_Get(client, endpoint, params, "application/json", String(), &res)) {
@@ -3371,7 +3459,9 @@ namespace Discord {
 	}
 
 	ThreadsInfo *ListPrivateArchivedThread(Client *client, Snowflake channel_id, Timestamp before, int32_t limit) {
-		String endpoint = FmtStr(client->scratch, "/channels/%zu/threads/archived/private", channel_id);
+		MemoryArenaCheckpointScope(client->scratch, __FUNCTION__);
+
+		String endpoint = Fmt(client->scratch, "/channels/{}/threads/archived/private", channel_id.value);
 
 		uint8_t buffer[32];
 
@@ -3382,7 +3472,7 @@ namespace Discord {
 		}
 
 		if (limit)
-			Http_QueryParamSet(&params, "limit", FmtStr(client->scratch, "%d", limit));
+			Http_QueryParamSet(&params, "limit", Fmt(client->scratch, "{}", limit));
 
 		Json res;
 		if (Discord_Get(client, endpoint, params, "application/json", String(), &res)) {
@@ -3415,7 +3505,9 @@ namespace Discord {
 	}
 
 	ThreadsInfo *ListJoinedArchivedThreads(Client *client, Snowflake channel_id, Timestamp before, int32_t limit) {
-		String endpoint = FmtStr(client->scratch, "/channels/%zu/users/@me/threads/archived/private", channel_id);
+		MemoryArenaCheckpointScope(client->scratch, __FUNCTION__);
+
+		String endpoint = Fmt(client->scratch, "/channels/{}/users/@me/threads/archived/private", channel_id.value);
 
 		uint8_t buffer[32];
 
@@ -3426,7 +3518,7 @@ namespace Discord {
 		}
 
 		if (limit)
-			Http_QueryParamSet(&params, "limit", FmtStr(client->scratch, "%d", limit));
+			Http_QueryParamSet(&params, "limit", Fmt(client->scratch, "{}", limit));
 
 		Json res;
 		if (Discord_Get(client, endpoint, params, "application/json", String(), &res)) {
@@ -3463,12 +3555,8 @@ namespace Discord {
 //
 //
 
-static void Discord_InitHttpRequest(Http *http, Http_Request *req, String authorization, String content_type, String body) {
-	Http_InitRequest(req);
-	Http_SetHost(req, http);
-	Http_SetHeader(req, HTTP_HEADER_CONNECTION, "keep-alive");
-	Http_SetHeader(req, HTTP_HEADER_USER_AGENT, Discord::UserAgent);
-	Http_SetHeader(req, HTTP_HEADER_AUTHORIZATION, authorization);
+static void Discord_InitHttpRequest(Discord::Client *client, Http_Request *req, String content_type, String body) {
+	Http_InitRequest(req, &client->headers);
 	Http_SetContent(req, content_type, body);
 }
 
@@ -3477,26 +3565,52 @@ static bool Discord_HttpConnect(Discord::Client *client) {
 	client->http = Http_Connect(host, HTTPS_CONNECTION, client->allocator);
 	if (!client->http) {
 		LogErrorEx("Discord", "Unable to connect to \"" StrFmt "\".", StrArg(host));
-		return nullptr;
+		return false;
+	}
+
+	Http_Request req;
+	Http_InitRequest(&req);
+	Http_SetHost(&req, client->http);
+	Http_SetHeader(&req, HTTP_HEADER_CONNECTION, "keep-alive");
+	Http_SetHeader(&req, HTTP_HEADER_USER_AGENT, Discord::UserAgent);
+	Http_SetHeader(&req, HTTP_HEADER_AUTHORIZATION, client->authorization);
+
+	if (!Http_PrepareTemplate(&client->headers, req)) {
+		Http_Disconnect(client->http);
+		client->http = nullptr;
+		return false;
 	}
 
 	return true;
 }
 
-static bool Discord_CustomMethod(Discord::Client *client, const String method, const String api_endpoint, const Http_Query_Params &params, const String content_type, const String body, Json *json) {
+static bool Discord_SendHttpRequest(Discord::Client *client, const String method, const String api_endpoint, const Http_Query_Params &params, const String content_type, const String body, Http_Multipart *multipart, Json *json) {
 	if (!client->http) {
 		if (!Discord_HttpConnect(client))
 			return false;
 	}
 
-	String endpoint = FmtStr(client->scratch, StrFmt StrFmt, StrArg(Discord::BaseHttpUrl), StrArg(api_endpoint));
+	String endpoint = Fmt(client->scratch, "{}{}", Discord::BaseHttpUrl, api_endpoint);
 
 	Http_Request req;
 	Http_Response res;
 
 	for (int retry = 0; retry < 2; ++retry) {
-		Discord_InitHttpRequest(client->http, &req, client->authorization, content_type, body);
-		if (Http_CustomMethod(client->http, method, endpoint, params, req, &res, client->scratch)) {
+		Discord_InitHttpRequest(client, &req, content_type, body);
+
+		bool sent;
+		if (multipart) {
+			Http_SetContentLength(&req, multipart->length);
+			Http_Multipart_Reader multipart_reader;
+			Http_Reader reader = Http_MultipartReader(&multipart_reader, multipart);
+			sent = Http_CustomMethod(client->http, method, endpoint, params, req, reader, &res, client->scratch);
+		} else if (client->cache && method == "GET") {
+			sent = Http_Get(client->http, client->cache, endpoint, params, req, &res, client->scratch);
+		} else {
+			sent = Http_CustomMethod(client->http, method, endpoint, params, req, &res, client->scratch);
+		}
+
+		if (sent) {
 			if (res.status.code > 299) {
 				LogInfo("===> Request :: " StrFmt, StrArg(endpoint));
 				Http_DumpHeader(req);
@@ -3525,6 +3639,19 @@ static bool Discord_CustomMethod(Discord::Client *client, const String method, c
 	return false;
 }
 
+static bool Discord_CustomMethod(Discord::Client *client, const String method, const String api_endpoint, const Http_Query_Params &params, const String content_type, const String body, Json *json) {
+	ProfileZone("Discord_CustomMethod");
+	return Discord_SendHttpRequest(client, method, api_endpoint, params, content_type, body, nullptr, json);
+}
+
+static bool Discord_CustomMethod(Discord::Client *client, const String method, const String api_endpoint, Http_Multipart *multipart, Json *json) {
+	ProfileZone("Discord_CustomMethod");
+	String boundary     = String(multipart->boundary, HTTP_MULTIPART_LENGTH);
+	String content_type = Fmt(client->scratch, "multipart/form-data; boundary={}", boundary);
+	Http_Query_Params params;
+	return Discord_SendHttpRequest(client, method, api_endpoint, params, content_type, String(), multipart, json);
+}
+
 //
 //
 //
@@ -4254,9 +4381,14 @@ static constexpr Discord_Event_Handler DiscordEventHandlers[] = {
 static_assert(ArrayCount(DiscordEventHandlers) == ArrayCount(Discord::EventNames), "");
 
 static void Discord_HandleEvent(Discord::Client *client, String event, const Json &data) {
+	ProfileZone("Discord_HandleEvent");
+
 	for (int index = 0; index < ArrayCount(Discord::EventNames); ++index) {
 		if (event == Discord::EventNames[index]) {
 			TraceEx("Discord", "Event " StrFmt, StrArg(event));
+			MemoryArenaCheckpointScope(client->scratch, (const char *)Discord::EventNames[index].data);
+			// The zone of the handler is named after the event, the names are literals
+			ProfileZone((const char *)Discord::EventNames[index].data);
 			DiscordEventHandlers[index](client, data);
 			return;
 		}
@@ -4292,16 +4424,19 @@ static void Discord_HandleWebsocketEvent(Discord::Client *client, const Websocke
 			}
 
 			if (opcode == (int)Discord::Opcode::RECONNECT) {
+				ProfileZone("RECONNECT");
 				Discord_EventHandlerReconnect(client, data);
 				return;
 			}
 
 			if (opcode == (int)Discord::Opcode::INVALID_SESSION) {
+				ProfileZone("INVALID_SESSION");
 				Discord_EventHandlerInvalidSession(client, data);
 				return;
 			}
 
 			if (opcode == (int)Discord::Opcode::HELLO) {
+				ProfileZone("HELLO");
 				Discord_EventHandlerHello(client, data);
 				// If session_id is present, then there's a possibility that the connection can be resumed
 				if (strlen((char *)client->session_id)) {
@@ -1,6 +1,7 @@
 #pragma once
 #include "Kr/KrBasic.h"
 #include "Json.h"
+#include "Http.h"
 
 namespace Discord {
 	struct Snowflake {
@@ -350,17 +351,17 @@ namespace Discord {
 	//
 
 	struct GuildMember {
-		User *           user = nullptr;
-		String           nick;
-		String           avatar;
-		Array<Snowflake> roles;
-		Timestamp        joined_at;
-		Timestamp        premium_since;
-		bool             deaf = false;
-		bool             mute = false;
-		bool             pending = false;
-		Permission       permissions = 0;
-		Timestamp        communication_disabled_until = 0;
+		User *                    user = nullptr;
+		String                    nick;
+		String                    avatar;
+		Small_Array<Snowflake, 4> roles;
+		Timestamp                 joined_at;
+		Timestamp                 premium_since;
+		bool                      deaf = false;
+		bool                      mute = false;
+		bool                      pending = false;
+		Permission                permissions = 0;
+		Timestamp                 communication_disabled_until = 0;
 
 		GuildMember() = default;
 		GuildMember(Memory_Allocator allocator): roles(allocator) {}
@@ -433,33 +434,33 @@ namespace Discord {
 	};
 
 	struct Channel {
-		Snowflake        id;
-		ChannelType      type = ChannelType::GUILD_TEXT;
-		Snowflake        guild_id;
-		int32_t          position = 0;
-		Array<Overwrite> permission_overwrites;
-		String           name;
-		String           topic;
-		bool             nsfw = false;
-		Snowflake        last_message_id;
-		int32_t          bitrate;
-		int32_t          user_limit;
-		int32_t          rate_limit_per_user;
-		Array<User>      recipients;
-		String           icon;
-		Snowflake        owner_id;
-		Snowflake        application_id;
-		Snowflake        parent_id;
-		Timestamp        last_pin_timestamp = 0;
-		String           rtc_region;
-		VideoQualityMode video_quality_mode = VideoQualityMode::NONE;
-		int32_t          message_count = 0;
-		int32_t          member_count = 0;
-		ThreadMetadata * thread_metadata;
-		ThreadMember *   member;
-		int32_t          default_auto_archive_duration = 0;
-		Permission       permissions = 0;
-		ChannelFlag      flags = 0;
+		Snowflake                 id;
+		ChannelType               type = ChannelType::GUILD_TEXT;
+		Snowflake                 guild_id;
+		int32_t                   position = 0;
+		Small_Array<Overwrite, 2> permission_overwrites;
+		String                    name;
+		String                    topic;
+		bool                      nsfw = false;
+		Snowflake                 last_message_id;
+		int32_t                   bitrate;
+		int32_t                   user_limit;
+		int32_t                   rate_limit_per_user;
+		Array<User>               recipients;
+		String                    icon;
+		Snowflake                 owner_id;
+		Snowflake                 application_id;
+		Snowflake                 parent_id;
+		Timestamp                 last_pin_timestamp = 0;
+		String                    rtc_region;
+		VideoQualityMode          video_quality_mode = VideoQualityMode::NONE;
+		int32_t                   message_count = 0;
+		int32_t                   member_count = 0;
+		ThreadMetadata *          thread_metadata;
+		ThreadMember *            member;
+		int32_t                   default_auto_archive_duration = 0;
+		Permission                permissions = 0;
+		ChannelFlag               flags = 0;
 
 		Channel() = default;
 		Channel(Memory_Allocator allocator): permission_overwrites(allocator), recipients(allocator) {}
@@ -1109,36 +1110,36 @@ namespace Discord {
 	};
 
 	struct Message {
-		Snowflake             id;
-		Snowflake             channel_id;
-		Snowflake             guild_id;
-		User                  author;
-		GuildMember *         member = nullptr;
-		String                content;
-		Timestamp             timestamp = 0;
-		Timestamp             edited_timestamp = 0;
-		bool                  tts = false;
-		bool                  mention_everyone = false;
-		Array<Mentions>       mentions;
-		Array<Snowflake>      mention_roles;
-		Array<ChannelMention> mention_channels;
-		Array<Attachment>     attachments;
-		Array<Embed>          embeds;
-		Array<Reaction>       reactions;
-		String                nonce;
-		bool                  pinned = false;
-		Snowflake             webhook_id;
-		MessageType           type = MessageType::DEFAULT;
-		MessageActivity *     activity = nullptr;
-		Application *         application = nullptr;
-		Snowflake             application_id;
-		MessageReference *    message_reference = nullptr;
-		MessageFlag           flags = 0;
-		Message *             referenced_message = nullptr;
-		MessageInteraction *  interaction = nullptr;
-		Channel *             thread = nullptr;
-		Array<Component>      components;
-		Array<StickerItem>    sticker_items;
+		Snowflake                   id;
+		Snowflake                   channel_id;
+		Snowflake                   guild_id;
+		User                        author;
+		GuildMember *               member = nullptr;
+		String                      content;
+		Timestamp                   timestamp = 0;
+		Timestamp                   edited_timestamp = 0;
+		bool                        tts = false;
+		bool                        mention_everyone = false;
+		Small_Array<Mentions, 1>    mentions;
+		Small_Array<Snowflake, 2>   mention_roles;
+		Array<ChannelMention>       mention_channels;
+		Small_Array<Attachment, 1>  attachments;
+		Small_Array<Embed, 1>       embeds;
+		Array<Reaction>             reactions;
+		String                      nonce;
+		bool                        pinned = false;
+		Snowflake                   webhook_id;
+		MessageType                 type = MessageType::DEFAULT;
+		MessageActivity *           activity = nullptr;
+		Application *               application = nullptr;
+		Snowflake                   application_id;
+		MessageReference *          message_reference = nullptr;
+		MessageFlag                 flags = 0;
+		Message *                   referenced_message = nullptr;
+		MessageInteraction *        interaction = nullptr;
+		Channel *                   thread = nullptr;
+		Array<Component>            components;
+		Small_Array<StickerItem, 1> sticker_items;
 
 		Message() = default;
 		Message(Memory_Allocator allocator) :
@@ -1522,13 +1523,15 @@ namespace Discord {
 	void PresenceUpdateCommand(Client *client, const PresenceUpdate &presence_update);
 
 	struct ClientSpec {
-		int32_t          shards[2]    = { 0, 1 };
-		int32_t          tick_ms      = 500;
-		uint32_t         scratch_size = MegaBytes(512);
-		uint32_t         read_size    = MegaBytes(2);
-		uint32_t         write_size   = KiloBytes(8);
-		uint32_t         queue_size   = 32;
-		Memory_Allocator allocator    = ThreadContextDefaultParams.allocator;
+		int32_t          shards[2]     = { 0, 1 };
+		int32_t          tick_ms       = 500;
+		uint32_t         scratch_size  = MegaBytes(512);
+		uint32_t         scratch_flags = MEMORY_ARENA_DEFAULT; // MEMORY_ARENA_HUGE_PAGES for large guilds, MEMORY_ARENA_DECOMMIT to give bursts back
+		uint32_t         read_size     = MegaBytes(2);
+		uint32_t         write_size    = KiloBytes(8);
+		uint32_t         queue_size    = 32;
+		uint32_t         cache_size    = 0; // memory for caching GET responses, 0 disables the cache
+		Memory_Allocator allocator     = ThreadContextDefaultParams.allocator;
 	};
 
 	struct Shard {
@@ -1545,6 +1548,16 @@ namespace Discord {
 	void  LoginSharded(const String token, int32_t intents = 0, EventHandler onevent = EventHandler{}, PresenceUpdate *presence = nullptr, int32_t shard_count = 0, const ShardSpec &specs = ShardSpec());
 	void  Logout(Client *client);
 	Shard GetShard(Client *client);
+	Http_Cache_Stats GetHttpCacheStats(Client *client);
+
+	// Peak scratch usage per reset and per event or REST call, null unless built with MEMORY_ARENA_INSTRUMENTATION
+	const Memory_Arena_Stats *GetScratchStats(Client *client);
+
+	// Committed and used scratch memory, and how much was given back after bursts
+	Memory_Arena_Usage GetScratchUsage(Client *client);
+
+	// Reads a message the way MESSAGE_CREATE does: strings point into 'data', the rest comes from ThreadContext.allocator
+	void DeserializeMessage(const Json &data, Message *message);
 
 	void Initialize();
 
@@ -1574,6 +1587,7 @@ namespace Discord {
 		String description;
 		String content_type;
 		Buffer content;
+		String path; // when present, the content is streamed from this file instead
 	};
 
 	struct MessagePost {
@@ -1,6 +1,21 @@
 #include "Http.h"
+#include "NetworkNative.h"
 #include "Kr/KrString.h"
+#include "Kr/KrBasic.h"
+#include "Kr/KrAtomic.h"
+#include "Kr/KrThread.h"
+#include "Kr/KrProfile.h"
 #include <stdlib.h>
+#include <stdio.h>
+#include <time.h>
+
+#if ARCH_X64
+#if COMPILER_MSVC
+#include <intrin.h>
+#else
+#include <immintrin.h>
+#endif
+#endif
 
 //
 //
@@ -65,6 +80,69 @@ static const String HttpHeaderMap[] = {
 
 static_assert(_HTTP_HEADER_COUNT == ArrayCount(HttpHeaderMap), "");
 
+// Case insensitive FNV-1a, names with the same hash are still compared
+static uint32_t Http_HashHeaderName(String name) {
+	uint32_t hash = 2166136261u;
+	for (ptrdiff_t index = 0; index < name.length; ++index) {
+		hash ^= (uint32_t)(name.data[index] | 0x20);
+		hash *= 16777619u;
+	}
+	return hash;
+}
+
+struct Http_Header_Hashes {
+	uint32_t known[_HTTP_HEADER_COUNT];
+};
+
+static Http_Header_Hashes Http_HashKnownHeaders() {
+	Http_Header_Hashes hashes;
+	for (int index = 0; index < _HTTP_HEADER_COUNT; ++index)
+		hashes.known[index] = Http_HashHeaderName(HttpHeaderMap[index]);
+	return hashes;
+}
+
+static const Http_Header_Hashes HttpHeaderHashes = Http_HashKnownHeaders();
+
+static int Http_FindHeaderId(String name, uint32_t hash) {
+	for (int index = 0; index < _HTTP_HEADER_COUNT; ++index) {
+		if (HttpHeaderHashes.known[index] == hash && StrMatchICase(name, HttpHeaderMap[index]))
+			return index;
+	}
+	return -1;
+}
+
+static int Http_FindHeaderId(String name) {
+	return Http_FindHeaderId(name, Http_HashHeaderName(name));
+}
+
+static String Http_StatusName(uint32_t code) {
+	switch (code) {
+		case 100: return "Continue";
+		case 200: return "OK";
+		case 201: return "Created";
+		case 202: return "Accepted";
+		case 204: return "No Content";
+		case 206: return "Partial Content";
+		case 301: return "Moved Permanently";
+		case 302: return "Found";
+		case 304: return "Not Modified";
+		case 400: return "Bad Request";
+		case 401: return "Unauthorized";
+		case 403: return "Forbidden";
+		case 404: return "Not Found";
+		case 405: return "Method Not Allowed";
+		case 408: return "Request Timeout";
+		case 411: return "Length Required";
+		case 413: return "Payload Too Large";
+		case 429: return "Too Many Requests";
+		case 431: return "Request Header Fields Too Large";
+		case 500: return "Internal Server Error";
+		case 501: return "Not Implemented";
+		case 503: return "Service Unavailable";
+	}
+	return "Unknown";
+}
+
 struct Url {
 	String scheme;
 	String host;
@@ -102,48 +180,69 @@ struct Http { int __unused; };
 Net_Socket *Http_GetSocket(Http *http)    { return (Net_Socket *)http; }
 Http *Http_FromSocket(Net_Socket *socket) { return (Http *)socket; }
 
-Http *Http_Connect(const String host, const String port, Http_Connection connection, Memory_Allocator allocator) {
-	Net_Socket *http = Net_OpenConnection(host, port, NET_SOCKET_TCP, allocator);
-	if (http) {
-		if (connection == HTTP_DEFAULT && (port == "80" || StrMatchICase(port, "http"))) {
-			connection = HTTP_CONNECTION;
-		} else {
-			connection = HTTPS_CONNECTION;
+Http *Http_Connect(const String host, const String port, Http_Connection connection, Memory_Allocator allocator, uint64_t deadline, Http_Phase *timeout) {
+	if (timeout) *timeout = HTTP_PHASE_NONE;
+
+	Net_Socket *http = Net_OpenConnection(host, port, NET_SOCKET_TCP, allocator, deadline);
+	if (!http) {
+		if (deadline && MonotonicMillisecs() >= deadline) {
+			LogErrorEx("Http", "Connecting timed out");
+			if (timeout) *timeout = HTTP_PHASE_CONNECT;
 		}
+		return nullptr;
+	}
 
-		if (connection == HTTPS_CONNECTION) {
-			if (Net_OpenSecureChannel(http, true)) {
-				Net_SetSocketBlockingMode(http, false);
-				return (Http *)http;
-			}
+	if (connection == HTTP_DEFAULT) {
+		bool http_port = port == "80" || StrMatchICase(port, "http");
+		connection     = http_port ? HTTP_CONNECTION : HTTPS_CONNECTION;
+	}
+
+	if (connection == HTTPS_CONNECTION) {
+		if (!Net_OpenSecureChannel(http, true)) {
+			if (timeout && Net_GetLastError(http) == NET_E_TIMED_OUT)
+				*timeout = HTTP_PHASE_HANDSHAKE;
 			Net_CloseConnection(http);
 			return nullptr;
 		}
-		Net_SetSocketBlockingMode(http, false);
-		return (Http *)http;
 	}
-	return nullptr;
+
+	// The deadline belongs to the connect, requests carry their own
+	Net_SetDeadline(http, 0);
+	Net_SetSocketBlockingMode(http, false);
+	// Header and body are sent separately, which Nagle's algorithm would hold back until acknowledged
+	Net_SetSocketNoDelay(http, true);
+	return (Http *)http;
 }
 
-Http *Http_Connect(const String hostname, Http_Connection connection, Memory_Allocator allocator) {
+Http *Http_Connect(const String hostname, Http_Connection connection, Memory_Allocator allocator, uint64_t deadline, Http_Phase *timeout) {
 	Url url;
 	if (Http_UrlExtract(hostname, &url)) {
 		if (connection == HTTP_DEFAULT && (url.scheme == "80" || StrMatchICase(url.scheme, "http")))
 			connection = HTTP_CONNECTION;
-		return Http_Connect(url.host, url.port, connection, allocator);
+		return Http_Connect(url.host, url.port, connection, allocator, deadline, timeout);
 	}
+	if (timeout) *timeout = HTTP_PHASE_NONE;
 	LogErrorEx("Http", "Invalid hostname: %*.s", (int)hostname.length, hostname.data);
 	return nullptr;
 }
 
 bool Http_Reconnect(Http *http) {
-	return Net_TryReconnect((Net_Socket *)http);
+	Net_Socket *net = (Net_Socket *)http;
+	if (!Net_TryReconnect(net))
+		return false;
+	Net_SetSocketBlockingMode(net, false);
+	Net_SetSocketNoDelay(net, true);
+	return true;
 }
 
 void Http_Disconnect(Http *http) {
 	Net_CloseConnection((Net_Socket *)http);
 }
 
+void Http_SetDeadline(Http *http, uint64_t deadline) {
+	Net_SetDeadline((Net_Socket *)http, deadline);
+}
+
 //
 //
 //
@@ -175,6 +274,16 @@ void Http_DumpHeader(const Http_Request &req) {
 		if (raw.name.length)
 			LogInfo("> " StrFmt ": " StrFmt, StrArg(raw.name), StrArg(raw.value));
 	}
+	if (req.prepared) {
+		String    lines = String(req.prepared->buffer, req.prepared->length);
+		ptrdiff_t start = 0;
+		while (start < lines.length) {
+			ptrdiff_t end = StrFind(lines, "\r\n", start);
+			if (end < 0) end = lines.length;
+			LogInfo("> " StrFmt, StrArg(SubStr(lines, start, end - start)));
+			start = end + 2;
+		}
+	}
 	LogInfoEx("Http", "=================================================");
 }
 
@@ -196,7 +305,13 @@ void Http_DumpHeader(const Http_Response &res) {
 }
 
 void Http_InitRequest(Http_Request *req) {
-	memset(req, 0, sizeof(*req));
+	// The buffer is only read up to 'length'
+	memset(req, 0, offsetof(Http_Request, buffer));
+}
+
+void Http_InitRequest(Http_Request *req, const Http_Request_Template *prepared) {
+	Http_InitRequest(req);
+	req->prepared = prepared;
 }
 
 void Http_SetHost(Http_Request *req, Http *http) {
@@ -424,9 +539,11 @@ static inline bool Http_IterateSend(Http *http, uint8_t *bytes, ptrdiff_t bytes_
 
 static inline int Http_Receive(Http *http, uint8_t *buffer, int length) {
 	int ret = Net_ReceiveBlocked((Net_Socket *)http, buffer, length, HTTP_TIMEOUT_MS);
-	if (ret >= 0) return ret;
+	if (ret > 0) return ret;
 	Net_Error error = Net_GetLastError((Net_Socket *)http);
-	if (error == NET_E_TIMED_OUT) {
+	if (error == NET_E_TIMED_OUT || error == NET_E_WOULD_BLOCK) {
+		// Nothing arrived within HTTP_TIMEOUT_MS
+		Net_SetError((Net_Socket *)http, NET_E_TIMED_OUT);
 		LogErrorEx("Http", "Receiving timed out");
 		return -1;
 	}
@@ -444,9 +561,37 @@ void Http_DumpProc(Http_Header &header, uint8_t *buffer, ptrdiff_t length, void
 	LogInfo(StrFmt, StrArg(String(buffer, length)));
 }
 
+static void Http_WriteHeaders(Builder *builder, const Http_Header &headers) {
+	for (int id = 0; id < _HTTP_HEADER_COUNT; ++id) {
+		String value = headers.known[id];
+		if (value.length) {
+			BuilderWrite(builder, HttpHeaderMap[id], String(":"), value, String("\r\n"));
+		}
+	}
+	for (ptrdiff_t index = 0; index < headers.raw.count; ++index) {
+		const Http_Raw_Headers::Header &raw = headers.raw.data[index];
+		BuilderWrite(builder, raw.name, String(":"), raw.value, String("\r\n"));
+	}
+}
+
+bool Http_PrepareTemplate(Http_Request_Template *prepared, const Http_Request &req) {
+	Builder builder;
+	BuilderBegin(&builder, prepared->buffer, sizeof(prepared->buffer));
+	Http_WriteHeaders(&builder, req.headers);
+
+	if (builder.thrown) {
+		LogErrorEx("Http", "Preparing request template failed: out of memory");
+		prepared->length = 0;
+		return false;
+	}
+
+	prepared->length = BuilderEnd(&builder).length;
+	return true;
+}
+
 ptrdiff_t Http_BuildRequest(const String method, const String endpoint, const Http_Query_Params *params, const Http_Request &req, uint8_t *buffer, ptrdiff_t buff_len) {
 	Builder builder;
-	BuilderBegin(&builder, buffer, HTTP_STREAM_CHUNK_SIZE);
+	BuilderBegin(&builder, buffer, buff_len);
 	BuilderWrite(&builder, method, String(" "), endpoint);
 
 	if (params && params->count > 0) {
@@ -466,16 +611,33 @@ ptrdiff_t Http_BuildRequest(const String method, const String endpoint, const Ht
 
 	BuilderWrite(&builder, String(" HTTP/1.1\r\n"));
 
-	for (int id = 0; id < _HTTP_HEADER_COUNT; ++id) {
-		String value = req.headers.known[id];
-		if (value.length) {
-			BuilderWrite(&builder, HttpHeaderMap[id], String(":"), value, String("\r\n"));
-		}
-	}
-	for (ptrdiff_t index = 0; index < req.headers.raw.count; ++index) {
-		const Http_Raw_Headers::Header &raw = req.headers.raw.data[index];
-		BuilderWrite(&builder, raw.name, String(":"), raw.value, String("\r\n"));
+	if (req.prepared)
+		BuilderWrite(&builder, Buffer(req.prepared->buffer, req.prepared->length));
+
+	Http_WriteHeaders(&builder, req.headers);
+	BuilderWrite(&builder, "\r\n");
+
+	if (builder.thrown) {
+		return -1;
 	}
+
+	String header = BuilderEnd(&builder);
+	return header.length;
+}
+
+ptrdiff_t Http_BuildResponse(const Http_Response &res, uint8_t *buffer, ptrdiff_t buff_len) {
+	uint32_t code = res.status.code ? res.status.code : 200;
+	String   name = res.status.name.length ? res.status.name : Http_StatusName(code);
+
+	char status[16];
+	int  status_len = snprintf(status, sizeof(status), " %u ", code);
+
+	Builder builder;
+	BuilderBegin(&builder, buffer, buff_len);
+	BuilderWrite(&builder, res.status.version == HTTP_VERSION_1_0 ? String("HTTP/1.0") : String("HTTP/1.1"));
+	BuilderWrite(&builder, String(status, status_len), name, String("\r\n"));
+
+	Http_WriteHeaders(&builder, res.headers);
 	BuilderWrite(&builder, "\r\n");
 
 	if (builder.thrown) {
@@ -486,14 +648,12 @@ ptrdiff_t Http_BuildRequest(const String method, const String endpoint, const Ht
 	return header.length;
 }
 
-bool Http_SendRequest(Http *http, const String header, Http_Reader reader) {
+static bool Http_SendBody(Http *http, Http_Reader reader) {
 	uint8_t buffer[HTTP_STREAM_CHUNK_SIZE];
 
-	if (!Http_IterateSend(http, header.data, header.length))
-		return false;
-
 	while (true) {
 		int read = reader.proc(buffer, HTTP_STREAM_CHUNK_SIZE, reader.context);
+		if (read < 0) return false;
 		if (!read) break;
 		if (!Http_IterateSend(http, buffer, read))
 			return false;
@@ -502,322 +662,721 @@ bool Http_SendRequest(Http *http, const String header, Http_Reader reader) {
 	return true;
 }
 
-bool Http_ReceiveResponse(Http *http, Http_Response *res, Http_Writer writer) {
-	uint8_t buffer[HTTP_STREAM_CHUNK_SIZE];
+bool Http_SendRequest(Http *http, const String header, Http_Reader reader) {
+	if (!Http_IterateSend(http, header.data, header.length))
+		return false;
+	return Http_SendBody(http, reader);
+}
 
-	ptrdiff_t body_read = 0;
+//
+// Header scanner: finds the line ends and the first colon of every line in a single pass over
+// the received bytes, 16 or 32 bytes at a time. The scan resumes where the last read ended, so a
+// header split across reads is never searched twice.
+//
 
-	{
-		// Read Header
-		uint8_t *read_ptr  = res->buffer;
-		int buffer_size    = HTTP_MAX_HEADER_SIZE;
-		uint8_t *parse_ptr = read_ptr;
+static constexpr int HTTP_MAX_HEADER_FIELDS = 256;
 
-		bool read_more = true;
+static_assert(HTTP_MAX_HEADER_SIZE <= UINT16_MAX, "Header field offsets are 16 bits");
 
-		while (read_more) {
-			int bytes_read = Http_Receive(http, read_ptr, buffer_size);
-			if (bytes_read <= 0)
-				return false;
+struct Http_Header_Field {
+	uint16_t start; // offset of the line in the header buffer
+	uint16_t colon; // offset of the first ':' in the line, 0 if there is none
+	uint16_t end;   // offset of the line end, excluding "\r\n"
+};
 
-			Assert(res->buffer[0] != '\n');
+struct Http_Header_Scanner {
+	ptrdiff_t         scanned;  // bytes of the header buffer already scanned
+	ptrdiff_t         line;     // start of the line being scanned
+	ptrdiff_t         colon;    // first colon of the line being scanned, 0 if none yet
+	ptrdiff_t         length;   // length of the header including the empty line, 0 until it is found
+	bool              overflow; // more than HTTP_MAX_HEADER_FIELDS lines
+	int               count;
+	Http_Header_Field fields[HTTP_MAX_HEADER_FIELDS]; // the first one is the status line
+};
 
-			read_ptr += bytes_read;
-			buffer_size -= bytes_read;
+static void Http_ScannerInit(Http_Header_Scanner *scanner) {
+	scanner->scanned  = 0;
+	scanner->line     = 0;
+	scanner->colon    = 0;
+	scanner->length   = 0;
+	scanner->overflow = false;
+	scanner->count    = 0;
+}
 
-			while (read_ptr - parse_ptr > 1) {
-				String part(parse_ptr, read_ptr - parse_ptr);
-				ptrdiff_t pos = StrFind(part, "\r\n");
-				if (pos < 0) {
-					if (buffer_size)
-						break;
-					LogErrorEx("Http", "Reader header failed: out of memory");
-					Http_FlushRead(http, res);
-					return false;
-				}
+// Visits a byte that is either '\n' or ':', returns false when the scan is finished
+static inline bool Http_ScanVisit(Http_Header_Scanner *scanner, const uint8_t *buffer, ptrdiff_t pos) {
+	if (buffer[pos] == ':') {
+		if (!scanner->colon)
+			scanner->colon = pos;
+		return true;
+	}
 
-				parse_ptr += pos + 2;
+	ptrdiff_t end = pos;
+	if (end > scanner->line && buffer[end - 1] == '\r')
+		end -= 1;
 
-				if (pos == 0) {
-					res->length = parse_ptr - res->buffer;
-					body_read = read_ptr - parse_ptr;
-					Assert(body_read <= HTTP_STREAM_CHUNK_SIZE);
-					memcpy(buffer, parse_ptr, body_read);
-					read_more = false;
-					break;
-				}
-			}
-		}
+	if (end == scanner->line) {
+		scanner->length = pos + 1;
+		return false;
 	}
 
-	{
-		// Parse headers
-		uint8_t *trav = res->buffer;
-		uint8_t *last = trav + res->length;
+	if (scanner->count == HTTP_MAX_HEADER_FIELDS) {
+		scanner->overflow = true;
+		return false;
+	}
+
+	Http_Header_Field *field = &scanner->fields[scanner->count++];
+	field->start = (uint16_t)scanner->line;
+	field->colon = (uint16_t)scanner->colon;
+	field->end   = (uint16_t)end;
+
+	scanner->line  = pos + 1;
+	scanner->colon = 0;
+	return true;
+}
+
+static inline uint32_t Http_CountTrailingZeros(uint32_t mask) {
+#if COMPILER_MSVC
+	unsigned long index;
+	_BitScanForward(&index, mask);
+	return (uint32_t)index;
+#else
+	return (uint32_t)__builtin_ctz(mask);
+#endif
+}
 
-		enum { PARSISNG_STATUS, PARSING_FIELDS };
+static inline bool Http_ScanMask(Http_Header_Scanner *scanner, const uint8_t *buffer, ptrdiff_t pos, uint32_t mask) {
+	for (; mask; mask &= mask - 1) {
+		if (!Http_ScanVisit(scanner, buffer, pos + Http_CountTrailingZeros(mask)))
+			return false;
+	}
+	return true;
+}
 
-		int state = PARSISNG_STATUS;
+// Scans whole blocks from 'pos', returns the position where the scan stopped
+typedef ptrdiff_t(*Http_Scan_Proc)(Http_Header_Scanner *scanner, const uint8_t *buffer, ptrdiff_t pos, ptrdiff_t end);
 
-		while (true) {
-			String part(trav, last - trav);
-			ptrdiff_t pos = StrFind(part, "\r\n");
-			if (pos == 0) // Finished
+static ptrdiff_t Http_ScanScalar(Http_Header_Scanner *scanner, const uint8_t *buffer, ptrdiff_t pos, ptrdiff_t end) {
+	for (; pos < end; ++pos) {
+		if (buffer[pos] == '\n' || buffer[pos] == ':') {
+			if (!Http_ScanVisit(scanner, buffer, pos))
 				break;
+		}
+	}
+	return pos;
+}
 
-			if (pos < 0) {
-				LogErrorEx("Http", "Corrupt header received: missing headers");
-				Http_FlushRead(http, res);
-				return false;
-			}
+#if ARCH_X64
+static ptrdiff_t Http_ScanSse2(Http_Header_Scanner *scanner, const uint8_t *buffer, ptrdiff_t pos, ptrdiff_t end) {
+	const __m128i lf    = _mm_set1_epi8('\n');
+	const __m128i colon = _mm_set1_epi8(':');
 
-			String line(trav, pos);
-			trav += pos + 2;
+	for (; pos + 16 <= end; pos += 16) {
+		__m128i  bytes = _mm_loadu_si128((const __m128i *)(buffer + pos));
+		uint32_t mask  = (uint32_t)_mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(bytes, lf), _mm_cmpeq_epi8(bytes, colon)));
+		if (!Http_ScanMask(scanner, buffer, pos, mask))
+			break;
+	}
+	return pos;
+}
 
-			if (state == PARSING_FIELDS) {
-				ptrdiff_t colon = StrFindChar(line, ':');
-				if (colon <= 0) {
-					LogErrorEx("Http", "Corrupt header received: value for header not present");
-					Http_FlushRead(http, res);
-					return false;
-				}
+#if COMPILER_MSVC
+#define HTTP_TARGET_AVX2
+#else
+#define HTTP_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
 
-				String name = SubStr(line, 0, colon);
-				name = StrTrim(name);
-				String value = SubStr(line, colon + 1);
-				value = StrTrim(value);
+HTTP_TARGET_AVX2 static ptrdiff_t Http_ScanAvx2(Http_Header_Scanner *scanner, const uint8_t *buffer, ptrdiff_t pos, ptrdiff_t end) {
+	const __m256i lf    = _mm256_set1_epi8('\n');
+	const __m256i colon = _mm256_set1_epi8(':');
 
-				bool known_header = false;
-				for (int index = 0; index < _HTTP_HEADER_COUNT; ++index) {
-					if (StrMatchICase(name, HttpHeaderMap[index])) {
-						Http_AppendHeader(res, (Http_Header_Id)index, value);
-						known_header = true;
-						break;
-					}
-				}
+	for (; pos + 32 <= end; pos += 32) {
+		__m256i  bytes = _mm256_loadu_si256((const __m256i *)(buffer + pos));
+		uint32_t mask  = (uint32_t)_mm256_movemask_epi8(_mm256_or_si256(_mm256_cmpeq_epi8(bytes, lf), _mm256_cmpeq_epi8(bytes, colon)));
+		if (!Http_ScanMask(scanner, buffer, pos, mask))
+			break;
+	}
+	return pos;
+}
 
-				if (!known_header) {
-					if (res->headers.raw.count < HTTP_MAX_HEADER_SIZE) {
-						Http_AppendHeader(res, name, value);
-					} else {
-						LogWarningEx("Http", "Custom header  \"" StrFmt "\" could not be added: out of memory", StrArg(name));
-					}
-				}
+static bool Http_CpuHasAvx2() {
+#if COMPILER_MSVC
+	int info[4];
+	__cpuid(info, 0);
+	if (info[0] < 7) return false;
+	__cpuid(info, 1);
+	bool osxsave = (info[2] & (1 << 27)) != 0;
+	bool avx     = (info[2] & (1 << 28)) != 0;
+	// The OS must save the ymm registers
+	if (!osxsave || !avx || (_xgetbv(0) & 0x6) != 0x6) return false;
+	__cpuidex(info, 7, 0);
+	return (info[1] & (1 << 5)) != 0;
+#else
+	__builtin_cpu_init();
+	return __builtin_cpu_supports("avx2");
+#endif
+}
+
+static Http_Scan_Proc Http_SelectScanProc() {
+	return Http_CpuHasAvx2() ? Http_ScanAvx2 : Http_ScanSse2;
+}
+#else
+static Http_Scan_Proc Http_SelectScanProc() {
+	return Http_ScanScalar;
+}
+#endif
+
+static const Http_Scan_Proc HttpScanBlocks = Http_SelectScanProc();
+
+// Scans the header bytes received since the last call, 'received' is the total received into 'buffer'
+static void Http_ScanHeader(Http_Header_Scanner *scanner, const uint8_t *buffer, ptrdiff_t received) {
+	ptrdiff_t pos = HttpScanBlocks(scanner, buffer, scanner->scanned, received);
+	if (!scanner->length && !scanner->overflow)
+		pos = Http_ScanScalar(scanner, buffer, pos, received);
+	scanner->scanned = pos;
+}
+
+//
+//
+//
+
+enum Http_Parser_State {
+	HTTP_PARSER_HEADER,
+	HTTP_PARSER_BODY,
+	HTTP_PARSER_CHUNK_HEADER,
+	HTTP_PARSER_CHUNK_DATA,
+	HTTP_PARSER_CHUNK_END,
+	HTTP_PARSER_DONE,
+};
+
+// Incremental response parser, the receiving is left to the caller so that it can be
+// driven by both the blocking calls and the client's I/O thread
+struct Http_Response_Parser {
+	Http_Parser_State   state;
+	ptrdiff_t           received;     // header bytes received into the response buffer
+	ptrdiff_t           remaining;    // bytes left in the body or in the current chunk
+	ptrdiff_t           chunk_length;
+	uint8_t *           dst;          // reserved memory for the remaining bytes
+	bool                discard;
+	bool                interim;      // an interim (1xx) response was received and skipped
+	bool                head;         // the request was HEAD
+	String              pending;      // received bytes that are not parsed yet
+	Http_Header_Scanner scanner;
+	uint8_t             stream[HTTP_STREAM_CHUNK_SIZE];
+};
+
+static void Http_ParserInit(Http_Response_Parser *parser, bool head = false) {
+	parser->state        = HTTP_PARSER_HEADER;
+	parser->received     = 0;
+	parser->remaining    = 0;
+	parser->chunk_length = 0;
+	parser->dst          = nullptr;
+	parser->discard      = false;
+	parser->interim      = false;
+	parser->head         = head;
+	parser->pending      = String();
+	Http_ScannerInit(&parser->scanner);
+}
+
+static bool Http_ParseHeader(Http_Response_Parser *parser, Http_Response *res, ptrdiff_t header_length) {
+	const Http_Header_Scanner &scanner = parser->scanner;
+
+	if (!scanner.count) {
+		LogErrorEx("Http", "Corrupt header received: missing status");
+		return false;
+	}
+
+	// Hashes of the custom header names, repeated names are found without comparing every name
+	uint32_t raw_hashes[HTTP_MAX_RAW_HEADERS];
+
+	for (int index = 0; index < scanner.count; ++index) {
+		const Http_Header_Field &field = scanner.fields[index];
+		String line(res->buffer + field.start, field.end - field.start);
+
+		if (index) {
+			if (field.colon <= field.start) {
+				LogErrorEx("Http", "Corrupt header received: value for header not present");
+				return false;
+			}
+
+			String name  = StrTrim(String(res->buffer + field.start, field.colon - field.start));
+			String value = StrTrim(String(res->buffer + field.colon + 1, field.end - field.colon - 1));
+
+			uint32_t hash      = Http_HashHeaderName(name);
+			int      header_id = Http_FindHeaderId(name, hash);
+
+			String    existing;
+			ptrdiff_t raw_index = -1;
+			if (header_id >= 0) {
+				existing = res->headers.known[header_id];
 			} else {
-				const String prefixes[] = { "HTTP/1.1 ", "HTTP/1.0 " };
-				constexpr Http_Version versions[] = { HTTP_VERSION_1_1, HTTP_VERSION_1_0 };
-				static_assert(ArrayCount(prefixes) == ArrayCount(versions), "");
-
-				bool prefix_present = false;
-				for (int index = 0; index < ArrayCount(prefixes); ++index) {
-					String prefix = prefixes[index];
-					if (StrStartsWithICase(line, prefix)) {
-						line = StrRemovePrefix(line, prefix.length);
-						res->status.version = versions[index];
-						prefix_present = true;
+				for (ptrdiff_t raw = 0; raw < res->headers.raw.count; ++raw) {
+					if (raw_hashes[raw] == hash && StrMatchICase(name, res->headers.raw.data[raw].name)) {
+						existing  = res->headers.raw.data[raw].value;
+						raw_index = raw;
 						break;
 					}
 				}
-				if (!prefix_present) {
-					LogErrorEx("Http", "Corrupt header received: missing HTTP prefix: " StrFmt, StrArg(line));
-					LogInfoEx("Http", "Received: " StrFmt, StrArg(String(res->buffer, res->length)));
-					Http_FlushRead(http, res);
-					return false;
-				}
+			}
 
-				line = StrTrim(line);
-				ptrdiff_t name_pos = StrFindChar(line, ' ');
-				if (name_pos < 0) {
-					LogErrorEx("Http", "Corrupt header received: missing status code");
-					LogInfoEx("Http", "Received: " StrFmt, StrArg(String(res->buffer, res->length)));
-					Http_FlushRead(http, res);
-					return false;
-				}
+			// Repeated headers are joined after the received bytes, so the body bytes are
+			// moved out of the way only when that space is needed
+			if (existing.length && parser->pending.data != parser->stream &&
+				res->length + existing.length + value.length + 1 > HTTP_MAX_HEADER_SIZE) {
+				memcpy(parser->stream, parser->pending.data, parser->pending.length);
+				parser->pending.data = parser->stream;
+				res->length          = header_length;
+			}
 
-				ptrdiff_t status_code;
-				if (!ParseInt(SubStr(line, 0, name_pos), &status_code)) {
-					LogErrorEx("Http", "Corrupt header received: invalid status code");
-					LogInfoEx("Http", "Received: " StrFmt, StrArg(String(res->buffer, res->length)));
-					Http_FlushRead(http, res);
-					return false;
-				} else if (status_code < 0) {
-					LogErrorEx("Http", "Corrupt header received: status code is negative");
-					LogInfoEx("Http", "Received: " StrFmt, StrArg(String(res->buffer, res->length)));
-					Http_FlushRead(http, res);
-					return false;
+			if (header_id >= 0) {
+				Http_AppendHeader(res, (Http_Header_Id)header_id, value);
+			} else if (raw_index >= 0) {
+				Http_AppendHeader(res, name, value);
+			} else {
+				if (res->headers.raw.count < HTTP_MAX_RAW_HEADERS) {
+					raw_hashes[res->headers.raw.count] = hash;
+					Http_SetHeader(res, name, value);
+				} else {
+					LogWarningEx("Http", "Custom header  \"" StrFmt "\" could not be added: out of memory", StrArg(name));
+				}
+			}
+		} else {
+			const String prefixes[] = { "HTTP/1.1 ", "HTTP/1.0 " };
+			constexpr Http_Version versions[] = { HTTP_VERSION_1_1, HTTP_VERSION_1_0 };
+			static_assert(ArrayCount(prefixes) == ArrayCount(versions), "");
+
+			bool prefix_present = false;
+			for (int index = 0; index < ArrayCount(prefixes); ++index) {
+				String prefix = prefixes[index];
+				if (StrStartsWithICase(line, prefix)) {
+					line = StrRemovePrefix(line, prefix.length);
+					res->status.version = versions[index];
+					prefix_present = true;
+					break;
 				}
+			}
+			if (!prefix_present) {
+				LogErrorEx("Http", "Corrupt header received: missing HTTP prefix: " StrFmt, StrArg(line));
+				LogInfoEx("Http", "Received: " StrFmt, StrArg(String(res->buffer, header_length)));
+				return false;
+			}
 
-				res->status.code = (uint32_t)status_code;
-				res->status.name = SubStr(line, name_pos + 1);
+			line = StrTrim(line);
+			ptrdiff_t name_pos = StrFindChar(line, ' ');
+			if (name_pos < 0) {
+				LogErrorEx("Http", "Corrupt header received: missing status code");
+				LogInfoEx("Http", "Received: " StrFmt, StrArg(String(res->buffer, header_length)));
+				return false;
+			}
 
-				state = PARSING_FIELDS;
+			ptrdiff_t status_code;
+			if (!ParseInt(SubStr(line, 0, name_pos), &status_code)) {
+				LogErrorEx("Http", "Corrupt header received: invalid status code");
+				LogInfoEx("Http", "Received: " StrFmt, StrArg(String(res->buffer, header_length)));
+				return false;
+			} else if (status_code < 0) {
+				LogErrorEx("Http", "Corrupt header received: status code is negative");
+				LogInfoEx("Http", "Received: " StrFmt, StrArg(String(res->buffer, header_length)));
+				return false;
 			}
+
+			res->status.code = (uint32_t)status_code;
+			res->status.name = SubStr(line, name_pos + 1);
 		}
 	}
 
+	return true;
+}
+
+static void Http_ParserBeginData(Http_Response_Parser *parser, Http_Response *res, Http_Writer writer, Http_Parser_State state, ptrdiff_t length) {
+	parser->state     = state;
+	parser->remaining = length;
+	parser->dst       = writer.reserve ? writer.reserve(res->headers, length, writer.context) : nullptr;
+	// If the reservation failed, the body is still read so that the connection stays usable
+	parser->discard   = !parser->dst && (writer.reserve || !writer.proc);
+}
+
+static void Http_ParserEndData(Http_Response_Parser *parser) {
+	parser->dst   = nullptr;
+	parser->state = parser->state == HTTP_PARSER_BODY ? HTTP_PARSER_DONE : HTTP_PARSER_CHUNK_END;
+}
+
+static bool Http_ParserBeginBody(Http_Response_Parser *parser, Http_Response *res, Http_Writer writer) {
+	// These have no body whatever Content-Length says, a 304 or a response to HEAD carries the length
+	// of the body that was not sent
+	uint32_t code = res->status.code;
+	if (parser->head || code < 200 || code == 204 || code == 304) {
+		parser->state = HTTP_PARSER_DONE;
+		return true;
+	}
+
 	// Body: Content-Length
 	const String content_length_value = res->headers.known[HTTP_HEADER_CONTENT_LENGTH];
 	if (content_length_value.length) {
 		ptrdiff_t content_length = 0;
-		if (!ParseInt(content_length_value, &content_length)) {
+		if (!ParseInt(content_length_value, &content_length) || content_length < parser->pending.length) {
 			LogErrorEx("Http", "Corrupt header received: invalid content length");
-			Http_FlushRead(http, res);
-			return false;
-		}
-
-		if (content_length < body_read) {
-			LogErrorEx("Http", "Corrupt header received: invalid content length");
-			Http_FlushRead(http, res);
 			return false;
 		}
 
-		if (body_read) {
-			writer.proc(res->headers, buffer, body_read, writer.context);
-		}
-
-		ptrdiff_t remaining = content_length - body_read;
-		while (remaining) {
-			int bytes_read = Http_Receive(http, buffer, (int)Minimum(remaining, HTTP_STREAM_CHUNK_SIZE));
-			if (bytes_read <= 0) return false;
-			writer.proc(res->headers, buffer, bytes_read, writer.context);
-			remaining -= bytes_read;
-		}
-	} else {
-		String transfer_encoding = res->headers.known[HTTP_HEADER_TRANSFER_ENCODING];
+		if (content_length)
+			Http_ParserBeginData(parser, res, writer, HTTP_PARSER_BODY, content_length);
+		else
+			parser->state = HTTP_PARSER_DONE;
+		return true;
+	}
 
-		// Transfer-Encoding: chunked
-		if (transfer_encoding.length && StrFindICase(transfer_encoding, "chunked") >= 0) {
-			ptrdiff_t chunk_read  = body_read;
+	// Transfer-Encoding: chunked
+	String transfer_encoding = res->headers.known[HTTP_HEADER_TRANSFER_ENCODING];
+	if (transfer_encoding.length && StrFindICase(transfer_encoding, "chunked") >= 0) {
+		parser->state = HTTP_PARSER_CHUNK_HEADER;
+		return true;
+	}
 
-			while (true) {
-				ptrdiff_t data_pos = -1;
+	parser->state = HTTP_PARSER_DONE;
+	return true;
+}
 
-				while (data_pos < 0) {
-					int bytes_read = Http_Receive(http, buffer + chunk_read, (HTTP_STREAM_CHUNK_SIZE - (int)chunk_read));
-					if (bytes_read <= 0) {
-						LogErrorEx("Http", "Failed to receive chunked data");
-						return false;
-					}
-					chunk_read += bytes_read;
-					data_pos = StrFind(String(buffer, chunk_read), "\r\n");
+static bool Http_ParserConsume(Http_Response_Parser *parser, Http_Response *res, Http_Writer writer) {
+	while (parser->pending.length && parser->state != HTTP_PARSER_DONE) {
+		if (parser->state == HTTP_PARSER_BODY || parser->state == HTTP_PARSER_CHUNK_DATA) {
+			ptrdiff_t length = Minimum(parser->pending.length, parser->remaining);
+			if (parser->dst) {
+				// Bytes received ahead are copied, the rest is received straight into the destination
+				memcpy(parser->dst, parser->pending.data, length);
+				parser->dst += length;
+			} else if (!parser->discard) {
+				writer.proc(res->headers, parser->pending.data, length, writer.context);
+			}
+			parser->pending    = StrRemovePrefix(parser->pending, length);
+			parser->remaining -= length;
+			if (!parser->remaining)
+				Http_ParserEndData(parser);
+		} else if (parser->state == HTTP_PARSER_CHUNK_HEADER) {
+			ptrdiff_t data_pos = StrFind(parser->pending, "\r\n");
+			if (data_pos < 0) {
+				if (parser->pending.length == HTTP_STREAM_CHUNK_SIZE) {
+					LogErrorEx("Http", "Transfer-Encoding: chunk header too large");
+					return false;
 				}
+				break;
+			}
 
-				while (data_pos >= 0) {
-					String chunk_header(buffer, chunk_read);
-					String length_str = SubStr(chunk_header, 0, data_pos);
+			ptrdiff_t chunk_length;
+			if (!ParseHex(SubStr(parser->pending, 0, data_pos), &chunk_length) || chunk_length < 0) {
+				LogErrorEx("Http", "Transfer-Encoding: invalid chunk size");
+				return false;
+			}
 
-					ptrdiff_t chunk_length;
-					if (!ParseHex(length_str, &chunk_length) || chunk_length < 0) {
-						LogErrorEx("Http", "Transfer-Encoding: invalid chunk size");
-						Http_FlushRead(http, res);
-						return false;
-					}
+			parser->pending      = StrRemovePrefix(parser->pending, data_pos + 2); // skip \r\n
+			parser->chunk_length = chunk_length;
 
-					data_pos += 2; // skip \r\n
-					ptrdiff_t streamed_chunk_len = chunk_read - data_pos;
-
-					if (chunk_length <= streamed_chunk_len) {
-						writer.proc(res->headers, buffer + data_pos, chunk_length, writer.context);
-						chunk_read -= (data_pos + chunk_length);
-						memmove(buffer, buffer + data_pos + chunk_length, chunk_read);
-					} else {
-						writer.proc(res->headers, buffer + data_pos, streamed_chunk_len, writer.context);
-
-						ptrdiff_t remaining = chunk_length - streamed_chunk_len;
-						while (remaining) {
-							int bytes_read = Http_Receive(http, buffer, (int)Minimum(remaining, HTTP_STREAM_CHUNK_SIZE));
-							if (bytes_read <= 0)
-								return false;
-							writer.proc(res->headers, buffer, bytes_read, writer.context);
-							remaining -= bytes_read;
-						}
-
-						chunk_read = 0;
-					}
+			if (chunk_length)
+				Http_ParserBeginData(parser, res, writer, HTTP_PARSER_CHUNK_DATA, chunk_length);
+			else
+				parser->state = HTTP_PARSER_CHUNK_END;
+		} else if (parser->state == HTTP_PARSER_CHUNK_END) {
+			if (parser->pending.length < 2)
+				break;
 
-					{
-						// Read the next "\r\n"
-						ptrdiff_t remaining = 2 - chunk_read;
-						while (remaining > 0) {
-							int bytes_read = Http_Receive(http, buffer + chunk_read, (HTTP_STREAM_CHUNK_SIZE - (int)chunk_read));
-							if (bytes_read <= 0) {
-								LogErrorEx("Http", "Failed to receive chunked data");
-								return false;
-							}
-							chunk_read += bytes_read;
-							remaining -= bytes_read;
-						}
-						if (buffer[0] == '\r' && buffer[1] == '\n') {
-							memmove(buffer, buffer + 2, chunk_read - 2);
-							chunk_read -= 2;
-						} else {
-							LogErrorEx("Http", "Invalid chunks present in the body");
-							return false;
-						}
-
-						if (chunk_length == 0)
-							return true;
-
-						data_pos = StrFind(String(buffer, chunk_read), "\r\n");
-					}
-				}
+			if (parser->pending[0] != '\r' || parser->pending[1] != '\n') {
+				LogErrorEx("Http", "Invalid chunks present in the body");
+				return false;
 			}
+
+			parser->pending = StrRemovePrefix(parser->pending, 2);
+			parser->state   = parser->chunk_length ? HTTP_PARSER_CHUNK_HEADER : HTTP_PARSER_DONE;
 		}
 	}
 
 	return true;
 }
 
-bool Http_CustomMethod(Http *http, const String method, const String endpoint, const Http_Query_Params &params, const Http_Request &req, Http_Reader reader, Http_Response *res, Http_Writer writer) {
-	uint8_t buffer[HTTP_STREAM_CHUNK_SIZE];
+static inline bool Http_ParserReceivesDirect(Http_Response_Parser *parser) {
+	return parser->dst && !parser->pending.length;
+}
 
-	{
-		ptrdiff_t len = Http_BuildRequest(method, endpoint, &params, req, buffer, HTTP_STREAM_CHUNK_SIZE);
-		if (len < 0) {
-			LogErrorEx("Http", "Writing header failed: out of memory");
-			return false;
-		}
+// Returns the memory where the next received bytes must be written
+static String Http_ParserNextRead(Http_Response_Parser *parser, Http_Response *res) {
+	if (parser->state == HTTP_PARSER_HEADER)
+		return String(res->buffer + parser->received, HTTP_MAX_HEADER_SIZE - parser->received);
 
-		if (!Http_SendRequest(http, String(buffer, len), reader))
-			return false;
+	if (Http_ParserReceivesDirect(parser))
+		return String(parser->dst, Minimum(parser->remaining, INT32_MAX));
+
+	// Only the unparsed tail (partial chunk header) is moved to the front, body bytes never are
+	if (parser->pending.data != parser->stream) {
+		memmove(parser->stream, parser->pending.data, parser->pending.length);
+		parser->pending.data = parser->stream;
 	}
 
-	Http_InitResponse(res);
+	ptrdiff_t length = HTTP_STREAM_CHUNK_SIZE - parser->pending.length;
+	if (parser->state == HTTP_PARSER_BODY || parser->state == HTTP_PARSER_CHUNK_DATA)
+		length = Minimum(length, parser->remaining);
 
-	bool received = Http_ReceiveResponse(http, res, writer);
-	return received;
+	return String(parser->stream + parser->pending.length, length);
 }
 
-bool Http_Post(Http *http, const String endpoint, const Http_Query_Params &params, const Http_Request &req, Http_Reader reader, Http_Response *res, Http_Writer writer) {
-	return Http_CustomMethod(http, "POST", endpoint, params, req, reader, res, writer);
-}
+// Advances the parser by the number of bytes received into the memory given by Http_ParserNextRead
+static bool Http_ParserAdvance(Http_Response_Parser *parser, Http_Response *res, Http_Writer writer, ptrdiff_t bytes_read) {
+	if (parser->state == HTTP_PARSER_HEADER) {
+		Assert(res->buffer[0] != '\n');
 
-bool Http_Get(Http *http, const String endpoint, const Http_Query_Params &params, const Http_Request &req, Http_Reader reader, Http_Response *res, Http_Writer writer) {
-	return Http_CustomMethod(http, "GET", endpoint, params, req, reader, res, writer);
-}
+		parser->received += bytes_read;
 
-bool Http_Put(Http *http, const String endpoint, const Http_Query_Params &params, const Http_Request &req, Http_Reader reader, Http_Response *res, Http_Writer writer) {
-	return Http_CustomMethod(http, "PUT", endpoint, params, req, reader, res, writer);
-}
+		Http_ScanHeader(&parser->scanner, res->buffer, parser->received);
 
-//
-//
-//
+		if (parser->scanner.overflow) {
+			LogErrorEx("Http", "Reader header failed: too many fields");
+			return false;
+		}
 
-bool Http_CustomMethod(Http *http, const String method, const String endpoint, const Http_Request &req, Http_Reader reader, Http_Response *res, Http_Writer writer) {
-	Http_Query_Params params;
-	return Http_CustomMethod(http, method, endpoint, params, req, reader, res, writer);
-}
+		if (!parser->scanner.length) {
+			if (parser->received < HTTP_MAX_HEADER_SIZE)
+				return true;
+			LogErrorEx("Http", "Reader header failed: out of memory");
+			return false;
+		}
 
-bool Http_Post(Http *http, const String endpoint, const Http_Request &req, Http_Reader reader, Http_Response *res, Http_Writer writer) {
-	return Http_CustomMethod(http, "POST", endpoint, req, reader, res, writer);
-}
+		ptrdiff_t header_length = parser->scanner.length;
 
-bool Http_Get(Http *http, const String endpoint, const Http_Request &req, Http_Reader reader, Http_Response *res, Http_Writer writer) {
-	return Http_CustomMethod(http, "GET", endpoint, req, reader, res, writer);
-}
+		// Body bytes received with the header are left in place, appended header
+		// values are written after them
+		parser->pending = String(res->buffer + header_length, parser->received - header_length);
+		res->length     = parser->received;
 
-bool Http_Put(Http *http, const String endpoint, const Http_Request &req, Http_Reader reader, Http_Response *res, Http_Writer writer) {
+		if (!Http_ParseHeader(parser, res, header_length))
+			return false;
+
+		// Interim responses (100 Continue, 103 Early Hints) have no body and precede the final response,
+		// the bytes after it are parsed again as the start of a new header
+		if (res->status.code >= 100 && res->status.code < 200 && res->status.code != 101) {
+			ptrdiff_t pending = parser->pending.length;
+			memmove(res->buffer, parser->pending.data, pending);
+			res->status      = Http_Status{};
+			res->headers     = Http_Header{};
+			res->length      = 0;
+			parser->received = 0;
+			parser->pending  = String();
+			parser->interim  = true;
+			Http_ScannerInit(&parser->scanner);
+			return pending ? Http_ParserAdvance(parser, res, writer, pending) : true;
+		}
+
+		if (!Http_ParserBeginBody(parser, res, writer))
+			return false;
+
+		return Http_ParserConsume(parser, res, writer);
+	}
+
+	if (Http_ParserReceivesDirect(parser)) {
+		parser->dst       += bytes_read;
+		parser->remaining -= bytes_read;
+		if (!parser->remaining)
+			Http_ParserEndData(parser);
+		return true;
+	}
+
+	parser->pending.length += bytes_read;
+	return Http_ParserConsume(parser, res, writer);
+}
+
+static bool Http_ReceiveParsed(Http *http, Http_Response_Parser *parser, Http_Response *res, Http_Writer writer) {
+	while (parser->state != HTTP_PARSER_DONE) {
+		String dst = Http_ParserNextRead(parser, res);
+
+		int bytes_read = Http_Receive(http, dst.data, (int)dst.length);
+		if (bytes_read <= 0) {
+			if (Net_GetLastError((Net_Socket *)http) == NET_E_TIMED_OUT)
+				res->timeout = parser->state == HTTP_PARSER_HEADER ? HTTP_PHASE_HEADER : HTTP_PHASE_BODY;
+			return false;
+		}
+
+		if (!Http_ParserAdvance(parser, res, writer, bytes_read)) {
+			Http_FlushRead(http, res);
+			return false;
+		}
+	}
+
+	return true;
+}
+
+bool Http_ReceiveResponse(Http *http, Http_Response *res, Http_Writer writer, bool head) {
+	ProfileZone("Http_ReceiveResponse");
+
+	Http_Response_Parser parser;
+	Http_ParserInit(&parser, head);
+	return Http_ReceiveParsed(http, &parser, res, writer);
+}
+
+//
+//
+//
+
+constexpr int HTTP_CONTINUE_TIMEOUT_MS = 1000;
+
+static bool Http_ShouldExpectContinue(const Http_Request &req, Http_Reader reader) {
+	if (!reader.proc || req.expect_continue < 0 || req.headers.known[HTTP_HEADER_EXPECT].length)
+		return false;
+
+	// Chunked bodies have no known length, they are sent without waiting
+	String    content_length = req.headers.known[HTTP_HEADER_CONTENT_LENGTH];
+	ptrdiff_t length         = 0;
+	if (!content_length.length || !ParseInt(content_length, &length))
+		return false;
+
+	ptrdiff_t threshold = req.expect_continue ? req.expect_continue : HTTP_EXPECT_CONTINUE_SIZE;
+	return length >= threshold;
+}
+
+// Adds 'Expect: 100-continue' to the end of the header built by Http_BuildRequest
+static ptrdiff_t Http_AppendExpectContinue(uint8_t *buffer, ptrdiff_t length, ptrdiff_t buff_len) {
+	const String expect = "Expect: 100-continue\r\n\r\n";
+	if (length + expect.length - 2 > buff_len)
+		return -1;
+	memcpy(buffer + length - 2, expect.data, expect.length);
+	return length + expect.length - 2;
+}
+
+enum Http_Continue {
+	HTTP_CONTINUE_SEND,
+	HTTP_CONTINUE_FINAL,
+	HTTP_CONTINUE_FAILED,
+};
+
+// Waits for '100 Continue' for at most HTTP_CONTINUE_TIMEOUT_MS, servers that ignore the expectation
+// get the body once it elapses. A final status received instead is left in the parser.
+static Http_Continue Http_AwaitContinue(Http *http, Http_Response_Parser *parser, Http_Response *res, Http_Writer writer) {
+	Net_Socket *socket = Http_GetSocket(http);
+	uint64_t limit     = MonotonicMillisecs() + HTTP_CONTINUE_TIMEOUT_MS;
+
+	while (parser->state == HTTP_PARSER_HEADER && !parser->interim) {
+		uint64_t now = MonotonicMillisecs();
+		if (now >= limit)
+			return HTTP_CONTINUE_SEND;
+
+		String dst = Http_ParserNextRead(parser, res);
+
+		int bytes_read = Net_ReceiveBlocked(socket, dst.data, (int)dst.length, (int)(limit - now));
+		if (bytes_read < 0) {
+			if (Net_GetLastError(socket) == NET_E_TIMED_OUT) {
+				LogErrorEx("Http", "Receiving timed out");
+				res->timeout = HTTP_PHASE_HEADER;
+			}
+			return HTTP_CONTINUE_FAILED;
+		}
+
+		if (!Http_ParserAdvance(parser, res, writer, bytes_read)) {
+			Http_FlushRead(http, res);
+			return HTTP_CONTINUE_FAILED;
+		}
+	}
+
+	return parser->state == HTTP_PARSER_HEADER ? HTTP_CONTINUE_SEND : HTTP_CONTINUE_FINAL;
+}
+
+static bool Http_SendExpectContinue(Http *http, const String header, Http_Reader reader, Http_Response *res, Http_Writer writer, bool head) {
+	Http_Response_Parser parser;
+	Http_ParserInit(&parser, head);
+
+	if (!Http_IterateSend(http, header.data, header.length)) {
+		if (Net_GetLastError(Http_GetSocket(http)) == NET_E_TIMED_OUT)
+			res->timeout = HTTP_PHASE_SEND;
+		return false;
+	}
+
+	Http_Continue next = Http_AwaitContinue(http, &parser, res, writer);
+	if (next == HTTP_CONTINUE_FAILED)
+		return false;
+
+	if (next == HTTP_CONTINUE_SEND) {
+		if (!Http_SendBody(http, reader)) {
+			if (Net_GetLastError(Http_GetSocket(http)) == NET_E_TIMED_OUT)
+				res->timeout = HTTP_PHASE_SEND;
+			return false;
+		}
+		return Http_ReceiveParsed(http, &parser, res, writer);
+	}
+
+	if (!Http_ReceiveParsed(http, &parser, res, writer))
+		return false;
+
+	// The server may still be waiting for the body that was never sent, so the connection can not
+	// be used for the next request
+	if (!Http_Reconnect(http))
+		LogWarningEx("Http", "Reconnecting after a rejected upload failed");
+
+	return true;
+}
+
+bool Http_CustomMethod(Http *http, const String method, const String endpoint, const Http_Query_Params &params, const Http_Request &req, Http_Reader reader, Http_Response *res, Http_Writer writer) {
+	uint8_t buffer[HTTP_STREAM_CHUNK_SIZE];
+
+	Http_InitResponse(res);
+
+	Net_Socket *socket = Http_GetSocket(http);
+	Net_SetDeadline(socket, req.deadline);
+	Defer{ Net_SetDeadline(socket, 0); };
+
+	bool head = method == "HEAD";
+
+	{
+		ptrdiff_t len = Http_BuildRequest(method, endpoint, &params, req, buffer, HTTP_STREAM_CHUNK_SIZE);
+		if (len < 0) {
+			LogErrorEx("Http", "Writing header failed: out of memory");
+			return false;
+		}
+
+		if (Http_ShouldExpectContinue(req, reader)) {
+			len = Http_AppendExpectContinue(buffer, len, HTTP_STREAM_CHUNK_SIZE);
+			if (len < 0) {
+				LogErrorEx("Http", "Writing header failed: out of memory");
+				return false;
+			}
+			return Http_SendExpectContinue(http, String(buffer, len), reader, res, writer, head);
+		}
+
+		if (!Http_SendRequest(http, String(buffer, len), reader)) {
+			if (Net_GetLastError(socket) == NET_E_TIMED_OUT)
+				res->timeout = HTTP_PHASE_SEND;
+			return false;
+		}
+	}
+
+	bool received = Http_ReceiveResponse(http, res, writer, head);
+	return received;
+}
+
+bool Http_Post(Http *http, const String endpoint, const Http_Query_Params &params, const Http_Request &req, Http_Reader reader, Http_Response *res, Http_Writer writer) {
+	return Http_CustomMethod(http, "POST", endpoint, params, req, reader, res, writer);
+}
+
+bool Http_Get(Http *http, const String endpoint, const Http_Query_Params &params, const Http_Request &req, Http_Reader reader, Http_Response *res, Http_Writer writer) {
+	return Http_CustomMethod(http, "GET", endpoint, params, req, reader, res, writer);
+}
+
+bool Http_Put(Http *http, const String endpoint, const Http_Query_Params &params, const Http_Request &req, Http_Reader reader, Http_Response *res, Http_Writer writer) {
+	return Http_CustomMethod(http, "PUT", endpoint, params, req, reader, res, writer);
+}
+
+//
+//
+//
+
+bool Http_CustomMethod(Http *http, const String method, const String endpoint, const Http_Request &req, Http_Reader reader, Http_Response *res, Http_Writer writer) {
+	Http_Query_Params params;
+	return Http_CustomMethod(http, method, endpoint, params, req, reader, res, writer);
+}
+
+bool Http_Post(Http *http, const String endpoint, const Http_Request &req, Http_Reader reader, Http_Response *res, Http_Writer writer) {
+	return Http_CustomMethod(http, "POST", endpoint, req, reader, res, writer);
+}
+
+bool Http_Get(Http *http, const String endpoint, const Http_Request &req, Http_Reader reader, Http_Response *res, Http_Writer writer) {
+	return Http_CustomMethod(http, "GET", endpoint, req, reader, res, writer);
+}
+
+bool Http_Put(Http *http, const String endpoint, const Http_Request &req, Http_Reader reader, Http_Response *res, Http_Writer writer) {
 	return Http_CustomMethod(http, "PUT", endpoint, req, reader, res, writer);
 }
 
@@ -914,6 +1473,23 @@ static void Http_ArenaWriterProc(Http_Header &header, uint8_t *buffer, ptrdiff_t
 	writer->length = -1;
 }
 
+static uint8_t *Http_ArenaWriterReserve(Http_Header &header, ptrdiff_t length, void *context) {
+	Http_Arena_Writer *writer = (Http_Arena_Writer *)context;
+	if (writer->length >= 0) {
+		uint8_t *dst = (uint8_t *)PushSize(writer->arena, length);
+		if (dst) {
+			Assert(dst == writer->last_pos);
+			writer->last_pos = dst + length;
+			writer->length += length;
+			return dst;
+		}
+	}
+	Net_SetError((Net_Socket *)writer->socket, NET_E_OUT_OF_MEMORY);
+	LogErrorEx("Http", "Receiving body failed: arena writer out of memory");
+	writer->length = -1;
+	return nullptr;
+}
+
 bool Http_CustomMethod(Http *http, const String method, const String endpoint, const Http_Query_Params &params, const Http_Request &req, Http_Reader reader, Http_Response *res, Memory_Arena *arena) {
 	uint8_t *body = (uint8_t *)MemoryArenaGetCurrent(arena);
 	auto temp     = BeginTemporaryMemory(arena);
@@ -927,6 +1503,7 @@ bool Http_CustomMethod(Http *http, const String method, const String endpoint, c
 	Http_Writer writer;
 	writer.proc    = Http_ArenaWriterProc;
 	writer.context = &arena_writer;
+	writer.reserve = Http_ArenaWriterReserve;
 
 	bool result = Http_CustomMethod(http, method, endpoint, params, req, reader, res, writer);
 	if (result && arena_writer.length >= 0) {
@@ -1046,6 +1623,19 @@ static void Http_BufferWriterProc(Http_Header &header, uint8_t *buffer, ptrdiff_
 	writer->written = -1;
 }
 
+static uint8_t *Http_BufferWriterReserve(Http_Header &header, ptrdiff_t length, void *context) {
+	Http_Buffer_Writer *writer = (Http_Buffer_Writer *)context;
+	if (writer->written >= 0 && writer->written + length <= writer->length) {
+		uint8_t *dst = writer->buffer + writer->written;
+		writer->written += length;
+		return dst;
+	}
+	Net_SetError((Net_Socket *)writer->socket, NET_E_OUT_OF_MEMORY);
+	LogErrorEx("Http", "Receiving body failed: buffer writer out of memory");
+	writer->written = -1;
+	return nullptr;
+}
+
 bool Http_CustomMethod(Http *http, const String method, const String endpoint, const Http_Query_Params &params, const Http_Request &req, Http_Reader reader, Http_Response *res, uint8_t *memory, ptrdiff_t length) {
 	Http_Buffer_Writer buffer_writer;
 	buffer_writer.written = 0;
@@ -1054,8 +1644,9 @@ bool Http_CustomMethod(Http *http, const String method, const String endpoint, c
 	buffer_writer.socket = http;
 
 	Http_Writer writer;
-	writer.proc = Http_BufferWriterProc;
+	writer.proc    = Http_BufferWriterProc;
 	writer.context = &buffer_writer;
+	writer.reserve = Http_BufferWriterReserve;
 
 	bool result = Http_CustomMethod(http, method, endpoint, params, req, reader, res, writer);
 	if (result && buffer_writer.written >= 0) {
@@ -1112,6 +1703,7 @@ bool Http_CustomMethod(Http *http, const String method, const String endpoint, c
 	Http_Writer writer;
 	writer.proc    = Http_BufferWriterProc;
 	writer.context = &buffer_writer;
+	writer.reserve = Http_BufferWriterReserve;
 
 	bool result = Http_CustomMethod(http, method, endpoint, params, req, res, writer);
 	if (result && buffer_writer.written >= 0) {
@@ -1167,88 +1759,2256 @@ Http_Multipart Http_MultipartBegin(Memory_Arena *arena) {
 	for (int i = 12; i < sizeof(mt.boundary); ++i) {
 		mt.boundary[i] = AlphaNums[rand() % AlphaNums.length];
 	}
-	mt.memory  = (uint8_t *)MemoryArenaGetCurrent(arena);
-	mt.current = mt.memory;
-	mt.length  = 0;
+	mt.length = 0;
+	mt.first  = nullptr;
+	mt.last   = nullptr;
 	return mt;
 }
 
-bool Http_MultipartData(Http_Multipart *mt, String content, String content_disposition) {
-	uint8_t header[HTTP_MAX_HEADER_SIZE];
-
-	int hlen = snprintf((char *)header, HTTP_MAX_HEADER_SIZE,
-		"--" StrFmt "\r\n"
-		"Content-Disposition: form-data; " StrFmt "\r\n\r\n",
-		StrArg(String(mt->boundary, HTTP_MULTIPART_LENGTH)),
-		StrArg(content_disposition));
-
-	ptrdiff_t length = hlen + content.length + 2;
-
-	uint8_t *dst = (uint8_t *)PushSize(mt->arena, length);
-	if (!dst) {
+static bool Http_MultipartPush(Http_Multipart *mt, Http_Segment_Kind kind, String content, ptrdiff_t length) {
+	Http_Segment *segment = PushType(mt->arena, Http_Segment);
+	if (!segment) {
 		LogErrorEx("Http", "Could not add data to multipart. Reason: Out of memory");
 		return false;
 	}
 
-	Assert(dst == mt->current);
+	segment->next    = nullptr;
+	segment->kind    = kind;
+	segment->content = content;
+	segment->length  = length;
 
-	memcpy(dst, header, hlen);
-	memcpy(dst + hlen, content.data, content.length);
-	dst[length - 2] = '\r';
-	dst[length - 1] = '\n';
+	if (mt->last)
+		mt->last->next = segment;
+	else
+		mt->first = segment;
+	mt->last = segment;
 
 	mt->length += length;
-	mt->current = dst + length;
 
 	return true;
 }
 
-bool Http_MultipartData(Http_Multipart *mt, String content, String content_type, String content_disposition) {
+static bool Http_MultipartHeader(Http_Multipart *mt, String content_type, String content_disposition) {
 	uint8_t header[HTTP_MAX_HEADER_SIZE];
 
-	int hlen = snprintf((char *)header, HTTP_MAX_HEADER_SIZE,
-		"--" StrFmt "\r\n"
-		"Content-Disposition: form-data; " StrFmt "\r\n"
-		"Content-Type: " StrFmt "\r\n\r\n",
-		StrArg(String(mt->boundary, HTTP_MULTIPART_LENGTH)),
-		StrArg(content_disposition),
-		StrArg(content_type));
-
-	ptrdiff_t length = hlen + content.length + 2;
+	int hlen;
+	if (content_type.length) {
+		hlen = snprintf((char *)header, HTTP_MAX_HEADER_SIZE,
+			"--" StrFmt "\r\n"
+			"Content-Disposition: form-data; " StrFmt "\r\n"
+			"Content-Type: " StrFmt "\r\n\r\n",
+			StrArg(String(mt->boundary, HTTP_MULTIPART_LENGTH)),
+			StrArg(content_disposition),
+			StrArg(content_type));
+	} else {
+		hlen = snprintf((char *)header, HTTP_MAX_HEADER_SIZE,
+			"--" StrFmt "\r\n"
+			"Content-Disposition: form-data; " StrFmt "\r\n\r\n",
+			StrArg(String(mt->boundary, HTTP_MULTIPART_LENGTH)),
+			StrArg(content_disposition));
+	}
 
-	uint8_t *dst = (uint8_t *)PushSize(mt->arena, length);
+	uint8_t *dst = (uint8_t *)PushSize(mt->arena, hlen);
 	if (!dst) {
 		LogErrorEx("Http", "Could not add data to multipart. Reason: Out of memory");
 		return false;
 	}
 
-	Assert(dst == mt->current);
-
 	memcpy(dst, header, hlen);
-	memcpy(dst + hlen, content.data, content.length);
-	dst[length - 2] = '\r';
-	dst[length - 1] = '\n';
+	return Http_MultipartPush(mt, HTTP_SEGMENT_MEMORY, String(dst, hlen), hlen);
+}
 
-	mt->length += length;
-	mt->current = dst + length;
+// Content is only referenced, it must stay valid until the request is sent
+bool Http_MultipartData(Http_Multipart *mt, String content, String content_disposition) {
+	return Http_MultipartData(mt, content, String(), content_disposition);
+}
 
-	return true;
+bool Http_MultipartData(Http_Multipart *mt, String content, String content_type, String content_disposition) {
+	if (!Http_MultipartHeader(mt, content_type, content_disposition))
+		return false;
+	if (!Http_MultipartPush(mt, HTTP_SEGMENT_MEMORY, content, content.length))
+		return false;
+	return Http_MultipartPush(mt, HTTP_SEGMENT_MEMORY, "\r\n", 2);
+}
+
+// fseek and ftell take a long, 32 bits on Windows, files over 2 GB need the 64-bit ones
+static bool Http_FileSeek(FILE *fp, int64_t offset, int origin) {
+#if PLATFORM_WINDOWS
+	return _fseeki64(fp, offset, origin) == 0;
+#else
+	return fseeko(fp, (off_t)offset, origin) == 0;
+#endif
+}
+
+static int64_t Http_FileTell(FILE *fp) {
+#if PLATFORM_WINDOWS
+	return _ftelli64(fp);
+#else
+	return (int64_t)ftello(fp);
+#endif
+}
+
+bool Http_MultipartFile(Http_Multipart *mt, String path, String content_type, String content_disposition) {
+	String filepath = StrDup(path, mt->arena);
+	if (!filepath.data) {
+		LogErrorEx("Http", "Could not add file to multipart. Reason: Out of memory");
+		return false;
+	}
+
+	FILE *fp = fopen((char *)filepath.data, "rb");
+	if (!fp) {
+		LogErrorEx("Http", "Could not add file to multipart. Reason: Failed to open \"" StrFmt "\"", StrArg(path));
+		return false;
+	}
+
+	int64_t length = Http_FileSeek(fp, 0, SEEK_END) ? Http_FileTell(fp) : -1;
+	fclose(fp);
+
+	if (length < 0) {
+		LogErrorEx("Http", "Could not add file to multipart. Reason: Failed to read \"" StrFmt "\"", StrArg(path));
+		return false;
+	}
+
+	if (!Http_MultipartHeader(mt, content_type, content_disposition))
+		return false;
+	if (!Http_MultipartPush(mt, HTTP_SEGMENT_FILE, filepath, (ptrdiff_t)length))
+		return false;
+	return Http_MultipartPush(mt, HTTP_SEGMENT_MEMORY, "\r\n", 2);
 }
 
-String Http_MultipartEnd(Http_Multipart *mt) {
+bool Http_MultipartEnd(Http_Multipart *mt) {
 	uint8_t *dst = (uint8_t *)PushSize(mt->arena, 2 + HTTP_MULTIPART_LENGTH + 2);
 	if (!dst)
-		return String();
-
-	Assert(dst == mt->current);
-	mt->current = dst;
+		return false;
 
 	memcpy(dst + 2, mt->boundary, HTTP_MULTIPART_LENGTH);
 	dst[0] = '-';
 	dst[1] = '-';
 	dst[HTTP_MULTIPART_LENGTH + 2 + 0] = '-';
 	dst[HTTP_MULTIPART_LENGTH + 2 + 1] = '-';
-	mt->length += (2 + HTTP_MULTIPART_LENGTH + 2);
 
-	return String(mt->memory, mt->length);
+	return Http_MultipartPush(mt, HTTP_SEGMENT_MEMORY, String(dst, 2 + HTTP_MULTIPART_LENGTH + 2), 2 + HTTP_MULTIPART_LENGTH + 2);
+}
+
+static int Http_MultipartReaderProc(uint8_t *buffer, int length, void *context) {
+	Http_Multipart_Reader *reader = (Http_Multipart_Reader *)context;
+
+	int written = 0;
+
+	while (written < length && reader->segment) {
+		Http_Segment *segment = reader->segment;
+		ptrdiff_t     count   = Minimum(length - written, segment->length - reader->offset);
+
+		if (segment->kind == HTTP_SEGMENT_MEMORY) {
+			memcpy(buffer + written, segment->content.data + reader->offset, count);
+		} else {
+			if (!reader->file) {
+				reader->file = fopen((char *)segment->content.data, "rb");
+				if (!reader->file) {
+					LogErrorEx("Http", "Multipart: Failed to open \"" StrFmt "\"", StrArg(segment->content));
+					return -1;
+				}
+			}
+			if (fread(buffer + written, 1, count, (FILE *)reader->file) != (size_t)count) {
+				LogErrorEx("Http", "Multipart: Failed to read \"" StrFmt "\"", StrArg(segment->content));
+				fclose((FILE *)reader->file);
+				reader->file = nullptr;
+				return -1;
+			}
+		}
+
+		written        += (int)count;
+		reader->offset += count;
+
+		if (reader->offset == segment->length) {
+			if (reader->file) {
+				fclose((FILE *)reader->file);
+				reader->file = nullptr;
+			}
+			reader->segment = segment->next;
+			reader->offset  = 0;
+		}
+	}
+
+	return written;
+}
+
+Http_Reader Http_MultipartReader(Http_Multipart_Reader *reader, Http_Multipart *mt) {
+	reader->segment = mt->first;
+	reader->offset  = 0;
+	reader->file    = nullptr;
+
+	Http_Reader result;
+	result.proc    = Http_MultipartReaderProc;
+	result.context = reader;
+	return result;
+}
+
+//
+//
+//
+
+enum Http_Task_State {
+	HTTP_TASK_QUEUED,
+	HTTP_TASK_CONNECTING,
+	HTTP_TASK_HANDSHAKING,
+	HTTP_TASK_SENDING,
+	HTTP_TASK_RECEIVING,
+	HTTP_TASK_COMPLETED,
+};
+
+struct Http_Task {
+	Http_Task *          next;
+	Http_Client *        client;
+	Memory_Allocator     allocator;
+	int32_t volatile     refcount;
+	int32_t volatile     cancelled;
+	int32_t volatile     result;
+	Http_Task_State      state;
+	bool                 reused;      // sent over a kept-alive connection
+	bool                 head;        // the response has no body
+	bool                 restartable; // body is sent from memory and can be sent again
+	int                  attempts;
+	uint64_t             deadline;
+	Http_Reader          reader;
+	Http_Writer          writer;
+	Http_Response *      res;
+	Http_Completion      completion;
+	Http_Buffer_Reader   body;
+	uint8_t *            out;
+	ptrdiff_t            out_length;
+	ptrdiff_t            sent;
+	bool                 body_sent;
+	ptrdiff_t            header_length;
+	uint8_t              header[HTTP_STREAM_CHUNK_SIZE];
+	uint8_t              chunk[HTTP_STREAM_CHUNK_SIZE];
+	Http_Response_Parser parser;
+};
+
+struct Http_Task_List {
+	Http_Task *first;
+	Http_Task *last;
+};
+
+struct Http_Client_Connection {
+	Http *     http;
+	Http_Task *task;
+	bool       used;
+	short      events; // what the connect or the handshake waits on
+};
+
+struct Http_Client {
+	String                 host;
+	String                 port;
+	Http_Connection        connection;
+	Memory_Allocator       allocator;
+	Thread *               thread;
+	int32_t volatile       running;
+	int32_t volatile       woken;  // a wake is sent and not read yet
+	Net_Socket *           wakeup; // in the poll set of the client's thread
+	Semaphore *            completed;
+	Atomic_Guard           submit_guard;
+	Http_Task_List         submitted;
+	Atomic_Guard           completion_guard;
+	Http_Task_List         completions;
+	Http_Task_List         pending;     // only touched by the client's thread
+	int                    connection_count;
+	Http_Client_Connection connections[HTTP_CLIENT_MAX_CONNECTIONS];
+};
+
+static void Http_TaskListPush(Http_Task_List *list, Http_Task *task) {
+	task->next = nullptr;
+	if (list->last)
+		list->last->next = task;
+	else
+		list->first = task;
+	list->last = task;
+}
+
+static void Http_TaskListPushFront(Http_Task_List *list, Http_Task *task) {
+	task->next  = list->first;
+	list->first = task;
+	if (!list->last)
+		list->last = task;
+}
+
+static void Http_TaskListAppend(Http_Task_List *list, Http_Task_List *other) {
+	if (!other->first) return;
+	if (list->last)
+		list->last->next = other->first;
+	else
+		list->first = other->first;
+	list->last = other->last;
+}
+
+static Http_Task *Http_TaskListPop(Http_Task_List *list) {
+	Http_Task *task = list->first;
+	if (task) {
+		list->first = task->next;
+		if (!list->first)
+			list->last = nullptr;
+		task->next = nullptr;
+	}
+	return task;
+}
+
+static Http_Phase Http_TaskPhase(Http_Task *task) {
+	if (task->state == HTTP_TASK_QUEUED)
+		return HTTP_PHASE_QUEUED;
+	if (task->state == HTTP_TASK_CONNECTING)
+		return HTTP_PHASE_CONNECT;
+	if (task->state == HTTP_TASK_HANDSHAKING)
+		return HTTP_PHASE_HANDSHAKE;
+	if (task->state == HTTP_TASK_SENDING)
+		return HTTP_PHASE_SEND;
+	return task->parser.state == HTTP_PARSER_HEADER ? HTTP_PHASE_HEADER : HTTP_PHASE_BODY;
+}
+
+static void Http_TaskComplete(Http_Client *client, Http_Task *task, Http_Result result, Http_Phase timeout = HTTP_PHASE_NONE) {
+	task->res->timeout = timeout;
+	task->state        = HTTP_TASK_COMPLETED;
+	AtomicStore(&task->result, result);
+
+	if (task->completion.proc) {
+		task->completion.proc(task, result, task->res, task->completion.context);
+		Http_ReleaseTask(task);
+		return;
+	}
+
+	SpinLock(&client->completion_guard);
+	Http_TaskListPush(&client->completions, task);
+	SpinUnlock(&client->completion_guard);
+	Semaphore_Signal(client->completed);
+}
+
+static void Http_TaskStart(Http_Task *task, Http_Client_Connection *conn) {
+	task->state      = HTTP_TASK_SENDING;
+	task->reused     = conn->used;
+	task->attempts  += 1;
+	task->out        = task->header;
+	task->out_length = task->header_length;
+	task->sent       = 0;
+	task->body_sent  = false;
+	if (task->restartable)
+		task->body.written = 0;
+
+	Http_InitResponse(task->res);
+	Http_ParserInit(&task->parser, task->head);
+
+	conn->task = task;
+	conn->used = true;
+}
+
+// New connections are connected by the client's thread along with the other sockets, the TLS handshake
+// is started once the connect is done
+static bool Http_TaskConnect(Http_Client *client, Http_Client_Connection *conn) {
+	Http_Task * task   = conn->task;
+	Net_Socket *socket = Http_GetSocket(conn->http);
+
+	while (task->state != HTTP_TASK_SENDING) {
+		Net_Connect_Status status = Net_ContinueConnection(socket);
+		if (status == NET_CONNECT_FAILED)
+			return false;
+
+		if (status != NET_CONNECT_DONE) {
+			conn->events = status == NET_CONNECT_WAIT_READ ? POLLRDNORM : POLLWRNORM;
+			return true;
+		}
+
+		if (task->state == HTTP_TASK_CONNECTING && client->connection == HTTPS_CONNECTION) {
+			if (!Net_StartSecureChannel(socket, true))
+				return false;
+			task->state = HTTP_TASK_HANDSHAKING;
+		} else {
+			task->state = HTTP_TASK_SENDING;
+		}
+	}
+
+	return true;
+}
+
+static short Http_TaskEvents(Http_Client_Connection *conn) {
+	Http_Task_State state = conn->task->state;
+	if (state == HTTP_TASK_CONNECTING || state == HTTP_TASK_HANDSHAKING)
+		return conn->events;
+	return state == HTTP_TASK_SENDING ? POLLWRNORM : POLLRDNORM;
+}
+
+static bool Http_TaskSend(Http_Task *task, Net_Socket *socket) {
+	while (true) {
+		if (task->sent == task->out_length) {
+			if (!task->body_sent) {
+				int length = task->reader.proc(task->chunk, HTTP_STREAM_CHUNK_SIZE, task->reader.context);
+				if (length < 0)
+					return false;
+				if (length) {
+					task->out        = task->chunk;
+					task->out_length = length;
+					task->sent       = 0;
+					continue;
+				}
+				task->body_sent = true;
+			}
+			task->state = HTTP_TASK_RECEIVING;
+			return true;
+		}
+
+		int sent = Net_Send(socket, task->out + task->sent, (int)(task->out_length - task->sent));
+		if (sent < 0) return false;
+		if (sent == 0) return true;
+		task->sent += sent;
+	}
+}
+
+static bool Http_TaskReceive(Http_Task *task, Net_Socket *socket) {
+	while (task->parser.state != HTTP_PARSER_DONE) {
+		String dst = Http_ParserNextRead(&task->parser, task->res);
+
+		int bytes_read = Net_Receive(socket, dst.data, (int)dst.length);
+		if (bytes_read < 0) return false;
+		if (bytes_read == 0) return true;
+
+		if (!Http_ParserAdvance(&task->parser, task->res, task->writer, bytes_read))
+			return false;
+	}
+	return true;
+}
+
+static void Http_ClientRelease(Http_Client_Connection *conn, bool keep_alive) {
+	conn->task = nullptr;
+	if (!keep_alive) {
+		Http_Disconnect(conn->http);
+		conn->http = nullptr;
+	}
+}
+
+static void Http_ClientFinish(Http_Client *client, Http_Client_Connection *conn) {
+	Http_Task *task = conn->task;
+
+	String connection = task->res->headers.known[HTTP_HEADER_CONNECTION];
+	bool keep_alive   = task->res->status.version == HTTP_VERSION_1_1 && StrFindICase(connection, "close") < 0;
+
+	Http_ClientRelease(conn, keep_alive);
+	Http_TaskComplete(client, task, HTTP_OK);
+}
+
+static void Http_ClientFail(Http_Client *client, Http_Client_Connection *conn) {
+	Http_Task *task = conn->task;
+
+	// The server may close a kept-alive connection before reading the request, in which
+	// case the request is sent again over a new connection
+	bool retry = task->reused && task->restartable && task->attempts < 2 &&
+		task->parser.state == HTTP_PARSER_HEADER && task->parser.received == 0;
+
+	Http_ClientRelease(conn, false);
+
+	if (retry) {
+		task->state = HTTP_TASK_QUEUED;
+		Http_TaskListPushFront(&client->pending, task);
+		return;
+	}
+
+	Http_TaskComplete(client, task, HTTP_E_FAILED);
+}
+
+static Http_Result Http_TaskExpired(Http_Task *task, uint64_t now) {
+	if (AtomicLoad(&task->cancelled))
+		return HTTP_E_CANCELLED;
+	if (task->deadline && now >= task->deadline)
+		return HTTP_E_TIMED_OUT;
+	return HTTP_PENDING;
+}
+
+static void Http_ClientExpire(Http_Client *client) {
+	uint64_t now = MonotonicMillisecs();
+
+	Http_Task_List pending = client->pending;
+	client->pending = Http_Task_List{};
+
+	while (Http_Task *task = Http_TaskListPop(&pending)) {
+		Http_Result result = Http_TaskExpired(task, now);
+		if (result == HTTP_PENDING)
+			Http_TaskListPush(&client->pending, task);
+		else if (result == HTTP_E_TIMED_OUT)
+			Http_TaskComplete(client, task, result, HTTP_PHASE_QUEUED);
+		else
+			Http_TaskComplete(client, task, result);
+	}
+
+	for (int index = 0; index < client->connection_count; ++index) {
+		Http_Client_Connection *conn = &client->connections[index];
+		if (!conn->task) continue;
+
+		Http_Result result = Http_TaskExpired(conn->task, now);
+		if (result != HTTP_PENDING) {
+			// Connection is in the middle of an exchange, so it can't be reused
+			Http_Task *task  = conn->task;
+			Http_Phase phase = result == HTTP_E_TIMED_OUT ? Http_TaskPhase(task) : HTTP_PHASE_NONE;
+			Http_ClientRelease(conn, false);
+			Http_TaskComplete(client, task, result, phase);
+		}
+	}
+}
+
+// Only the name resolution blocks, the connect is left to the poll loop
+static Http *Http_ClientStartConnect(Http_Client *client) {
+	Net_Socket *socket = Net_StartConnection(client->host, client->port, NET_SOCKET_TCP, client->allocator);
+	if (!socket)
+		return nullptr;
+	// Header and body are sent separately, which Nagle's algorithm would hold back until acknowledged
+	Net_SetSocketNoDelay(socket, true);
+	return Http_FromSocket(socket);
+}
+
+static void Http_ClientDispatch(Http_Client *client) {
+	for (int index = 0; index < client->connection_count && client->pending.first; ++index) {
+		Http_Client_Connection *conn = &client->connections[index];
+		if (conn->task) continue;
+
+		bool connect = !conn->http;
+		if (connect) {
+			conn->http   = Http_ClientStartConnect(client);
+			conn->used   = false;
+			conn->events = POLLWRNORM;
+			if (!conn->http) {
+				Http_Task *task = Http_TaskListPop(&client->pending);
+				Http_TaskComplete(client, task, HTTP_E_FAILED);
+				continue;
+			}
+		}
+
+		Http_TaskStart(Http_TaskListPop(&client->pending), conn);
+		if (connect)
+			conn->task->state = HTTP_TASK_CONNECTING;
+	}
+}
+
+// Until the nearest deadline, -1 when no task has one
+static int Http_ClientWaitTime(Http_Client *client) {
+	uint64_t nearest = 0;
+
+	for (Http_Task *task = client->pending.first; task; task = task->next) {
+		if (task->deadline && (!nearest || task->deadline < nearest))
+			nearest = task->deadline;
+	}
+
+	for (int index = 0; index < client->connection_count; ++index) {
+		Http_Task *task = client->connections[index].task;
+		if (task && task->deadline && (!nearest || task->deadline < nearest))
+			nearest = task->deadline;
+	}
+
+	if (!nearest)
+		return -1;
+
+	uint64_t now = MonotonicMillisecs();
+	return now < nearest ? (int)Minimum(nearest - now, (uint64_t)INT32_MAX) : 0;
+}
+
+static void Http_ClientWake(Http_Client *client) {
+	if (AtomicCmpExg(&client->woken, 1, 0) == 0)
+		Net_Wake(client->wakeup);
+}
+
+static int Http_ClientThreadProc(void *arg) {
+	Http_Client *client = (Http_Client *)arg;
+
+	pollfd                  fds[HTTP_CLIENT_MAX_CONNECTIONS + 1];
+	Http_Client_Connection *polled[HTTP_CLIENT_MAX_CONNECTIONS + 1];
+
+	while (AtomicLoad(&client->running)) {
+		// Cleared before the lists are read, a wake sent after that is left for the poll
+		Net_ClearWake(client->wakeup);
+		AtomicStore(&client->woken, 0);
+
+		SpinLock(&client->submit_guard);
+		Http_TaskListAppend(&client->pending, &client->submitted);
+		client->submitted = Http_Task_List{};
+		SpinUnlock(&client->submit_guard);
+
+		Http_ClientExpire(client);
+		Http_ClientDispatch(client);
+
+		fds[0].fd      = Net_GetSocketDescriptor(client->wakeup);
+		fds[0].events  = POLLRDNORM;
+		fds[0].revents = 0;
+
+		int count = 1;
+		for (int index = 0; index < client->connection_count; ++index) {
+			Http_Client_Connection *conn = &client->connections[index];
+			if (!conn->task) continue;
+			fds[count].fd      = Net_GetSocketDescriptor(Http_GetSocket(conn->http));
+			fds[count].events  = Http_TaskEvents(conn);
+			fds[count].revents = 0;
+			polled[count]      = conn;
+			count += 1;
+		}
+
+		// Submits, cancels and Http_DestroyClient wake the poll, deadlines end it
+		int presult = poll(fds, count, Http_ClientWaitTime(client));
+		if (presult <= 0) continue;
+
+		for (int index = 1; index < count; ++index) {
+			if (!fds[index].revents) continue;
+
+			Http_Client_Connection *conn = polled[index];
+			Net_Socket *socket = Http_GetSocket(conn->http);
+			Http_Task * task   = conn->task;
+
+			bool progress = true;
+			if (task->state == HTTP_TASK_CONNECTING || task->state == HTTP_TASK_HANDSHAKING)
+				progress = Http_TaskConnect(client, conn);
+			if (progress && task->state == HTTP_TASK_SENDING)
+				progress = Http_TaskSend(task, socket);
+			if (progress && task->state == HTTP_TASK_RECEIVING)
+				progress = Http_TaskReceive(task, socket);
+
+			if (!progress)
+				Http_ClientFail(client, conn);
+			else if (task->parser.state == HTTP_PARSER_DONE)
+				Http_ClientFinish(client, conn);
+		}
+	}
+
+	return 0;
+}
+
+Http_Client *Http_CreateClient(const String hostname, Http_Connection connection, int max_connections, Memory_Allocator allocator) {
+	Url url;
+	if (!Http_UrlExtract(hostname, &url)) {
+		LogErrorEx("Http", "Invalid hostname: " StrFmt, StrArg(hostname));
+		return nullptr;
+	}
+
+	if (connection == HTTP_DEFAULT && (url.scheme == "80" || StrMatchICase(url.scheme, "http")))
+		connection = HTTP_CONNECTION;
+	if (connection == HTTP_DEFAULT) {
+		bool http_port = url.port == "80" || StrMatchICase(url.port, "http");
+		connection     = http_port ? HTTP_CONNECTION : HTTPS_CONNECTION;
+	}
+
+	ptrdiff_t size = sizeof(Http_Client) + url.host.length + url.port.length;
+	Http_Client *client = (Http_Client *)MemoryAllocate(size, allocator);
+	if (!client) {
+		LogErrorEx("Http", "Creating client failed: out of memory");
+		return nullptr;
+	}
+
+	*client = Http_Client{};
+
+	uint8_t *names = (uint8_t *)(client + 1);
+	memcpy(names, url.host.data, url.host.length);
+	memcpy(names + url.host.length, url.port.data, url.port.length);
+
+	client->host             = String(names, url.host.length);
+	client->port             = String(names + url.host.length, url.port.length);
+	client->connection       = connection;
+	client->allocator        = allocator;
+	client->running          = 1;
+	client->connection_count = Clamp(1, HTTP_CLIENT_MAX_CONNECTIONS, max_connections);
+	client->wakeup           = Net_OpenWakeup(allocator);
+	client->completed        = Semaphore_Create(0);
+
+	if (!client->wakeup) {
+		LogErrorEx("Http", "Creating client failed: could not open the wakeup socket");
+		Semaphore_Destory(client->completed);
+		MemoryFree(client, size, allocator);
+		return nullptr;
+	}
+
+	Thread_Context_Params params = ThreadContextDefaultParams;
+	params.logger = ThreadContext.logger;
+
+	client->thread = Thread_Create(Http_ClientThreadProc, client, 0, params);
+	if (!client->thread) {
+		LogErrorEx("Http", "Creating client failed: could not start the thread");
+		Net_CloseConnection(client->wakeup);
+		Semaphore_Destory(client->completed);
+		MemoryFree(client, size, allocator);
+		return nullptr;
+	}
+
+	return client;
+}
+
+void Http_DestroyClient(Http_Client *client) {
+	AtomicStore(&client->running, 0);
+	Net_Wake(client->wakeup);
+	Thread_Wait(client->thread, -1);
+	Thread_Destroy(client->thread);
+
+	// Outstanding tasks are cancelled, their completions are still invoked
+	for (int index = 0; index < client->connection_count; ++index) {
+		Http_Client_Connection *conn = &client->connections[index];
+		if (conn->task)
+			Http_TaskComplete(client, conn->task, HTTP_E_CANCELLED);
+		if (conn->http)
+			Http_Disconnect(conn->http);
+	}
+
+	Http_TaskListAppend(&client->pending, &client->submitted);
+	while (Http_Task *task = Http_TaskListPop(&client->pending))
+		Http_TaskComplete(client, task, HTTP_E_CANCELLED);
+
+	// Queued completions that were never polled
+	while (Http_Task *task = Http_TaskListPop(&client->completions))
+		Http_ReleaseTask(task);
+
+	Net_CloseConnection(client->wakeup);
+	Semaphore_Destory(client->completed);
+
+	MemoryFree(client, sizeof(Http_Client) + client->host.length + client->port.length, client->allocator);
+}
+
+void Http_SetHost(Http_Request *req, Http_Client *client) {
+	req->headers.known[HTTP_HEADER_HOST] = client->host;
+}
+
+Http_Task *Http_Submit(Http_Client *client, const Http_Async_Request &request, Http_Completion completion) {
+	Assert(request.req && request.res);
+
+	Http_Task *task = (Http_Task *)MemoryAllocate(sizeof(Http_Task), client->allocator);
+	if (!task) {
+		LogErrorEx("Http", "Submitting request failed: out of memory");
+		return nullptr;
+	}
+
+	task->header_length = Http_BuildRequest(request.method, request.endpoint, &request.params, *request.req, task->header, HTTP_STREAM_CHUNK_SIZE);
+	if (task->header_length < 0) {
+		LogErrorEx("Http", "Writing header failed: out of memory");
+		MemoryFree(task, sizeof(Http_Task), client->allocator);
+		return nullptr;
+	}
+
+	task->next       = nullptr;
+	task->client     = client;
+	task->allocator  = client->allocator;
+	task->refcount   = 2; // caller and the client
+	task->cancelled  = 0;
+	task->result     = HTTP_PENDING;
+	task->state      = HTTP_TASK_QUEUED;
+	task->reused     = false;
+	task->head       = request.method == "HEAD";
+	task->attempts   = 0;
+	task->deadline   = request.req->deadline;
+	task->writer     = request.writer;
+	task->res        = request.res;
+	task->completion = completion;
+
+	if (request.reader.proc) {
+		task->reader      = request.reader;
+		task->restartable = false;
+	} else {
+		task->body.written  = 0;
+		task->body.length   = request.req->body.length;
+		task->body.buffer   = request.req->body.data;
+		task->reader.proc    = Http_BufferReaderProc;
+		task->reader.context = &task->body;
+		task->restartable   = true;
+	}
+
+	SpinLock(&client->submit_guard);
+	Http_TaskListPush(&client->submitted, task);
+	SpinUnlock(&client->submit_guard);
+	Http_ClientWake(client);
+
+	return task;
+}
+
+Http_Task *Http_PollCompletion(Http_Client *client, int millisecs) {
+	if (Semaphore_Wait(client->completed, millisecs) <= 0)
+		return nullptr;
+
+	SpinLock(&client->completion_guard);
+	Http_Task *task = Http_TaskListPop(&client->completions);
+	SpinUnlock(&client->completion_guard);
+
+	return task;
+}
+
+void Http_Cancel(Http_Task *task) {
+	AtomicStore(&task->cancelled, 1);
+	Http_ClientWake(task->client);
+}
+
+Http_Result Http_GetResult(Http_Task *task) {
+	return (Http_Result)AtomicLoad(&task->result);
+}
+
+void *Http_GetContext(Http_Task *task) {
+	return task->completion.context;
+}
+
+void Http_ReleaseTask(Http_Task *task) {
+	if (AtomicDec(&task->refcount) == 0)
+		MemoryFree(task, sizeof(Http_Task), task->allocator);
+}
+
+//
+//
+//
+
+constexpr uint32_t HTTP_DOWNLOAD_MAGIC         = 0x4c44484b;
+constexpr int      HTTP_DOWNLOAD_MAX_VALIDATOR = 256;
+
+// Written to "<path>.part", followed by one byte per segment that is set once the segment is on disk
+struct Http_Download_Journal {
+	uint32_t magic;
+	uint32_t validator_length;
+	int64_t  total;
+	int64_t  segment_size;
+	uint8_t  validator[HTTP_DOWNLOAD_MAX_VALIDATOR];
+};
+
+struct Http_Download_Segment {
+	int32_t attempts;
+	bool    done;
+};
+
+struct Http_Downloader {
+	const char *           path;
+	FILE *                 file;
+	FILE *                 journal;
+	bool                   resumed;    // the journal of an earlier download was found
+	int64_t                position;   // of the file after the last write, only used by the client's thread
+	Http_Download_Journal  header;
+	Http_Download_Segment *segments;
+	ptrdiff_t              count;
+};
+
+struct Http_Download_Slot {
+	Http_Downloader *download;
+	Http_Task *      task;
+	ptrdiff_t        segment;  // -1 for the requests made before the segments are known
+	int64_t          offset;   // next byte written to the file
+	int64_t          end;      // one past the last requested byte, negative when the whole body is requested
+	bool             checked;
+	bool             accepted;
+	bool             failed;   // writing to the file failed
+	Http_Response    res;
+};
+
+static String Http_DownloadValidator(Http_Header &header) {
+	String etag = header.known[HTTP_HEADER_ETAG];
+	return etag.length ? etag : header.known[HTTP_HEADER_LAST_MODIFIED];
+}
+
+// Content-Range: bytes <first>-<last>/<total>
+static bool Http_ParseContentRange(String value, int64_t *first, int64_t *last, int64_t *total) {
+	value = StrTrim(value);
+	if (!StrStartsWithICase(value, "bytes "))
+		return false;
+	value = StrTrim(StrRemovePrefix(value, 6));
+
+	ptrdiff_t dash  = StrFindChar(value, '-');
+	ptrdiff_t slash = StrFindChar(value, '/');
+	if (dash <= 0 || slash <= dash + 1 || slash + 1 == value.length)
+		return false;
+
+	ptrdiff_t a, b, c;
+	if (!ParseInt(SubStr(value, 0, dash), &a) || !ParseInt(SubStr(value, dash + 1, slash - dash - 1), &b) ||
+		!ParseInt(SubStr(value, slash + 1), &c) || a > b || b >= c)
+		return false;
+
+	*first = a;
+	*last  = b;
+	*total = c;
+	return true;
+}
+
+static bool Http_DownloadRestart(Http_Downloader *download) {
+	if (download->journal) {
+		fclose(download->journal);
+		download->journal = nullptr;
+	}
+
+	download->file     = download->file ? freopen(download->path, "w+b", download->file) : fopen(download->path, "w+b");
+	download->position = -1;
+	download->resumed  = false;
+	return download->file != nullptr;
+}
+
+static bool Http_DownloadAccept(Http_Download_Slot *slot, Http_Header &header) {
+	Http_Downloader *download = slot->download;
+	uint32_t         code     = slot->res.status.code;
+
+	if (code == 200) {
+		// Servers without range support send the whole body to the first request, it replaces
+		// the partial file of an earlier download
+		if (slot->segment >= 0)
+			return false;
+		slot->end = -1;
+		return !download->resumed || Http_DownloadRestart(download);
+	}
+
+	if (code != 206)
+		return false;
+
+	int64_t first, last, total;
+	if (!Http_ParseContentRange(header.known[HTTP_HEADER_CONTENT_RANGE], &first, &last, &total))
+		return false;
+	if (first != slot->offset || last + 1 != slot->end)
+		return false;
+
+	// A body longer than the range would spill into the next segment
+	String    content_length = header.known[HTTP_HEADER_CONTENT_LENGTH];
+	ptrdiff_t length;
+	if (content_length.length && (!ParseInt(content_length, &length) || length != last - first + 1))
+		return false;
+
+	// The probe's total and validator are checked against the journal once it completes
+	if (slot->segment < 0)
+		return true;
+
+	String validator = Http_DownloadValidator(header);
+	return total == download->header.total &&
+		StrMatch(validator, String(download->header.validator, download->header.validator_length));
+}
+
+static void Http_DownloadWriterProc(Http_Header &header, uint8_t *buffer, ptrdiff_t length, void *context) {
+	Http_Download_Slot *slot     = (Http_Download_Slot *)context;
+	Http_Downloader *   download = slot->download;
+
+	if (!slot->checked) {
+		slot->checked  = true;
+		slot->accepted = Http_DownloadAccept(slot, header);
+	}
+
+	if (!slot->accepted || slot->failed)
+		return;
+
+	if (slot->end >= 0 && slot->offset + length > slot->end) {
+		slot->failed = true;
+		return;
+	}
+
+	// Consecutive writes of the same response don't need to seek
+	if (download->position != slot->offset && !Http_FileSeek(download->file, slot->offset, SEEK_SET)) {
+		download->position = -1;
+		slot->failed       = true;
+		return;
+	}
+
+	if (fwrite(buffer, 1, length, download->file) != (size_t)length) {
+		download->position = -1;
+		slot->failed       = true;
+		return;
+	}
+
+	slot->offset      += length;
+	download->position = slot->offset;
+}
+
+static bool Http_DownloadSubmit(Http_Client *client, Http_Download_Slot *slot, String endpoint, uint64_t deadline) {
+	Http_Request req;
+	Http_InitRequest(&req);
+	Http_SetHost(&req, client);
+	req.deadline = deadline;
+
+	if (slot->end >= 0)
+		Http_SetHeaderFmt(&req, HTTP_HEADER_RANGE, "bytes=%lld-%lld", (long long)slot->offset, (long long)slot->end - 1);
+
+	slot->checked  = false;
+	slot->accepted = false;
+	slot->failed   = false;
+
+	Http_Async_Request request;
+	request.method         = "GET";
+	request.endpoint       = endpoint;
+	request.req            = &req;
+	request.res            = &slot->res;
+	request.writer.proc    = Http_DownloadWriterProc;
+	request.writer.context = slot;
+
+	Http_Completion completion;
+	completion.context = slot;
+
+	slot->task = Http_Submit(client, request, completion);
+	return slot->task != nullptr;
+}
+
+enum Http_Download_Outcome {
+	HTTP_DOWNLOAD_COMPLETE,
+	HTTP_DOWNLOAD_RETRY,
+	HTTP_DOWNLOAD_FAILED,
+};
+
+static Http_Download_Outcome Http_DownloadComplete(Http_Download_Slot *slot, Http_Result result) {
+	Http_ReleaseTask(slot->task); // from Http_PollCompletion
+	Http_ReleaseTask(slot->task); // from Http_Submit
+	slot->task = nullptr;
+
+	uint32_t code = slot->res.status.code;
+
+	if (result == HTTP_OK && !slot->checked) {
+		slot->checked  = true;
+		slot->accepted = Http_DownloadAccept(slot, slot->res.headers);
+	}
+
+	if (slot->failed) {
+		LogErrorEx("Http", "Download failed: could not write to the file");
+		return HTTP_DOWNLOAD_FAILED;
+	}
+
+	if (result == HTTP_OK && slot->accepted && (slot->end < 0 || slot->offset == slot->end))
+		return HTTP_DOWNLOAD_COMPLETE;
+
+	if (result == HTTP_E_FAILED || (result == HTTP_OK && (code >= 500 || code == 408 || code == 429)))
+		return HTTP_DOWNLOAD_RETRY;
+
+	// Empty files can't satisfy the probe's range, they are requested whole
+	if (result == HTTP_OK && code == 416 && slot->segment < 0 && slot->end >= 0)
+		return HTTP_DOWNLOAD_RETRY;
+
+	if (result == HTTP_E_TIMED_OUT)
+		LogErrorEx("Http", "Download failed: timed out");
+	else if (result == HTTP_OK && code == 206)
+		LogErrorEx("Http", "Download failed: the content changed or the range does not match");
+	else if (result == HTTP_OK)
+		LogErrorEx("Http", "Download failed: unexpected response (%u " StrFmt ")", code, StrArg(slot->res.status.name));
+	return HTTP_DOWNLOAD_FAILED;
+}
+
+static Http_Download_Outcome Http_DownloadWait(Http_Client *client, Http_Download_Slot **slot) {
+	Http_Task *task = Http_PollCompletion(client, -1);
+	*slot = (Http_Download_Slot *)Http_GetContext(task);
+	return Http_DownloadComplete(*slot, Http_GetResult(task));
+}
+
+// Opens the journal of an earlier download of the same file, the file itself is opened for update
+static bool Http_DownloadResume(Http_Downloader *download, const char *journal_path) {
+	download->journal = fopen(journal_path, "r+b");
+	if (!download->journal)
+		return false;
+
+	Http_Download_Journal *header = &download->header;
+	if (fread(header, sizeof(*header), 1, download->journal) != 1 || header->magic != HTTP_DOWNLOAD_MAGIC ||
+		header->validator_length > HTTP_DOWNLOAD_MAX_VALIDATOR || header->total <= 0 || header->segment_size <= 0) {
+		fclose(download->journal);
+		download->journal = nullptr;
+		return false;
+	}
+
+	download->file = fopen(download->path, "r+b");
+	if (!download->file) {
+		fclose(download->journal);
+		download->journal = nullptr;
+		return false;
+	}
+
+	return true;
+}
+
+static bool Http_DownloadCreateJournal(Http_Downloader *download, const char *journal_path) {
+	download->journal = fopen(journal_path, "w+b");
+	if (!download->journal)
+		return false;
+
+	if (fwrite(&download->header, sizeof(download->header), 1, download->journal) != 1)
+		return false;
+
+	uint8_t zeros[512] = {};
+	for (ptrdiff_t index = 0; index < download->count; index += sizeof(zeros)) {
+		size_t count = (size_t)Minimum(download->count - index, (ptrdiff_t)sizeof(zeros));
+		if (fwrite(zeros, 1, count, download->journal) != count)
+			return false;
+	}
+
+	return fflush(download->journal) == 0;
+}
+
+static bool Http_DownloadMarkDone(Http_Downloader *download, ptrdiff_t segment) {
+	download->segments[segment].done = true;
+
+	// Segments are only recorded once their bytes have left the process
+	if (fflush(download->file) != 0)
+		return false;
+	if (!Http_FileSeek(download->journal, sizeof(Http_Download_Journal) + segment, SEEK_SET))
+		return false;
+	if (fputc(1, download->journal) == EOF)
+		return false;
+	return fflush(download->journal) == 0;
+}
+
+static void Http_DownloadSegmentRange(Http_Downloader *download, Http_Download_Slot *slot, ptrdiff_t segment) {
+	int64_t size  = download->header.segment_size;
+	slot->segment = segment;
+	slot->offset  = segment * size;
+	slot->end     = Minimum(slot->offset + size, download->header.total);
+}
+
+// Runs the remaining segments, each slot retries its segment from the last written byte
+static bool Http_DownloadSegments(Http_Client *client, Http_Downloader *download, Http_Download_Slot *slots, int slot_count, String endpoint, const Http_Download_Spec &spec) {
+	ptrdiff_t next     = 0;
+	int       inflight = 0;
+	bool      failed   = false;
+
+	for (int index = 0; index < slot_count; ++index) {
+		while (next < download->count && download->segments[next].done)
+			next += 1;
+		if (next == download->count)
+			break;
+
+		Http_DownloadSegmentRange(download, &slots[index], next++);
+		if (!Http_DownloadSubmit(client, &slots[index], endpoint, spec.deadline))
+			return false;
+		inflight += 1;
+	}
+
+	while (inflight) {
+		Http_Download_Slot *slot;
+		Http_Download_Outcome outcome = Http_DownloadWait(client, &slot);
+		inflight -= 1;
+
+		if (failed)
+			continue;
+
+		if (outcome == HTTP_DOWNLOAD_RETRY) {
+			Http_Download_Segment *segment = &download->segments[slot->segment];
+			if (++segment->attempts <= spec.retries) {
+				LogWarningEx("Http", "Retrying download of segment %zd from byte %lld", slot->segment, (long long)slot->offset);
+				if (Http_DownloadSubmit(client, slot, endpoint, spec.deadline)) {
+					inflight += 1;
+					continue;
+				}
+			}
+			LogErrorEx("Http", "Download failed: segment %zd could not be received", slot->segment);
+			outcome = HTTP_DOWNLOAD_FAILED;
+		}
+
+		if (outcome == HTTP_DOWNLOAD_COMPLETE && !Http_DownloadMarkDone(download, slot->segment)) {
+			LogErrorEx("Http", "Download failed: could not write to the file");
+			outcome = HTTP_DOWNLOAD_FAILED;
+		}
+
+		if (outcome == HTTP_DOWNLOAD_FAILED) {
+			// Completed segments stay in the journal for the next attempt
+			for (int index = 0; index < slot_count; ++index) {
+				if (slots[index].task)
+					Http_Cancel(slots[index].task);
+			}
+			failed = true;
+			continue;
+		}
+
+		while (next < download->count && download->segments[next].done)
+			next += 1;
+		if (next < download->count) {
+			Http_DownloadSegmentRange(download, slot, next++);
+			if (!Http_DownloadSubmit(client, slot, endpoint, spec.deadline)) {
+				failed = true;
+				continue;
+			}
+			inflight += 1;
+		}
+	}
+
+	return !failed;
+}
+
+// Sends the first request, which is retried the same way as the segments
+static bool Http_DownloadProbe(Http_Client *client, Http_Download_Slot *slot, String endpoint, const Http_Download_Spec &spec) {
+	for (int attempt = 0; attempt <= spec.retries; ++attempt) {
+		// A single byte tells the length and whether ranges are supported
+		slot->segment = -1;
+		slot->offset  = 0;
+		slot->end     = slot->res.status.code == 416 ? -1 : 1;
+		if (!Http_DownloadSubmit(client, slot, endpoint, spec.deadline))
+			return false;
+
+		Http_Download_Outcome outcome = Http_DownloadWait(client, &slot);
+		if (outcome == HTTP_DOWNLOAD_COMPLETE)
+			return true;
+		if (outcome == HTTP_DOWNLOAD_FAILED)
+			return false;
+	}
+	LogErrorEx("Http", "Download failed: retries exhausted");
+	return false;
+}
+
+bool Http_Download(const String url, const String path, const Http_Download_Spec &spec, Memory_Allocator allocator) {
+	ptrdiff_t scheme = StrFind(url, "://");
+	ptrdiff_t slash  = StrFindChar(url, '/', scheme >= 0 ? scheme + 3 : 0);
+	String hostname  = slash >= 0 ? SubStr(url, 0, slash) : url;
+	String endpoint  = slash >= 0 ? SubStr(url, slash) : String("/");
+
+	Memory_Arena *   scratch = ThreadScratchpad();
+	Temporary_Memory temp    = BeginTemporaryMemory(scratch);
+	Defer{ EndTemporaryMemory(&temp); };
+
+	const char *journal_path = (const char *)FmtStr(scratch, StrFmt ".part", StrArg(path)).data;
+
+	Http_Downloader download;
+	memset(&download, 0, sizeof(download));
+	download.path     = StrNullTerminatedArena(scratch, path);
+	download.position = -1;
+
+	int          slot_count = Clamp(1, HTTP_CLIENT_MAX_CONNECTIONS, spec.connections);
+	Http_Client *client     = Http_CreateClient(hostname, HTTP_DEFAULT, slot_count, allocator);
+	if (!client)
+		return false;
+
+	Http_Download_Slot *slots = (Http_Download_Slot *)MemoryAllocate(sizeof(Http_Download_Slot) * slot_count, allocator);
+	if (!slots) {
+		LogErrorEx("Http", "Download failed: out of memory");
+		Http_DestroyClient(client);
+		return false;
+	}
+
+	for (int index = 0; index < slot_count; ++index) {
+		slots[index]          = Http_Download_Slot{};
+		slots[index].download = &download;
+	}
+
+	Defer{
+		// Writers run on the client's thread, the files are closed after it has stopped
+		Http_DestroyClient(client);
+		for (int index = 0; index < slot_count; ++index) {
+			if (slots[index].task)
+				Http_ReleaseTask(slots[index].task);
+		}
+		MemoryFree(slots, sizeof(Http_Download_Slot) * slot_count, allocator);
+		if (download.segments)
+			MemoryFree(download.segments, sizeof(Http_Download_Segment) * download.count, allocator);
+		if (download.file)
+			fclose(download.file);
+		if (download.journal)
+			fclose(download.journal);
+	};
+
+	download.resumed = Http_DownloadResume(&download, journal_path);
+	if (!download.resumed && !Http_DownloadRestart(&download)) {
+		LogErrorEx("Http", "Download failed: could not open \"" StrFmt "\"", StrArg(path));
+		return false;
+	}
+
+	Http_Download_Slot *probe = &slots[0];
+	if (!Http_DownloadProbe(client, probe, endpoint, spec))
+		return false;
+
+	if (probe->end < 0) {
+		// The whole body was written by the probe
+		String    content_length = probe->res.headers.known[HTTP_HEADER_CONTENT_LENGTH];
+		ptrdiff_t length         = 0;
+		if (content_length.length && (!ParseInt(content_length, &length) || length != probe->offset)) {
+			LogErrorEx("Http", "Download failed: received %lld bytes of %zd", (long long)probe->offset, length);
+			return false;
+		}
+		remove(journal_path);
+		return fflush(download.file) == 0;
+	}
+
+	int64_t first, last, total;
+	Http_ParseContentRange(probe->res.headers.known[HTTP_HEADER_CONTENT_RANGE], &first, &last, &total);
+
+	String validator = Http_DownloadValidator(probe->res.headers);
+	if (validator.length > HTTP_DOWNLOAD_MAX_VALIDATOR)
+		validator = String();
+
+	Http_Download_Journal *header = &download.header;
+
+	// Without a validator there is no telling whether the partial file belongs to the same content
+	if (download.resumed) {
+		if (!validator.length || header->total != total ||
+			!StrMatch(validator, String(header->validator, header->validator_length))) {
+			if (!Http_DownloadRestart(&download)) {
+				LogErrorEx("Http", "Download failed: could not open \"" StrFmt "\"", StrArg(path));
+				return false;
+			}
+		}
+	}
+
+	if (!download.resumed) {
+		memset(header, 0, sizeof(*header));
+		header->magic            = HTTP_DOWNLOAD_MAGIC;
+		header->validator_length = (uint32_t)validator.length;
+		header->total            = total;
+		header->segment_size     = Maximum(spec.segment, (ptrdiff_t)HTTP_STREAM_CHUNK_SIZE);
+		memcpy(header->validator, validator.data, validator.length);
+	}
+
+	download.count    = (ptrdiff_t)((header->total + header->segment_size - 1) / header->segment_size);
+	download.segments = (Http_Download_Segment *)MemoryAllocate(sizeof(Http_Download_Segment) * download.count, allocator);
+	if (!download.segments) {
+		LogErrorEx("Http", "Download failed: out of memory");
+		return false;
+	}
+	memset(download.segments, 0, sizeof(Http_Download_Segment) * download.count);
+
+	if (download.resumed) {
+		uint8_t   done[512];
+		ptrdiff_t resumed = 0;
+		for (ptrdiff_t index = 0; index < download.count; index += sizeof(done)) {
+			size_t count = fread(done, 1, (size_t)Minimum(download.count - index, (ptrdiff_t)sizeof(done)), download.journal);
+			for (size_t i = 0; i < count; ++i) {
+				download.segments[index + i].done = done[i] != 0;
+				resumed += done[i] != 0;
+			}
+			if (count < sizeof(done))
+				break;
+		}
+		LogInfoEx("Http", "Resuming download of \"" StrFmt "\", %zd of %zd segments present", StrArg(path), resumed, download.count);
+	} else if (!Http_DownloadCreateJournal(&download, journal_path)) {
+		LogErrorEx("Http", "Download failed: could not write the journal");
+		return false;
+	}
+
+	if (!Http_DownloadSegments(client, &download, slots, slot_count, endpoint, spec))
+		return false;
+
+	if (fflush(download.file) != 0 || !Http_FileSeek(download.file, 0, SEEK_END) || Http_FileTell(download.file) != header->total) {
+		// A partial file that does not match can't be trusted for the next attempt
+		LogErrorEx("Http", "Download failed: length of \"" StrFmt "\" does not match %lld bytes", StrArg(path), (long long)header->total);
+		fclose(download.journal);
+		download.journal = nullptr;
+		remove(journal_path);
+		return false;
+	}
+
+	fclose(download.journal);
+	download.journal = nullptr;
+	remove(journal_path);
+
+	return true;
+}
+
+//
+//
+//
+
+struct Http_Cache_Entry {
+	Http_Cache_Entry *prev;
+	Http_Cache_Entry *next;
+	String            key;
+	String            etag;
+	String            last_modified;
+	String            content_type;
+	Buffer            body;
+	uint64_t          fresh_until; // in MonotonicMillisecs()
+	ptrdiff_t         size;
+};
+
+struct Http_Cache {
+	Atomic_Guard                           guard;
+	Hash_Table<String, Http_Cache_Entry *> table;
+	Http_Cache_Entry                       lru;  // sentinel, 'next' is the most recently used
+	ptrdiff_t                              max_memory;
+	Memory_Allocator                       allocator;
+	Http_Cache_Stats                       stats;
+
+	Http_Cache(Memory_Allocator _allocator) : table(_allocator), allocator(_allocator) {}
+};
+
+// Parses IMF-fixdate, e.g. "Sun, 06 Nov 1994 08:49:37 GMT", into seconds since unix epoch
+static bool Http_ParseDate(String value, int64_t *seconds) {
+	static const char *Months[] = { "Jan", "Feb", "Mar", "Apr", "May", "Jun", "Jul", "Aug", "Sep", "Oct", "Nov", "Dec" };
+
+	ptrdiff_t comma = StrFindChar(value, ',');
+	if (comma < 0) return false;
+
+	char date[64];
+	String fixdate = StrTrim(SubStr(value, comma + 1));
+	if (fixdate.length >= (ptrdiff_t)sizeof(date)) return false;
+	memcpy(date, fixdate.data, fixdate.length);
+	date[fixdate.length] = 0;
+
+	char month_name[4];
+	int  day, year, hour, minute, second;
+	if (sscanf(date, "%d %3s %d %d:%d:%d", &day, month_name, &year, &hour, &minute, &second) != 6)
+		return false;
+
+	int month = -1;
+	for (int index = 0; index < (int)ArrayCount(Months); ++index) {
+		if (strcmp(month_name, Months[index]) == 0) {
+			month = index + 1;
+			break;
+		}
+	}
+	if (month < 0) return false;
+
+	// Days from civil
+	int64_t y   = month <= 2 ? year - 1 : year;
+	int64_t era = (y >= 0 ? y : y - 399) / 400;
+	int64_t yoe = y - era * 400;
+	int64_t doy = (153 * (month + (month > 2 ? -3 : 9)) + 2) / 5 + day - 1;
+	int64_t doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+	int64_t days = era * 146097 + doe - 719468;
+
+	*seconds = days * 86400 + hour * 3600 + minute * 60 + second;
+	return true;
+}
+
+// Returns false if the response must not be stored, 'lifetime' is in seconds
+static bool Http_CacheLifetime(Http_Response *res, int64_t *lifetime) {
+	String cache_control = res->headers.known[HTTP_HEADER_CACHE_CONTROL];
+
+	if (StrFindICase(cache_control, "no-store") >= 0)
+		return false;
+
+	*lifetime = 0;
+
+	ptrdiff_t max_age_pos = StrFindICase(cache_control, "max-age=");
+
+	if (StrFindICase(cache_control, "no-cache") >= 0) {
+		*lifetime = 0;
+	} else if (max_age_pos >= 0) {
+		ptrdiff_t max_age;
+		ParseInt(SubStr(cache_control, max_age_pos + 8), &max_age);
+		*lifetime = max_age;
+	} else if (res->headers.known[HTTP_HEADER_EXPIRES].length) {
+		int64_t expires, date;
+		if (Http_ParseDate(res->headers.known[HTTP_HEADER_EXPIRES], &expires)) {
+			if (!Http_ParseDate(res->headers.known[HTTP_HEADER_DATE], &date))
+				date = (int64_t)time(nullptr);
+			*lifetime = Maximum(expires - date, 0);
+		}
+	}
+
+	ptrdiff_t age;
+	if (res->headers.known[HTTP_HEADER_AGE].length && ParseInt(res->headers.known[HTTP_HEADER_AGE], &age))
+		*lifetime = Maximum(*lifetime - age, 0);
+
+	// Without freshness or validators there is nothing to serve from the cache
+	bool validators = res->headers.known[HTTP_HEADER_ETAG].length || res->headers.known[HTTP_HEADER_LAST_MODIFIED].length;
+	return *lifetime > 0 || validators;
+}
+
+static String Http_CacheKey(Http *http, const String endpoint, const Http_Query_Params &params, uint8_t *buffer) {
+	Builder builder;
+	BuilderBegin(&builder, buffer, HTTP_MAX_HEADER_SIZE);
+	BuilderWrite(&builder, Net_GetHostname((Net_Socket *)http), endpoint);
+
+	for (ptrdiff_t index = 0; index < params.count; ++index) {
+		BuilderWrite(&builder, index ? String("&") : String("?"));
+		BuilderWrite(&builder, params.queries[index].name, String("="), params.queries[index].value);
+	}
+
+	if (builder.thrown)
+		return String();
+	return BuilderEnd(&builder);
+}
+
+static void Http_CacheUnlink(Http_Cache_Entry *entry) {
+	entry->prev->next = entry->next;
+	entry->next->prev = entry->prev;
+}
+
+static void Http_CacheLinkFront(Http_Cache *cache, Http_Cache_Entry *entry) {
+	entry->prev           = &cache->lru;
+	entry->next           = cache->lru.next;
+	cache->lru.next->prev = entry;
+	cache->lru.next       = entry;
+}
+
+static void Http_CacheRemove(Http_Cache *cache, Http_Cache_Entry *entry) {
+	Http_CacheUnlink(entry);
+	cache->table.Remove(entry->key);
+	cache->stats.entries -= 1;
+	cache->stats.memory  -= entry->size;
+	MemoryFree(entry, entry->size, cache->allocator);
+}
+
+static void Http_CacheStore(Http_Cache *cache, String key, Http_Response *res, int64_t lifetime) {
+	String etag          = res->headers.known[HTTP_HEADER_ETAG];
+	String last_modified = res->headers.known[HTTP_HEADER_LAST_MODIFIED];
+	String content_type  = res->headers.known[HTTP_HEADER_CONTENT_TYPE];
+
+	ptrdiff_t size = sizeof(Http_Cache_Entry) + key.length + etag.length + last_modified.length + content_type.length + res->body.length;
+	if (size > cache->max_memory)
+		return;
+
+	Http_Cache_Entry *entry = (Http_Cache_Entry *)MemoryAllocate(size, cache->allocator);
+	if (!entry) return;
+
+	uint8_t *mem = (uint8_t *)(entry + 1);
+
+	auto copy = [&mem](String src) -> String {
+		memcpy(mem, src.data, src.length);
+		String dst(mem, src.length);
+		mem += src.length;
+		return dst;
+	};
+
+	entry->key           = copy(key);
+	entry->etag          = copy(etag);
+	entry->last_modified = copy(last_modified);
+	entry->content_type  = copy(content_type);
+	entry->body          = copy(res->body);
+	entry->fresh_until   = MonotonicMillisecs() + (uint64_t)lifetime * 1000;
+	entry->size          = size;
+
+	SpinLock(&cache->guard);
+
+	Http_Cache_Entry **existing = cache->table.Find(key);
+	if (existing)
+		Http_CacheRemove(cache, *existing);
+
+	while (cache->stats.memory + size > cache->max_memory && cache->lru.prev != &cache->lru) {
+		Http_CacheRemove(cache, cache->lru.prev);
+		cache->stats.evictions += 1;
+	}
+
+	Http_Cache_Entry **dst = cache->table.FindOrDefault(entry->key, nullptr);
+	if (dst) {
+		*dst = entry;
+		Http_CacheLinkFront(cache, entry);
+		cache->stats.entries += 1;
+		cache->stats.memory  += size;
+	} else {
+		MemoryFree(entry, size, cache->allocator);
+	}
+
+	SpinUnlock(&cache->guard);
+}
+
+// Must be called with the guard held
+static bool Http_CacheServe(Http_Cache_Entry *entry, Http_Response *res, Memory_Arena *arena) {
+	uint8_t *body = (uint8_t *)PushSize(arena, entry->body.length);
+	if (!body && entry->body.length) {
+		LogErrorEx("Http", "Serving cached response failed: out of memory");
+		return false;
+	}
+
+	memcpy(body, entry->body.data, entry->body.length);
+
+	Http_InitResponse(res);
+	res->status.version = HTTP_VERSION_1_1;
+	res->status.code    = 200;
+	res->status.name    = "OK";
+	res->body           = Buffer(body, entry->body.length);
+
+	Http_SetContentLength(res, entry->body.length);
+	if (entry->content_type.length)
+		Http_SetHeaderFmt(res, HTTP_HEADER_CONTENT_TYPE, StrFmt, StrArg(entry->content_type));
+	if (entry->etag.length)
+		Http_SetHeaderFmt(res, HTTP_HEADER_ETAG, StrFmt, StrArg(entry->etag));
+	if (entry->last_modified.length)
+		Http_SetHeaderFmt(res, HTTP_HEADER_LAST_MODIFIED, StrFmt, StrArg(entry->last_modified));
+
+	return true;
+}
+
+Http_Cache *Http_CreateCache(ptrdiff_t max_memory, Memory_Allocator allocator) {
+	Http_Cache *cache = new (allocator) Http_Cache(allocator);
+	if (!cache) {
+		LogErrorEx("Http", "Creating cache failed: out of memory");
+		return nullptr;
+	}
+
+	cache->guard.value = 0;
+	cache->lru.prev    = &cache->lru;
+	cache->lru.next    = &cache->lru;
+	cache->max_memory  = max_memory;
+	memset(&cache->stats, 0, sizeof(cache->stats));
+
+	return cache;
+}
+
+void Http_ClearCache(Http_Cache *cache) {
+	SpinLock(&cache->guard);
+	while (cache->lru.next != &cache->lru)
+		Http_CacheRemove(cache, cache->lru.next);
+	SpinUnlock(&cache->guard);
+}
+
+void Http_DestroyCache(Http_Cache *cache) {
+	Http_ClearCache(cache);
+	Free(&cache->table);
+	MemoryFree(cache, sizeof(*cache), cache->allocator);
+}
+
+Http_Cache_Stats Http_GetCacheStats(Http_Cache *cache) {
+	SpinLock(&cache->guard);
+	Http_Cache_Stats stats = cache->stats;
+	SpinUnlock(&cache->guard);
+	return stats;
+}
+
+bool Http_Get(Http *http, Http_Cache *cache, const String endpoint, const Http_Query_Params &params, const Http_Request &req, Http_Response *res, Memory_Arena *arena) {
+	uint8_t buffer[HTTP_MAX_HEADER_SIZE];
+
+	String key = Http_CacheKey(http, endpoint, params, buffer);
+	if (!key.length)
+		return Http_Get(http, endpoint, params, req, res, arena);
+
+	Http_Request revalidate;
+	bool         validating = false;
+
+	SpinLock(&cache->guard);
+
+	Http_Cache_Entry **found = cache->table.Find(key);
+	if (found) {
+		Http_Cache_Entry *entry = *found;
+		Http_CacheUnlink(entry);
+		Http_CacheLinkFront(cache, entry);
+
+		if (MonotonicMillisecs() < entry->fresh_until) {
+			bool served = Http_CacheServe(entry, res, arena);
+			if (served) cache->stats.hits += 1;
+			SpinUnlock(&cache->guard);
+			return served;
+		}
+
+		if (entry->etag.length || entry->last_modified.length) {
+			revalidate = req;
+			if (entry->etag.length)
+				Http_SetHeaderFmt(&revalidate, HTTP_HEADER_IF_NONE_MATCH, StrFmt, StrArg(entry->etag));
+			if (entry->last_modified.length)
+				Http_SetHeaderFmt(&revalidate, HTTP_HEADER_IF_MODIFIED_SINCE, StrFmt, StrArg(entry->last_modified));
+			validating = true;
+		}
+	}
+
+	SpinUnlock(&cache->guard);
+
+	if (!Http_Get(http, endpoint, params, validating ? revalidate : req, res, arena))
+		return false;
+
+	int64_t lifetime = 0;
+
+	if (validating && res->status.code == 304) {
+		SpinLock(&cache->guard);
+		found = cache->table.Find(key);
+		if (found) {
+			Http_Cache_Entry *entry = *found;
+			// Freshness is updated from the 304 headers
+			if (Http_CacheLifetime(res, &lifetime))
+				entry->fresh_until = MonotonicMillisecs() + (uint64_t)lifetime * 1000;
+			bool served = Http_CacheServe(entry, res, arena);
+			if (served) cache->stats.revalidations += 1;
+			SpinUnlock(&cache->guard);
+			return served;
+		}
+		SpinUnlock(&cache->guard);
+
+		// Entry was evicted while revalidating
+		if (!Http_Get(http, endpoint, params, req, res, arena))
+			return false;
+	}
+
+	SpinLock(&cache->guard);
+	cache->stats.misses += 1;
+	SpinUnlock(&cache->guard);
+
+	if (res->status.code == 200 && Http_CacheLifetime(res, &lifetime))
+		Http_CacheStore(cache, key, res, lifetime);
+
+	return true;
+}
+
+bool Http_Get(Http *http, Http_Cache *cache, const String endpoint, const Http_Request &req, Http_Response *res, Memory_Arena *arena) {
+	Http_Query_Params params;
+	return Http_Get(http, cache, endpoint, params, req, res, arena);
+}
+
+//
+//
+//
+
+constexpr int HTTP_SERVER_POLL_MS         = 50;
+constexpr int HTTP_SERVER_SCRATCHPAD_SIZE = MegaBytes(64);
+
+struct Http_Server_Connection {
+	Net_Socket *socket;
+	uint64_t    active;         // last time bytes were received or sent
+	ptrdiff_t   header_length;  // 0 until the whole header is received
+	ptrdiff_t   content_length;
+	ptrdiff_t   scanned;        // header bytes searched for the terminator
+	ptrdiff_t   received;
+	ptrdiff_t   capacity;
+	uint8_t *   data;           // header followed by the body and the pipelined requests
+	ptrdiff_t   sent;           // bytes of the output already sent
+	ptrdiff_t   pending;        // bytes of the output, sent or not
+	ptrdiff_t   out_capacity;
+	uint8_t *   out;            // what the socket did not take, null when everything is sent
+	bool        closing;        // closed once the output is sent
+};
+
+struct Http_Server_Worker {
+	Http_Server *            server;
+	Thread *                 thread;
+	Net_Socket *             listener;
+	int                      count;
+	Http_Server_Connection **connections;
+	Http_Server_Request      request;
+	Http_Response            response;
+};
+
+struct Http_Server {
+	Http_Handler        handler;
+	Memory_Allocator    allocator;
+	int32_t volatile    running;
+	int                 port;
+	int                 max_connections;
+	int                 idle_timeout;
+	ptrdiff_t           max_body;
+	bool                shared_listener;
+	int                 worker_count;
+	Http_Server_Worker *workers;
+};
+
+// Returns 0 when the request is parsed, otherwise the status code of the error response
+static uint32_t Http_ServerParseHeader(Http_Server *server, Http_Server_Request *request, uint8_t *header, ptrdiff_t header_length, ptrdiff_t *content_length) {
+	Http_Request *req = &request->req;
+
+	Http_InitRequest(req);
+	memcpy(req->buffer, header, header_length);
+	req->length = header_length;
+
+	String part(req->buffer, header_length);
+
+	ptrdiff_t pos = StrFind(part, "\r\n");
+	String line   = SubStr(part, 0, pos);
+	part          = SubStr(part, pos + 2);
+
+	ptrdiff_t method_end = StrFindChar(line, ' ');
+	ptrdiff_t target_end = method_end > 0 ? StrFind(line, " ", method_end + 1) : -1;
+	if (target_end < 0)
+		return 400;
+
+	String version = SubStr(line, target_end + 1);
+	if (version == "HTTP/1.1")
+		req->version = HTTP_VERSION_1_1;
+	else if (version == "HTTP/1.0")
+		req->version = HTTP_VERSION_1_0;
+	else
+		return 400;
+
+	request->method = SubStr(line, 0, method_end);
+	String target   = SubStr(line, method_end + 1, target_end - method_end - 1);
+
+	ptrdiff_t query = StrFindChar(target, '?');
+	request->endpoint     = query >= 0 ? SubStr(target, 0, query) : target;
+	request->query        = query >= 0 ? SubStr(target, query + 1) : String();
+	request->params.count = 0;
+
+	String params = request->query;
+	while (params.length && request->params.count < HTTP_MAX_QUERY_PARAMS) {
+		ptrdiff_t amp = StrFindChar(params, '&');
+		String    pair = amp >= 0 ? SubStr(params, 0, amp) : params;
+		params         = amp >= 0 ? SubStr(params, amp + 1) : String();
+
+		ptrdiff_t equals = StrFindChar(pair, '=');
+		if (equals >= 0)
+			Http_QueryParamSet(&request->params, SubStr(pair, 0, equals), SubStr(pair, equals + 1));
+		else if (pair.length)
+			Http_QueryParamSet(&request->params, pair, String());
+	}
+
+	while (true) {
+		pos = StrFind(part, "\r\n");
+		if (pos <= 0) break;
+
+		line = SubStr(part, 0, pos);
+		part = SubStr(part, pos + 2);
+
+		ptrdiff_t colon = StrFindChar(line, ':');
+		if (colon <= 0)
+			return 400;
+
+		String name  = StrTrim(SubStr(line, 0, colon));
+		String value = StrTrim(SubStr(line, colon + 1));
+
+		int header_id   = Http_FindHeaderId(name);
+		String existing = header_id >= 0 ? req->headers.known[header_id] : Http_GetHeader(req, name);
+
+		// Repeated headers are joined after the received header
+		if (existing.length && req->length + existing.length + value.length + 1 >= HTTP_MAX_HEADER_SIZE)
+			return 431;
+
+		if (header_id >= 0) {
+			Http_AppendHeader(req, (Http_Header_Id)header_id, value);
+		} else {
+			if (!existing.length && req->headers.raw.count == HTTP_MAX_RAW_HEADERS)
+				return 431;
+			Http_AppendHeader(req, name, value);
+		}
+	}
+
+	String encoding = req->headers.known[HTTP_HEADER_TRANSFER_ENCODING];
+	if (encoding.length && !StrMatchICase(encoding, "identity"))
+		return 501;
+
+	*content_length = 0;
+
+	String length = req->headers.known[HTTP_HEADER_CONTENT_LENGTH];
+	if (length.length) {
+		ptrdiff_t value;
+		if (!ParseInt(length, &value) || value < 0)
+			return 400;
+		if (value > server->max_body)
+			return 413;
+		*content_length = value;
+	}
+
+	return 0;
+}
+
+// Sends what is left of the output without waiting, returns false when the connection is lost
+static bool Http_ServerFlush(Http_Server *server, Http_Server_Connection *conn, uint64_t now) {
+	while (conn->sent < conn->pending) {
+		int length = (int)Minimum(conn->pending - conn->sent, (ptrdiff_t)INT32_MAX);
+		int sent   = Net_Send(conn->socket, conn->out + conn->sent, length);
+		if (sent < 0) return false;
+		if (sent == 0) return true;
+		conn->sent  += sent;
+		conn->active = now;
+	}
+
+	if (conn->out)
+		MemoryFree(conn->out, conn->out_capacity, server->allocator);
+	conn->out          = nullptr;
+	conn->out_capacity = 0;
+	conn->sent         = 0;
+	conn->pending      = 0;
+	return true;
+}
+
+// Sends the bytes as far as the socket takes them without waiting, the rest is kept in the
+// output of the connection and sent once the socket is writable
+static bool Http_ServerWrite(Http_Server *server, Http_Server_Connection *conn, const uint8_t *bytes, ptrdiff_t length) {
+	while (!conn->pending && length) {
+		int sent = Net_Send(conn->socket, (void *)bytes, (int)Minimum(length, (ptrdiff_t)INT32_MAX));
+		if (sent < 0) return false;
+		if (sent == 0) break;
+		bytes  += sent;
+		length -= sent;
+	}
+
+	if (!length)
+		return true;
+
+	conn->pending -= conn->sent;
+	memmove(conn->out, conn->out + conn->sent, conn->pending);
+	conn->sent = 0;
+
+	if (conn->pending + length > conn->out_capacity) {
+		ptrdiff_t capacity = Maximum(conn->pending + length, (ptrdiff_t)HTTP_STREAM_CHUNK_SIZE);
+		uint8_t *out = (uint8_t *)MemoryReallocate(conn->out_capacity, capacity, conn->out, server->allocator);
+		if (!out) {
+			LogErrorEx("Http", "Sending response failed: out of memory");
+			return false;
+		}
+		conn->out          = out;
+		conn->out_capacity = capacity;
+	}
+
+	memcpy(conn->out + conn->pending, bytes, length);
+	conn->pending += length;
+	return true;
+}
+
+static bool Http_ServerSend(Http_Server *server, Http_Server_Connection *conn, Http_Response *res, bool head) {
+	uint8_t buffer[HTTP_STREAM_CHUNK_SIZE];
+
+	ptrdiff_t header_length = Http_BuildResponse(*res, buffer, HTTP_STREAM_CHUNK_SIZE);
+	if (header_length < 0) {
+		LogErrorEx("Http", "Writing response header failed: out of memory");
+		return false;
+	}
+
+	Buffer body = head ? Buffer() : res->body;
+
+	// Small bodies go out with the header in a single send
+	if (body.length <= HTTP_STREAM_CHUNK_SIZE - header_length) {
+		memcpy(buffer + header_length, body.data, body.length);
+		return Http_ServerWrite(server, conn, buffer, header_length + body.length);
+	}
+
+	if (!Http_ServerWrite(server, conn, buffer, header_length))
+		return false;
+	return Http_ServerWrite(server, conn, body.data, body.length);
+}
+
+static void Http_ServerRespondError(Http_Server_Worker *worker, Http_Server_Connection *conn, uint32_t code) {
+	Http_Response *res = &worker->response;
+	Http_InitResponse(res);
+	res->status.code = code;
+	Http_SetHeader(res, HTTP_HEADER_CONNECTION, "close");
+	Http_SetContentLength(res, 0);
+	Http_ServerSend(worker->server, conn, res, false);
+}
+
+// Returns whether the connection is kept alive
+static bool Http_ServerRespond(Http_Server_Worker *worker, Http_Server_Connection *conn) {
+	Http_Server *        server  = worker->server;
+	Http_Server_Request *request = &worker->request;
+	Http_Response *      res     = &worker->response;
+	Memory_Arena *       arena   = ThreadScratchpad();
+
+	String connection = request->req.headers.known[HTTP_HEADER_CONNECTION];
+	bool keep_alive   = request->req.version == HTTP_VERSION_1_1 ?
+		StrFindICase(connection, "close") < 0 : StrFindICase(connection, "keep-alive") >= 0;
+
+	Http_InitResponse(res);
+	res->status.version = request->req.version;
+
+	auto temp = BeginTemporaryMemory(arena);
+	Defer{ EndTemporaryMemory(&temp); };
+
+	server->handler.proc(*request, res, arena, server->handler.context);
+
+	if (StrFindICase(res->headers.known[HTTP_HEADER_CONNECTION], "close") >= 0)
+		keep_alive = false;
+
+	if (!keep_alive)
+		Http_SetHeader(res, HTTP_HEADER_CONNECTION, "close");
+	else if (request->req.version == HTTP_VERSION_1_0)
+		Http_SetHeader(res, HTTP_HEADER_CONNECTION, "keep-alive");
+
+	if (!res->headers.known[HTTP_HEADER_CONTENT_LENGTH].length)
+		Http_SetContentLength(res, res->body.length);
+
+	bool head = request->method == "HEAD";
+	return Http_ServerSend(server, conn, res, head) && keep_alive;
+}
+
+static bool Http_ServerReserve(Http_Server *server, Http_Server_Connection *conn, ptrdiff_t capacity) {
+	if (conn->capacity == capacity)
+		return true;
+	uint8_t *data = (uint8_t *)MemoryReallocate(conn->capacity, capacity, conn->data, server->allocator);
+	if (!data) {
+		LogErrorEx("Http", "Receiving request failed: out of memory");
+		return false;
+	}
+	conn->data     = data;
+	conn->capacity = capacity;
+	return true;
+}
+
+// Serves every complete request in the received bytes, returns false when the connection must be closed
+static bool Http_ServerProcess(Http_Server_Worker *worker, Http_Server_Connection *conn) {
+	Http_Server *server = worker->server;
+
+	while (true) {
+		// The request is parsed into the worker, other connections may use it before the body arrives
+		bool parsed = false;
+
+		if (!conn->header_length) {
+			String received(conn->data, conn->received);
+			ptrdiff_t end = StrFind(received, "\r\n\r\n", Maximum(conn->scanned - 3, 0));
+			if (end < 0) {
+				conn->scanned = conn->received;
+				if (conn->received >= HTTP_MAX_HEADER_SIZE) {
+					Http_ServerRespondError(worker, conn, 431);
+					return false;
+				}
+				return true;
+			}
+
+			ptrdiff_t header_length = end + 4;
+			if (header_length > HTTP_MAX_HEADER_SIZE) {
+				Http_ServerRespondError(worker, conn, 431);
+				return false;
+			}
+
+			uint32_t error = Http_ServerParseHeader(server, &worker->request, conn->data, header_length, &conn->content_length);
+			if (error) {
+				Http_ServerRespondError(worker, conn, error);
+				return false;
+			}
+
+			conn->header_length = header_length;
+			parsed              = true;
+
+			ptrdiff_t total = conn->header_length + conn->content_length;
+			if (conn->capacity < total && !Http_ServerReserve(server, conn, total)) {
+				Http_ServerRespondError(worker, conn, 413);
+				return false;
+			}
+
+			if (conn->received < total) {
+				String expect = worker->request.req.headers.known[HTTP_HEADER_EXPECT];
+				if (StrFindICase(expect, "100-continue") >= 0) {
+					String interim = worker->request.req.version == HTTP_VERSION_1_0 ?
+						String("HTTP/1.0 100 Continue\r\n\r\n") : String("HTTP/1.1 100 Continue\r\n\r\n");
+					if (!Http_ServerWrite(server, conn, interim.data, interim.length))
+						return false;
+				}
+			}
+		}
+
+		ptrdiff_t total = conn->header_length + conn->content_length;
+		if (conn->received < total)
+			return true;
+
+		if (!parsed) {
+			ptrdiff_t content_length;
+			Http_ServerParseHeader(server, &worker->request, conn->data, conn->header_length, &content_length);
+		}
+
+		worker->request.req.body = Buffer(conn->data + conn->header_length, conn->content_length);
+
+		if (!Http_ServerRespond(worker, conn))
+			return false;
+
+		conn->received -= total;
+		memmove(conn->data, conn->data + total, conn->received);
+
+		conn->header_length  = 0;
+		conn->content_length = 0;
+		conn->scanned        = 0;
+
+		// Memory of large bodies is given back
+		if (conn->capacity > HTTP_MAX_HEADER_SIZE && conn->received <= HTTP_MAX_HEADER_SIZE)
+			Http_ServerReserve(server, conn, HTTP_MAX_HEADER_SIZE);
+
+		// The pipelined requests wait until the socket took the responses
+		if (!conn->received || conn->pending)
+			return true;
+	}
+}
+
+static bool Http_ServerReceive(Http_Server_Worker *worker, Http_Server_Connection *conn, uint64_t now) {
+	while (true) {
+		// With the header incomplete the buffer is at most HTTP_MAX_HEADER_SIZE, and with the header
+		// complete it is large enough for the body, so a full buffer is only left by a header that is too large
+		if (conn->received == conn->capacity) {
+			Http_ServerRespondError(worker, conn, 431);
+			conn->closing = true;
+			return conn->pending != 0;
+		}
+
+		int bytes_read = Net_Receive(conn->socket, conn->data + conn->received, (int)(conn->capacity - conn->received));
+		if (bytes_read < 0) return false;
+		if (bytes_read == 0) return true;
+
+		conn->active    = now;
+		conn->received += bytes_read;
+
+		// The response of the last request is sent before the connection is closed
+		if (!Http_ServerProcess(worker, conn)) {
+			conn->closing = true;
+			return conn->pending != 0;
+		}
+
+		// Nothing more is read until the socket took the responses
+		if (conn->pending)
+			return true;
+	}
+}
+
+// Sends the output once the socket is writable and serves the pipelined requests that waited on it,
+// returns false when the connection must be closed
+static bool Http_ServerResume(Http_Server_Worker *worker, Http_Server_Connection *conn, uint64_t now) {
+	if (!Http_ServerFlush(worker->server, conn, now))
+		return false;
+
+	if (conn->pending)
+		return true;
+
+	if (conn->closing)
+		return false;
+
+	if (!Http_ServerProcess(worker, conn)) {
+		conn->closing = true;
+		return conn->pending != 0;
+	}
+
+	return true;
+}
+
+static void Http_ServerClose(Http_Server_Worker *worker, int index) {
+	Http_Server *           server = worker->server;
+	Http_Server_Connection *conn   = worker->connections[index];
+
+	Net_CloseConnection(conn->socket);
+	MemoryFree(conn->data, conn->capacity, server->allocator);
+	if (conn->out)
+		MemoryFree(conn->out, conn->out_capacity, server->allocator);
+	MemoryFree(conn, sizeof(*conn), server->allocator);
+
+	worker->count -= 1;
+	worker->connections[index] = worker->connections[worker->count];
+}
+
+static void Http_ServerAccept(Http_Server_Worker *worker, uint64_t now) {
+	Http_Server *server = worker->server;
+
+	while (worker->count < server->max_connections) {
+		Net_Socket *socket = Net_Accept(worker->listener, server->allocator);
+		if (!socket) break;
+
+		Net_SetSocketBlockingMode(socket, false);
+		Net_SetSocketNoDelay(socket, true);
+
+		Http_Server_Connection *conn = (Http_Server_Connection *)MemoryAllocate(sizeof(*conn), server->allocator);
+		uint8_t *data = (uint8_t *)MemoryAllocate(HTTP_MAX_HEADER_SIZE, server->allocator);
+
+		if (!conn || !data) {
+			LogErrorEx("Http", "Accepting connection failed: out of memory");
+			if (conn) MemoryFree(conn, sizeof(*conn), server->allocator);
+			if (data) MemoryFree(data, HTTP_MAX_HEADER_SIZE, server->allocator);
+			Net_CloseConnection(socket);
+			break;
+		}
+
+		memset(conn, 0, sizeof(*conn));
+		conn->socket   = socket;
+		conn->active   = now;
+		conn->capacity = HTTP_MAX_HEADER_SIZE;
+		conn->data     = data;
+
+		worker->connections[worker->count++] = conn;
+	}
+}
+
+static int Http_ServerThreadProc(void *arg) {
+	Http_Server_Worker *worker = (Http_Server_Worker *)arg;
+	Http_Server *       server = worker->server;
+
+	pollfd *fds = (pollfd *)MemoryAllocate(sizeof(pollfd) * (server->max_connections + 1), server->allocator);
+	if (!fds) {
+		LogErrorEx("Http", "Starting server worker failed: out of memory");
+		return 1;
+	}
+
+	while (AtomicLoad(&server->running)) {
+		fds[0].fd      = Net_GetSocketDescriptor(worker->listener);
+		fds[0].events  = worker->count < server->max_connections ? POLLRDNORM : 0;
+		fds[0].revents = 0;
+
+		for (int index = 0; index < worker->count; ++index) {
+			fds[index + 1].fd      = Net_GetSocketDescriptor(worker->connections[index]->socket);
+			fds[index + 1].events  = worker->connections[index]->pending ? POLLWRNORM : POLLRDNORM;
+			fds[index + 1].revents = 0;
+		}
+
+		int presult  = poll(fds, worker->count + 1, HTTP_SERVER_POLL_MS);
+		uint64_t now = MonotonicMillisecs();
+
+		if (presult > 0) {
+			// Closing moves the last connection into the closed slot, so the connections are
+			// visited from the back to keep them matched with their descriptors
+			for (int index = worker->count - 1; index >= 0; --index) {
+				if (!fds[index + 1].revents) continue;
+
+				Http_Server_Connection *conn = worker->connections[index];
+
+				// Only writes are polled while output is pending, errors show up in the send
+				bool open = conn->pending ? Http_ServerResume(worker, conn, now) : Http_ServerReceive(worker, conn, now);
+				if (!open)
+					Http_ServerClose(worker, index);
+			}
+
+			if (fds[0].revents)
+				Http_ServerAccept(worker, now);
+		}
+
+		for (int index = worker->count - 1; index >= 0; --index) {
+			if (now - worker->connections[index]->active >= (uint64_t)server->idle_timeout)
+				Http_ServerClose(worker, index);
+		}
+	}
+
+	while (worker->count)
+		Http_ServerClose(worker, worker->count - 1);
+
+	MemoryFree(fds, sizeof(pollfd) * (server->max_connections + 1), server->allocator);
+
+	return 0;
+}
+
+static void Http_ServerFree(Http_Server *server) {
+	for (int index = 0; index < server->worker_count; ++index) {
+		Http_Server_Worker *worker = &server->workers[index];
+		if (worker->listener && (index == 0 || !server->shared_listener))
+			Net_CloseConnection(worker->listener);
+		if (worker->connections)
+			MemoryFree(worker->connections, sizeof(Http_Server_Connection *) * server->max_connections, server->allocator);
+	}
+	MemoryFree(server, sizeof(Http_Server) + sizeof(Http_Server_Worker) * server->worker_count, server->allocator);
+}
+
+Http_Server *Http_StartServer(const Http_Server_Spec &spec, Http_Handler handler, Memory_Allocator allocator) {
+	Assert(handler.proc);
+
+	int worker_count = Clamp(1, HTTP_SERVER_MAX_WORKERS, spec.workers);
+
+	ptrdiff_t size = sizeof(Http_Server) + sizeof(Http_Server_Worker) * worker_count;
+	Http_Server *server = (Http_Server *)MemoryAllocate(size, allocator);
+	if (!server) {
+		LogErrorEx("Http", "Starting server failed: out of memory");
+		return nullptr;
+	}
+
+	*server = Http_Server{};
+
+	server->handler         = handler;
+	server->allocator       = allocator;
+	server->running         = 1;
+	server->max_connections = Maximum(1, spec.max_connections);
+	server->idle_timeout    = spec.idle_timeout;
+	server->max_body        = spec.max_body;
+	server->shared_listener = !Net_CanReusePort();
+	server->worker_count    = worker_count;
+	server->workers         = (Http_Server_Worker *)(server + 1);
+
+	for (int index = 0; index < worker_count; ++index)
+		server->workers[index] = Http_Server_Worker{};
+
+	char port[16];
+
+	for (int index = 0; index < worker_count; ++index) {
+		Http_Server_Worker *worker = &server->workers[index];
+		worker->server = server;
+
+		if (index == 0 || !server->shared_listener) {
+			// Once the first listener is bound, the rest are bound to its port in case "0" was requested
+			String service = index ? String(port, strlen(port)) : spec.port;
+			worker->listener = Net_Listen(spec.node, service, NET_SOCKET_TCP, spec.backlog, !server->shared_listener, allocator);
+			if (!worker->listener) {
+				Http_ServerFree(server);
+				return nullptr;
+			}
+			Net_SetSocketBlockingMode(worker->listener, false);
+
+			if (index == 0) {
+				server->port = Net_GetPort(worker->listener);
+				snprintf(port, sizeof(port), "%d", server->port);
+			}
+		} else {
+			worker->listener = server->workers[0].listener;
+		}
+
+		worker->connections = (Http_Server_Connection **)MemoryAllocate(sizeof(Http_Server_Connection *) * server->max_connections, allocator);
+		if (!worker->connections) {
+			LogErrorEx("Http", "Starting server failed: out of memory");
+			Http_ServerFree(server);
+			return nullptr;
+		}
+	}
+
+	Thread_Context_Params params = ThreadContextDefaultParams;
+	params.logger = ThreadContext.logger;
+
+	for (int index = 0; index < worker_count; ++index) {
+		Http_Server_Worker *worker = &server->workers[index];
+		worker->thread = Thread_Create(Http_ServerThreadProc, worker, HTTP_SERVER_SCRATCHPAD_SIZE, params);
+		if (!worker->thread) {
+			LogErrorEx("Http", "Starting server failed: could not start the workers");
+			Http_StopServer(server);
+			return nullptr;
+		}
+	}
+
+	return server;
+}
+
+void Http_StopServer(Http_Server *server) {
+	AtomicStore(&server->running, 0);
+
+	for (int index = 0; index < server->worker_count; ++index) {
+		Http_Server_Worker *worker = &server->workers[index];
+		if (worker->thread) {
+			Thread_Wait(worker->thread, -1);
+			Thread_Destroy(worker->thread);
+		}
+	}
+
+	Http_ServerFree(server);
+}
+
+int Http_GetServerPort(Http_Server *server) {
+	return server->port;
 }
@@ -6,6 +6,8 @@ static constexpr int HTTP_STREAM_CHUNK_SIZE = HTTP_MAX_HEADER_SIZE;
 static constexpr int HTTP_MAX_RAW_HEADERS   = 64;
 static constexpr int HTTP_MAX_QUERY_PARAMS  = 8;
 
+static constexpr ptrdiff_t HTTP_EXPECT_CONTINUE_SIZE = MegaBytes(1);
+
 static_assert(HTTP_MAX_HEADER_SIZE >= HTTP_STREAM_CHUNK_SIZE, "");
 
 enum Http_Connection {
@@ -109,12 +111,32 @@ struct Http_Status {
 	String       name;
 };
 
+enum Http_Phase : uint32_t {
+	HTTP_PHASE_NONE,
+	HTTP_PHASE_QUEUED,
+	HTTP_PHASE_CONNECT,
+	HTTP_PHASE_HANDSHAKE,
+	HTTP_PHASE_SEND,
+	HTTP_PHASE_HEADER,
+	HTTP_PHASE_BODY,
+};
+
+// Header lines serialized once by Http_PrepareTemplate and written as is by Http_BuildRequest,
+// for the headers that stay the same across the requests of a connection
+struct Http_Request_Template {
+	ptrdiff_t length;
+	uint8_t   buffer[HTTP_MAX_HEADER_SIZE];
+};
+
 struct Http_Request {
 	Http_Version version;
 	Http_Header  headers;
 	ptrdiff_t    length;
-	uint8_t      buffer[HTTP_MAX_HEADER_SIZE];
 	Buffer       body;
+	uint64_t     deadline; // in MonotonicMillisecs(), 0 for none
+	ptrdiff_t    expect_continue; // body length from which 'Expect: 100-continue' is sent, 0 for HTTP_EXPECT_CONTINUE_SIZE, negative for never
+	const Http_Request_Template *prepared; // written before 'headers', may be null
+	uint8_t      buffer[HTTP_MAX_HEADER_SIZE];
 };
 
 struct Http_Response {
@@ -123,19 +145,25 @@ struct Http_Response {
 	ptrdiff_t    length;
 	uint8_t      buffer[HTTP_MAX_HEADER_SIZE];
 	Buffer       body;
+	Http_Phase   timeout;  // phase that timed out, HTTP_PHASE_NONE if none did
 };
 
 typedef int(*Http_Reader_Proc)(uint8_t *buffer, int length, void *context);
 typedef void(*Http_Writer_Proc)(Http_Header &header, uint8_t *buffer, ptrdiff_t length, void *context);
 
+// Returns the destination memory of 'length' bytes where the body is received directly from the socket,
+// or null if the writer is out of memory. The returned memory is considered written once filled.
+typedef uint8_t *(*Http_Reserve_Proc)(Http_Header &header, ptrdiff_t length, void *context);
+
 struct Http_Reader {
 	Http_Reader_Proc proc;
 	void *           context;
 };
 
 struct Http_Writer {
-	Http_Writer_Proc proc;
-	void *           context;
+	Http_Writer_Proc  proc;
+	void *            context;
+	Http_Reserve_Proc reserve = nullptr; // optional, when present 'proc' is not used for the body
 };
 
 struct Http;
@@ -143,15 +171,20 @@ struct Http;
 Net_Socket *Http_GetSocket(Http *http);
 Http *      Http_FromSocket(Net_Socket *socket);
 
-Http *Http_Connect(const String host, const String port, Http_Connection connection, Memory_Allocator allocator);
-Http *Http_Connect(const String hostname, Http_Connection connection = HTTP_DEFAULT, Memory_Allocator allocator = ThreadContext.allocator);
+// When connecting fails because of the deadline, the phase that timed out is written to 'timeout'
+Http *Http_Connect(const String host, const String port, Http_Connection connection, Memory_Allocator allocator, uint64_t deadline = 0, Http_Phase *timeout = nullptr);
+Http *Http_Connect(const String hostname, Http_Connection connection = HTTP_DEFAULT, Memory_Allocator allocator = ThreadContext.allocator, uint64_t deadline = 0, Http_Phase *timeout = nullptr);
 bool  Http_Reconnect(Http *http);
 void  Http_Disconnect(Http *http);
 
+// Deadline used by Http_SendRequest and Http_ReceiveResponse, the request functions set it from 'req.deadline'
+void  Http_SetDeadline(Http *http, uint64_t deadline);
+
 void      Http_DumpProc(Http_Header &header, uint8_t *buffer, ptrdiff_t length, void *context);
 ptrdiff_t Http_BuildRequest(const String method, const String endpoint, const Http_Query_Params *params, const Http_Request &req, uint8_t *buffer, ptrdiff_t buff_len);
+ptrdiff_t Http_BuildResponse(const Http_Response &res, uint8_t *buffer, ptrdiff_t buff_len);
 bool      Http_SendRequest(Http *http, const String header, Http_Reader reader);
-bool      Http_ReceiveResponse(Http *http, Http_Response *res, Http_Writer writer);
+bool      Http_ReceiveResponse(Http *http, Http_Response *res, Http_Writer writer, bool head = false); // 'head' when the request was HEAD
 
 bool Http_CustomMethod(Http *http, const String method, const String endpoint, const Http_Query_Params &params, const Http_Request &req, Http_Reader reader, Http_Response *res, Http_Writer writer);
 bool Http_Post(Http *http, const String endpoint, const Http_Query_Params &params, const Http_Request &req, Http_Reader reader, Http_Response *res, Http_Writer writer);
@@ -214,6 +247,7 @@ String Http_QueryParamGet(Http_Query_Params *params, String name);
 void   Http_DumpHeader(const Http_Request &req);
 void   Http_DumpHeader(const Http_Response &res);
 void   Http_InitRequest(Http_Request *req);
+void   Http_InitRequest(Http_Request *req, const Http_Request_Template *prepared);
 void   Http_SetHost(Http_Request *req, Http *http);
 void   Http_SetHeaderFmt(Http_Request *req, Http_Header_Id id, const char *fmt, ...);
 void   Http_SetHeaderFmt(Http_Request *req, String name, const char *fmt, ...);
@@ -227,6 +261,10 @@ void   Http_SetBody(Http_Request *req, Buffer content);
 String Http_GetHeader(Http_Request *req, Http_Header_Id id);
 String Http_GetHeader(Http_Request *req, const String name);
 
+// Serializes the headers of 'req' into 'prepared', the headers are not checked against the ones
+// set on the requests using the template so a header must only be set in one of them
+bool   Http_PrepareTemplate(Http_Request_Template *prepared, const Http_Request &req);
+
 void   Http_InitResponse(Http_Response *res);
 void   Http_SetHeaderFmt(Http_Response *res, Http_Header_Id id, const char *fmt, ...);
 void   Http_SetHeaderFmt(Http_Response *res, String name, const char *fmt, ...);
@@ -246,15 +284,171 @@ String Http_GetHeader(Http_Response *res, const String name);
 
 constexpr int HTTP_MULTIPART_LENGTH = 64;
 
+enum Http_Segment_Kind : uint32_t {
+	HTTP_SEGMENT_MEMORY,
+	HTTP_SEGMENT_FILE,
+};
+
+struct Http_Segment {
+	Http_Segment *    next;
+	Http_Segment_Kind kind;
+	String            content; // bytes for memory, null terminated path for file
+	ptrdiff_t         length;
+};
+
+// Parts are recorded as segments, generated boundaries and headers are allocated from the arena
+// while the contents are referenced and only read when the body is sent
 struct Http_Multipart {
 	uint8_t       boundary[HTTP_MULTIPART_LENGTH];
 	ptrdiff_t     length = 0;
-	uint8_t *memory = nullptr;
-	uint8_t *current = nullptr;
-	Memory_Arena *arena = nullptr;
+	Http_Segment *first  = nullptr;
+	Http_Segment *last   = nullptr;
+	Memory_Arena *arena  = nullptr;
+};
+
+struct Http_Multipart_Reader {
+	Http_Segment *segment;
+	ptrdiff_t     offset;
+	void *        file;
 };
 
 Http_Multipart Http_MultipartBegin(Memory_Arena *arena);
 bool Http_MultipartData(Http_Multipart *mt, String content, String filename);
 bool Http_MultipartData(Http_Multipart *mt, String content, String content_type, String filename);
-String Http_MultipartEnd(Http_Multipart *mt);
+bool Http_MultipartFile(Http_Multipart *mt, String path, String content_type, String content_disposition);
+bool Http_MultipartEnd(Http_Multipart *mt);
+Http_Reader Http_MultipartReader(Http_Multipart_Reader *reader, Http_Multipart *mt);
+
+//
+//
+//
+
+static constexpr int HTTP_CLIENT_MAX_CONNECTIONS = 64;
+
+enum Http_Result : int32_t {
+	HTTP_PENDING,
+	HTTP_OK,
+	HTTP_E_FAILED,
+	HTTP_E_TIMED_OUT,
+	HTTP_E_CANCELLED,
+};
+
+struct Http_Client;
+struct Http_Task;
+
+typedef void(*Http_Completion_Proc)(Http_Task *task, Http_Result result, Http_Response *res, void *context);
+
+struct Http_Completion {
+	Http_Completion_Proc proc    = nullptr; // called on the client's thread, when null the task is queued for Http_PollCompletion
+	void *               context = nullptr;
+};
+
+// All the memory referenced here must stay valid until the task is completed,
+// except 'req' which is only used during Http_Submit. The task's deadline is 'req->deadline'
+struct Http_Async_Request {
+	String              method;
+	String              endpoint;
+	Http_Query_Params   params;
+	const Http_Request *req      = nullptr;
+	Http_Reader         reader   = {};      // when 'proc' is null, 'req->body' is sent
+	Http_Writer         writer   = {};      // when both 'proc' and 'reserve' are null, the body is discarded
+	Http_Response *     res      = nullptr;
+};
+
+// The allocator is used from both the calling thread and the client's thread
+Http_Client *Http_CreateClient(const String hostname, Http_Connection connection = HTTP_DEFAULT, int max_connections = 8, Memory_Allocator allocator = ThreadContext.allocator);
+void         Http_DestroyClient(Http_Client *client);
+void         Http_SetHost(Http_Request *req, Http_Client *client);
+
+// Tasks returned by both Http_Submit and Http_PollCompletion must be released with Http_ReleaseTask,
+// Http_Submit returns null if the request could not be queued
+Http_Task *  Http_Submit(Http_Client *client, const Http_Async_Request &request, Http_Completion completion = Http_Completion());
+Http_Task *  Http_PollCompletion(Http_Client *client, int millisecs);
+void         Http_Cancel(Http_Task *task);
+Http_Result  Http_GetResult(Http_Task *task);
+void *       Http_GetContext(Http_Task *task);
+void         Http_ReleaseTask(Http_Task *task);
+
+//
+//
+//
+
+struct Http_Download_Spec {
+	int       connections = 4;
+	ptrdiff_t segment     = MegaBytes(4); // bytes requested by each Range request
+	int       retries     = 3;            // per segment
+	uint64_t  deadline    = 0;            // in MonotonicMillisecs(), 0 for none
+};
+
+// Downloads 'url' into the file at 'path' with Range requests sent in parallel over pooled connections,
+// the body is written to the file as it arrives. Completed segments are recorded in "<path>.part", which
+// lets a failed download resume from them when called again. Servers that ignore ranges are downloaded
+// whole over a single connection.
+bool Http_Download(const String url, const String path, const Http_Download_Spec &spec = Http_Download_Spec(), Memory_Allocator allocator = ThreadContext.allocator);
+
+//
+//
+//
+
+struct Http_Cache;
+
+struct Http_Cache_Stats {
+	int64_t   hits;          // served from the cache without contacting the server
+	int64_t   misses;
+	int64_t   revalidations; // served from the cache after a 304
+	int64_t   evictions;
+	ptrdiff_t entries;
+	ptrdiff_t memory;
+};
+
+// Caches successful GET responses keyed by host and endpoint, least recently used entries
+// are evicted to stay under 'max_memory'. Safe to share between threads.
+Http_Cache *     Http_CreateCache(ptrdiff_t max_memory, Memory_Allocator allocator = ThreadContext.allocator);
+void             Http_DestroyCache(Http_Cache *cache);
+void             Http_ClearCache(Http_Cache *cache);
+Http_Cache_Stats Http_GetCacheStats(Http_Cache *cache);
+
+bool Http_Get(Http *http, Http_Cache *cache, const String endpoint, const Http_Query_Params &params, const Http_Request &req, Http_Response *res, Memory_Arena *arena);
+bool Http_Get(Http *http, Http_Cache *cache, const String endpoint, const Http_Request &req, Http_Response *res, Memory_Arena *arena);
+
+//
+//
+//
+
+static constexpr int HTTP_SERVER_MAX_WORKERS = 64;
+
+struct Http_Server;
+
+struct Http_Server_Request {
+	String            method;
+	String            endpoint; // path without the query
+	String            query;
+	Http_Query_Params params;   // not decoded, extra parameters are only present in 'query'
+	Http_Request      req;      // headers and body
+};
+
+// Called on one of the server's workers. 'arena' is reset once the response is handed to the socket,
+// what the socket does not take right away is copied, so the response body can be allocated from it.
+// A status code of 0 is sent as 200.
+typedef void(*Http_Handler_Proc)(const Http_Server_Request &request, Http_Response *res, Memory_Arena *arena, void *context);
+
+struct Http_Handler {
+	Http_Handler_Proc proc;
+	void *            context = nullptr;
+};
+
+struct Http_Server_Spec {
+	String    node            = "";           // empty for all interfaces
+	String    port            = "8080";       // "0" picks a free port, see Http_GetServerPort
+	int       workers         = 4;
+	int       backlog         = 512;
+	int       max_connections = 256;          // per worker
+	int       idle_timeout    = 5000;         // in milliseconds, for kept-alive connections
+	ptrdiff_t max_body        = MegaBytes(8);
+};
+
+// Each worker accepts and serves its own connections. Where SO_REUSEPORT is available every worker
+// has its own listener, otherwise the listener is shared. The allocator is used from the workers.
+Http_Server *Http_StartServer(const Http_Server_Spec &spec, Http_Handler handler, Memory_Allocator allocator = ThreadContext.allocator);
+void         Http_StopServer(Http_Server *server);
+int          Http_GetServerPort(Http_Server *server);
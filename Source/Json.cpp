@@ -1,4 +1,6 @@
 #include "Json.h"
+#include "Kr/KrString.h"
+#include "Kr/KrProfile.h"
 
 #include <stdlib.h>
 #include <stdio.h>
@@ -93,24 +95,24 @@ void Jsonify::PushString(String str) {
 
 void Jsonify::PushId(uint64_t id) {
 	NextElement(false);
-	char buff[100];
-	int len = snprintf(buff, sizeof(buff), "%zu", id);
-	PushByte('"');
-	PushBuffer(Buffer(buff, len));
-	PushByte('"');
+	uint8_t buff[FMT_INT_SIZE + 2];
+	buff[0] = '"';
+	int len = FmtU64(buff + 1, id);
+	buff[len + 1] = '"';
+	PushBuffer(Buffer(buff, len + 2));
 }
 
 void Jsonify::PushFloat(float number) {
 	NextElement(false);
-	char buff[100];
-	int len = snprintf(buff, sizeof(buff), "%f", number);
+	uint8_t buff[FMT_FLOAT_SIZE];
+	int len = FmtF32(buff, number);
 	PushBuffer(Buffer(buff, len));
 }
 
 void Jsonify::PushInt(int number) {
 	NextElement(false);
-	char buff[100];
-	int len = snprintf(buff, sizeof(buff), "%d", number);
+	uint8_t buff[FMT_INT_SIZE];
+	int len = FmtI64(buff, number);
 	PushBuffer(Buffer(buff, len));
 }
 
@@ -742,6 +744,8 @@ static bool JsonParseRoot(Json_Parser *parser) {
 }
 
 bool JsonParse(String json_string, Json *out_json, Memory_Allocator allocator) {
+	ProfileZone("JsonParse");
+
 	Json_Parser parser = JsonParserBegin(json_string, out_json, allocator);
 	bool parsed = JsonParseRoot(&parser);
 	parsed = JsonParserEnd(&parser);
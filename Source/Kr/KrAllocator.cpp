@@ -0,0 +1,512 @@
+#include "KrAllocator.h"
+#include "KrAtomic.h"
+
+#include <string.h>
+
+#if COMPILER_MSVC == 1
+#include <intrin.h>
+#endif
+
+//
+// Every block lives in a span aligned to CachingAllocatorSpanSize with the span header at its start, the
+// header of a large allocation is placed right before it. Masking the pointer finds the header either way.
+//
+
+constexpr uint32_t CachingAllocatorLargeClass  = UINT32_MAX;
+constexpr size_t   CachingAllocatorRegionSize  = MegaBytes(64); // reserved at once, spans are committed from it
+constexpr size_t   CachingAllocatorBatchBytes  = KiloBytes(32); // moved between a thread cache and the depot
+constexpr uint32_t CachingAllocatorReuseSpans  = 16;            // freed large mappings of up to this many spans are kept
+constexpr size_t   CachingAllocatorReuseBytes  = MegaBytes(16); // for reuse, up to this many bytes in total
+
+struct alignas(64) Caching_Span {
+	uint32_t      size_class;
+	uint32_t      block_size;
+	size_t        mapped; // large allocations only
+	Caching_Span *next;   // freed large mappings kept for reuse
+};
+
+struct alignas(64) Caching_Depot {
+	Atomic_Guard     lock;
+	int32_t volatile count;
+	void *           batches; // the second word of the first block of a batch links the next batch
+};
+
+struct Caching_Region {
+	Atomic_Guard lock;
+	uint8_t *    cursor;
+	uint8_t *    end;
+};
+
+// Growing an Array past the small sizes would otherwise map and unmap on every step
+struct Caching_Reuse {
+	Atomic_Guard  lock;
+	size_t        bytes;
+	Caching_Span *spans[CachingAllocatorReuseSpans]; // by the span count of the mapping
+};
+
+struct Caching_Global_Stats {
+	int64_t volatile small_spans;
+	int64_t volatile large_live;
+	int64_t volatile large_bytes;
+	int64_t volatile large_total;
+	int64_t volatile large_reused;
+	int64_t volatile depot_refills;
+	int64_t volatile depot_releases;
+	int64_t volatile thread_caches;
+	int64_t volatile allocations;
+	int64_t volatile frees;
+};
+
+enum Caching_Thread_State : uint32_t {
+	CACHING_THREAD_UNUSED,
+	CACHING_THREAD_ACTIVE,
+	CACHING_THREAD_EXITED,
+};
+
+struct Caching_Free_List {
+	void *   head;
+	uint32_t count;
+};
+
+struct Caching_Thread_Cache {
+	uint32_t          state;
+	Caching_Free_List lists[CachingAllocatorClassCount];
+	uint8_t *         bump[CachingAllocatorClassCount]; // the part of the newest span not carved yet
+	uint8_t *         bump_end[CachingAllocatorClassCount];
+	int64_t           allocations;
+	int64_t           frees;
+};
+
+struct Caching_Thread_Exit {
+	~Caching_Thread_Exit();
+};
+
+static Caching_Depot                       CachingDepots[CachingAllocatorClassCount];
+static Caching_Region                      CachingRegion;
+static Caching_Reuse                       CachingReuse;
+static Caching_Global_Stats                CachingStats;
+static thread_local Caching_Thread_Cache   CachingThreadCache;
+static thread_local Caching_Thread_Exit    CachingThreadExit;
+
+static_assert(sizeof(Caching_Span) == 64, "blocks are placed right after the span header");
+
+//
+//
+//
+
+// 16 byte steps up to 128, then four classes per power of two up to CachingAllocatorMaxSmallSize
+static constexpr uint32_t CachingAllocatorClassSize(uint32_t size_class) {
+	if (size_class < 8)
+		return (size_class + 1) * 16;
+	uint32_t base = 128u << ((size_class - 8) / 4);
+	return base + ((size_class - 8) % 4 + 1) * (base / 4);
+}
+
+static_assert(CachingAllocatorClassSize(CachingAllocatorClassCount - 1) == CachingAllocatorMaxSmallSize, "size classes must end at the small size limit");
+
+static inline uint32_t CachingAllocatorHighestBit(size_t value) {
+#if COMPILER_MSVC == 1
+	unsigned long index;
+	_BitScanReverse64(&index, value);
+	return (uint32_t)index;
+#else
+	return 63 - (uint32_t)__builtin_clzll((unsigned long long)value);
+#endif
+}
+
+static inline uint32_t CachingAllocatorSizeClass(size_t size) {
+	if (size <= 128)
+		return size ? (uint32_t)((size - 1) >> 4) : 0;
+	size_t   last = size - 1;
+	uint32_t bit  = CachingAllocatorHighestBit(last);
+	return 8 + (bit - 7) * 4 + (uint32_t)((last >> (bit - 2)) & 3);
+}
+
+static inline uint32_t CachingAllocatorBatchCount(uint32_t size_class) {
+	return Clamp(2u, 32u, (uint32_t)(CachingAllocatorBatchBytes / CachingAllocatorClassSize(size_class)));
+}
+
+static inline Caching_Span *CachingAllocatorSpanOf(void *ptr) {
+	return (Caching_Span *)AlignPower2Down((size_t)ptr, CachingAllocatorSpanSize);
+}
+
+//
+//
+//
+
+static uint8_t *CachingAllocatorReserve(size_t size) {
+#if PLATFORM_WINDOWS == 1
+	// Reservations are aligned to the 64 KB allocation granularity
+	return (uint8_t *)VirtualMemoryAllocate(nullptr, size);
+#else
+	size_t   padded = size + CachingAllocatorSpanSize;
+	uint8_t *mem    = (uint8_t *)VirtualMemoryAllocate(nullptr, padded);
+	if (!mem)
+		return nullptr;
+
+	uint8_t *aligned = AlignPointer(mem, CachingAllocatorSpanSize);
+	uint8_t *tail    = aligned + size;
+	if (aligned != mem)
+		VirtualMemoryFree(mem, aligned - mem);
+	if (tail != mem + padded)
+		VirtualMemoryFree(tail, (mem + padded) - tail);
+	return aligned;
+#endif
+}
+
+static Caching_Span *CachingAllocatorNewSpan(uint32_t size_class) {
+	Caching_Region *region = &CachingRegion;
+
+	SpinLock(&region->lock);
+	if (region->cursor == region->end) {
+		uint8_t *mem = CachingAllocatorReserve(CachingAllocatorRegionSize);
+		if (!mem) {
+			SpinUnlock(&region->lock);
+			return nullptr;
+		}
+		region->cursor = mem;
+		region->end    = mem + CachingAllocatorRegionSize;
+	}
+	uint8_t *mem = region->cursor;
+	region->cursor += CachingAllocatorSpanSize;
+	SpinUnlock(&region->lock);
+
+	if (!VirtualMemoryCommit(mem, CachingAllocatorSpanSize))
+		return nullptr;
+
+	Caching_Span *span = (Caching_Span *)mem;
+	span->size_class   = size_class;
+	span->block_size   = CachingAllocatorClassSize(size_class);
+	span->mapped       = 0;
+	span->next         = nullptr;
+
+	AtomicInc(&CachingStats.small_spans);
+
+	return span;
+}
+
+static Caching_Span *CachingAllocatorReuseLarge(size_t mapped) {
+	size_t spans = mapped / CachingAllocatorSpanSize;
+	if (spans > CachingAllocatorReuseSpans)
+		return nullptr;
+
+	Caching_Reuse *reuse = &CachingReuse;
+	SpinLock(&reuse->lock);
+	Caching_Span *span = reuse->spans[spans - 1];
+	if (span) {
+		reuse->spans[spans - 1] = span->next;
+		reuse->bytes           -= mapped;
+	}
+	SpinUnlock(&reuse->lock);
+
+	if (span)
+		AtomicInc(&CachingStats.large_reused);
+
+	return span;
+}
+
+static bool CachingAllocatorKeepLarge(Caching_Span *span) {
+	size_t spans = span->mapped / CachingAllocatorSpanSize;
+	if (spans > CachingAllocatorReuseSpans)
+		return false;
+
+	Caching_Reuse *reuse = &CachingReuse;
+	SpinLock(&reuse->lock);
+	bool kept = reuse->bytes + span->mapped <= CachingAllocatorReuseBytes;
+	if (kept) {
+		span->next              = reuse->spans[spans - 1];
+		reuse->spans[spans - 1] = span;
+		reuse->bytes           += span->mapped;
+	}
+	SpinUnlock(&reuse->lock);
+
+	return kept;
+}
+
+static void *CachingAllocatorAllocateLarge(size_t size) {
+	size_t mapped = AlignPower2Up(size + sizeof(Caching_Span), CachingAllocatorSpanSize);
+
+	Caching_Span *span = CachingAllocatorReuseLarge(mapped);
+	if (!span) {
+		uint8_t *mem = CachingAllocatorReserve(mapped);
+		if (!mem)
+			return nullptr;
+
+		if (!VirtualMemoryCommit(mem, mapped)) {
+			VirtualMemoryFree(mem, mapped);
+			return nullptr;
+		}
+
+		span             = (Caching_Span *)mem;
+		span->size_class = CachingAllocatorLargeClass;
+		span->block_size = 0;
+		span->mapped     = mapped;
+		span->next       = nullptr;
+	}
+
+	AtomicInc(&CachingStats.large_live);
+	AtomicInc(&CachingStats.large_total);
+	AtomicAdd(&CachingStats.large_bytes, (int64_t)mapped);
+
+	return (uint8_t *)span + sizeof(Caching_Span);
+}
+
+static void CachingAllocatorFreeLarge(Caching_Span *span) {
+	size_t mapped = span->mapped;
+	AtomicSub(&CachingStats.large_live, 1);
+	AtomicSub(&CachingStats.large_bytes, (int64_t)mapped);
+	if (!CachingAllocatorKeepLarge(span))
+		VirtualMemoryFree(span, mapped);
+}
+
+//
+//
+//
+
+static void CachingAllocatorPushBatch(uint32_t size_class, void *batch) {
+	Caching_Depot *depot = &CachingDepots[size_class];
+	SpinLock(&depot->lock);
+	((void **)batch)[1] = depot->batches;
+	depot->batches      = batch;
+	AtomicStore(&depot->count, depot->count + 1);
+	SpinUnlock(&depot->lock);
+}
+
+static void *CachingAllocatorPopBatch(uint32_t size_class) {
+	Caching_Depot *depot = &CachingDepots[size_class];
+
+	// Racy peek, threads that only allocate find the depot empty most of the time and skip the lock
+	if (!AtomicLoad(&depot->count))
+		return nullptr;
+
+	SpinLock(&depot->lock);
+	void *batch = depot->batches;
+	if (batch) {
+		depot->batches = ((void **)batch)[1];
+		AtomicStore(&depot->count, depot->count - 1);
+	}
+	SpinUnlock(&depot->lock);
+
+	return batch;
+}
+
+// Gives back the first batch of the list
+static void CachingAllocatorRelease(Caching_Free_List *list, uint32_t size_class, uint32_t count) {
+	void *head = list->head;
+	void *tail = head;
+	for (uint32_t index = 1; index < count; ++index)
+		tail = *(void **)tail;
+
+	list->head     = *(void **)tail;
+	list->count   -= count;
+	*(void **)tail = nullptr;
+
+	CachingAllocatorPushBatch(size_class, head);
+	AtomicInc(&CachingStats.depot_releases);
+}
+
+static void CachingAllocatorFlush(Caching_Thread_Cache *cache) {
+	for (uint32_t size_class = 0; size_class < CachingAllocatorClassCount; ++size_class) {
+		Caching_Free_List *list = &cache->lists[size_class];
+
+		uint32_t block_size = CachingAllocatorClassSize(size_class);
+		while ((size_t)(cache->bump_end[size_class] - cache->bump[size_class]) >= block_size) {
+			uint8_t *block = cache->bump[size_class];
+			cache->bump[size_class] += block_size;
+			*(void **)block = list->head;
+			list->head      = block;
+			list->count    += 1;
+		}
+		cache->bump[size_class]     = nullptr;
+		cache->bump_end[size_class] = nullptr;
+
+		uint32_t batch = CachingAllocatorBatchCount(size_class);
+		while (list->count)
+			CachingAllocatorRelease(list, size_class, Minimum(batch, list->count));
+	}
+
+	AtomicAdd(&CachingStats.allocations, cache->allocations);
+	AtomicAdd(&CachingStats.frees, cache->frees);
+	cache->allocations = 0;
+	cache->frees       = 0;
+}
+
+Caching_Thread_Exit::~Caching_Thread_Exit() {
+	Caching_Thread_Cache *cache = &CachingThreadCache;
+	if (cache->state == CACHING_THREAD_ACTIVE) {
+		CachingAllocatorFlush(cache);
+		cache->state = CACHING_THREAD_EXITED;
+		AtomicSub(&CachingStats.thread_caches, 1);
+	}
+}
+
+static Caching_Thread_Cache *CachingAllocatorThreadCache() {
+	Caching_Thread_Cache *cache = &CachingThreadCache;
+	if (cache->state == CACHING_THREAD_UNUSED) {
+		// Registers the exit hook of the thread
+		Caching_Thread_Exit *hook = &CachingThreadExit;
+		(void)hook;
+		cache->state = CACHING_THREAD_ACTIVE;
+		AtomicInc(&CachingStats.thread_caches);
+	}
+	return cache;
+}
+
+//
+//
+//
+
+static void *CachingAllocatorRefill(Caching_Thread_Cache *cache, uint32_t size_class) {
+	Caching_Free_List *list = &cache->lists[size_class];
+
+	void *batch = CachingAllocatorPopBatch(size_class);
+	if (batch) {
+		uint32_t count = 0;
+		for (void *block = *(void **)batch; block; block = *(void **)block)
+			count += 1;
+		list->head  = *(void **)batch;
+		list->count = count;
+		AtomicInc(&CachingStats.depot_refills);
+		return batch;
+	}
+
+	uint32_t block_size = CachingAllocatorClassSize(size_class);
+	if ((size_t)(cache->bump_end[size_class] - cache->bump[size_class]) < block_size) {
+		Caching_Span *span = CachingAllocatorNewSpan(size_class);
+		if (!span)
+			return nullptr;
+		cache->bump[size_class]     = (uint8_t *)span + sizeof(Caching_Span);
+		cache->bump_end[size_class] = (uint8_t *)span + CachingAllocatorSpanSize;
+	}
+
+	void *block = cache->bump[size_class];
+	cache->bump[size_class] += block_size;
+	return block;
+}
+
+static void *CachingAllocatorAllocate(size_t size) {
+	if (size > CachingAllocatorMaxSmallSize)
+		return CachingAllocatorAllocateLarge(size);
+
+	Caching_Thread_Cache *cache = CachingAllocatorThreadCache();
+
+	uint32_t           size_class = CachingAllocatorSizeClass(size);
+	Caching_Free_List *list       = &cache->lists[size_class];
+
+	void *block = list->head;
+	if (block) {
+		list->head   = *(void **)block;
+		list->count -= 1;
+	} else {
+		block = CachingAllocatorRefill(cache, size_class);
+		if (!block)
+			return nullptr;
+	}
+
+	cache->allocations += 1;
+
+	// The thread is being torn down, nothing may stay in its cache
+	if (cache->state == CACHING_THREAD_EXITED)
+		CachingAllocatorFlush(cache);
+
+	return block;
+}
+
+static void CachingAllocatorFree(void *ptr) {
+	if (!ptr)
+		return;
+
+	Caching_Span *span = CachingAllocatorSpanOf(ptr);
+	if (span->size_class == CachingAllocatorLargeClass) {
+		CachingAllocatorFreeLarge(span);
+		return;
+	}
+
+	Caching_Thread_Cache *cache = CachingAllocatorThreadCache();
+
+	uint32_t           size_class = span->size_class;
+	Caching_Free_List *list       = &cache->lists[size_class];
+
+	*(void **)ptr = list->head;
+	list->head    = ptr;
+	list->count  += 1;
+
+	cache->frees += 1;
+
+	uint32_t batch = CachingAllocatorBatchCount(size_class);
+	if (list->count > 2 * batch)
+		CachingAllocatorRelease(list, size_class, batch);
+
+	if (cache->state == CACHING_THREAD_EXITED)
+		CachingAllocatorFlush(cache);
+}
+
+static void *CachingAllocatorReallocate(void *ptr, size_t new_size) {
+	if (!ptr)
+		return CachingAllocatorAllocate(new_size);
+
+	Caching_Span *span = CachingAllocatorSpanOf(ptr);
+
+	size_t capacity;
+	if (span->size_class == CachingAllocatorLargeClass) {
+		capacity = span->mapped - sizeof(Caching_Span);
+		if (new_size > CachingAllocatorMaxSmallSize && new_size <= capacity)
+			return ptr;
+	} else {
+		capacity = span->block_size;
+		if (new_size <= CachingAllocatorMaxSmallSize && CachingAllocatorSizeClass(new_size) == span->size_class)
+			return ptr;
+	}
+
+	void *mem = CachingAllocatorAllocate(new_size);
+	if (mem) {
+		memcpy(mem, ptr, Minimum(capacity, new_size));
+		CachingAllocatorFree(ptr);
+	}
+	return mem;
+}
+
+//
+//
+//
+
+void *CachingAllocatorProc(Allocation_Kind kind, void *mem, size_t prev_size, size_t new_size, void *context) {
+	if (kind == ALLOCATION_KIND_ALLOC) {
+		return CachingAllocatorAllocate(new_size);
+	} else if (kind == ALLOCATION_KIND_REALLOC) {
+		return CachingAllocatorReallocate(mem, new_size);
+	} else {
+		CachingAllocatorFree(mem);
+		return nullptr;
+	}
+}
+
+Memory_Allocator CachingAllocator() {
+	Memory_Allocator allocator;
+	allocator.proc    = CachingAllocatorProc;
+	allocator.context = nullptr;
+	return allocator;
+}
+
+void CachingAllocatorFlushThread() {
+	Caching_Thread_Cache *cache = &CachingThreadCache;
+	if (cache->state != CACHING_THREAD_UNUSED)
+		CachingAllocatorFlush(cache);
+}
+
+void CachingAllocatorGetStats(Caching_Allocator_Stats *stats) {
+	stats->small_spans    = AtomicLoad(&CachingStats.small_spans);
+	stats->large_live     = AtomicLoad(&CachingStats.large_live);
+	stats->large_bytes    = AtomicLoad(&CachingStats.large_bytes);
+	stats->large_total    = AtomicLoad(&CachingStats.large_total);
+	stats->large_reused   = AtomicLoad(&CachingStats.large_reused);
+	stats->depot_refills  = AtomicLoad(&CachingStats.depot_refills);
+	stats->depot_releases = AtomicLoad(&CachingStats.depot_releases);
+	stats->thread_caches  = AtomicLoad(&CachingStats.thread_caches);
+	stats->allocations    = AtomicLoad(&CachingStats.allocations) + CachingThreadCache.allocations;
+	stats->frees          = AtomicLoad(&CachingStats.frees) + CachingThreadCache.frees;
+
+	stats->depot_batches = 0;
+	for (uint32_t size_class = 0; size_class < CachingAllocatorClassCount; ++size_class)
+		stats->depot_batches += AtomicLoad(&CachingDepots[size_class].count);
+}
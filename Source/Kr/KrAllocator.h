@@ -0,0 +1,50 @@
+#pragma once
+#include "KrCommon.h"
+
+//
+// Thread caching allocator. Small allocations are rounded up to one of the size classes and served from a
+// free list of the calling thread, without any locking. Blocks freed by another thread go to that thread's
+// list, lists that grow past their limit give a batch back to the depot of the size class, and lists that
+// run empty take a batch from it. Only batch transfers and new spans take the (per size class) lock.
+//
+// Allocations larger than CachingAllocatorMaxSmallSize are mapped with VirtualMemoryAllocate. Freed mappings
+// of up to 1 MB are kept for reuse (16 MB at most), larger ones are unmapped. Memory of the small size classes
+// is kept and reused, it is not given back to the system.
+//
+// The size is found from the pointer, so blocks can be freed through the global operator delete. A thread
+// that exits gives its cached blocks back to the depot.
+//
+
+constexpr size_t   CachingAllocatorSpanSize     = KiloBytes(64);
+constexpr size_t   CachingAllocatorMaxSmallSize = KiloBytes(16);
+constexpr uint32_t CachingAllocatorClassCount   = 36;
+
+struct Caching_Allocator_Stats {
+	int64_t small_spans;    // spans carved into small blocks
+	int64_t large_live;     // large allocations currently mapped
+	int64_t large_bytes;    // bytes mapped for them
+	int64_t large_total;    // large allocations made
+	int64_t large_reused;   // of them, served from a freed mapping
+	int64_t depot_batches;  // batches waiting in the depots
+	int64_t depot_refills;  // batches taken by the thread caches
+	int64_t depot_releases; // batches given back by the thread caches
+	int64_t thread_caches;  // threads that have used the allocator and not exited
+	int64_t allocations;    // small allocations, of the exited threads and the calling thread
+	int64_t frees;
+};
+
+void *CachingAllocatorProc(Allocation_Kind kind, void *mem, size_t prev_size, size_t new_size, void *context);
+
+Memory_Allocator CachingAllocator();
+
+// Gives the blocks cached by the calling thread back to the depot, done automatically when the thread exits
+void CachingAllocatorFlushThread();
+
+void CachingAllocatorGetStats(Caching_Allocator_Stats *stats);
+
+static constexpr Thread_Context_Params ThreadContextCachingParams = {
+	{ CachingAllocatorProc, nullptr },
+	{ DefaultLoggerProc, nullptr },
+	DefaultFatalErrorProc,
+	MaxThreadContextScratchpadArena
+};
@@ -0,0 +1,197 @@
+#include "KrAtomic.h"
+
+#if PLATFORM_WINDOWS == 1
+#include <Windows.h>
+#pragma comment(lib, "Synchronization.lib")
+#else
+#include <sched.h>
+#include <time.h>
+#include <errno.h>
+#endif
+
+#if PLATFORM_LINUX == 1
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+constexpr uint32_t SpinLockBackoffLimit = 64;  // pauses between attempts, doubled up to this
+constexpr uint32_t TicketLockBackoff    = 32;  // pauses per waiter ahead in the line
+constexpr uint32_t TicketLockYieldAhead = 4;   // waiters further back yield instead of spinning
+constexpr uint32_t TicketLockSpinCount  = 64;  // rounds of backoff before yielding
+constexpr uint32_t RWLockSpinCount      = 128; // attempts before parking
+
+//
+//
+//
+
+#if PLATFORM_WINDOWS == 1
+
+bool AtomicWait(int32_t volatile *addr, int32_t expected, int millisecs) {
+	if (WaitOnAddress(addr, &expected, sizeof(expected), millisecs >= 0 ? (DWORD)millisecs : INFINITE))
+		return true;
+	return GetLastError() != ERROR_TIMEOUT;
+}
+
+void AtomicWakeOne(int32_t volatile *addr) {
+	WakeByAddressSingle((PVOID)addr);
+}
+
+void AtomicWakeAll(int32_t volatile *addr) {
+	WakeByAddressAll((PVOID)addr);
+}
+
+void AtomicYield() {
+	SwitchToThread();
+}
+
+#elif PLATFORM_LINUX == 1
+
+bool AtomicWait(int32_t volatile *addr, int32_t expected, int millisecs) {
+	timespec  timeout;
+	timespec *ptimeout = nullptr;
+	if (millisecs >= 0) {
+		timeout.tv_sec  = millisecs / 1000;
+		timeout.tv_nsec = (long)(millisecs % 1000) * 1000000;
+		ptimeout        = &timeout;
+	}
+	long result = syscall(SYS_futex, (int32_t *)addr, FUTEX_WAIT_PRIVATE, expected, ptimeout, nullptr, 0);
+	return result == 0 || errno != ETIMEDOUT;
+}
+
+void AtomicWakeOne(int32_t volatile *addr) {
+	syscall(SYS_futex, (int32_t *)addr, FUTEX_WAKE_PRIVATE, 1, nullptr, nullptr, 0);
+}
+
+void AtomicWakeAll(int32_t volatile *addr) {
+	syscall(SYS_futex, (int32_t *)addr, FUTEX_WAKE_PRIVATE, INT32_MAX, nullptr, nullptr, 0);
+}
+
+void AtomicYield() {
+	sched_yield();
+}
+
+#else
+
+// No public futex, waiters poll with short sleeps
+bool AtomicWait(int32_t volatile *addr, int32_t expected, int millisecs) {
+	timespec nap = { 0, 50000 };
+	int64_t  waited = 0;
+	while (AtomicLoadAcquire(addr) == expected) {
+		if (millisecs >= 0 && waited >= (int64_t)millisecs * 1000000)
+			return false;
+		nanosleep(&nap, nullptr);
+		waited += nap.tv_nsec;
+	}
+	return true;
+}
+
+void AtomicWakeOne(int32_t volatile *addr) {}
+
+void AtomicWakeAll(int32_t volatile *addr) {}
+
+void AtomicYield() {
+	sched_yield();
+}
+
+#endif
+
+//
+//
+//
+
+void SpinLockContended(Atomic_Guard *guard) {
+	uint32_t backoff = 1;
+	for (;;) {
+		for (uint32_t pause = 0; pause < backoff; ++pause)
+			AtomicPause();
+
+		if (SpinTryLock(guard))
+			return;
+
+		if (backoff < SpinLockBackoffLimit)
+			backoff <<= 1;
+		else
+			AtomicYield();
+	}
+}
+
+void TicketLockContended(Ticket_Lock *lock, int32_t ticket) {
+	uint32_t spins = 0;
+	for (;;) {
+		uint32_t ahead = (uint32_t)ticket - (uint32_t)AtomicLoadAcquire(&lock->serving);
+		if (ahead == 0)
+			return;
+
+		// The holder or a waiter ahead may not be running, spinning longer would only keep it from it
+		if (ahead > TicketLockYieldAhead || spins >= TicketLockSpinCount) {
+			AtomicYield();
+			continue;
+		}
+
+		spins += 1;
+		for (uint32_t pause = 0; pause < ahead * TicketLockBackoff; ++pause)
+			AtomicPause();
+	}
+}
+
+void ReadLockContended(RW_Lock *lock) {
+	uint32_t spins = 0;
+	for (;;) {
+		int32_t state = AtomicLoadRelaxed(&lock->state);
+
+		if (!(state & RWLockWriter)) {
+			if (AtomicCmpExgAcquire(&lock->state, state + 1, state) == state)
+				return;
+			continue;
+		}
+
+		if (spins < RWLockSpinCount) {
+			spins += 1;
+			AtomicPause();
+			continue;
+		}
+
+		if (!(state & RWLockParked) && AtomicCmpExg(&lock->state, state | RWLockParked, state) != state)
+			continue;
+
+		AtomicWait(&lock->state, state | RWLockParked);
+	}
+}
+
+void WriteLockContended(RW_Lock *lock) {
+	uint32_t spins = 0;
+	for (;;) {
+		int32_t state = AtomicLoadRelaxed(&lock->state);
+
+		// The parked flag stays, the threads that set it are woken on unlock
+		if ((state & ~RWLockParked) == 0) {
+			if (AtomicCmpExgAcquire(&lock->state, state | RWLockWriter, state) == state)
+				return;
+			continue;
+		}
+
+		if (spins < RWLockSpinCount) {
+			spins += 1;
+			AtomicPause();
+			continue;
+		}
+
+		if (!(state & RWLockParked) && AtomicCmpExg(&lock->state, state | RWLockParked, state) != state)
+			continue;
+
+		AtomicWait(&lock->state, state | RWLockParked);
+	}
+}
+
+void RWLockWake(RW_Lock *lock, int32_t state) {
+	// All parked threads are woken, the ones that have to wait again set the flag again
+	while (state & RWLockParked) {
+		int32_t prev = AtomicCmpExg(&lock->state, state & ~RWLockParked, state);
+		if (prev == state) {
+			AtomicWakeAll(&lock->state);
+			return;
+		}
+		state = prev;
+	}
+}
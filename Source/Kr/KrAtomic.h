@@ -40,13 +40,13 @@ INLINE_PROCEDURE void *  AtomicCmpExg(void *volatile *dst, void *exchange, void
 INLINE_PROCEDURE int32_t AtomicLoad(int32_t volatile *src) { return __atomic_load_n(src, __ATOMIC_SEQ_CST); }
 INLINE_PROCEDURE int32_t AtomicExchange(int32_t volatile *src, int32_t value) { return __atomic_exchange_n(src, value, __ATOMIC_SEQ_CST); }
 INLINE_PROCEDURE void    AtomicStore(int32_t volatile *src, int32_t value) { __atomic_store_n(src, value, __ATOMIC_SEQ_CST); }
-INLINE_PROCEDURE void *  AtomicLoad(void *volatile *dst) { return __atomic_load_n(src, __ATOMIC_SEQ_CST); }
+INLINE_PROCEDURE void *  AtomicLoad(void *volatile *src) { return __atomic_load_n(src, __ATOMIC_SEQ_CST); }
 INLINE_PROCEDURE void *  AtomicExchange(void *volatile *src, void *value) { return __atomic_exchange_n(src, value, __ATOMIC_SEQ_CST); }
 INLINE_PROCEDURE void    AtomicStore(void *volatile *src, void *value) { __atomic_store_n(src, value, __ATOMIC_SEQ_CST); }
 
 #if ARCH_X64 == 1 || ARCH_ARM64 == 1
 INLINE_PROCEDURE int64_t AtomicInc(int64_t volatile *addend) { return __sync_add_and_fetch(addend, 1); }
-INLINE_PROCEDURE int64_t AtomicDec(int64_t volatile *addend) { return __sync_add_and_fetch(addend, 1); }
+INLINE_PROCEDURE int64_t AtomicDec(int64_t volatile *addend) { return __sync_sub_and_fetch(addend, 1); }
 INLINE_PROCEDURE int64_t AtomicAdd(int64_t volatile *addend, int64_t value) { return __sync_add_and_fetch(addend, value); }
 INLINE_PROCEDURE int64_t AtomicSub(int64_t volatile *sub, int64_t value) { return __sync_sub_and_fetch(sub, value); }
 INLINE_PROCEDURE int64_t AtomicCmpExg(int64_t volatile *dst, int64_t exchange, int64_t comperand) { return __sync_val_compare_and_swap(dst, comperand, exchange); }
@@ -57,24 +57,186 @@ INLINE_PROCEDURE void    AtomicStore(int64_t volatile *src, int64_t value) { __a
 
 #endif
 
+//
+// Explicit memory orders. Relaxed only makes the access itself atomic, Acquire keeps the loads and stores
+// that follow after it and Release keeps the ones before it in front. The functions above are sequentially
+// consistent. The read-modify-write functions return the new value, as above, except for the exchanges.
+//
+
+#if PLATFORM_WINDOWS == 1 && (ARCH_X64 == 1 || ARCH_X86 == 1)
+
+// Loads and stores are ordered on x86, only the compiler has to be kept from moving them
+INLINE_PROCEDURE int32_t AtomicLoadRelaxed(int32_t volatile *src) { return *src; }
+INLINE_PROCEDURE int32_t AtomicLoadAcquire(int32_t volatile *src) { int32_t value = *src; _ReadWriteBarrier(); return value; }
+INLINE_PROCEDURE void    AtomicStoreRelaxed(int32_t volatile *dst, int32_t value) { *dst = value; }
+INLINE_PROCEDURE void    AtomicStoreRelease(int32_t volatile *dst, int32_t value) { _ReadWriteBarrier(); *dst = value; }
+INLINE_PROCEDURE int32_t AtomicAddRelaxed(int32_t volatile *addend, int32_t value) { return _interlockedadd((volatile long *)addend, value); }
+INLINE_PROCEDURE int32_t AtomicCmpExgAcquire(int32_t volatile *dst, int32_t exchange, int32_t comperand) { return _InterlockedCompareExchange((volatile long *)dst, exchange, comperand); }
+INLINE_PROCEDURE int32_t AtomicCmpExgRelease(int32_t volatile *dst, int32_t exchange, int32_t comperand) { return _InterlockedCompareExchange((volatile long *)dst, exchange, comperand); }
+INLINE_PROCEDURE int32_t AtomicExchangeAcquire(int32_t volatile *dst, int32_t value) { return _InterlockedExchange((volatile long *)dst, value); }
+INLINE_PROCEDURE void *  AtomicLoadRelaxed(void *volatile *src) { return *src; }
+INLINE_PROCEDURE void *  AtomicLoadAcquire(void *volatile *src) { void *value = *src; _ReadWriteBarrier(); return value; }
+INLINE_PROCEDURE void    AtomicStoreRelaxed(void *volatile *dst, void *value) { *dst = value; }
+INLINE_PROCEDURE void    AtomicStoreRelease(void *volatile *dst, void *value) { _ReadWriteBarrier(); *dst = value; }
+INLINE_PROCEDURE void *  AtomicCmpExgAcquire(void *volatile *dst, void *exchange, void *comperand) { return _InterlockedCompareExchangePointer(dst, exchange, comperand); }
+INLINE_PROCEDURE void *  AtomicCmpExgRelease(void *volatile *dst, void *exchange, void *comperand) { return _InterlockedCompareExchangePointer(dst, exchange, comperand); }
+
+#if ARCH_X64 == 1
+INLINE_PROCEDURE int64_t AtomicLoadRelaxed(int64_t volatile *src) { return *src; }
+INLINE_PROCEDURE int64_t AtomicLoadAcquire(int64_t volatile *src) { int64_t value = *src; _ReadWriteBarrier(); return value; }
+INLINE_PROCEDURE void    AtomicStoreRelaxed(int64_t volatile *dst, int64_t value) { *dst = value; }
+INLINE_PROCEDURE void    AtomicStoreRelease(int64_t volatile *dst, int64_t value) { _ReadWriteBarrier(); *dst = value; }
+INLINE_PROCEDURE int64_t AtomicAddRelaxed(int64_t volatile *addend, int64_t value) { return _interlockedadd64((volatile long long *)addend, value); }
+INLINE_PROCEDURE int64_t AtomicCmpExgAcquire(int64_t volatile *dst, int64_t exchange, int64_t comperand) { return _InterlockedCompareExchange64((volatile long long *)dst, exchange, comperand); }
+INLINE_PROCEDURE int64_t AtomicCmpExgRelease(int64_t volatile *dst, int64_t exchange, int64_t comperand) { return _InterlockedCompareExchange64((volatile long long *)dst, exchange, comperand); }
+#endif
+
+INLINE_PROCEDURE void AtomicFenceAcquire() { _ReadWriteBarrier(); }
+INLINE_PROCEDURE void AtomicFenceRelease() { _ReadWriteBarrier(); }
+INLINE_PROCEDURE void AtomicFence() { _mm_mfence(); }
+INLINE_PROCEDURE void AtomicPause() { _mm_pause(); }
+
+#else
+
+INLINE_PROCEDURE int32_t AtomicLoadRelaxed(int32_t volatile *src) { return __atomic_load_n(src, __ATOMIC_RELAXED); }
+INLINE_PROCEDURE int32_t AtomicLoadAcquire(int32_t volatile *src) { return __atomic_load_n(src, __ATOMIC_ACQUIRE); }
+INLINE_PROCEDURE void    AtomicStoreRelaxed(int32_t volatile *dst, int32_t value) { __atomic_store_n(dst, value, __ATOMIC_RELAXED); }
+INLINE_PROCEDURE void    AtomicStoreRelease(int32_t volatile *dst, int32_t value) { __atomic_store_n(dst, value, __ATOMIC_RELEASE); }
+INLINE_PROCEDURE int32_t AtomicAddRelaxed(int32_t volatile *addend, int32_t value) { return __atomic_add_fetch(addend, value, __ATOMIC_RELAXED); }
+INLINE_PROCEDURE int32_t AtomicCmpExgAcquire(int32_t volatile *dst, int32_t exchange, int32_t comperand) { __atomic_compare_exchange_n(dst, &comperand, exchange, false, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED); return comperand; }
+INLINE_PROCEDURE int32_t AtomicCmpExgRelease(int32_t volatile *dst, int32_t exchange, int32_t comperand) { __atomic_compare_exchange_n(dst, &comperand, exchange, false, __ATOMIC_RELEASE, __ATOMIC_RELAXED); return comperand; }
+INLINE_PROCEDURE int32_t AtomicExchangeAcquire(int32_t volatile *dst, int32_t value) { return __atomic_exchange_n(dst, value, __ATOMIC_ACQUIRE); }
+INLINE_PROCEDURE void *  AtomicLoadRelaxed(void *volatile *src) { return __atomic_load_n(src, __ATOMIC_RELAXED); }
+INLINE_PROCEDURE void *  AtomicLoadAcquire(void *volatile *src) { return __atomic_load_n(src, __ATOMIC_ACQUIRE); }
+INLINE_PROCEDURE void    AtomicStoreRelaxed(void *volatile *dst, void *value) { __atomic_store_n(dst, value, __ATOMIC_RELAXED); }
+INLINE_PROCEDURE void    AtomicStoreRelease(void *volatile *dst, void *value) { __atomic_store_n(dst, value, __ATOMIC_RELEASE); }
+INLINE_PROCEDURE void *  AtomicCmpExgAcquire(void *volatile *dst, void *exchange, void *comperand) { __atomic_compare_exchange_n(dst, &comperand, exchange, false, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED); return comperand; }
+INLINE_PROCEDURE void *  AtomicCmpExgRelease(void *volatile *dst, void *exchange, void *comperand) { __atomic_compare_exchange_n(dst, &comperand, exchange, false, __ATOMIC_RELEASE, __ATOMIC_RELAXED); return comperand; }
+
+#if ARCH_X64 == 1 || ARCH_ARM64 == 1
+INLINE_PROCEDURE int64_t AtomicLoadRelaxed(int64_t volatile *src) { return __atomic_load_n(src, __ATOMIC_RELAXED); }
+INLINE_PROCEDURE int64_t AtomicLoadAcquire(int64_t volatile *src) { return __atomic_load_n(src, __ATOMIC_ACQUIRE); }
+INLINE_PROCEDURE void    AtomicStoreRelaxed(int64_t volatile *dst, int64_t value) { __atomic_store_n(dst, value, __ATOMIC_RELAXED); }
+INLINE_PROCEDURE void    AtomicStoreRelease(int64_t volatile *dst, int64_t value) { __atomic_store_n(dst, value, __ATOMIC_RELEASE); }
+INLINE_PROCEDURE int64_t AtomicAddRelaxed(int64_t volatile *addend, int64_t value) { return __atomic_add_fetch(addend, value, __ATOMIC_RELAXED); }
+INLINE_PROCEDURE int64_t AtomicCmpExgAcquire(int64_t volatile *dst, int64_t exchange, int64_t comperand) { __atomic_compare_exchange_n(dst, &comperand, exchange, false, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED); return comperand; }
+INLINE_PROCEDURE int64_t AtomicCmpExgRelease(int64_t volatile *dst, int64_t exchange, int64_t comperand) { __atomic_compare_exchange_n(dst, &comperand, exchange, false, __ATOMIC_RELEASE, __ATOMIC_RELAXED); return comperand; }
+#endif
+
+INLINE_PROCEDURE void AtomicFenceAcquire() { __atomic_thread_fence(__ATOMIC_ACQUIRE); }
+INLINE_PROCEDURE void AtomicFenceRelease() { __atomic_thread_fence(__ATOMIC_RELEASE); }
+INLINE_PROCEDURE void AtomicFence() { __atomic_thread_fence(__ATOMIC_SEQ_CST); }
+
+INLINE_PROCEDURE void AtomicPause() {
+#if ARCH_X64 == 1 || ARCH_X86 == 1
+	__builtin_ia32_pause();
+#elif ARCH_ARM64 == 1 || ARCH_ARM32 == 1
+	__asm__ __volatile__("yield");
+#endif
+}
+
+#endif
+
 template <typename T>
 INLINE_PROCEDURE void *AtomicCmpExg(T *volatile *dst, T *exchange, T *comperand) {
 	return (T *)AtomicCmpExg((void *volatile *)dst, (void *)exchange, (void *)comperand);
 }
 
 //
+// Waiting on an address, the thread sleeps until the value at 'addr' is no longer 'expected' and it is woken,
+// (futex on Linux, WaitOnAddress on Windows). Wake ups may be spurious, callers check the value again.
+// Returns false on timeout.
+//
+
+bool AtomicWait(int32_t volatile *addr, int32_t expected, int millisecs = -1);
+void AtomicWakeOne(int32_t volatile *addr);
+void AtomicWakeAll(int32_t volatile *addr);
+
+// Gives up the rest of the time slice
+void AtomicYield();
+
 //
+// Test and test and set spin lock. Waiters spin on a plain load with a pause and exponential backoff and
+// yield the processor once the backoff is at its limit, so a holder that got descheduled gets to run.
 //
 
 struct Atomic_Guard {
 	int32_t volatile value;
 };
 
+void SpinLockContended(Atomic_Guard *guard);
+
+INLINE_PROCEDURE bool SpinTryLock(Atomic_Guard *guard) {
+	return AtomicLoadRelaxed(&guard->value) == 0 && AtomicExchangeAcquire(&guard->value, 1) == 0;
+}
+
 INLINE_PROCEDURE void SpinLock(Atomic_Guard *guard) {
-	while (AtomicCmpExg(&guard->value, 1, 0) == 1)
-		;
+	if (!SpinTryLock(guard))
+		SpinLockContended(guard);
 }
 
 INLINE_PROCEDURE void SpinUnlock(Atomic_Guard *guard) {
-	AtomicStore(&guard->value, 0);
+	AtomicStoreRelease(&guard->value, 0);
+}
+
+//
+// Ticket lock, the lock is handed out in the order it was asked for. Waiters back off in proportion to
+// their place in the line.
+//
+
+struct Ticket_Lock {
+	int32_t volatile next;
+	int32_t volatile serving;
+};
+
+void TicketLockContended(Ticket_Lock *lock, int32_t ticket);
+
+INLINE_PROCEDURE void TicketLock(Ticket_Lock *lock) {
+	int32_t ticket = (int32_t)((uint32_t)AtomicInc(&lock->next) - 1);
+	if (AtomicLoadAcquire(&lock->serving) != ticket)
+		TicketLockContended(lock, ticket);
+}
+
+INLINE_PROCEDURE void TicketUnlock(Ticket_Lock *lock) {
+	AtomicStoreRelease(&lock->serving, (int32_t)((uint32_t)AtomicLoadRelaxed(&lock->serving) + 1));
+}
+
+//
+// Reader-writer lock. Readers share it, writers hold it alone. Both spin for a short while and then park on
+// the lock word with AtomicWait. Readers are preferred, a steady stream of them keeps writers waiting.
+//
+
+struct RW_Lock {
+	int32_t volatile state; // reader count and the flags below
+};
+
+constexpr int32_t RWLockWriter  = 0x40000000;
+constexpr int32_t RWLockParked  = 0x20000000; // some thread waits in AtomicWait
+constexpr int32_t RWLockReaders = RWLockParked - 1;
+
+void ReadLockContended(RW_Lock *lock);
+void WriteLockContended(RW_Lock *lock);
+void RWLockWake(RW_Lock *lock, int32_t state);
+
+INLINE_PROCEDURE void ReadLock(RW_Lock *lock) {
+	int32_t state = AtomicLoadRelaxed(&lock->state);
+	if ((state & RWLockWriter) || AtomicCmpExgAcquire(&lock->state, state + 1, state) != state)
+		ReadLockContended(lock);
+}
+
+INLINE_PROCEDURE void ReadUnlock(RW_Lock *lock) {
+	int32_t state = AtomicAdd(&lock->state, -1);
+	if ((state & RWLockParked) && (state & RWLockReaders) == 0)
+		RWLockWake(lock, state);
+}
+
+INLINE_PROCEDURE void WriteLock(RW_Lock *lock) {
+	if (AtomicCmpExgAcquire(&lock->state, RWLockWriter, 0) != 0)
+		WriteLockContended(lock);
+}
+
+INLINE_PROCEDURE void WriteUnlock(RW_Lock *lock) {
+	int32_t state = AtomicAdd(&lock->state, -RWLockWriter);
+	if (state & RWLockParked)
+		RWLockWake(lock, state);
 }
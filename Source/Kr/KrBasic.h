@@ -3,6 +3,14 @@
 
 #include <string.h>
 
+#if ARCH_X64 == 1 || ARCH_X86 == 1
+#include <emmintrin.h>
+#endif
+
+#if COMPILER_MSVC == 1
+#include <intrin.h>
+#endif
+
 template <typename T>
 struct Array {
 	ptrdiff_t          count;
@@ -151,6 +159,153 @@ inline void Free(Array<T> *a) {
 		MemoryFree(a->data, sizeof(T) * a->allocated, a->allocator);
 }
 
+//
+// Array with room for N elements inside the struct, more than N are moved to memory from the allocator.
+// The inline elements are copied with the struct and the spilled ones are shared, as with Array.
+//
+
+template <typename T, ptrdiff_t N>
+struct Small_Array {
+	static_assert(N > 0, "Small_Array needs room for at least one element");
+
+	ptrdiff_t          count;
+	ptrdiff_t          allocated;
+	Memory_Allocator   allocator;
+
+	union {
+		T *            heap;
+		alignas(T) uint8_t buffer[sizeof(T) * N];
+	};
+
+	inline Small_Array() : count(0), allocated(N), allocator(ThreadContext.allocator) {}
+	inline Small_Array(Memory_Allocator _allocator) : count(0), allocated(N), allocator(_allocator) {}
+	inline T *Data() { return allocated > N ? heap : (T *)buffer; }
+	inline const T *Data() const { return allocated > N ? heap : (const T *)buffer; }
+	inline bool IsInline() const { return allocated == N; }
+	inline operator Array_View<T>() { return Array_View<T>(Data(), count); }
+	inline operator const Array_View<T>() const { return Array_View<T>((T *)Data(), count); }
+	inline T &operator[](ptrdiff_t i) { Assert(i >= 0 && i < count); return Data()[i]; }
+	inline const T &operator[](ptrdiff_t i) const { Assert(i >= 0 && i < count); return Data()[i]; }
+	inline T *begin() { return Data(); }
+	inline T *end() { return Data() + count; }
+	inline const T *begin() const { return Data(); }
+	inline const T *end() const { return Data() + count; }
+	T &First() { Assert(count); return Data()[0]; }
+	const T &First() const { Assert(count); return Data()[0]; }
+	T &Last() { Assert(count); return Data()[count - 1]; }
+	const T &Last() const { Assert(count); return Data()[count - 1]; }
+
+	inline ptrdiff_t GetGrowCapacity(ptrdiff_t size) const {
+		ptrdiff_t new_capacity = allocated > N ? (allocated + allocated / 2) : Maximum(N * 2, (ptrdiff_t)4);
+		return new_capacity > size ? new_capacity : size;
+	}
+
+	inline bool Reserve(ptrdiff_t new_capacity) {
+		if (new_capacity <= allocated)
+			return true;
+		if (allocated > N) {
+			T *new_data = (T *)MemoryReallocate(allocated * sizeof(T), new_capacity * sizeof(T), heap, allocator);
+			if (!new_data) return false;
+			heap = new_data;
+		} else {
+			T *new_data = (T *)MemoryAllocate(new_capacity * sizeof(T), allocator);
+			if (!new_data) return false;
+			memcpy(new_data, buffer, count * sizeof(T));
+			heap = new_data;
+		}
+		allocated = new_capacity;
+		return true;
+	}
+
+	inline bool Resize(ptrdiff_t new_count) {
+		if (Reserve(new_count)) {
+			T *data = Data();
+			for (ptrdiff_t index = count; index < new_count; ++index)
+				data[index] = T{};
+			count = new_count;
+			return true;
+		}
+		return false;
+	}
+
+	template <typename... Args> void Emplace(const Args &...args) {
+		if (count == allocated) {
+			ptrdiff_t n = GetGrowCapacity(allocated + 1);
+			if (!Reserve(n)) return;
+		}
+		Data()[count] = T(args...);
+		count += 1;
+	}
+
+	T *Add() {
+		if (count == allocated) {
+			ptrdiff_t c = GetGrowCapacity(allocated + 1);
+			if (!Reserve(c))
+				return nullptr;
+		}
+		count += 1;
+		return Data() + (count - 1);
+	}
+
+	T *AddN(uint32_t n) {
+		if (count + n > allocated) {
+			ptrdiff_t c = GetGrowCapacity(count + n);
+			if (!Reserve(c))
+				return nullptr;
+		}
+		T *ptr = Data() + count;
+		count += n;
+		return ptr;
+	}
+
+	void Add(const T &d) {
+		T *m = Add();
+		if (m)
+			*m = d;
+	}
+
+	void RemoveLast() {
+		Assert(count > 0);
+		count -= 1;
+	}
+
+	void Remove(ptrdiff_t index) {
+		Assert(index < count);
+		T *data = Data();
+		memmove(data + index, data + index + 1, (count - index - 1) * sizeof(T));
+		count -= 1;
+	}
+
+	void RemoveUnordered(ptrdiff_t index) {
+		Assert(index < count);
+		T *data = Data();
+		data[index] = data[count - 1];
+		count -= 1;
+	}
+
+	void Insert(ptrdiff_t index, const T &v) {
+		Assert(index < count + 1);
+		if (!Add()) return;
+		T *data = Data();
+		for (ptrdiff_t move_index = count - 1; move_index > index; --move_index) {
+			data[move_index] = data[move_index - 1];
+		}
+		data[index] = v;
+	}
+
+	void Reset() {
+		count = 0;
+	}
+};
+
+template <typename T, ptrdiff_t N>
+inline void Free(Small_Array<T, N> *a) {
+	if (a->allocated > N)
+		MemoryFree(a->heap, sizeof(T) * a->allocated, a->allocator);
+	a->count     = 0;
+	a->allocated = N;
+}
+
 template <typename T>
 inline ptrdiff_t Find(Array_View<T> arr, const T &v) {
 	for (ptrdiff_t index = 0; index < arr.count; ++index) {
@@ -173,25 +328,112 @@ inline ptrdiff_t Find(Array_View<T> arr, SearchFunc func, const Args &...args) {
 }
 
 //
+// Hashing, wyhash (final version 4) for bytes and the murmur3 finalizer for integers
 //
-//
 
-constexpr int HASHTABLE_BUCKET_SIZE = 4;
-constexpr int HASHTABLE_BUCKET_SHIFT = 2;
-constexpr int HASHTABLE_BUCKET_MASK = HASHTABLE_BUCKET_SIZE - 1;
-constexpr int HASHTABLE_EMPTY = 0;
-constexpr int HASHTABLE_TOMBSTONE = 1;
-constexpr int HASHTABLE_MAX_RES_HASH = 1;
-constexpr int HASHTABLE_INITIAL_SIZE = 4;
-
-static_assert(IsPower2(HASHTABLE_BUCKET_SIZE), "");
-static_assert(HASHTABLE_BUCKET_SIZE == 8 || HASHTABLE_BUCKET_SIZE == 4, "");
-
-static uint32_t SDBM(const uint8_t *buff, ptrdiff_t len) {
-	uint32_t hash = 0;
-	for (ptrdiff_t i = 0; i < len; ++i)
-		hash = buff[i] + (hash << 6) + (hash << 16) - hash;
-	return hash;
+// 128 bit product of a and b, the low half in a and the high half in b
+INLINE_PROCEDURE void HashMultiply(uint64_t *a, uint64_t *b) {
+#if COMPILER_MSVC == 1 && ARCH_X64 == 1
+	*a = _umul128(*a, *b, b);
+#elif defined(__SIZEOF_INT128__)
+	__uint128_t product = (__uint128_t)*a * *b;
+	*a = (uint64_t)product;
+	*b = (uint64_t)(product >> 64);
+#else
+	uint64_t ha = *a >> 32, hb = *b >> 32, la = (uint32_t)*a, lb = (uint32_t)*b;
+	uint64_t rh = ha * hb, rm0 = ha * lb, rm1 = hb * la, rl = la * lb;
+	uint64_t t = rl + (rm0 << 32), c = t < rl;
+	uint64_t low = t + (rm1 << 32);
+	c += low < t;
+	*a = low;
+	*b = rh + (rm0 >> 32) + (rm1 >> 32) + c;
+#endif
+}
+
+INLINE_PROCEDURE uint64_t HashMix(uint64_t a, uint64_t b) {
+	HashMultiply(&a, &b);
+	return a ^ b;
+}
+
+INLINE_PROCEDURE uint64_t HashRead64(const uint8_t *p) { uint64_t v; memcpy(&v, p, sizeof(v)); return v; }
+INLINE_PROCEDURE uint64_t HashRead32(const uint8_t *p) { uint32_t v; memcpy(&v, p, sizeof(v)); return v; }
+
+INLINE_PROCEDURE uint64_t HashBytes(const void *data, ptrdiff_t length, uint64_t seed = 0) {
+	constexpr uint64_t secret[4] = { 0x2d358dccaa6c78a5ull, 0x8bb84b93962eacc9ull, 0x4b33a62ed433d4a3ull, 0x4d5a2da51de1aa47ull };
+
+	const uint8_t *p   = (const uint8_t *)data;
+	size_t         len = (size_t)length;
+
+	seed ^= HashMix(seed ^ secret[0], secret[1]);
+
+	uint64_t a, b;
+	if (len <= 16) {
+		if (len >= 4) {
+			a = (HashRead32(p) << 32) | HashRead32(p + ((len >> 3) << 2));
+			b = (HashRead32(p + len - 4) << 32) | HashRead32(p + len - 4 - ((len >> 3) << 2));
+		} else if (len > 0) {
+			a = ((uint64_t)p[0] << 16) | ((uint64_t)p[len >> 1] << 8) | p[len - 1];
+			b = 0;
+		} else {
+			a = b = 0;
+		}
+	} else {
+		size_t left = len;
+		if (left > 48) {
+			uint64_t see1 = seed, see2 = seed;
+			do {
+				seed = HashMix(HashRead64(p) ^ secret[1], HashRead64(p + 8) ^ seed);
+				see1 = HashMix(HashRead64(p + 16) ^ secret[2], HashRead64(p + 24) ^ see1);
+				see2 = HashMix(HashRead64(p + 32) ^ secret[3], HashRead64(p + 40) ^ see2);
+				p += 48;
+				left -= 48;
+			} while (left > 48);
+			seed ^= see1 ^ see2;
+		}
+		while (left > 16) {
+			seed = HashMix(HashRead64(p) ^ secret[1], HashRead64(p + 8) ^ seed);
+			p += 16;
+			left -= 16;
+		}
+		a = HashRead64(p + left - 16);
+		b = HashRead64(p + left - 8);
+	}
+
+	a ^= secret[1];
+	b ^= seed;
+	HashMultiply(&a, &b);
+	return HashMix(a ^ secret[0] ^ len, b ^ secret[1]);
+}
+
+INLINE_PROCEDURE uint64_t HashU64(uint64_t value) {
+	value ^= value >> 33;
+	value *= 0xff51afd7ed558ccdull;
+	value ^= value >> 33;
+	value *= 0xc4ceb9fe1a85ec53ull;
+	value ^= value >> 33;
+	return value;
+}
+
+INLINE_PROCEDURE uint32_t CountTrailingZeros32(uint32_t value) {
+	Assert(value);
+#if COMPILER_MSVC == 1
+	unsigned long index;
+	_BitScanForward(&index, value);
+	return (uint32_t)index;
+#else
+	return (uint32_t)__builtin_ctz(value);
+#endif
+}
+
+INLINE_PROCEDURE uint32_t CountLeadingZeros32(uint32_t value) {
+	Assert(value);
+#if COMPILER_MSVC == 1
+	unsigned long index;
+	_BitScanReverse(&index, value);
+	return 31 - (uint32_t)index;
+#else
+	return (uint32_t)__builtin_clz(value);
+#endif
 }
 
 static inline ptrdiff_t NextPowerOf2(ptrdiff_t n) {
@@ -205,31 +447,21 @@ static inline ptrdiff_t NextPowerOf2(ptrdiff_t n) {
 	return (ptrdiff_t)1 << (ptrdiff_t)count;
 }
 
+// Keys up to 8 bytes are mixed as an integer, larger ones hashed as bytes (including any padding)
 template <typename T> struct Hasher_Default {
-	size_t operator()(const T v) const {
-		return SDBM((uint8_t *)&v, sizeof(v));
+	size_t operator()(const T &v) const {
+		if constexpr (sizeof(T) <= sizeof(uint64_t)) {
+			uint64_t value = 0;
+			memcpy(&value, &v, sizeof(T));
+			return (size_t)HashU64(value);
+		} else {
+			return (size_t)HashBytes(&v, sizeof(v));
+		}
 	}
 };
 template <> struct Hasher_Default<String> {
 	size_t operator()(const String v) const {
-		return SDBM(v.data, v.length);
-	}
-};
-template <> struct Hasher_Default<ptrdiff_t> {
-	size_t operator()(const ptrdiff_t v) const {
-		return (uint32_t)v;
-	}
-};
-template <>
-struct Hasher_Default<uint64_t> {
-	size_t operator()(const uint64_t v) const {
-		return (uint32_t)v;
-	}
-};
-template <>
-struct Hasher_Default<int> {
-	size_t operator()(const uint64_t v) const {
-		return (uint32_t)v;
+		return (size_t)HashBytes(v.data, v.length);
 	}
 };
 
@@ -243,22 +475,61 @@ struct Trivial_Key_Free {
 	void operator()(const T *key) {}
 };
 
+//
+// Hash_Table keeps the pairs packed in 'storage' and finds them through an open addressed index. Every index
+// slot has a control byte, empty, deleted or the low 7 bits of the hash of its key, and the high bits of the
+// hash pick the first group of slots to probe. A group of HASHTABLE_GROUP_WIDTH control bytes is compared at
+// once, keys are only compared for slots whose 7 bits match.
+//
+
+constexpr int     HASHTABLE_GROUP_WIDTH  = 16;
+constexpr uint8_t HASHTABLE_EMPTY        = 0x80;
+constexpr uint8_t HASHTABLE_DELETED      = 0xFE;
+constexpr int     HASHTABLE_INITIAL_SIZE = HASHTABLE_GROUP_WIDTH;
+
+// Bit i of the results is set for control[i]
+#if ARCH_X64 == 1 || ARCH_X86 == 1
+INLINE_PROCEDURE uint32_t HashGroupMatch(const uint8_t *control, uint8_t h2) {
+	__m128i group = _mm_loadu_si128((const __m128i *)control);
+	return (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(group, _mm_set1_epi8((char)h2)));
+}
+
+INLINE_PROCEDURE uint32_t HashGroupMatchEmptyOrDeleted(const uint8_t *control) {
+	__m128i group = _mm_loadu_si128((const __m128i *)control);
+	return (uint32_t)_mm_movemask_epi8(group);
+}
+#else
+INLINE_PROCEDURE uint32_t HashGroupMatch(const uint8_t *control, uint8_t h2) {
+	uint32_t mask = 0;
+	for (int index = 0; index < HASHTABLE_GROUP_WIDTH; ++index)
+		mask |= (uint32_t)(control[index] == h2) << index;
+	return mask;
+}
+
+INLINE_PROCEDURE uint32_t HashGroupMatchEmptyOrDeleted(const uint8_t *control) {
+	uint32_t mask = 0;
+	for (int index = 0; index < HASHTABLE_GROUP_WIDTH; ++index)
+		mask |= (uint32_t)(control[index] >> 7) << index;
+	return mask;
+}
+#endif
+
+INLINE_PROCEDURE uint32_t HashGroupMatchEmpty(const uint8_t *control) {
+	return HashGroupMatch(control, HASHTABLE_EMPTY);
+}
+
 template <typename K, typename V,
 	typename Hasher = Hasher_Default<K>,
 	typename Key_Alloc = Trivial_Key_Alloc<K>,
 	typename Key_Free = Trivial_Key_Free<K>>
 struct Hash_Table {
-	struct Bucket {
-		size_t    hash[HASHTABLE_BUCKET_SIZE];
-		ptrdiff_t index[HASHTABLE_BUCKET_SIZE];
-	};
-
 	struct Pair {
 		K key;
 		V value;
 	};
 
-	Bucket *         buckets;
+	uint8_t *        control;     // p2allocated bytes followed by a copy of the first group, for unaligned loads
+	uint32_t *       slots;       // index into storage, for the slots in use
 	ptrdiff_t        count;
 	ptrdiff_t        p2allocated;
 	ptrdiff_t        tombstones;
@@ -269,138 +540,113 @@ struct Hash_Table {
 	Key_Alloc        key_alloc;
 	Key_Free         key_free;
 
-	Hash_Table() : buckets(nullptr), count(0), p2allocated(0), tombstones(0), storage(ThreadContext.allocator), allocator(ThreadContext.allocator) {}
-	Hash_Table(Memory_Allocator _allocator) : buckets(nullptr), count(0), p2allocated(0), tombstones(0), storage(_allocator), allocator(_allocator) {}
+	Hash_Table() : control(nullptr), slots(nullptr), count(0), p2allocated(0), tombstones(0), storage(ThreadContext.allocator), allocator(ThreadContext.allocator) {}
+	Hash_Table(Memory_Allocator _allocator) : control(nullptr), slots(nullptr), count(0), p2allocated(0), tombstones(0), storage(_allocator), allocator(_allocator) {}
 
 	inline Pair *begin() { return storage.begin(); }
 	inline Pair *end() { return storage.end(); }
 	inline const Pair *begin() const { return storage.begin(); }
 	inline const Pair *end() const { return storage.end(); }
 
-	size_t GetHash(const K key) const {
-		size_t hash = hasher(key);
-		if (hash <= HASHTABLE_MAX_RES_HASH)
-			hash += HASHTABLE_MAX_RES_HASH + 1;
-		return hash;
+	static size_t IndexSize(ptrdiff_t capacity) {
+		return capacity * sizeof(uint32_t) + capacity + HASHTABLE_GROUP_WIDTH;
 	}
 
-	bool Resize(ptrdiff_t new_p2allocated) {
-		Assert(new_p2allocated >= count);
-
-		new_p2allocated = NextPowerOf2(new_p2allocated);
-
-		Bucket *nbuckets = (Bucket *)MemoryAllocate(sizeof(Bucket) * (new_p2allocated >> HASHTABLE_BUCKET_SHIFT));
-		if (!nbuckets) return false;
-
-		memset(nbuckets, 0, sizeof(Bucket) * (new_p2allocated >> HASHTABLE_BUCKET_SHIFT));
-
-		if (buckets) {
-			ptrdiff_t src_bucket_count = p2allocated >> HASHTABLE_BUCKET_SHIFT;
-
-			for (ptrdiff_t i = 0; i < src_bucket_count; ++i) {
-				Bucket *src_bucket = &buckets[i];
-				for (size_t j = 0; j < HASHTABLE_BUCKET_SIZE; ++j) {
-					if (src_bucket->hash[j] <= HASHTABLE_MAX_RES_HASH)
-						continue;
-
-					size_t    hash = src_bucket->hash[j];
-					ptrdiff_t pos = hash & (new_p2allocated - 1);
-					ptrdiff_t step = HASHTABLE_BUCKET_SIZE;
-
-					bool inserted = false;
-					while (!inserted) {
-						Bucket *dst_bucket = &nbuckets[pos >> HASHTABLE_BUCKET_SHIFT];
-
-						for (int iter = (int)(pos & HASHTABLE_BUCKET_MASK); iter < HASHTABLE_BUCKET_SIZE; ++iter) {
-							if (dst_bucket->hash[iter] == HASHTABLE_EMPTY) {
-								dst_bucket->hash[iter]  = hash;
-								dst_bucket->index[iter] = src_bucket->index[j];
-								inserted = true;
-								break;
-							}
-						}
-
-						if (!inserted) {
-							auto limit = pos & HASHTABLE_BUCKET_MASK;
-							for (auto iter = 0; iter < limit; ++iter) {
-								if (dst_bucket->hash[iter] == HASHTABLE_EMPTY) {
-									dst_bucket->hash[iter] = hash;
-									dst_bucket->index[iter] = src_bucket->index[j];
-									inserted = true;
-									break;
-								}
-							}
-						}
-
-						pos += step;
-						pos &= (new_p2allocated - 1);
-						step += HASHTABLE_BUCKET_SIZE;
-					}
-				}
-			}
+	void SetControl(ptrdiff_t slot, uint8_t value) {
+		control[slot] = value;
+		if (slot < HASHTABLE_GROUP_WIDTH)
+			control[p2allocated + slot] = value;
+	}
 
-			MemoryFree(buckets, (p2allocated >> HASHTABLE_BUCKET_SHIFT) * sizeof(Bucket), allocator);
+	// First empty or deleted slot on the probe sequence of the hash
+	ptrdiff_t FindFreeSlot(size_t hash) const {
+		ptrdiff_t mask = p2allocated - 1;
+		ptrdiff_t pos  = (ptrdiff_t)(hash >> 7) & mask;
+		for (ptrdiff_t step = HASHTABLE_GROUP_WIDTH; ; step += HASHTABLE_GROUP_WIDTH) {
+			uint32_t free = HashGroupMatchEmptyOrDeleted(control + pos);
+			if (free)
+				return (pos + CountTrailingZeros32(free)) & mask;
+			pos = (pos + step) & mask;
 		}
+	}
 
-		buckets = nbuckets;
-		p2allocated = new_p2allocated;
-		tombstones = 0;
+	ptrdiff_t FindSlot(const K &key, size_t hash) const {
+		if (!count)
+			return -1;
 
-		return true;
+		ptrdiff_t mask = p2allocated - 1;
+		ptrdiff_t pos  = (ptrdiff_t)(hash >> 7) & mask;
+		uint8_t   h2   = (uint8_t)(hash & 0x7F);
+
+		// Triangular steps over the groups visit every group once, and the load limit leaves an empty slot
+		for (ptrdiff_t step = HASHTABLE_GROUP_WIDTH; ; step += HASHTABLE_GROUP_WIDTH) {
+			for (uint32_t match = HashGroupMatch(control + pos, h2); match; match &= match - 1) {
+				ptrdiff_t slot = (pos + CountTrailingZeros32(match)) & mask;
+				if (storage.data[slots[slot]].key == key)
+					return slot;
+			}
+			if (HashGroupMatchEmpty(control + pos))
+				return -1;
+			pos = (pos + step) & mask;
+		}
 	}
 
-	ptrdiff_t FindSlot(const K key) const {
+	ptrdiff_t FindSlot(const K &key) const {
 		if (!count)
 			return -1;
+		return FindSlot(key, hasher(key));
+	}
 
-		size_t hash = GetHash(key);
-		ptrdiff_t step = HASHTABLE_BUCKET_SIZE;
-		ptrdiff_t pos = hash & (p2allocated - 1);
+	bool Resize(ptrdiff_t new_p2allocated) {
+		Assert(new_p2allocated >= count);
 
-		while (1) {
-			Bucket *bucket = &buckets[pos >> HASHTABLE_BUCKET_SHIFT];
+		new_p2allocated = NextPowerOf2(Maximum(new_p2allocated, (ptrdiff_t)HASHTABLE_INITIAL_SIZE));
+		while (count * 8 >= new_p2allocated * 7)
+			new_p2allocated *= 2;
 
-			for (int iter = (int)(pos & HASHTABLE_BUCKET_MASK); iter < HASHTABLE_BUCKET_SIZE; ++iter) {
-				if (bucket->hash[iter] == hash && storage[bucket->index[iter]].key == key)
-					return (pos & ~HASHTABLE_BUCKET_MASK) + iter;
-				else if (bucket->hash[iter] == HASHTABLE_EMPTY)
-					return -1;
-			}
+		uint8_t *index = (uint8_t *)MemoryAllocate(IndexSize(new_p2allocated), allocator);
+		if (!index) return false;
 
-			int limit = (int)(pos & HASHTABLE_BUCKET_MASK);
-			for (int iter = 0; iter < limit; ++iter) {
-				if (bucket->hash[iter] == hash && storage[bucket->index[iter]].key == key)
-					return (pos & ~HASHTABLE_BUCKET_MASK) + iter;
-				else if (bucket->hash[iter] == HASHTABLE_EMPTY)
-					return -1;
-			}
+		if (slots)
+			MemoryFree(slots, IndexSize(p2allocated), allocator);
+
+		slots       = (uint32_t *)index;
+		control     = index + new_p2allocated * sizeof(uint32_t);
+		p2allocated = new_p2allocated;
+		tombstones  = 0;
 
-			pos += step;
-			pos &= (p2allocated - 1);
-			step += HASHTABLE_BUCKET_SIZE;
+		memset(control, HASHTABLE_EMPTY, p2allocated + HASHTABLE_GROUP_WIDTH);
+
+		for (ptrdiff_t pos = 0; pos < storage.count; ++pos) {
+			size_t    hash = hasher(storage.data[pos].key);
+			ptrdiff_t slot = FindFreeSlot(hash);
+			SetControl(slot, (uint8_t)(hash & 0x7F));
+			slots[slot] = (uint32_t)pos;
 		}
 
-		Unreachable();
-		return -1;
+		return true;
+	}
+
+	// Sizes the index and the storage for 'new_count' pairs
+	bool Reserve(ptrdiff_t new_count) {
+		if (!storage.Reserve(new_count))
+			return false;
+		if (new_count * 8 >= p2allocated * 7)
+			return Resize(new_count + new_count / 7 + 1);
+		return true;
 	}
 
 	V *Find(const K key) {
 		ptrdiff_t slot = FindSlot(key);
-		if (slot >= 0) {
-			Bucket *bucket = &buckets[slot >> HASHTABLE_BUCKET_SHIFT];
-			int index = (int)(slot & HASHTABLE_BUCKET_MASK);
-			return &storage[bucket->index[index]].value;
-		}
+		if (slot >= 0)
+			return &storage.data[slots[slot]].value;
 		return nullptr;
 	}
 
 	const V *Find(const K key) const {
 		ptrdiff_t slot = FindSlot(key);
-		if (slot >= 0) {
-			Bucket *bucket = &buckets[slot >> HASHTABLE_BUCKET_SHIFT];
-			int index = (int)(slot & HASHTABLE_BUCKET_MASK);
-			return &storage[bucket->index[index]].value;
-		}
+		if (slot >= 0)
+			return &storage.data[slots[slot]].value;
 		return nullptr;
 	}
 
@@ -414,86 +660,42 @@ struct Hash_Table {
 			storage[index] = storage[last];
 
 			ptrdiff_t pos = FindSlot(storage[index].key);
-			Assert(pos >= 0);
-
-			Bucket *bucket = &buckets[pos >> HASHTABLE_BUCKET_SHIFT];
-			int iter       = (int)(pos & HASHTABLE_BUCKET_MASK);
-			Assert(bucket->index[iter] == last);
-			bucket->index[iter] = index;
+			Assert(pos >= 0 && slots[pos] == (uint32_t)last);
+			slots[pos] = (uint32_t)index;
 		}
 		storage.count -= 1;
 	}
 
 	V *FindOrDefault(const K key, const V &def) {
-		ptrdiff_t used_count_threshold = p2allocated - (p2allocated >> 2);
-		if (count >= used_count_threshold) {
-			ptrdiff_t new_p2allocated = p2allocated ? p2allocated * 2 : HASHTABLE_INITIAL_SIZE;
-			Resize(new_p2allocated);
-		}
-
-		size_t hash = GetHash(key);
-		ptrdiff_t step = HASHTABLE_BUCKET_SIZE;
-		ptrdiff_t pos = hash & (p2allocated - 1);
-
-		ptrdiff_t tombstone_pos = -1;
-
-		while (1) {
-			Bucket *bucket = &buckets[pos >> HASHTABLE_BUCKET_SHIFT];
-
-			for (int iter = (int)(pos & HASHTABLE_BUCKET_MASK); iter < HASHTABLE_BUCKET_SIZE; ++iter) {
-				if (bucket->hash[iter] == hash && storage[bucket->index[iter]].key == key) {
-					return &storage[bucket->index[iter]].value;
-				} else if (bucket->hash[iter] == HASHTABLE_EMPTY) {
-					pos = (pos & ~HASHTABLE_BUCKET_MASK) + iter;
-					goto EmptyFound;
-				} else if (tombstone_pos < 0 && bucket->hash[iter] == HASHTABLE_TOMBSTONE) {
-					tombstone_pos = (pos & ~HASHTABLE_BUCKET_MASK) + iter;
-				}
-			}
+		size_t hash = hasher(key);
 
-			int limit = (int)(pos & HASHTABLE_BUCKET_MASK);
-			for (int iter = 0; iter < limit; ++iter) {
-				if (bucket->hash[iter] == hash && storage[bucket->index[iter]].key == key) {
-					return &storage[bucket->index[iter]].value;
-				} else if (bucket->hash[iter] == HASHTABLE_EMPTY) {
-					pos = (pos & ~HASHTABLE_BUCKET_MASK) + iter;
-					goto EmptyFound;
-				} else if (tombstone_pos < 0 && bucket->hash[iter] == HASHTABLE_TOMBSTONE) {
-					tombstone_pos = (pos & ~HASHTABLE_BUCKET_MASK) + iter;
-				}
-			}
+		ptrdiff_t slot = FindSlot(key, hash);
+		if (slot >= 0)
+			return &storage.data[slots[slot]].value;
 
-			pos += step;
-			pos &= (p2allocated - 1);
-			step += HASHTABLE_BUCKET_SIZE;
+		// Deleted slots count against the load, they are dropped by rehashing when there are enough of them
+		if ((count + tombstones + 1) * 8 > p2allocated * 7) {
+			ptrdiff_t new_p2allocated = tombstones > count / 2 ? p2allocated : p2allocated * 2;
+			if (!Resize(new_p2allocated))
+				return nullptr;
 		}
 
-	EmptyFound:
-		if (count == p2allocated)
-			return nullptr;
-
 		Pair *pair = AllocateNode();
-		if (pair) {
-			if (tombstone_pos >= 0) {
-				pos = tombstone_pos;
-				tombstones -= 1;
-			}
-
-			count += 1;
-
-			Bucket *bucket = &buckets[pos >> HASHTABLE_BUCKET_SHIFT];
+		if (!pair)
+			return nullptr;
 
-			int index = (int)(pos & HASHTABLE_BUCKET_MASK);
-			bucket->hash[index]  = hash;
-			bucket->index[index] = storage.count - 1;
+		slot = FindFreeSlot(hash);
+		if (control[slot] == HASHTABLE_DELETED)
+			tombstones -= 1;
 
-			pair->key   = key_alloc(key);
-			pair->value = def;
+		SetControl(slot, (uint8_t)(hash & 0x7F));
+		slots[slot] = (uint32_t)(storage.count - 1);
+		count += 1;
 
-			return &pair->value;
-		}
+		pair->key   = key_alloc(key);
+		pair->value = def;
 
-		return nullptr;
+		return &pair->value;
 	}
 
 	void Put(const K key, const V &value) {
@@ -509,36 +711,96 @@ struct Hash_Table {
 		ptrdiff_t pos = FindSlot(key);
 		if (pos < 0) return;
 
-		Bucket *bucket = &buckets[pos >> HASHTABLE_BUCKET_SHIFT];
-		int index = (int)(pos & HASHTABLE_BUCKET_MASK);
+		// A probe stops at an empty slot, so the slot can only become empty if no group that covers it was
+		// ever full. Otherwise it is marked as deleted.
+		ptrdiff_t mask   = p2allocated - 1;
+		uint32_t  before = HashGroupMatchEmpty(control + ((pos - HASHTABLE_GROUP_WIDTH) & mask));
+		uint32_t  after  = HashGroupMatchEmpty(control + pos);
+		bool      empty  = before && after &&
+			(CountLeadingZeros32(before) - (32 - HASHTABLE_GROUP_WIDTH)) + CountTrailingZeros32(after) < HASHTABLE_GROUP_WIDTH;
 
-		ptrdiff_t to_free    = bucket->index[index];
-		bucket->hash[index]  = HASHTABLE_TOMBSTONE;
-		bucket->index[index] = -1;
+		ptrdiff_t to_free = slots[pos];
+		SetControl(pos, empty ? HASHTABLE_EMPTY : HASHTABLE_DELETED);
+		if (!empty)
+			tombstones += 1;
 
 		key_free(&storage[to_free].key);
 
 		FreeNode(to_free);
 
 		count -= 1;
-		tombstones += 1;
 
-		ptrdiff_t shrink_threshold = p2allocated >> 2;
-		ptrdiff_t tombstone_threshold = (p2allocated >> 3) + (p2allocated >> 4);
-		if (count < shrink_threshold && p2allocated > HASHTABLE_INITIAL_SIZE)
-			Resize(p2allocated >> 2);
-		else if (tombstones > tombstone_threshold)
-			Resize(p2allocated);
+		if (count * 8 < p2allocated && p2allocated > HASHTABLE_INITIAL_SIZE)
+			Resize(p2allocated >> 1);
 	}
 };
 
 template <typename K, typename V, typename Hasher, typename Key_Alloc, typename Key_Free>
 void Free(Hash_Table<K, V, Hasher, Key_Alloc, Key_Free> *table) {
-	ptrdiff_t bucket_count = table->p2allocated >> HASHTABLE_BUCKET_SHIFT;
-	MemoryFree(table->buckets, sizeof(typename Hash_Table<K, V, Hasher, Key_Alloc, Key_Free>::Bucket) * bucket_count, table->allocator);
+	if (table->slots)
+		MemoryFree(table->slots, table->IndexSize(table->p2allocated), table->allocator);
 	for (auto &pair : table->storage) {
 		table->key_free(&pair.key);
 	}
 	Free(&table->storage);
 	*table = Hash_Table<K, V, Hasher, Key_Alloc, Key_Free>(table->allocator);
 }
+
+//
+// Ring buffer over memory mapped twice back to back, the bytes past the end are the ones at the start. The
+// readable and the writable bytes are always contiguous from RingBuffer_ReadPointer and RingBuffer_WritePointer,
+// however they wrap, so the data can be received into and parsed in place without copying the wrapped part.
+// The positions only grow and are masked when used.
+//
+
+struct Ring_Buffer {
+	uint8_t * data;
+	ptrdiff_t size; // a power of 2
+	uint64_t  read;
+	uint64_t  write;
+};
+
+// 'size' is rounded up to a power of 2 and to VirtualMemoryMirrorGranularity
+INLINE_PROCEDURE bool RingBuffer_Create(Ring_Buffer *ring, ptrdiff_t size) {
+	ptrdiff_t granularity = (ptrdiff_t)VirtualMemoryMirrorGranularity();
+	size                  = Maximum(NextPowerOf2(size), NextPowerOf2(granularity));
+
+	ring->data  = (uint8_t *)VirtualMemoryAllocateMirrored(size);
+	ring->size  = ring->data ? size : 0;
+	ring->read  = 0;
+	ring->write = 0;
+	return ring->data != nullptr;
+}
+
+INLINE_PROCEDURE void RingBuffer_Destroy(Ring_Buffer *ring) {
+	if (ring->data)
+		VirtualMemoryFreeMirrored(ring->data, ring->size);
+	memset(ring, 0, sizeof(*ring));
+}
+
+INLINE_PROCEDURE ptrdiff_t RingBuffer_ReadableSize(const Ring_Buffer *ring) {
+	return (ptrdiff_t)(ring->write - ring->read);
+}
+
+INLINE_PROCEDURE ptrdiff_t RingBuffer_WritableSize(const Ring_Buffer *ring) {
+	return ring->size - (ptrdiff_t)(ring->write - ring->read);
+}
+
+INLINE_PROCEDURE uint8_t *RingBuffer_ReadPointer(const Ring_Buffer *ring) {
+	return ring->data + (ring->read & (ring->size - 1));
+}
+
+INLINE_PROCEDURE uint8_t *RingBuffer_WritePointer(const Ring_Buffer *ring) {
+	return ring->data + (ring->write & (ring->size - 1));
+}
+
+// Marks 'count' bytes written at RingBuffer_WritePointer as readable
+INLINE_PROCEDURE void RingBuffer_Commit(Ring_Buffer *ring, ptrdiff_t count) {
+	Assert(count >= 0 && count <= RingBuffer_WritableSize(ring));
+	ring->write += count;
+}
+
+INLINE_PROCEDURE void RingBuffer_Consume(Ring_Buffer *ring, ptrdiff_t count) {
+	Assert(count >= 0 && count <= RingBuffer_ReadableSize(ring));
+	ring->read += count;
+}
@@ -0,0 +1,398 @@
+#pragma once
+#include "KrBasic.h"
+#include "KrAtomic.h"
+
+//
+// Cache with a budget of entries and of bytes, split in shards by the hash of the key. Every shard has its own
+// lock, its own slab of entries (allocated once, with the cache) and its own open addressed index into them.
+//
+// Lookups take the shard lock shared and only mark the entry they find as referenced, so threads reading the
+// same shard do not wait for each other. Puts take it alone and evict with CLOCK: the hand goes round the slab,
+// clears the referenced mark of the entries it passes and evicts the first one that was not referenced since
+// the hand last went past it. Expired entries are evicted whether they were referenced or not. New entries
+// start unreferenced, an entry that is put once and never looked up is the first to go.
+//
+// Values are copied in by Put and out by Find under the lock, so they should be plain data that eviction can
+// drop: ids, counts, permissions, small records, not memory owned by the cache.
+//
+// Keys of up to 8 bytes (integers, snowflakes) are kept in the index itself and compared there, a lookup only
+// reads the entry it finds. The index of larger keys keeps their hash and the key is compared in the entry.
+//
+
+struct Cache_Spec {
+	ptrdiff_t max_entries;
+	ptrdiff_t max_bytes;     // sum of the sizes given to Put, 0 for no limit
+	int64_t   ttl_millisecs; // 0 for entries that do not expire
+	int32_t   shards;        // rounded up to a power of 2
+};
+
+constexpr Cache_Spec CacheDefaultSpec = { 4096, 0, 0, 16 };
+
+struct Cache_Stats {
+	int64_t hits;
+	int64_t misses;
+	int64_t expired;   // lookups that found an expired entry, also counted in misses
+	int64_t inserts;
+	int64_t updates;
+	int64_t evictions; // to make room for a put, or because they expired
+	int64_t rejected;  // puts larger than the byte budget of a shard
+	int64_t entries;
+	int64_t bytes;
+};
+
+template <typename K, typename V, typename Hasher = Hasher_Default<K>>
+struct Cache {
+	static constexpr bool KeyInIndex = sizeof(K) <= sizeof(uint64_t);
+
+	struct Entry {
+		K                key;
+		V                value;
+		uint64_t         expires; // MonotonicNanosecs, 0 for never
+		ptrdiff_t        bytes;
+		uint32_t         next_free;
+		int32_t          used;
+	};
+
+	struct Slot {
+		uint64_t tag;   // the bits of the key if KeyInIndex, its hash otherwise
+		uint32_t entry; // 1 based, 0 for an empty slot
+	};
+
+	struct Shard {
+		RW_Lock          lock;
+		Entry *          entries;
+		int32_t volatile *referenced; // by entry, apart from them so that the hand goes over a few lines
+		Slot *           index;
+		ptrdiff_t        capacity;
+		ptrdiff_t        p2slots;
+		ptrdiff_t        count;
+		ptrdiff_t        bytes;
+		ptrdiff_t        max_bytes;
+		uint32_t         hand;
+		uint32_t         free; // 1 based, 0 when the slab is full
+
+		int64_t volatile hits;
+		int64_t volatile misses;
+		int64_t volatile expired;
+		int64_t          inserts;
+		int64_t          updates;
+		int64_t          evictions;
+		int64_t          rejected;
+	};
+
+	// Shards are cache line aligned so that the locks of two shards never share a line
+	static constexpr size_t ShardSize = AlignPower2Up(sizeof(Shard), 64);
+
+	uint8_t *        shards;
+	ptrdiff_t        shard_mask;
+	uint64_t         ttl;
+	void *           memory;
+	size_t           memory_size;
+	Memory_Allocator allocator;
+	Hasher           hasher;
+
+	Cache() : shards(nullptr), shard_mask(0), ttl(0), memory(nullptr), memory_size(0), allocator(ThreadContext.allocator) {}
+
+	Shard *GetShard(ptrdiff_t index) {
+		return (Shard *)(shards + index * ShardSize);
+	}
+
+	Shard *ShardOf(size_t hash) {
+		return GetShard((ptrdiff_t)(hash >> 40) & shard_mask);
+	}
+
+	uint64_t Tag(const K &key, size_t hash) const {
+		if constexpr (KeyInIndex) {
+			uint64_t tag = 0;
+			memcpy(&tag, &key, sizeof(K));
+			return tag;
+		} else {
+			return (uint64_t)hash;
+		}
+	}
+
+	size_t SlotHash(const Slot &slot) const {
+		if constexpr (KeyInIndex) {
+			K key;
+			memcpy(&key, &slot.tag, sizeof(K));
+			return hasher(key);
+		} else {
+			return (size_t)slot.tag;
+		}
+	}
+
+	ptrdiff_t FindSlot(const Shard *shard, const K &key, size_t hash) const {
+		uint64_t  tag  = Tag(key, hash);
+		ptrdiff_t mask = shard->p2slots - 1;
+
+		// The index is kept at most half full, there is always an empty slot to stop at
+		for (ptrdiff_t pos = (ptrdiff_t)hash & mask; ; pos = (pos + 1) & mask) {
+			const Slot &slot = shard->index[pos];
+			if (!slot.entry)
+				return -1;
+			if (slot.tag == tag) {
+				if constexpr (KeyInIndex)
+					return pos;
+				else if (shard->entries[slot.entry - 1].key == key)
+					return pos;
+			}
+		}
+	}
+
+	// Moves the slots that follow back into the hole, so that no probe sequence goes through an empty slot
+	void RemoveSlot(Shard *shard, ptrdiff_t pos) {
+		ptrdiff_t mask = shard->p2slots - 1;
+		ptrdiff_t hole = pos;
+		for (ptrdiff_t next = (pos + 1) & mask; shard->index[next].entry; next = (next + 1) & mask) {
+			ptrdiff_t home = (ptrdiff_t)SlotHash(shard->index[next]) & mask;
+			if (((next - home) & mask) >= ((next - hole) & mask)) {
+				shard->index[hole] = shard->index[next];
+				hole               = next;
+			}
+		}
+		shard->index[hole].entry = 0;
+	}
+
+	void RemoveEntry(Shard *shard, ptrdiff_t pos) {
+		uint32_t id    = shard->index[pos].entry;
+		Entry *  entry = &shard->entries[id - 1];
+
+		RemoveSlot(shard, pos);
+
+		shard->count -= 1;
+		shard->bytes -= entry->bytes;
+
+		entry->used      = 0;
+		entry->next_free = shard->free;
+		shard->free      = id;
+
+		AtomicStoreRelaxed(&shard->referenced[id - 1], 0);
+	}
+
+	// Returns false if the shard is empty
+	bool EvictOne(Shard *shard, uint64_t now) {
+		// Every entry is passed at most twice, the first pass clears the marks
+		for (ptrdiff_t step = 0; step <= 2 * shard->capacity; ++step) {
+			uint32_t hand = shard->hand;
+			if (++shard->hand == (uint32_t)shard->capacity)
+				shard->hand = 0;
+
+			// Only entries in use are marked, a marked one is passed over unless it expired
+			if (AtomicLoadRelaxed(&shard->referenced[hand])) {
+				if (!ttl || shard->entries[hand].expires > now) {
+					AtomicStoreRelaxed(&shard->referenced[hand], 0);
+					continue;
+				}
+			}
+
+			Entry *entry = &shard->entries[hand];
+			if (!entry->used)
+				continue;
+
+			RemoveEntry(shard, FindSlot(shard, entry->key, hasher(entry->key)));
+			shard->evictions += 1;
+			return true;
+		}
+		return false;
+	}
+
+	bool Create(Cache_Spec spec, Memory_Allocator _allocator = ThreadContext.allocator) {
+		ptrdiff_t count    = NextPowerOf2(Clamp((ptrdiff_t)1, (ptrdiff_t)1 << 16, (ptrdiff_t)spec.shards));
+		ptrdiff_t capacity = Maximum((ptrdiff_t)1, (spec.max_entries + count - 1) / count);
+		ptrdiff_t p2slots  = NextPowerOf2(capacity * 2);
+
+		Assert(capacity < UINT32_MAX);
+
+		size_t entries_size = AlignPower2Up(sizeof(Entry) * capacity, 64);
+		size_t marks_size   = AlignPower2Up(sizeof(int32_t) * capacity, 64);
+		size_t index_size   = AlignPower2Up(sizeof(Slot) * p2slots, 64);
+
+		allocator   = _allocator;
+		memory_size = (ShardSize + entries_size + marks_size + index_size) * count + 64;
+		memory      = MemoryAllocate(memory_size, allocator);
+		if (!memory) {
+			memory_size = 0;
+			return false;
+		}
+
+		memset(memory, 0, memory_size);
+
+		shards     = (uint8_t *)AlignPower2Up((size_t)memory, 64);
+		shard_mask = count - 1;
+		ttl        = (uint64_t)Maximum((int64_t)0, spec.ttl_millisecs) * 1000000;
+
+		uint8_t *slab = shards + ShardSize * count;
+
+		for (ptrdiff_t index = 0; index < count; ++index) {
+			Shard *shard     = GetShard(index);
+			shard->entries    = (Entry *)slab;
+			shard->referenced = (int32_t volatile *)(slab + entries_size);
+			shard->index      = (Slot *)(slab + entries_size + marks_size);
+			shard->capacity  = capacity;
+			shard->p2slots   = p2slots;
+			shard->max_bytes = spec.max_bytes ? Maximum((ptrdiff_t)1, spec.max_bytes / count) : 0;
+
+			for (ptrdiff_t id = 1; id < capacity; ++id)
+				shard->entries[id - 1].next_free = (uint32_t)id + 1;
+			shard->free = 1;
+
+			slab += entries_size + marks_size + index_size;
+		}
+
+		return true;
+	}
+
+	void Destroy() {
+		if (memory)
+			MemoryFree(memory, memory_size, allocator);
+		shards      = nullptr;
+		shard_mask  = 0;
+		memory      = nullptr;
+		memory_size = 0;
+	}
+
+	// Copies the value out if the key is cached and has not expired
+	bool Find(const K &key, V *value) {
+		size_t hash  = hasher(key);
+		Shard *shard = ShardOf(hash);
+
+		ReadLock(&shard->lock);
+
+		bool      found = false;
+		ptrdiff_t pos   = FindSlot(shard, key, hash);
+		if (pos >= 0) {
+			Entry *entry = &shard->entries[shard->index[pos].entry - 1];
+			if (entry->expires && entry->expires <= MonotonicNanosecs()) {
+				AtomicAddRelaxed(&shard->expired, 1);
+			} else {
+				// Only written when not set already, a hot entry's line is not written by every reader
+				int32_t volatile *referenced = &shard->referenced[shard->index[pos].entry - 1];
+				if (!AtomicLoadRelaxed(referenced))
+					AtomicStoreRelaxed(referenced, 1);
+				*value = entry->value;
+				found  = true;
+			}
+		}
+
+		ReadUnlock(&shard->lock);
+
+		AtomicAddRelaxed(found ? &shard->hits : &shard->misses, 1);
+		return found;
+	}
+
+	// 'bytes' counts against max_bytes, returns false if it is more than the budget of a shard
+	bool Put(const K &key, const V &value, ptrdiff_t bytes = sizeof(V)) {
+		size_t hash  = hasher(key);
+		Shard *shard = ShardOf(hash);
+
+		WriteLock(&shard->lock);
+
+		if (shard->max_bytes && bytes > shard->max_bytes) {
+			shard->rejected += 1;
+			WriteUnlock(&shard->lock);
+			return false;
+		}
+
+		uint64_t now     = ttl ? MonotonicNanosecs() : 0;
+		uint64_t expires = ttl ? now + ttl : 0;
+
+		ptrdiff_t pos = FindSlot(shard, key, hash);
+		if (pos >= 0) {
+			Entry *entry = &shard->entries[shard->index[pos].entry - 1];
+			shard->bytes += bytes - entry->bytes;
+			entry->value      = value;
+			entry->bytes      = bytes;
+			entry->expires    = expires;
+			shard->updates += 1;
+
+			AtomicStoreRelaxed(&shard->referenced[shard->index[pos].entry - 1], 1);
+
+			while (shard->max_bytes && shard->bytes > shard->max_bytes)
+				EvictOne(shard, now);
+
+			WriteUnlock(&shard->lock);
+			return true;
+		}
+
+		while (!shard->free || (shard->max_bytes && shard->bytes + bytes > shard->max_bytes)) {
+			if (!EvictOne(shard, now))
+				break;
+		}
+
+		uint32_t id    = shard->free;
+		Entry *  entry = &shard->entries[id - 1];
+		shard->free    = entry->next_free;
+
+		entry->key        = key;
+		entry->value      = value;
+		entry->expires    = expires;
+		entry->bytes      = bytes;
+		entry->used       = 1;
+
+		ptrdiff_t mask = shard->p2slots - 1;
+		for (pos = (ptrdiff_t)hash & mask; shard->index[pos].entry; pos = (pos + 1) & mask) {}
+		shard->index[pos].tag   = Tag(key, hash);
+		shard->index[pos].entry = id;
+
+		shard->count += 1;
+		shard->bytes += bytes;
+		shard->inserts += 1;
+
+		WriteUnlock(&shard->lock);
+		return true;
+	}
+
+	bool Remove(const K &key) {
+		size_t hash  = hasher(key);
+		Shard *shard = ShardOf(hash);
+
+		WriteLock(&shard->lock);
+		ptrdiff_t pos = FindSlot(shard, key, hash);
+		if (pos >= 0)
+			RemoveEntry(shard, pos);
+		WriteUnlock(&shard->lock);
+
+		return pos >= 0;
+	}
+
+	void Clear() {
+		for (ptrdiff_t index = 0; index <= shard_mask; ++index) {
+			Shard *shard = GetShard(index);
+			WriteLock(&shard->lock);
+
+			memset(shard->index, 0, sizeof(Slot) * shard->p2slots);
+			for (ptrdiff_t id = 1; id <= shard->capacity; ++id) {
+				Entry *entry     = &shard->entries[id - 1];
+				entry->used      = 0;
+				entry->next_free = id < shard->capacity ? (uint32_t)id + 1 : 0;
+				AtomicStoreRelaxed(&shard->referenced[id - 1], 0);
+			}
+
+			shard->count = 0;
+			shard->bytes = 0;
+			shard->hand  = 0;
+			shard->free  = 1;
+
+			WriteUnlock(&shard->lock);
+		}
+	}
+
+	// Sums the shards, each one is read under its lock but not all of them at once
+	void GetStats(Cache_Stats *stats) {
+		memset(stats, 0, sizeof(*stats));
+		for (ptrdiff_t index = 0; index <= shard_mask; ++index) {
+			Shard *shard = GetShard(index);
+			ReadLock(&shard->lock);
+			stats->hits      += AtomicLoadRelaxed(&shard->hits);
+			stats->misses    += AtomicLoadRelaxed(&shard->misses);
+			stats->expired   += AtomicLoadRelaxed(&shard->expired);
+			stats->inserts   += shard->inserts;
+			stats->updates   += shard->updates;
+			stats->evictions += shard->evictions;
+			stats->rejected  += shard->rejected;
+			stats->entries   += shard->count;
+			stats->bytes     += shard->bytes;
+			ReadUnlock(&shard->lock);
+		}
+	}
+};
@@ -1,6 +1,7 @@
 #include "KrCommon.h"
 
 #include <string.h>
+#include <stdio.h>
 
 thread_local Thread_Context ThreadContext;
 
@@ -8,6 +9,18 @@ struct Memory_Arena {
 	size_t current;
 	size_t reserved;
 	size_t committed;
+	size_t granularity; // commit step
+	uint32_t flags;
+	uint32_t decay_shift;
+	size_t peak;   // highest position since the last reset
+	size_t target; // decayed peak, kept committed on reset
+	size_t retain; // commit never released on reset
+	uint64_t decommits;
+	uint64_t decommitted;
+#if defined(MEMORY_ARENA_INSTRUMENTATION)
+	size_t             cycle_peak; // highest position since the reset or the innermost tagged scope began
+	Memory_Arena_Stats stats;
+#endif
 };
 
 bool operator==(const String a, const String b) {
@@ -26,17 +39,58 @@ uint8_t *AlignPointer(uint8_t *location, size_t alignment) {
 	return (uint8_t *)((size_t)(location + (alignment - 1)) & ~(alignment - 1));
 }
 
-Memory_Arena *MemoryArenaAllocate(size_t max_size, size_t initial_size) {
-	max_size = AlignPower2Up(max_size, 64 * 1024);
-	uint8_t *mem = (uint8_t *)VirtualMemoryAllocate(0, max_size);
+static bool MemoryArenaCommit(uint8_t *mem, size_t size, uint32_t flags) {
+	if (!VirtualMemoryCommit(mem, size))
+		return false;
+	if (flags & MEMORY_ARENA_PREFAULT)
+		VirtualMemoryPrefault(mem, size);
+	return true;
+}
+
+Memory_Arena *MemoryArenaAllocate(size_t max_size, size_t initial_size, uint32_t flags) {
+	uint8_t *mem         = nullptr;
+	size_t   granularity = MemoryArenaCommitSize;
+
+	if (flags & (MEMORY_ARENA_HUGE_PAGES | MEMORY_ARENA_HUGETLB)) {
+		size_t page_size = VirtualMemoryHugePageSize();
+		if (page_size) {
+			size_t size   = AlignPower2Up(max_size, page_size);
+			bool   pooled = false;
+			mem = (uint8_t *)VirtualMemoryAllocateHuge(size, (flags & MEMORY_ARENA_HUGETLB) != 0, &pooled);
+			if (mem) {
+				max_size    = size;
+				granularity = page_size;
+				flags       = (flags & ~MEMORY_ARENA_HUGETLB) | MEMORY_ARENA_HUGE_PAGES | (pooled ? (uint32_t)MEMORY_ARENA_HUGETLB : 0u);
+			}
+		}
+	}
+
+	if (!mem) {
+		flags    = flags & ~(MEMORY_ARENA_HUGE_PAGES | MEMORY_ARENA_HUGETLB);
+		max_size = AlignPower2Up(max_size, 64 * 1024);
+		mem      = (uint8_t *)VirtualMemoryAllocate(0, max_size);
+	}
+
 	if (mem) {
-		size_t commit_size = AlignPower2Up(initial_size, MemoryArenaCommitSize);
-		commit_size = Clamp(MemoryArenaCommitSize, max_size, commit_size);
-		if (VirtualMemoryCommit(mem, commit_size)) {
+		size_t commit_size = AlignPower2Up(initial_size, granularity);
+		commit_size = Clamp(granularity, max_size, commit_size);
+		if (MemoryArenaCommit(mem, commit_size, flags)) {
 			Memory_Arena *arena = (Memory_Arena *)mem;
 			arena->current = sizeof(Memory_Arena);
 			arena->reserved = max_size;
 			arena->committed = commit_size;
+			arena->granularity = granularity;
+			arena->flags = flags;
+			arena->decay_shift = MemoryArenaDecayShift;
+			arena->peak = arena->current;
+			arena->target = arena->current;
+			arena->retain = commit_size;
+			arena->decommits = 0;
+			arena->decommitted = 0;
+#if defined(MEMORY_ARENA_INSTRUMENTATION)
+			arena->cycle_peak = arena->current;
+			memset(&arena->stats, 0, sizeof(arena->stats));
+#endif
 			return arena;
 		}
 		VirtualMemoryFree(mem, max_size);
@@ -48,8 +102,90 @@ void MemoryArenaFree(Memory_Arena *arena) {
 	VirtualMemoryFree(arena, arena->reserved);
 }
 
+#if defined(MEMORY_ARENA_INSTRUMENTATION)
+static void MemoryArenaEndCycle(Memory_Arena *arena) {
+	Memory_Arena_Stats *stats = &arena->stats;
+
+	size_t usage  = arena->cycle_peak - sizeof(Memory_Arena);
+	int    bucket = 0;
+	for (size_t bits = usage; bits; bits >>= 1)
+		bucket += 1;
+	bucket = Minimum(bucket, MemoryArenaHistogramBuckets - 1);
+
+	stats->histogram[bucket] += 1;
+	stats->cycles += 1;
+	stats->peak = Maximum(stats->peak, usage);
+
+	arena->cycle_peak = sizeof(Memory_Arena);
+}
+
+static void MemoryArenaRecordTag(Memory_Arena *arena, const char *tag, size_t usage) {
+	Memory_Arena_Stats *stats = &arena->stats;
+
+	Memory_Arena_Tag_Stats *entry = nullptr;
+	for (int index = 0; index < stats->tag_count; ++index) {
+		const char *name = stats->tags[index].tag;
+		if (name == tag || strcmp(name, tag) == 0) {
+			entry = &stats->tags[index];
+			break;
+		}
+	}
+
+	if (!entry) {
+		if (stats->tag_count < MEMORY_ARENA_MAX_TAGS - 1) {
+			entry = &stats->tags[stats->tag_count++];
+		} else {
+			entry = &stats->tags[MEMORY_ARENA_MAX_TAGS - 1];
+			tag   = "(other)";
+			stats->tag_count = MEMORY_ARENA_MAX_TAGS;
+		}
+		entry->tag = tag;
+	}
+
+	entry->count += 1;
+	entry->peak   = Maximum(entry->peak, usage);
+	entry->total += usage;
+}
+#endif
+
+// A single large cycle would otherwise keep its commit, and the memory, for the lifetime of the arena
+static void MemoryArenaDecommitExcess(Memory_Arena *arena) {
+	if (arena->peak >= arena->target)
+		arena->target = arena->peak;
+	else
+		arena->target -= (arena->target - arena->peak) >> arena->decay_shift;
+
+	size_t committed = AlignPower2Up(Maximum(arena->target, arena->retain), arena->granularity);
+	committed = Clamp(arena->granularity, arena->reserved, committed);
+
+	// Small differences are left alone so that the target decaying doesn't turn into a syscall every reset
+	if (committed >= arena->committed || arena->committed - committed < Maximum(committed >> 2, arena->granularity))
+		return;
+
+	uint8_t *mem    = (uint8_t *)arena;
+	size_t   excess = arena->committed - committed;
+	if (VirtualMemoryDecommit(mem + committed, excess)) {
+		arena->committed    = committed;
+		arena->decommits   += 1;
+		arena->decommitted += excess;
+	}
+}
+
 void MemoryArenaReset(Memory_Arena *arena) {
+#if defined(MEMORY_ARENA_INSTRUMENTATION)
+	MemoryArenaEndCycle(arena);
+#endif
 	arena->current = sizeof(Memory_Arena);
+	if (arena->flags & MEMORY_ARENA_DECOMMIT)
+		MemoryArenaDecommitExcess(arena);
+	arena->peak = arena->current;
+}
+
+void MemoryArenaSetDecommit(Memory_Arena *arena, size_t retain, uint32_t decay_shift) {
+	Assert(decay_shift < sizeof(size_t) * 8);
+	arena->flags      |= MEMORY_ARENA_DECOMMIT;
+	arena->retain      = retain;
+	arena->decay_shift = decay_shift;
 }
 
 size_t MemoryArenaCapSize(Memory_Arena *arena) {
@@ -64,17 +200,32 @@ size_t MemoryArenaEmptySize(Memory_Arena *arena) {
 	return arena->reserved - arena->current;
 }
 
+uint32_t MemoryArenaGetFlags(Memory_Arena *arena) {
+	return arena->flags;
+}
+
+Memory_Arena_Usage MemoryArenaGetUsage(Memory_Arena *arena) {
+	Memory_Arena_Usage usage;
+	usage.used        = arena->current;
+	usage.committed   = arena->committed;
+	usage.peak        = arena->peak;
+	usage.target      = arena->target;
+	usage.decommits   = arena->decommits;
+	usage.decommitted = arena->decommitted;
+	return usage;
+}
+
 bool MemoryArenaEnsureCommit(Memory_Arena *arena, size_t pos) {
 	if (pos <= arena->committed) {
 		return true;
 	}
 
-	pos = Maximum(pos, MemoryArenaCommitSize);
+	pos = Maximum(pos, arena->granularity);
 	uint8_t *mem = (uint8_t *)arena;
 
-	size_t committed = AlignPower2Up(pos, MemoryArenaCommitSize);
+	size_t committed = AlignPower2Up(pos, arena->granularity);
 	committed = Minimum(committed, arena->reserved);
-	if (VirtualMemoryCommit(mem + arena->committed, committed - arena->committed)) {
+	if (MemoryArenaCommit(mem + arena->committed, committed - arena->committed, arena->flags)) {
 		arena->committed = committed;
 		return true;
 	}
@@ -84,6 +235,10 @@ bool MemoryArenaEnsureCommit(Memory_Arena *arena, size_t pos) {
 bool MemoryArenaSetPos(Memory_Arena *arena, size_t pos) {
 	if (MemoryArenaEnsureCommit(arena, pos)) {
 		arena->current = pos;
+		arena->peak    = Maximum(arena->peak, pos);
+#if defined(MEMORY_ARENA_INSTRUMENTATION)
+		arena->cycle_peak = Maximum(arena->cycle_peak, pos);
+#endif
 		return true;
 	}
 	return false;
@@ -91,8 +246,8 @@ bool MemoryArenaSetPos(Memory_Arena *arena, size_t pos) {
 
 bool MemoryArenaPackToPos(Memory_Arena *arena, size_t pos) {
 	if (MemoryArenaSetPos(arena, pos)) {
-		size_t committed = AlignPower2Up(pos, MemoryArenaCommitSize);
-		committed = Clamp(MemoryArenaCommitSize, arena->reserved, committed);
+		size_t committed = AlignPower2Up(pos, arena->granularity);
+		committed = Clamp(arena->granularity, arena->reserved, committed);
 
 		uint8_t *mem = (uint8_t *)arena;
 		if (committed < arena->committed) {
@@ -132,8 +287,82 @@ void *PushSizeAligned(Memory_Arena *arena, size_t size, uint32_t alignment) {
 	return nullptr;
 }
 
-Temporary_Memory BeginTemporaryMemory(Memory_Arena *arena) {
+Memory_Arena_Checkpoint MemoryArenaBeginCheckpoint(Memory_Arena *arena, const char *tag) {
+	Memory_Arena_Checkpoint checkpoint;
+	checkpoint.arena    = arena;
+	checkpoint.tag      = tag;
+	checkpoint.position = arena->current;
+#if defined(MEMORY_ARENA_INSTRUMENTATION)
+	checkpoint.peak     = arena->cycle_peak;
+	arena->cycle_peak   = arena->current;
+#else
+	checkpoint.peak     = 0;
+#endif
+	return checkpoint;
+}
+
+void MemoryArenaEndCheckpoint(Memory_Arena_Checkpoint *checkpoint) {
+#if defined(MEMORY_ARENA_INSTRUMENTATION)
+	Memory_Arena *arena = checkpoint->arena;
+	size_t usage = arena->cycle_peak > checkpoint->position ? arena->cycle_peak - checkpoint->position : 0;
+	MemoryArenaRecordTag(arena, checkpoint->tag, usage);
+	arena->cycle_peak = Maximum(arena->cycle_peak, checkpoint->peak);
+#endif
+}
+
+const Memory_Arena_Stats *MemoryArenaStats(Memory_Arena *arena) {
+#if defined(MEMORY_ARENA_INSTRUMENTATION)
+	arena->stats.current = arena->cycle_peak - sizeof(Memory_Arena);
+	return &arena->stats;
+#else
+	return nullptr;
+#endif
+}
+
+void MemoryArenaDumpStats(Memory_Arena *arena, const char *name, int count) {
+	const Memory_Arena_Stats *stats = MemoryArenaStats(arena);
+	if (!stats) return;
+
+	LogInfoEx("Arena", "%s: %zu reserved, %zu committed, peak %zu, current cycle %zu, %llu cycles",
+		name, arena->reserved, arena->committed, stats->peak, stats->current, (unsigned long long)stats->cycles);
+	if (arena->flags & MEMORY_ARENA_DECOMMIT) {
+		LogInfoEx("Arena", "  target %zu, %zu decommitted over %llu resets",
+			arena->target, (size_t)arena->decommitted, (unsigned long long)arena->decommits);
+	}
+
+	for (int bucket = 0; bucket < MemoryArenaHistogramBuckets; ++bucket) {
+		if (!stats->histogram[bucket]) continue;
+		size_t low  = bucket ? (size_t)1 << (bucket - 1) : 0;
+		size_t high = (size_t)1 << bucket;
+		LogInfoEx("Arena", "  [%zu, %zu): %llu cycles", low, high, (unsigned long long)stats->histogram[bucket]);
+	}
+
+	int order[MEMORY_ARENA_MAX_TAGS];
+	for (int index = 0; index < stats->tag_count; ++index)
+		order[index] = index;
+
+	count = Minimum(count, stats->tag_count);
+
+	// Partial selection sort, only the top 'count' are needed
+	for (int index = 0; index < count; ++index) {
+		int top = index;
+		for (int next = index + 1; next < stats->tag_count; ++next) {
+			if (stats->tags[order[next]].peak > stats->tags[order[top]].peak)
+				top = next;
+		}
+		int temp     = order[index];
+		order[index] = order[top];
+		order[top]   = temp;
+
+		const Memory_Arena_Tag_Stats &tag = stats->tags[order[index]];
+		LogInfoEx("Arena", "  %-40s peak %zu, average %zu, %llu scopes",
+			tag.tag, tag.peak, (size_t)(tag.total / Maximum(tag.count, (uint64_t)1)), (unsigned long long)tag.count);
+	}
+}
+
+Temporary_Memory BeginTemporaryMemory(Memory_Arena *arena, const char *tag) {
 	Temporary_Memory mem;
+	mem.checkpoint = tag ? MemoryArenaBeginCheckpoint(arena, tag) : Memory_Arena_Checkpoint{};
 	mem.arena = arena;
 	mem.position = arena->current;
 	return mem;
@@ -158,10 +387,14 @@ void PopSize(Memory_Arena *arena, size_t size) {
 }
 
 void EndTemporaryMemory(Temporary_Memory *temp) {
+	if (temp->checkpoint.tag)
+		MemoryArenaEndCheckpoint(&temp->checkpoint);
 	temp->arena->current = temp->position;
 }
 
 void FreeTemporaryMemory(Temporary_Memory *temp) {
+	if (temp->checkpoint.tag)
+		MemoryArenaEndCheckpoint(&temp->checkpoint);
 	MemoryArenaSetPos(temp->arena, temp->position);
 	MemoryArenaPackToPos(temp->arena, temp->position);
 }
@@ -294,8 +527,10 @@ void *DefaultMemoryAllocatorProc(Allocation_Kind kind, void *mem, size_t prev_si
 
 void DefaultLoggerProc(void *context, Log_Level level, const char *source, const char *fmt, va_list args) {}
 
+// Written straight to stderr, a logger that hands its lines to another thread would not get to it before the exit
 void DefaultFatalErrorProc(const char *message) {
-	LogErrorEx("Fatal Error", message);
+	fprintf(stderr, "[Fatal Error] %s\n", message);
+	fflush(stderr);
 	FatalErrorOS(message);
 }
 
@@ -439,11 +674,105 @@ bool VirtualMemoryFree(void *ptr, size_t size) {
 	return VirtualFree(ptr, 0, MEM_RELEASE);
 }
 
+// Large pages on Windows need the lock pages privilege and are committed when reserved,
+// they don't fit the reserve and commit model of the arenas so only regular pages are used
+size_t VirtualMemoryHugePageSize() {
+	return 0;
+}
+
+void *VirtualMemoryAllocateHuge(size_t size, bool hugetlb, bool *pooled) {
+	*pooled = false;
+	return nullptr;
+}
+
+bool VirtualMemoryPrefault(void *ptr, size_t size) {
+	WIN32_MEMORY_RANGE_ENTRY range = { ptr, size };
+	if (PrefetchVirtualMemory(GetCurrentProcess(), 1, &range, 0))
+		return true;
+	volatile uint8_t *bytes = (volatile uint8_t *)ptr;
+	for (size_t offset = 0; offset < size; offset += KiloBytes(4))
+		bytes[offset] = bytes[offset];
+	return true;
+}
+
+typedef PVOID(WINAPI *VirtualAlloc2_Proc)(HANDLE, PVOID, SIZE_T, ULONG, ULONG, void *, ULONG);
+typedef PVOID(WINAPI *MapViewOfFile3_Proc)(HANDLE, HANDLE, PVOID, ULONG64, SIZE_T, ULONG, ULONG, void *, ULONG);
+
+size_t VirtualMemoryMirrorGranularity() {
+	SYSTEM_INFO info;
+	GetSystemInfo(&info);
+	return info.dwAllocationGranularity;
+}
+
+// The range is reserved as a placeholder and split in two, then each half is replaced by a view of the same
+// section. The procedures are looked up so that the rest still runs on older systems.
+void *VirtualMemoryAllocateMirrored(size_t size) {
+	static HMODULE             kernelbase        = GetModuleHandleW(L"kernelbase.dll");
+	static VirtualAlloc2_Proc  VirtualAlloc2Ptr  = kernelbase ? (VirtualAlloc2_Proc)GetProcAddress(kernelbase, "VirtualAlloc2") : nullptr;
+	static MapViewOfFile3_Proc MapViewOfFile3Ptr = kernelbase ? (MapViewOfFile3_Proc)GetProcAddress(kernelbase, "MapViewOfFile3") : nullptr;
+
+	if (!VirtualAlloc2Ptr || !MapViewOfFile3Ptr)
+		return nullptr;
+
+	uint8_t *placeholder = (uint8_t *)VirtualAlloc2Ptr(nullptr, nullptr, 2 * size, MEM_RESERVE | MEM_RESERVE_PLACEHOLDER, PAGE_NOACCESS, nullptr, 0);
+	if (!placeholder)
+		return nullptr;
+
+	if (!VirtualFree(placeholder, size, MEM_RELEASE | MEM_PRESERVE_PLACEHOLDER)) {
+		VirtualFree(placeholder, 0, MEM_RELEASE);
+		return nullptr;
+	}
+
+	HANDLE section = CreateFileMappingW(INVALID_HANDLE_VALUE, nullptr, PAGE_READWRITE, (DWORD)((uint64_t)size >> 32), (DWORD)size, nullptr);
+	if (!section) {
+		VirtualFree(placeholder, 0, MEM_RELEASE);
+		VirtualFree(placeholder + size, 0, MEM_RELEASE);
+		return nullptr;
+	}
+
+	void *first  = MapViewOfFile3Ptr(section, nullptr, placeholder, 0, size, MEM_REPLACE_PLACEHOLDER, PAGE_READWRITE, nullptr, 0);
+	void *second = first ? MapViewOfFile3Ptr(section, nullptr, placeholder + size, 0, size, MEM_REPLACE_PLACEHOLDER, PAGE_READWRITE, nullptr, 0) : nullptr;
+
+	CloseHandle(section); // the views keep it alive
+
+	if (!second) {
+		if (first)
+			UnmapViewOfFile(first);
+		else
+			VirtualFree(placeholder, 0, MEM_RELEASE);
+		VirtualFree(placeholder + size, 0, MEM_RELEASE);
+		return nullptr;
+	}
+
+	return placeholder;
+}
+
+bool VirtualMemoryFreeMirrored(void *ptr, size_t size) {
+	bool first  = UnmapViewOfFile(ptr);
+	bool second = UnmapViewOfFile((uint8_t *)ptr + size);
+	return first && second;
+}
+
+uint64_t MonotonicNanosecs() {
+	static LARGE_INTEGER frequency;
+	if (!frequency.QuadPart)
+		QueryPerformanceFrequency(&frequency);
+	LARGE_INTEGER counter;
+	QueryPerformanceCounter(&counter);
+	uint64_t secs = (uint64_t)counter.QuadPart / (uint64_t)frequency.QuadPart;
+	uint64_t rem  = (uint64_t)counter.QuadPart % (uint64_t)frequency.QuadPart;
+	return secs * 1000000000ull + (rem * 1000000000ull) / (uint64_t)frequency.QuadPart;
+}
+
 #endif
 
 #if PLATFORM_LINUX == 1 || PLATFORM_MAC == 1
 #include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
 #include <stdlib.h>
+#include <stdio.h>
+#include <time.h>
 
 static void InitOSContent() {}
 
@@ -475,6 +804,9 @@ bool VirtualMemoryCommit(void *ptr, size_t size) {
 }
 
 bool VirtualMemoryDecommit(void *ptr, size_t size) {
+	// PROT_NONE alone keeps the pages resident, they have to be dropped first
+	if (madvise(ptr, size, MADV_DONTNEED) != 0)
+		return false;
 	return mprotect(ptr, size, PROT_NONE) == 0;
 }
 
@@ -482,4 +814,138 @@ bool VirtualMemoryFree(void *ptr, size_t size) {
 	return munmap(ptr, size) == 0;
 }
 
+#if PLATFORM_LINUX == 1
+size_t VirtualMemoryHugePageSize() {
+	static size_t page_size = 0;
+	if (!page_size) {
+		size_t size = MegaBytes(2);
+		FILE *fp = fopen("/sys/kernel/mm/transparent_hugepage/hpage_pmd_size", "rb");
+		if (fp) {
+			unsigned long long value = 0;
+			if (fscanf(fp, "%llu", &value) == 1 && IsPower2(value))
+				size = (size_t)value;
+			fclose(fp);
+		}
+		page_size = size;
+	}
+	return page_size;
+}
+
+void *VirtualMemoryAllocateHuge(size_t size, bool hugetlb, bool *pooled) {
+	*pooled = false;
+
+	if (hugetlb) {
+		// Fails unless the pool can back the whole reservation, so touching the pages later can't fault
+		void *result = mmap(0, size, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+		if (result != MAP_FAILED) {
+			*pooled = true;
+			return result;
+		}
+	}
+
+	// A huge page is only used for aligned ranges, so the reservation is over allocated and trimmed
+	size_t   page_size = VirtualMemoryHugePageSize();
+	size_t   padded    = size + page_size;
+	uint8_t *result    = (uint8_t *)mmap(0, padded, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (result == MAP_FAILED)
+		return nullptr;
+
+	uint8_t *aligned = (uint8_t *)AlignPower2Up((size_t)result, page_size);
+	if (aligned != result)
+		munmap(result, aligned - result);
+	munmap(aligned + size, (result + padded) - (aligned + size));
+
+	if (madvise(aligned, size, MADV_HUGEPAGE) != 0) {
+		munmap(aligned, size);
+		return nullptr;
+	}
+
+	return aligned;
+}
+
+bool VirtualMemoryPrefault(void *ptr, size_t size) {
+#if defined(MADV_POPULATE_WRITE)
+	if (madvise(ptr, size, MADV_POPULATE_WRITE) == 0)
+		return true;
+#endif
+	// Older kernels, one write per page
+	volatile uint8_t *bytes = (volatile uint8_t *)ptr;
+	for (size_t offset = 0; offset < size; offset += KiloBytes(4))
+		bytes[offset] = bytes[offset];
+	return true;
+}
+#else
+size_t VirtualMemoryHugePageSize() {
+	return 0;
+}
+
+void *VirtualMemoryAllocateHuge(size_t size, bool hugetlb, bool *pooled) {
+	*pooled = false;
+	return nullptr;
+}
+
+bool VirtualMemoryPrefault(void *ptr, size_t size) {
+	volatile uint8_t *bytes = (volatile uint8_t *)ptr;
+	for (size_t offset = 0; offset < size; offset += KiloBytes(4))
+		bytes[offset] = bytes[offset];
+	return true;
+}
+#endif
+
+size_t VirtualMemoryMirrorGranularity() {
+	return (size_t)sysconf(_SC_PAGESIZE);
+}
+
+// A file that only lives in memory, unlinked already
+static int VirtualMemoryAnonymousFile(size_t size) {
+#if PLATFORM_LINUX == 1
+	int fd = memfd_create("Kr_Mirrored", MFD_CLOEXEC);
+#else
+	static int counter = 0;
+	char name[32];
+	snprintf(name, sizeof(name), "/kr.%d.%d", (int)getpid(), counter++);
+	int fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0600);
+	if (fd >= 0) shm_unlink(name);
 #endif
+	if (fd < 0) return -1;
+	if (ftruncate(fd, (off_t)size) != 0) {
+		close(fd);
+		return -1;
+	}
+	return fd;
+}
+
+void *VirtualMemoryAllocateMirrored(size_t size) {
+	int fd = VirtualMemoryAnonymousFile(size);
+	if (fd < 0) return nullptr;
+
+	// The whole range is reserved first so that nothing else can be mapped in between the halves
+	uint8_t *result = (uint8_t *)mmap(0, 2 * size, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (result != MAP_FAILED) {
+		void *first  = mmap(result, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, fd, 0);
+		void *second = mmap(result + size, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, fd, 0);
+		if (first == MAP_FAILED || second == MAP_FAILED) {
+			munmap(result, 2 * size);
+			result = (uint8_t *)MAP_FAILED;
+		}
+	}
+
+	close(fd); // the mappings keep it alive
+	return result != MAP_FAILED ? result : nullptr;
+}
+
+bool VirtualMemoryFreeMirrored(void *ptr, size_t size) {
+	return munmap(ptr, 2 * size) == 0;
+}
+
+uint64_t MonotonicNanosecs() {
+	timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+#endif
+
+uint64_t MonotonicMillisecs() {
+	return MonotonicNanosecs() / 1000000;
+}
@@ -218,7 +218,8 @@ inline void Unreachable() { TriggerBreakpoint(); }
 
 typedef uint32_t boolx;
 
-constexpr size_t MemoryArenaCommitSize = KiloBytes(64);
+constexpr size_t   MemoryArenaCommitSize = KiloBytes(64);
+constexpr uint32_t MemoryArenaDecayShift = 3;
 
 struct String {
 	ptrdiff_t length;
@@ -288,12 +289,37 @@ uint8_t *AlignPointer(uint8_t *location, size_t alignment);
 
 struct Memory_Arena;
 
-Memory_Arena *MemoryArenaAllocate(size_t max_size, size_t commit_size = MemoryArenaCommitSize);
+enum Memory_Arena_Flags : uint32_t {
+	MEMORY_ARENA_DEFAULT    = 0x0,
+	MEMORY_ARENA_HUGE_PAGES = 0x1, // transparent huge pages, committed in huge page steps
+	MEMORY_ARENA_HUGETLB    = 0x2, // pages from the reserved huge page pool, falls back to MEMORY_ARENA_HUGE_PAGES
+	MEMORY_ARENA_PREFAULT   = 0x4, // committed memory is faulted in right away
+	MEMORY_ARENA_DECOMMIT   = 0x8, // commit over the working set target is released on reset, see MemoryArenaSetDecommit
+};
+
+struct Memory_Arena_Usage {
+	size_t   used;        // current position
+	size_t   committed;
+	size_t   peak;        // highest position since the last reset
+	size_t   target;      // working set target, the decayed peak of the reset cycles
+	uint64_t decommits;   // resets that released memory
+	uint64_t decommitted; // total bytes released
+};
+
+// The huge page flags are dropped if the system can't provide them, see MemoryArenaGetFlags
+Memory_Arena *MemoryArenaAllocate(size_t max_size, size_t commit_size = MemoryArenaCommitSize, uint32_t flags = MEMORY_ARENA_DEFAULT);
 void MemoryArenaFree(Memory_Arena *arena);
 void MemoryArenaReset(Memory_Arena *arena);
 size_t MemoryArenaCapSize(Memory_Arena *arena);
 size_t MemoryArenaUsedSize(Memory_Arena *arena);
 size_t MemoryArenaEmptySize(Memory_Arena *arena);
+uint32_t MemoryArenaGetFlags(Memory_Arena *arena);
+Memory_Arena_Usage MemoryArenaGetUsage(Memory_Arena *arena);
+
+// Enables MEMORY_ARENA_DECOMMIT. On reset the target rises to the peak of the cycle right away and otherwise
+// falls by 1/2^decay_shift of the difference, commit above Maximum(target, retain) is given back to the system.
+// Without this call 'retain' is the initial commit size and 'decay_shift' is MemoryArenaDecayShift
+void MemoryArenaSetDecommit(Memory_Arena *arena, size_t retain, uint32_t decay_shift = MemoryArenaDecayShift);
 
 bool  MemoryArenaEnsureCommit(Memory_Arena *arena, size_t pos);
 bool  MemoryArenaSetPos(Memory_Arena *arena, size_t pos);
@@ -318,12 +344,61 @@ void *PushSizeAlignedZero(Memory_Arena *arena, size_t size, uint32_t alignment);
 
 void PopSize(Memory_Arena *arena, size_t size);
 
+//
+// Arena instrumentation, enabled by defining MEMORY_ARENA_INSTRUMENTATION. The peak usage of every reset
+// cycle goes into a histogram, and the peak of every tagged scope (checkpoint or temporary memory) is kept
+// per tag. Tags are compared by pointer first and must outlive the arena, string literals or __FUNCTION__.
+//
+
+#ifndef MEMORY_ARENA_MAX_TAGS
+#define MEMORY_ARENA_MAX_TAGS 64
+#endif // !MEMORY_ARENA_MAX_TAGS
+
+constexpr int MemoryArenaHistogramBuckets = 40;
+
+struct Memory_Arena_Tag_Stats {
+	const char *tag;
+	uint64_t    count; // scopes ended
+	size_t      peak;  // highest usage of a single scope
+	size_t      total; // sum of the scope peaks
+};
+
+struct Memory_Arena_Stats {
+	size_t                 peak;    // highest usage of a reset cycle
+	size_t                 current; // peak usage of the current reset cycle
+	uint64_t               cycles;
+	uint64_t               histogram[MemoryArenaHistogramBuckets]; // cycles by the bit width of their peak usage
+	int                    tag_count;
+	Memory_Arena_Tag_Stats tags[MEMORY_ARENA_MAX_TAGS]; // the last one collects the tags that did not fit
+};
+
+struct Memory_Arena_Checkpoint {
+	Memory_Arena *arena;
+	const char *  tag;
+	size_t        position;
+	size_t        peak; // peak of the enclosing scope
+};
+
+Memory_Arena_Checkpoint MemoryArenaBeginCheckpoint(Memory_Arena *arena, const char *tag);
+void MemoryArenaEndCheckpoint(Memory_Arena_Checkpoint *checkpoint);
+
+#define MemoryArenaCheckpointScope(arena, tag)                                                       \
+	Memory_Arena_Checkpoint _zConcat(checkpoint__, __LINE__) = MemoryArenaBeginCheckpoint(arena, tag); \
+	Defer{ MemoryArenaEndCheckpoint(&_zConcat(checkpoint__, __LINE__)); }
+
+// Returns null if the instrumentation is disabled
+const Memory_Arena_Stats *MemoryArenaStats(Memory_Arena *arena);
+
+// Logs the reset cycle histogram and the 'count' tags with the highest peaks
+void MemoryArenaDumpStats(Memory_Arena *arena, const char *name, int count = 10);
+
 typedef struct Temporary_Memory {
+	Memory_Arena_Checkpoint checkpoint; // only tracked if tagged
 	Memory_Arena *arena;
 	size_t position;
 } Temporary_Memory;
 
-Temporary_Memory BeginTemporaryMemory(Memory_Arena *arena);
+Temporary_Memory BeginTemporaryMemory(Memory_Arena *arena, const char *tag = nullptr);
 void EndTemporaryMemory(Temporary_Memory *temp);
 void FreeTemporaryMemory(Temporary_Memory *temp);
 
@@ -475,3 +550,21 @@ void *VirtualMemoryAllocate(void *ptr, size_t size);
 bool VirtualMemoryCommit(void *ptr, size_t size);
 bool VirtualMemoryDecommit(void *ptr, size_t size);
 bool VirtualMemoryFree(void *ptr, size_t size);
+
+// Huge page size, 0 if huge pages are not supported
+size_t VirtualMemoryHugePageSize();
+// Reserves 'size' (a multiple of the huge page size) aligned to the huge page size. With 'hugetlb' the pages
+// are taken from the huge page pool and 'pooled' is set, otherwise or if the pool is empty they are transparent
+// huge pages. Returns null if neither is available.
+void *VirtualMemoryAllocateHuge(size_t size, bool hugetlb, bool *pooled);
+bool VirtualMemoryPrefault(void *ptr, size_t size);
+
+// Maps the same 'size' bytes twice, back to back, and returns the start of the 2 * size range. Writes to one
+// half show in the other. 'size' is a multiple of VirtualMemoryMirrorGranularity (the page size, 64 KB on
+// Windows where it needs Windows 10 1803). Returns null if the system can not do it.
+void * VirtualMemoryAllocateMirrored(size_t size);
+bool   VirtualMemoryFreeMirrored(void *ptr, size_t size);
+size_t VirtualMemoryMirrorGranularity();
+
+uint64_t MonotonicNanosecs();
+uint64_t MonotonicMillisecs();
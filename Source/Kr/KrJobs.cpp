@@ -0,0 +1,555 @@
+#include "KrJobs.h"
+#include "KrThread.h"
+#include "KrAllocator.h"
+#include "KrBasic.h"
+
+#include <string.h>
+
+
+//
+// The deques are the ones of Chase and Lev, with a fixed capacity and sequentially consistent atomics. The
+// owner pushes and pops at the bottom, thieves take from the top, and only taking the last job races with
+// the thieves, who settle it with a compare exchange on top.
+//
+
+constexpr uint32_t JobsMaxThreads       = 256;
+constexpr int32_t  JobsCounterReleasing = 0x40000000; // set while the counter hands out the jobs waiting on it
+
+struct Job {
+	Job_Proc       proc;
+	void *         arg;
+	Job_Counter *  counter;
+	Job *          next;  // in the waiting list of a counter or the shared queue
+	Job_Range_Proc range; // parallel for subranges, split further by whoever runs them
+	ptrdiff_t      begin;
+	ptrdiff_t      end;
+	ptrdiff_t      grain;
+};
+
+struct alignas(64) Jobs_Deque {
+	int64_t volatile            top;
+	alignas(64) int64_t volatile bottom;
+	alignas(64) Job *volatile * slots;
+	int64_t                     mask;
+};
+
+struct alignas(64) Jobs_Worker {
+	Jobs_Deque deque;
+	Thread *   thread;
+	uint32_t   index;
+	uint32_t   random; // picks the thread to steal from
+
+	// Written by the owner only
+	int64_t volatile executed;
+	int64_t volatile stolen;
+	int64_t volatile overflowed;
+	int64_t volatile sleeps;
+};
+
+// Jobs pushed by threads outside the pool
+struct Jobs_Shared_Queue {
+	Atomic_Guard     lock;
+	int32_t volatile count;
+	Job *            head;
+	Job *            tail;
+};
+
+struct Jobs_System {
+	int32_t volatile  running;
+	int32_t volatile  sleeping;
+	Semaphore *       wake;
+	Jobs_Worker *     workers; // the first one is the thread that initialized the system
+	uint32_t          count;
+	uint32_t          spin_count;
+	void *            memory;
+	size_t            memory_size;
+	Jobs_Shared_Queue shared;
+
+	int64_t volatile  executed; // by threads outside the pool
+	int64_t volatile  stolen;
+};
+
+static Jobs_System               JobSystem;
+static thread_local Jobs_Worker *JobsCurrentWorker;
+static thread_local uint32_t     JobsExternalRandom = 0x9e3779b9;
+
+//
+//
+//
+
+static inline uint32_t JobsRandom(uint32_t *state) {
+	uint32_t x = *state;
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+	*state = x;
+	return x;
+}
+
+// Only the owner writes the counter, others may read it at any time
+static inline void JobsCount(int64_t volatile *counter, int64_t count) {
+	AtomicStoreRelaxed(counter, AtomicLoadRelaxed(counter) + count);
+}
+
+static bool JobsDequePush(Jobs_Deque *deque, Job *job) {
+	int64_t bottom = AtomicLoad(&deque->bottom);
+	int64_t top    = AtomicLoad(&deque->top);
+	if (bottom - top > deque->mask)
+		return false;
+	AtomicStore((void *volatile *)&deque->slots[bottom & deque->mask], job);
+	AtomicStore(&deque->bottom, bottom + 1);
+	return true;
+}
+
+static Job *JobsDequePop(Jobs_Deque *deque) {
+	int64_t bottom = AtomicLoad(&deque->bottom) - 1;
+	AtomicStore(&deque->bottom, bottom);
+	int64_t top = AtomicLoad(&deque->top);
+
+	if (top > bottom) {
+		AtomicStore(&deque->bottom, bottom + 1);
+		return nullptr;
+	}
+
+	Job *job = (Job *)AtomicLoad((void *volatile *)&deque->slots[bottom & deque->mask]);
+	if (top == bottom) {
+		// The last one, a thief may be taking it at the same time
+		if (AtomicCmpExg(&deque->top, top + 1, top) != top)
+			job = nullptr;
+		AtomicStore(&deque->bottom, bottom + 1);
+	}
+	return job;
+}
+
+static Job *JobsDequeSteal(Jobs_Deque *deque) {
+	int64_t top    = AtomicLoad(&deque->top);
+	int64_t bottom = AtomicLoad(&deque->bottom);
+	if (top >= bottom)
+		return nullptr;
+
+	Job *job = (Job *)AtomicLoad((void *volatile *)&deque->slots[top & deque->mask]);
+	if (AtomicCmpExg(&deque->top, top + 1, top) != top)
+		return nullptr;
+	return job;
+}
+
+static inline bool JobsDequeEmpty(Jobs_Deque *deque) {
+	return AtomicLoad(&deque->top) >= AtomicLoad(&deque->bottom);
+}
+
+//
+//
+//
+
+static void JobsSharedPush(Job *job) {
+	Jobs_Shared_Queue *shared = &JobSystem.shared;
+	job->next = nullptr;
+	SpinLock(&shared->lock);
+	if (shared->tail)
+		shared->tail->next = job;
+	else
+		shared->head = job;
+	shared->tail = job;
+	AtomicInc(&shared->count);
+	SpinUnlock(&shared->lock);
+}
+
+static Job *JobsSharedPop() {
+	Jobs_Shared_Queue *shared = &JobSystem.shared;
+	if (!AtomicLoad(&shared->count))
+		return nullptr;
+	SpinLock(&shared->lock);
+	Job *job = shared->head;
+	if (job) {
+		shared->head = job->next;
+		if (!shared->head)
+			shared->tail = nullptr;
+		AtomicDec(&shared->count);
+	}
+	SpinUnlock(&shared->lock);
+	return job;
+}
+
+//
+//
+//
+
+static Job *JobsAllocate(Job_Proc proc, void *arg, Job_Counter *counter) {
+	Job *job = (Job *)MemoryAllocate(sizeof(Job), CachingAllocator());
+	if (!job) return nullptr;
+	job->proc    = proc;
+	job->arg     = arg;
+	job->counter = counter;
+	job->next    = nullptr;
+	job->range   = nullptr;
+	job->begin   = 0;
+	job->end     = 0;
+	job->grain   = 0;
+	return job;
+}
+
+static void JobsPush(Job *job);
+
+static void JobsCounterDone(Job_Counter *counter) {
+	// The counter may be gone as soon as a waiting thread sees zero, so the one taking it to zero marks it
+	// as releasing until it is done with it
+	int32_t value = AtomicLoad(&counter->value);
+	for (;;) {
+		int32_t next = (value == 1) ? JobsCounterReleasing : value - 1;
+		int32_t prev = AtomicCmpExg(&counter->value, next, value);
+		if (prev == value) break;
+		value = prev;
+	}
+
+	if (value != 1)
+		return;
+
+	SpinLock(&counter->lock);
+	Job *waiting     = counter->waiting;
+	counter->waiting = nullptr;
+	SpinUnlock(&counter->lock);
+
+	AtomicSub(&counter->value, JobsCounterReleasing);
+
+	while (waiting) {
+		Job *next = waiting->next;
+		JobsPush(waiting);
+		waiting = next;
+	}
+}
+
+static void JobsRunRange(Job_Range_Proc range, void *arg, ptrdiff_t begin, ptrdiff_t end, ptrdiff_t grain, Job_Counter *counter) {
+	// Halves go to the deque so that thieves take the larger pieces
+	while (end - begin > grain) {
+		ptrdiff_t middle = begin + (end - begin) / 2;
+		Job *     half   = JobsAllocate(nullptr, arg, counter);
+		if (!half) break;
+		half->range = range;
+		half->begin = middle;
+		half->end   = end;
+		half->grain = grain;
+		AtomicInc(&counter->value);
+		JobsPush(half);
+		end = middle;
+	}
+	range(arg, begin, end);
+}
+
+static void JobsExecute(Job *job) {
+	Memory_Arena *   scratch = ThreadScratchpad();
+	Temporary_Memory temp;
+	if (scratch)
+		temp = BeginTemporaryMemory(scratch);
+
+	if (job->range)
+		JobsRunRange(job->range, job->arg, job->begin, job->end, job->grain, job->counter);
+	else
+		job->proc(job->arg);
+
+	if (scratch)
+		EndTemporaryMemory(&temp);
+
+	Job_Counter *counter = job->counter;
+	MemoryFree(job, sizeof(Job), CachingAllocator());
+
+	if (counter)
+		JobsCounterDone(counter);
+}
+
+static void JobsWake() {
+	if (AtomicLoad(&JobSystem.sleeping) > 0)
+		Semaphore_Signal(JobSystem.wake);
+}
+
+static void JobsPush(Job *job) {
+	if (!AtomicLoad(&JobSystem.running)) {
+		JobsExecute(job);
+		return;
+	}
+
+	Jobs_Worker *worker = JobsCurrentWorker;
+	if (worker) {
+		if (!JobsDequePush(&worker->deque, job)) {
+			JobsCount(&worker->overflowed, 1);
+			JobsExecute(job);
+			return;
+		}
+	} else {
+		JobsSharedPush(job);
+	}
+
+	JobsWake();
+}
+
+static Job *JobsSteal(uint32_t *random, Jobs_Worker *self) {
+	uint32_t count = JobSystem.count;
+	uint32_t first = JobsRandom(random) % count;
+	for (uint32_t offset = 0; offset < count; ++offset) {
+		Jobs_Worker *victim = &JobSystem.workers[(first + offset) % count];
+		if (victim == self) continue;
+		Job *job = JobsDequeSteal(&victim->deque);
+		if (job) return job;
+	}
+	return nullptr;
+}
+
+// Runs one job of the calling thread or of any other, false when none was found
+static bool JobsRunOne() {
+	Jobs_Worker *worker = JobsCurrentWorker;
+
+	Job *job = worker ? JobsDequePop(&worker->deque) : nullptr;
+	if (!job)
+		job = JobsSharedPop();
+
+	bool stolen = false;
+	if (!job) {
+		job    = JobsSteal(worker ? &worker->random : &JobsExternalRandom, worker);
+		stolen = job != nullptr;
+	}
+
+	if (!job)
+		return false;
+
+	if (worker) {
+		JobsCount(&worker->executed, 1);
+		JobsCount(&worker->stolen, stolen);
+	} else {
+		AtomicInc(&JobSystem.executed);
+		if (stolen) AtomicInc(&JobSystem.stolen);
+	}
+
+	JobsExecute(job);
+	return true;
+}
+
+static bool JobsAvailable() {
+	if (AtomicLoad(&JobSystem.shared.count))
+		return true;
+	for (uint32_t index = 0; index < JobSystem.count; ++index) {
+		if (!JobsDequeEmpty(&JobSystem.workers[index].deque))
+			return true;
+	}
+	return false;
+}
+
+static int JobsWorkerProc(void *arg) {
+	Jobs_Worker *worker = (Jobs_Worker *)arg;
+	JobsCurrentWorker   = worker;
+
+	uint32_t idle = 0;
+	while (AtomicLoad(&JobSystem.running)) {
+		if (JobsRunOne()) {
+			idle = 0;
+			continue;
+		}
+
+		idle += 1;
+		if (idle < JobSystem.spin_count) {
+			if (idle & 7)
+				AtomicPause();
+			else
+				Thread_Yield();
+			continue;
+		}
+
+		// Jobs pushed after the sleeping count went up signal the semaphore, earlier ones are found here
+		AtomicInc(&JobSystem.sleeping);
+		if (!JobsAvailable() && AtomicLoad(&JobSystem.running)) {
+			JobsCount(&worker->sleeps, 1);
+			Semaphore_Wait(JobSystem.wake, -1);
+		}
+		AtomicDec(&JobSystem.sleeping);
+		idle = 0;
+	}
+
+	JobsCurrentWorker = nullptr;
+	return 0;
+}
+
+//
+//
+//
+
+bool Jobs_Initialize(const Job_System_Spec &spec) {
+	if (AtomicLoad(&JobSystem.running)) {
+		LogWarningEx("Jobs", "Already initialized");
+		return true;
+	}
+
+	uint32_t workers = spec.workers >= 0 ? (uint32_t)spec.workers : Thread_ProcessorCount() - 1;
+	uint32_t count   = Minimum(workers + 1, JobsMaxThreads);
+
+	uint32_t capacity = Maximum(spec.deque_capacity, 16u);
+	if (!IsPower2(capacity))
+		capacity = (uint32_t)NextPowerOf2(capacity);
+
+	memset(&JobSystem, 0, sizeof(JobSystem));
+
+	size_t slots_size  = sizeof(Job *) * capacity;
+	size_t memory_size = sizeof(Jobs_Worker) * count + slots_size * count + alignof(Jobs_Worker);
+
+	JobSystem.memory = MemoryAllocate(memory_size);
+	if (!JobSystem.memory) {
+		LogErrorEx("Jobs", "Failed to allocate %u deques of %u jobs", count, capacity);
+		return false;
+	}
+
+	memset(JobSystem.memory, 0, memory_size);
+
+	JobSystem.memory_size = memory_size;
+	JobSystem.workers     = (Jobs_Worker *)AlignPower2Up((size_t)JobSystem.memory, alignof(Jobs_Worker));
+	JobSystem.count       = count;
+	JobSystem.spin_count  = spec.spin_count;
+	JobSystem.wake        = Semaphore_Create(0);
+
+	if (!JobSystem.wake) {
+		LogErrorEx("Jobs", "Failed to create the wake semaphore");
+		MemoryFree(JobSystem.memory, JobSystem.memory_size);
+		JobSystem.memory = nullptr;
+		return false;
+	}
+
+	Job **slots = (Job **)(JobSystem.workers + count);
+	for (uint32_t index = 0; index < count; ++index) {
+		Jobs_Worker *worker = &JobSystem.workers[index];
+		worker->index       = index;
+		worker->random      = 0x9e3779b9u * (index + 1);
+		worker->deque.slots = slots + (size_t)index * capacity;
+		worker->deque.mask  = capacity - 1;
+	}
+
+	AtomicStore(&JobSystem.running, 1);
+	JobsCurrentWorker = &JobSystem.workers[0];
+
+	uint32_t started = 1;
+	for (; started < count; ++started) {
+		Jobs_Worker *worker = &JobSystem.workers[started];
+		worker->thread = Thread_Create(JobsWorkerProc, worker, spec.scratchpad_size, spec.params);
+		if (!worker->thread) break;
+	}
+
+	if (started != count) {
+		LogWarningEx("Jobs", "Started %u of %u worker threads", started - 1, count - 1);
+		JobSystem.count = started;
+	}
+
+	LogInfoEx("Jobs", "Started with %u worker threads", JobSystem.count - 1);
+
+	return true;
+}
+
+void Jobs_Shutdown() {
+	if (!AtomicLoad(&JobSystem.running))
+		return;
+
+	AtomicStore(&JobSystem.running, 0);
+
+	for (uint32_t index = 1; index < JobSystem.count; ++index)
+		Semaphore_Signal(JobSystem.wake);
+
+	for (uint32_t index = 1; index < JobSystem.count; ++index) {
+		Thread *thread = JobSystem.workers[index].thread;
+		Thread_Wait(thread, -1);
+		Thread_Destroy(thread);
+	}
+
+	// Jobs nobody got to run now, the ones they push run right away
+	for (uint32_t index = 0; index < JobSystem.count; ++index) {
+		Jobs_Deque *deque = &JobSystem.workers[index].deque;
+		while (Job *job = JobsDequeSteal(deque))
+			JobsExecute(job);
+	}
+	while (Job *job = JobsSharedPop())
+		JobsExecute(job);
+
+	JobsCurrentWorker = nullptr;
+
+	Semaphore_Destory(JobSystem.wake);
+	MemoryFree(JobSystem.memory, JobSystem.memory_size);
+
+	JobSystem.wake    = nullptr;
+	JobSystem.memory  = nullptr;
+	JobSystem.workers = nullptr;
+	JobSystem.count   = 0;
+}
+
+uint32_t Jobs_ThreadCount() {
+	return AtomicLoad(&JobSystem.running) ? JobSystem.count : 1;
+}
+
+void Jobs_Run(Job_Proc proc, void *arg, Job_Counter *counter) {
+	Job *job = JobsAllocate(proc, arg, counter);
+	if (!job) {
+		proc(arg);
+		return;
+	}
+	if (counter)
+		AtomicInc(&counter->value);
+	JobsPush(job);
+}
+
+void Jobs_RunAfter(Job_Counter *dependency, Job_Proc proc, void *arg, Job_Counter *counter) {
+	Job *job = JobsAllocate(proc, arg, counter);
+	if (!job) {
+		Jobs_Wait(dependency);
+		proc(arg);
+		return;
+	}
+
+	if (counter)
+		AtomicInc(&counter->value);
+
+	SpinLock(&dependency->lock);
+	bool ready = (AtomicLoad(&dependency->value) & ~JobsCounterReleasing) == 0;
+	if (!ready) {
+		job->next           = dependency->waiting;
+		dependency->waiting = job;
+	}
+	SpinUnlock(&dependency->lock);
+
+	if (ready)
+		JobsPush(job);
+}
+
+void Jobs_Wait(Job_Counter *counter) {
+	uint32_t idle = 0;
+	while (AtomicLoad(&counter->value) != 0) {
+		if (JobsRunOne()) {
+			idle = 0;
+			continue;
+		}
+		// The remaining jobs run on other threads
+		idle += 1;
+		if (idle & 63)
+			AtomicPause();
+		else
+			Thread_Yield();
+	}
+}
+
+void Jobs_ParallelFor(ptrdiff_t count, ptrdiff_t grain, Job_Range_Proc proc, void *arg) {
+	if (count <= 0) return;
+	grain = Maximum(grain, (ptrdiff_t)1);
+
+	Job_Counter counter = {};
+	JobsRunRange(proc, arg, 0, count, grain, &counter);
+	Jobs_Wait(&counter);
+}
+
+void Jobs_GetStats(Job_System_Stats *stats) {
+	memset(stats, 0, sizeof(*stats));
+
+	stats->executed = AtomicLoad(&JobSystem.executed);
+	stats->stolen   = AtomicLoad(&JobSystem.stolen);
+
+	if (!AtomicLoad(&JobSystem.running))
+		return;
+
+	for (uint32_t index = 0; index < JobSystem.count; ++index) {
+		Jobs_Worker *worker = &JobSystem.workers[index];
+		stats->executed   += AtomicLoadRelaxed(&worker->executed);
+		stats->stolen     += AtomicLoadRelaxed(&worker->stolen);
+		stats->overflowed += AtomicLoadRelaxed(&worker->overflowed);
+		stats->sleeps     += AtomicLoadRelaxed(&worker->sleeps);
+	}
+}
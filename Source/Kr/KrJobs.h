@@ -0,0 +1,64 @@
+#pragma once
+#include "KrCommon.h"
+#include "KrAtomic.h"
+
+//
+// Job system, a fixed pool of worker threads with a work stealing deque each. A job runs on whichever
+// thread gets to it first: the thread that pushed it pops from the bottom of its own deque, idle workers
+// steal from the top of the others. The thread that calls Jobs_Initialize owns a deque as well and runs
+// jobs while it waits, other threads push into a shared queue.
+//
+// Completion is tracked with a Job_Counter, every job started with a counter increments it and decrements it
+// once it has run. Jobs_Wait runs other jobs until the counter drops to zero, so jobs may wait on jobs they
+// started themselves (fork-join). Jobs_RunAfter holds a job back until a counter drops to zero.
+//
+// Each job runs in a temporary memory block of the scratchpad of the thread that runs it, what it pushes
+// there is gone once it returns. Workers that find nothing to do spin for a while, then sleep until more
+// jobs are pushed.
+//
+// Without Jobs_Initialize (or after Jobs_Shutdown) every job runs right away on the calling thread.
+//
+
+struct Job;
+
+typedef void(*Job_Proc)(void *arg);
+typedef void(*Job_Range_Proc)(void *arg, ptrdiff_t begin, ptrdiff_t end);
+
+struct Job_Counter {
+	int32_t volatile value;
+	Atomic_Guard     lock;
+	Job *            waiting; // jobs held back by Jobs_RunAfter
+};
+
+struct Job_System_Spec {
+	int32_t               workers;         // threads besides the calling one, -1 for one per other processor
+	uint32_t              deque_capacity;  // jobs per deque, a power of 2, a push to a full deque runs the job
+	uint32_t              scratchpad_size; // of each worker
+	uint32_t              spin_count;      // attempts to find a job before a worker sleeps
+	Thread_Context_Params params;          // of each worker
+};
+
+static constexpr Job_System_Spec JobSystemDefaultSpec = {
+	-1, 4096, MegaBytes(16), 64, ThreadContextDefaultParams
+};
+
+struct Job_System_Stats {
+	int64_t executed;   // jobs run
+	int64_t stolen;     // of them, taken from the deque of another thread
+	int64_t overflowed; // run by the pushing thread because its deque was full
+	int64_t sleeps;     // times a worker went to sleep
+};
+
+bool     Jobs_Initialize(const Job_System_Spec &spec = JobSystemDefaultSpec);
+void     Jobs_Shutdown();
+uint32_t Jobs_ThreadCount(); // workers and the thread that initialized the system
+
+void Jobs_Run(Job_Proc proc, void *arg, Job_Counter *counter = nullptr);
+void Jobs_RunAfter(Job_Counter *dependency, Job_Proc proc, void *arg, Job_Counter *counter = nullptr);
+void Jobs_Wait(Job_Counter *counter);
+
+// Calls 'proc' on subranges of [0, count) of at most 'grain' elements, in parallel, and waits for all of them
+void Jobs_ParallelFor(ptrdiff_t count, ptrdiff_t grain, Job_Range_Proc proc, void *arg);
+
+// Counters are kept per thread and summed while the jobs run, exact once they are done
+void Jobs_GetStats(Job_System_Stats *stats);
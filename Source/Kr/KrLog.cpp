@@ -0,0 +1,942 @@
+#include "KrLog.h"
+#include "KrAtomic.h"
+#include "KrThread.h"
+#include "KrAllocator.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+//
+// The rings are single producer, single consumer: the thread that owns a ring moves head, the writer moves
+// tail. Entries are 8 byte aligned and never wrap around the end of the ring, a filler entry takes up what is
+// left at the end instead. Each argument takes 8 bytes, a string takes its length followed by its bytes. Both
+// sides parse the format the same way to know which argument is which.
+//
+
+constexpr uint32_t LogEntryFiller  = 0xffffffff; // the ring is unused from here up to its end
+constexpr uint32_t LogEntryName    = 0xfffffffe; // the thread changed its name, carried as a string argument
+constexpr uint32_t LogNameLength   = 31;
+constexpr uint32_t LogMinRingSize  = KiloBytes(4);
+constexpr uint32_t LogBlockSpins   = 16; // yields of a thread waiting for space before it sleeps
+
+struct Log_Entry {
+	uint32_t    size;  // with the arguments, a multiple of 8
+	uint32_t    level; // or LogEntryFiller, LogEntryName
+	uint64_t    time;
+	const char *source;
+	const char *fmt;
+};
+
+static_assert(sizeof(Log_Entry) % 8 == 0, "arguments follow the entry 8 byte aligned");
+
+struct Log_Ring {
+	alignas(64) int64_t volatile head; // written by the owner
+	alignas(64) int64_t volatile tail; // written by the writer
+	alignas(64) uint8_t *buffer;
+	int64_t              mask;
+	uint8_t *            staging; // the owner packs an entry here before it is copied into the ring
+	void *               memory;
+	size_t               memory_size;
+	Log_Ring *           next;
+	int32_t volatile     retired; // the owner has exited
+
+	// Written by the owner only
+	int64_t volatile     dropped;
+	int64_t volatile     blocked;
+	int64_t volatile     truncated;
+
+	// Used by the writer only
+	int64_t              limit;    // head when the drain started
+	int64_t              reported; // drops written to the log
+	char                 name[LogNameLength + 1];
+};
+
+struct Log_Thread {
+	Log_Ring *ring;
+	int32_t   generation;
+	char      name[LogNameLength + 1];
+
+	~Log_Thread();
+};
+
+struct Log_System {
+	int32_t volatile   running;
+	int32_t volatile   sleeping;   // the writer waits on the semaphore
+	int32_t volatile   generation; // of AsyncLog_Start, tells the rings of an earlier start apart
+	int32_t volatile   flush_requested;
+	int32_t volatile   flushed;
+	Semaphore *        wake;
+	Thread *           writer;
+	Async_Log_Spec     spec;
+	uint32_t           max_entry; // size of an entry with its arguments
+
+	Atomic_Guard       lock; // of the list of rings
+	Log_Ring *volatile rings;
+	uint32_t           next_id;
+
+	uint64_t           start_monotonic;
+	uint64_t           start_realtime;
+
+	// Used by the writer only
+	char *             batch;
+	size_t             batch_length;
+	size_t             batch_capacity;
+	int64_t            stamp_secs;
+	char               stamp[32];
+
+	int64_t volatile   written;
+	int64_t volatile   bytes;
+	int64_t volatile   dropped; // of the rings that are gone
+	int64_t volatile   blocked;
+	int64_t volatile   truncated;
+};
+
+static Log_System              LogSystem;
+static thread_local Log_Thread LogThread;
+
+static const char *LogLevelNames[] = { "INFO ", "WARN ", "ERROR" };
+
+static inline void LogCount(int64_t volatile *counter, int64_t count) {
+	AtomicStoreRelaxed(counter, AtomicLoadRelaxed(counter) + count);
+}
+
+//
+//
+//
+
+enum Log_Arg : uint8_t {
+	LOG_ARG_NONE, // %%
+	LOG_ARG_INT,
+	LOG_ARG_UINT,
+	LOG_ARG_CHAR,
+	LOG_ARG_DOUBLE,
+	LOG_ARG_POINTER,
+	LOG_ARG_STRING,
+	LOG_ARG_COUNT, // %n, nothing is stored there
+	LOG_ARG_UNKNOWN,
+};
+
+enum Log_Arg_Size : uint8_t {
+	LOG_SIZE_DEFAULT,
+	LOG_SIZE_CHAR,
+	LOG_SIZE_SHORT,
+	LOG_SIZE_LONG,
+	LOG_SIZE_LONG_LONG,
+	LOG_SIZE_SIZE,
+	LOG_SIZE_INTMAX,
+	LOG_SIZE_PTRDIFF,
+	LOG_SIZE_LONG_DOUBLE,
+	LOG_SIZE_INT32,
+	LOG_SIZE_INT64,
+};
+
+struct Log_Spec {
+	const char * start;    // the '%'
+	const char * modifier; // where the flags, width and precision end
+	char         conversion;
+	Log_Arg      arg;
+	Log_Arg_Size size;
+	bool         star_width;
+	bool         star_precision;
+	int          precision; // -1 if there is none or it is an argument
+};
+
+static inline bool LogIsDigit(char c) {
+	return c >= '0' && c <= '9';
+}
+
+// 'fmt' points to the '%', returns the end of the conversion
+static const char *LogParseSpec(const char *fmt, Log_Spec *spec) {
+	spec->start          = fmt++;
+	spec->star_width     = false;
+	spec->star_precision = false;
+	spec->precision      = -1;
+
+	while (*fmt == '-' || *fmt == '+' || *fmt == ' ' || *fmt == '#' || *fmt == '0' || *fmt == '\'')
+		fmt += 1;
+
+	if (*fmt == '*') {
+		spec->star_width = true;
+		fmt += 1;
+	} else {
+		while (LogIsDigit(*fmt))
+			fmt += 1;
+	}
+
+	if (*fmt == '.') {
+		fmt += 1;
+		if (*fmt == '*') {
+			spec->star_precision = true;
+			fmt += 1;
+		} else {
+			spec->precision = 0;
+			while (LogIsDigit(*fmt))
+				spec->precision = spec->precision * 10 + (*fmt++ - '0');
+		}
+	}
+
+	spec->modifier = fmt;
+	spec->size     = LOG_SIZE_DEFAULT;
+
+	switch (*fmt) {
+		case 'h': fmt += 1; spec->size = LOG_SIZE_SHORT; if (*fmt == 'h') { fmt += 1; spec->size = LOG_SIZE_CHAR; } break;
+		case 'l': fmt += 1; spec->size = LOG_SIZE_LONG; if (*fmt == 'l') { fmt += 1; spec->size = LOG_SIZE_LONG_LONG; } break;
+		case 'q': fmt += 1; spec->size = LOG_SIZE_LONG_LONG; break;
+		case 'z': fmt += 1; spec->size = LOG_SIZE_SIZE; break;
+		case 'j': fmt += 1; spec->size = LOG_SIZE_INTMAX; break;
+		case 't': fmt += 1; spec->size = LOG_SIZE_PTRDIFF; break;
+		case 'L': fmt += 1; spec->size = LOG_SIZE_LONG_DOUBLE; break;
+		case 'I': {
+			if (fmt[1] == '6' && fmt[2] == '4') {
+				fmt += 3;
+				spec->size = LOG_SIZE_INT64;
+			} else if (fmt[1] == '3' && fmt[2] == '2') {
+				fmt += 3;
+				spec->size = LOG_SIZE_INT32;
+			} else {
+				fmt += 1;
+				spec->size = LOG_SIZE_PTRDIFF;
+			}
+		} break;
+	}
+
+	spec->conversion = *fmt;
+
+	switch (*fmt) {
+		case 'd': case 'i':
+			spec->arg = LOG_ARG_INT;
+			break;
+		case 'u': case 'o': case 'x': case 'X':
+			spec->arg = LOG_ARG_UINT;
+			break;
+		case 'f': case 'F': case 'e': case 'E': case 'g': case 'G': case 'a': case 'A':
+			spec->arg = LOG_ARG_DOUBLE;
+			break;
+		case 'c': spec->arg = spec->size == LOG_SIZE_DEFAULT ? LOG_ARG_CHAR : LOG_ARG_UNKNOWN; break;
+		case 's': spec->arg = spec->size == LOG_SIZE_DEFAULT ? LOG_ARG_STRING : LOG_ARG_UNKNOWN; break;
+		case 'p': spec->arg = LOG_ARG_POINTER; break;
+		case 'n': spec->arg = LOG_ARG_COUNT; break;
+		case '%': spec->arg = LOG_ARG_NONE; break;
+		default:  spec->arg = LOG_ARG_UNKNOWN; break;
+	}
+
+	if (*fmt) fmt += 1;
+	return fmt;
+}
+
+//
+//
+//
+
+struct Log_Packer {
+	uint8_t *cursor;
+	uint8_t *end;
+	bool     truncated;
+};
+
+static bool LogPackValue(Log_Packer *packer, uint64_t value) {
+	if (packer->end - packer->cursor < 8) {
+		packer->truncated = true;
+		return false;
+	}
+	memcpy(packer->cursor, &value, sizeof(value));
+	packer->cursor += 8;
+	return true;
+}
+
+static bool LogPackString(Log_Packer *packer, const char *str, int precision) {
+	if (!str) str = "(null)";
+
+	ptrdiff_t room = packer->end - packer->cursor - 8 - 1;
+	if (room < 0) {
+		packer->truncated = true;
+		return false;
+	}
+
+	// Strings of "%.*s" need not be terminated, they are not read past the precision
+	size_t limit  = precision >= 0 ? Minimum((size_t)precision, (size_t)room) : (size_t)room;
+	size_t length = strnlen(str, limit);
+
+	if (length == (size_t)room && (precision < 0 || precision > room) && str[length])
+		packer->truncated = true;
+
+	uint64_t stored = length;
+	memcpy(packer->cursor, &stored, sizeof(stored));
+	memcpy(packer->cursor + 8, str, length);
+	packer->cursor[8 + length] = 0;
+	packer->cursor += AlignPower2Up(8 + length + 1, 8);
+	return true;
+}
+
+static void LogPackArguments(Log_Packer *packer, const char *fmt, va_list args) {
+	va_list list;
+	va_copy(list, args);
+
+	while (*fmt) {
+		if (*fmt != '%') {
+			fmt += 1;
+			continue;
+		}
+
+		Log_Spec spec;
+		fmt = LogParseSpec(fmt, &spec);
+
+		if (spec.arg == LOG_ARG_UNKNOWN) break;
+		if (spec.arg == LOG_ARG_NONE) continue;
+
+		int precision = spec.precision;
+		if (spec.star_width && !LogPackValue(packer, (uint64_t)(int64_t)va_arg(list, int)))
+			break;
+		if (spec.star_precision) {
+			precision = va_arg(list, int);
+			if (!LogPackValue(packer, (uint64_t)(int64_t)precision))
+				break;
+		}
+
+		bool packed = true;
+
+		switch (spec.arg) {
+			case LOG_ARG_INT: {
+				int64_t value;
+				switch (spec.size) {
+					case LOG_SIZE_CHAR:      value = (signed char)va_arg(list, int); break;
+					case LOG_SIZE_SHORT:     value = (short)va_arg(list, int); break;
+					case LOG_SIZE_LONG:      value = va_arg(list, long); break;
+					case LOG_SIZE_LONG_LONG: value = va_arg(list, long long); break;
+					case LOG_SIZE_SIZE:      value = va_arg(list, ptrdiff_t); break;
+					case LOG_SIZE_INTMAX:    value = va_arg(list, intmax_t); break;
+					case LOG_SIZE_PTRDIFF:   value = va_arg(list, ptrdiff_t); break;
+					case LOG_SIZE_INT64:     value = va_arg(list, int64_t); break;
+					default:                 value = va_arg(list, int); break;
+				}
+				packed = LogPackValue(packer, (uint64_t)value);
+			} break;
+
+			case LOG_ARG_UINT: {
+				uint64_t value;
+				switch (spec.size) {
+					case LOG_SIZE_CHAR:      value = (unsigned char)va_arg(list, unsigned int); break;
+					case LOG_SIZE_SHORT:     value = (unsigned short)va_arg(list, unsigned int); break;
+					case LOG_SIZE_LONG:      value = va_arg(list, unsigned long); break;
+					case LOG_SIZE_LONG_LONG: value = va_arg(list, unsigned long long); break;
+					case LOG_SIZE_SIZE:      value = va_arg(list, size_t); break;
+					case LOG_SIZE_INTMAX:    value = va_arg(list, uintmax_t); break;
+					case LOG_SIZE_PTRDIFF:   value = va_arg(list, size_t); break;
+					case LOG_SIZE_INT64:     value = va_arg(list, uint64_t); break;
+					default:                 value = va_arg(list, unsigned int); break;
+				}
+				packed = LogPackValue(packer, value);
+			} break;
+
+			case LOG_ARG_CHAR: {
+				packed = LogPackValue(packer, (uint64_t)(int64_t)va_arg(list, int));
+			} break;
+
+			case LOG_ARG_DOUBLE: {
+				double value = spec.size == LOG_SIZE_LONG_DOUBLE ? (double)va_arg(list, long double) : va_arg(list, double);
+				uint64_t bits;
+				memcpy(&bits, &value, sizeof(bits));
+				packed = LogPackValue(packer, bits);
+			} break;
+
+			case LOG_ARG_POINTER: {
+				packed = LogPackValue(packer, (uint64_t)(uintptr_t)va_arg(list, void *));
+			} break;
+
+			case LOG_ARG_STRING: {
+				packed = LogPackString(packer, va_arg(list, const char *), precision);
+			} break;
+
+			case LOG_ARG_COUNT: {
+				(void)va_arg(list, void *);
+			} break;
+
+			default: break;
+		}
+
+		if (!packed) break;
+	}
+
+	va_end(list);
+}
+
+//
+//
+//
+
+static inline void LogWake() {
+	if (AtomicCmpExg(&LogSystem.sleeping, 0, 1) == 1)
+		Semaphore_Signal(LogSystem.wake);
+}
+
+static bool LogPush(Log_Ring *ring, const void *data, uint32_t size, bool urgent) {
+	int64_t capacity = ring->mask + 1;
+	int64_t head     = ring->head;
+	int64_t offset   = head & ring->mask;
+	int64_t filler   = capacity - offset < size ? capacity - offset : 0;
+	int64_t tail     = AtomicLoadAcquire(&ring->tail);
+
+	if (capacity - (head - tail) < filler + size) {
+		if (LogSystem.spec.overflow == LOG_OVERFLOW_DROP) {
+			LogCount(&ring->dropped, 1);
+			LogWake();
+			return false;
+		}
+
+		LogCount(&ring->blocked, 1);
+		for (uint32_t spin = 0; capacity - (head - tail) < filler + size; ++spin) {
+			LogWake();
+			if (spin < LogBlockSpins)
+				Thread_Yield();
+			else
+				Thread_Sleep(1);
+			if (!AtomicLoadAcquire(&LogSystem.running))
+				return false;
+			tail = AtomicLoadAcquire(&ring->tail);
+		}
+	}
+
+	if (filler) {
+		Log_Entry *entry = (Log_Entry *)(ring->buffer + offset);
+		entry->size      = (uint32_t)filler;
+		entry->level     = LogEntryFiller;
+		head            += filler;
+		offset           = 0;
+	}
+
+	memcpy(ring->buffer + offset, data, size);
+	head += size;
+	AtomicStoreRelease(&ring->head, head);
+
+	if (urgent || head - tail > capacity / 2)
+		LogWake();
+
+	return true;
+}
+
+static Log_Ring *LogCreateRing(Log_Thread *thread, int32_t generation) {
+	size_t ring_size   = LogSystem.spec.ring_size;
+	size_t memory_size = sizeof(Log_Ring) + alignof(Log_Ring) + ring_size + LogSystem.max_entry;
+	void * memory      = MemoryAllocate(memory_size, CachingAllocator());
+	if (!memory) return nullptr;
+
+	Log_Ring *ring = (Log_Ring *)AlignPower2Up((size_t)memory, alignof(Log_Ring));
+	memset(ring, 0, sizeof(*ring));
+
+	ring->buffer      = (uint8_t *)(ring + 1);
+	ring->mask        = (int64_t)ring_size - 1;
+	ring->staging     = ring->buffer + ring_size;
+	ring->memory      = memory;
+	ring->memory_size = memory_size;
+
+	SpinLock(&LogSystem.lock);
+	LogSystem.next_id += 1;
+	if (thread->name[0])
+		memcpy(ring->name, thread->name, sizeof(ring->name));
+	else
+		snprintf(ring->name, sizeof(ring->name), "T%u", LogSystem.next_id);
+	ring->next = LogSystem.rings;
+	AtomicStoreRelease((void *volatile *)&LogSystem.rings, ring);
+	SpinUnlock(&LogSystem.lock);
+
+	thread->ring       = ring;
+	thread->generation = generation;
+
+	return ring;
+}
+
+// Rings are only freed once their owner has retired them, so a ring of an earlier start is still there
+static Log_Ring *LogThreadRing() {
+	Log_Thread *thread     = &LogThread;
+	int32_t     generation = AtomicLoadAcquire(&LogSystem.generation);
+	if (thread->ring && thread->generation == generation)
+		return thread->ring;
+	if (thread->ring)
+		AtomicStoreRelease(&thread->ring->retired, 1);
+	thread->ring = nullptr;
+	return LogCreateRing(thread, generation);
+}
+
+Log_Thread::~Log_Thread() {
+	if (ring)
+		AtomicStoreRelease(&ring->retired, 1);
+	ring = nullptr;
+}
+
+static void LogWriteDirect(Log_Level level, const char *source, const char *fmt, va_list args) {
+	if (*source)
+		fprintf(stderr, "%s [%s] ", LogLevelNames[level], source);
+	else
+		fprintf(stderr, "%s ", LogLevelNames[level]);
+	vfprintf(stderr, fmt, args);
+	fprintf(stderr, "\n");
+}
+
+void AsyncLogProc(void *context, Log_Level level, const char *source, const char *fmt, va_list args) {
+	Log_Ring *ring = AtomicLoadAcquire(&LogSystem.running) ? LogThreadRing() : nullptr;
+	if (!ring) {
+		LogWriteDirect(level, source, fmt, args);
+		return;
+	}
+
+	Log_Entry *entry = (Log_Entry *)ring->staging;
+	entry->level     = level;
+	entry->time      = MonotonicNanosecs();
+	entry->source    = source;
+	entry->fmt       = fmt;
+
+	Log_Packer packer = { (uint8_t *)(entry + 1), ring->staging + LogSystem.max_entry, false };
+	LogPackArguments(&packer, fmt, args);
+
+	entry->size = (uint32_t)(packer.cursor - ring->staging);
+	if (packer.truncated)
+		LogCount(&ring->truncated, 1);
+
+	LogPush(ring, entry, entry->size, level == LOG_LEVEL_ERROR);
+}
+
+void AsyncLog_SetThreadName(const char *fmt, ...) {
+	Log_Thread *thread = &LogThread;
+
+	va_list args;
+	va_start(args, fmt);
+	vsnprintf(thread->name, sizeof(thread->name), fmt, args);
+	va_end(args);
+
+	// A ring made from now on takes the name as it is
+	Log_Ring *ring = thread->ring;
+	if (!ring || thread->generation != AtomicLoadAcquire(&LogSystem.generation) || !AtomicLoadAcquire(&LogSystem.running))
+		return;
+
+	Log_Entry *entry = (Log_Entry *)ring->staging;
+	entry->level     = LogEntryName;
+	entry->time      = MonotonicNanosecs();
+	entry->source    = nullptr;
+	entry->fmt       = nullptr;
+
+	Log_Packer packer = { (uint8_t *)(entry + 1), ring->staging + LogSystem.max_entry, false };
+	LogPackString(&packer, thread->name, -1);
+
+	entry->size = (uint32_t)(packer.cursor - ring->staging);
+	LogPush(ring, entry, entry->size, false);
+}
+
+//
+//
+//
+
+static void LogBatchFlush() {
+	if (!LogSystem.batch_length) return;
+	LogSystem.spec.sink(LogSystem.spec.context, LogSystem.batch, LogSystem.batch_length);
+	LogCount(&LogSystem.bytes, (int64_t)LogSystem.batch_length);
+	LogSystem.batch_length = 0;
+}
+
+static void LogBatchAppend(const char *data, size_t length) {
+	while (length) {
+		if (LogSystem.batch_length == LogSystem.batch_capacity)
+			LogBatchFlush();
+		size_t count = Minimum(length, LogSystem.batch_capacity - LogSystem.batch_length);
+		memcpy(LogSystem.batch + LogSystem.batch_length, data, count);
+		LogSystem.batch_length += count;
+		data                   += count;
+		length                 -= count;
+	}
+}
+
+template <typename T>
+static void LogBatchFormat(const char *spec, const int *stars, int star_count, T value) {
+	for (;;) {
+		char * dst  = LogSystem.batch + LogSystem.batch_length;
+		size_t room = LogSystem.batch_capacity - LogSystem.batch_length;
+
+		int written;
+		if (star_count == 0)
+			written = snprintf(dst, room, spec, value);
+		else if (star_count == 1)
+			written = snprintf(dst, room, spec, stars[0], value);
+		else
+			written = snprintf(dst, room, spec, stars[0], stars[1], value);
+
+		if (written < 0) return;
+
+		if ((size_t)written < room) {
+			LogSystem.batch_length += written;
+			return;
+		}
+
+		// Cut short if it does not fit an empty batch either
+		if (LogSystem.batch_length == 0) {
+			LogSystem.batch_length += room - 1;
+			return;
+		}
+
+		LogBatchFlush();
+	}
+}
+
+static bool LogTakeValue(const uint8_t **args, const uint8_t *end, uint64_t *value) {
+	if (end - *args < 8) return false;
+	memcpy(value, *args, sizeof(*value));
+	*args += 8;
+	return true;
+}
+
+static void LogRenderMessage(const char *fmt, const uint8_t *args, const uint8_t *end) {
+	const char *literal = fmt;
+
+	while (*fmt) {
+		if (*fmt != '%') {
+			fmt += 1;
+			continue;
+		}
+
+		LogBatchAppend(literal, fmt - literal);
+		literal = fmt;
+
+		Log_Spec    spec;
+		const char *next = LogParseSpec(fmt, &spec);
+
+		if (spec.arg == LOG_ARG_UNKNOWN) break;
+
+		if (spec.arg == LOG_ARG_NONE) {
+			LogBatchAppend("%", 1);
+			fmt = literal = next;
+			continue;
+		}
+
+		uint64_t value;
+		int      stars[2];
+		int      star_count = 0;
+
+		if (spec.star_width) {
+			if (!LogTakeValue(&args, end, &value)) break;
+			stars[star_count++] = (int)(int64_t)value;
+		}
+		if (spec.star_precision) {
+			if (!LogTakeValue(&args, end, &value)) break;
+			stars[star_count++] = (int)(int64_t)value;
+		}
+
+		if (spec.arg == LOG_ARG_COUNT) {
+			fmt = literal = next;
+			continue;
+		}
+
+		// Integers are stored widened, they are printed with "ll" in place of the size they had
+		char   text[64];
+		size_t length = spec.modifier - spec.start;
+		if (length > sizeof(text) - 4) break;
+
+		memcpy(text, spec.start, length);
+		if (spec.arg == LOG_ARG_INT || spec.arg == LOG_ARG_UINT) {
+			text[length++] = 'l';
+			text[length++] = 'l';
+		}
+		text[length++] = spec.conversion;
+		text[length]   = 0;
+
+		if (!LogTakeValue(&args, end, &value)) break;
+
+		switch (spec.arg) {
+			case LOG_ARG_INT:     LogBatchFormat(text, stars, star_count, (long long)(int64_t)value); break;
+			case LOG_ARG_UINT:    LogBatchFormat(text, stars, star_count, (unsigned long long)value); break;
+			case LOG_ARG_CHAR:    LogBatchFormat(text, stars, star_count, (int)(int64_t)value); break;
+			case LOG_ARG_POINTER: LogBatchFormat(text, stars, star_count, (void *)(uintptr_t)value); break;
+
+			case LOG_ARG_DOUBLE: {
+				double number;
+				memcpy(&number, &value, sizeof(number));
+				LogBatchFormat(text, stars, star_count, number);
+			} break;
+
+			case LOG_ARG_STRING: {
+				const char *str = (const char *)args;
+				args += AlignPower2Up(value + 1, 8);
+				LogBatchFormat(text, stars, star_count, str);
+			} break;
+
+			default: break;
+		}
+
+		fmt = literal = next;
+	}
+
+	LogBatchAppend(literal, strlen(literal));
+}
+
+static void LogWriteHeader(uint64_t time, uint32_t level, const char *name, const char *source) {
+	uint64_t realtime = LogSystem.start_realtime + (time - LogSystem.start_monotonic);
+	int64_t  secs     = (int64_t)(realtime / 1000000000ull);
+	uint32_t nanosecs = (uint32_t)(realtime % 1000000000ull);
+
+	if (secs != LogSystem.stamp_secs) {
+		time_t    clock = (time_t)secs;
+		struct tm local;
+#if PLATFORM_WINDOWS == 1
+		localtime_s(&local, &clock);
+#else
+		localtime_r(&clock, &local);
+#endif
+		strftime(LogSystem.stamp, sizeof(LogSystem.stamp), "%Y-%m-%d %H:%M:%S", &local);
+		LogSystem.stamp_secs = secs;
+	}
+
+	char header[128];
+	int  length;
+	if (source && *source)
+		length = snprintf(header, sizeof(header), "%s.%09u %s [%s] [%s] ", LogSystem.stamp, nanosecs, LogLevelNames[level], name, source);
+	else
+		length = snprintf(header, sizeof(header), "%s.%09u %s [%s] ", LogSystem.stamp, nanosecs, LogLevelNames[level], name);
+	LogBatchAppend(header, Minimum((size_t)length, sizeof(header) - 1));
+}
+
+static void LogReportDrops(Log_Ring *ring) {
+	int64_t dropped = AtomicLoadRelaxed(&ring->dropped);
+	if (dropped == ring->reported) return;
+
+	LogWriteHeader(MonotonicNanosecs(), LOG_LEVEL_WARNING, ring->name, "Log");
+
+	char line[64];
+	int  length = snprintf(line, sizeof(line), "%lld entries dropped, the ring was full\n", (long long)(dropped - ring->reported));
+	LogBatchAppend(line, length);
+
+	ring->reported = dropped;
+}
+
+// Skips the filler and name entries, returns the next one to write or null
+static Log_Entry *LogNextEntry(Log_Ring *ring) {
+	while (ring->tail < ring->limit) {
+		Log_Entry *entry = (Log_Entry *)(ring->buffer + (ring->tail & ring->mask));
+
+		if (entry->level == LogEntryName) {
+			const uint8_t *args = (const uint8_t *)(entry + 1);
+			uint64_t       length;
+			memcpy(&length, args, sizeof(length));
+			length = Minimum(length, (uint64_t)LogNameLength);
+			memcpy(ring->name, args + 8, length);
+			ring->name[length] = 0;
+		} else if (entry->level != LogEntryFiller) {
+			return entry;
+		}
+
+		AtomicStoreRelease(&ring->tail, ring->tail + entry->size);
+	}
+	return nullptr;
+}
+
+// Rings of threads that are still running stay, they may be writing into them
+static void LogReleaseRetired() {
+	Log_Ring *released = nullptr;
+
+	SpinLock(&LogSystem.lock);
+	Log_Ring *volatile *link = &LogSystem.rings;
+	while (*link) {
+		Log_Ring *ring = *link;
+		if (AtomicLoadAcquire(&ring->retired) && AtomicLoadAcquire(&ring->head) == ring->tail) {
+			AtomicStoreRelease((void *volatile *)link, ring->next);
+			ring->next = released;
+			released   = ring;
+		} else {
+			link = (Log_Ring *volatile *)&ring->next;
+		}
+	}
+	SpinUnlock(&LogSystem.lock);
+
+	while (released) {
+		Log_Ring *ring = released;
+		released       = ring->next;
+
+		LogReportDrops(ring);
+		AtomicAdd(&LogSystem.dropped, AtomicLoadRelaxed(&ring->dropped));
+		AtomicAdd(&LogSystem.blocked, AtomicLoadRelaxed(&ring->blocked));
+		AtomicAdd(&LogSystem.truncated, AtomicLoadRelaxed(&ring->truncated));
+		MemoryFree(ring->memory, ring->memory_size, CachingAllocator());
+	}
+}
+
+// Writes what the rings hold, oldest first across all of them
+static void LogDrain() {
+	Log_Ring *first = (Log_Ring *)AtomicLoadAcquire((void *volatile *)&LogSystem.rings);
+
+	for (Log_Ring *ring = first; ring; ring = ring->next)
+		ring->limit = AtomicLoadAcquire(&ring->head);
+
+	int64_t written = 0;
+
+	for (;;) {
+		Log_Ring * oldest = nullptr;
+		Log_Entry *entry  = nullptr;
+
+		for (Log_Ring *ring = first; ring; ring = ring->next) {
+			Log_Entry *next = LogNextEntry(ring);
+			if (next && (!entry || next->time < entry->time)) {
+				oldest = ring;
+				entry  = next;
+			}
+		}
+
+		if (!oldest) break;
+
+		LogWriteHeader(entry->time, entry->level, oldest->name, entry->source);
+		LogRenderMessage(entry->fmt, (const uint8_t *)(entry + 1), (const uint8_t *)entry + entry->size);
+		LogBatchAppend("\n", 1);
+
+		AtomicStoreRelease(&oldest->tail, oldest->tail + entry->size);
+		written += 1;
+
+		if (LogSystem.batch_length >= LogSystem.spec.batch_size)
+			LogBatchFlush();
+	}
+
+	for (Log_Ring *ring = first; ring; ring = ring->next)
+		LogReportDrops(ring);
+
+	LogReleaseRetired();
+	LogBatchFlush();
+
+	LogCount(&LogSystem.written, written);
+}
+
+static void LogCompleteFlush(int32_t requested) {
+	if (AtomicLoadRelaxed(&LogSystem.flushed) == requested) return;
+	AtomicStoreRelease(&LogSystem.flushed, requested);
+	AtomicWakeAll(&LogSystem.flushed);
+}
+
+static int LogWriterProc(void *arg) {
+	while (AtomicLoadAcquire(&LogSystem.running)) {
+		int32_t requested = AtomicLoadAcquire(&LogSystem.flush_requested);
+		LogDrain();
+		LogCompleteFlush(requested);
+
+		AtomicStore(&LogSystem.sleeping, 1);
+		Semaphore_Wait(LogSystem.wake, (int)LogSystem.spec.flush_ms);
+		AtomicStore(&LogSystem.sleeping, 0);
+	}
+
+	int32_t requested = AtomicLoadAcquire(&LogSystem.flush_requested);
+	LogDrain();
+	LogCompleteFlush(requested);
+
+	return 0;
+}
+
+//
+//
+//
+
+void AsyncLogFileSink(void *context, const char *text, size_t length) {
+	FILE *fp = context ? (FILE *)context : stdout;
+	fwrite(text, 1, length, fp);
+	fflush(fp);
+}
+
+bool AsyncLog_Start(const Async_Log_Spec &spec) {
+	if (AtomicLoad(&LogSystem.running)) {
+		LogErrorEx("Log", "Asynchronous logger is already running");
+		return false;
+	}
+
+	Assert(IsPower2(spec.ring_size) && spec.sink);
+
+	LogSystem.spec           = spec;
+	LogSystem.spec.ring_size = Maximum(spec.ring_size, LogMinRingSize);
+	LogSystem.max_entry      = LogSystem.spec.ring_size / 4;
+	LogSystem.batch_capacity = 2 * Maximum((size_t)spec.batch_size, (size_t)LogSystem.max_entry);
+	LogSystem.batch_length   = 0;
+	LogSystem.batch          = (char *)MemoryAllocate(LogSystem.batch_capacity, CachingAllocator());
+	LogSystem.wake           = Semaphore_Create(0);
+
+	if (!LogSystem.batch || !LogSystem.wake) {
+		if (LogSystem.batch) MemoryFree(LogSystem.batch, LogSystem.batch_capacity, CachingAllocator());
+		if (LogSystem.wake) Semaphore_Destory(LogSystem.wake);
+		LogSystem.batch = nullptr;
+		LogSystem.wake  = nullptr;
+		LogErrorEx("Log", "Failed to allocate the asynchronous logger");
+		return false;
+	}
+
+	timespec realtime;
+	timespec_get(&realtime, TIME_UTC);
+
+	LogSystem.start_monotonic = MonotonicNanosecs();
+	LogSystem.start_realtime  = (uint64_t)realtime.tv_sec * 1000000000ull + (uint64_t)realtime.tv_nsec;
+	LogSystem.stamp_secs      = -1;
+	LogSystem.next_id         = 0;
+
+	AtomicInc(&LogSystem.generation);
+	AtomicStore(&LogSystem.running, 1);
+
+	// The writer does not log through itself
+	LogSystem.writer = Thread_Create(LogWriterProc, nullptr, 0, ThreadContextDefaultParams);
+	if (!LogSystem.writer) {
+		AtomicStore(&LogSystem.running, 0);
+		AtomicInc(&LogSystem.generation);
+		MemoryFree(LogSystem.batch, LogSystem.batch_capacity, CachingAllocator());
+		Semaphore_Destory(LogSystem.wake);
+		LogSystem.batch = nullptr;
+		LogSystem.wake  = nullptr;
+		LogErrorEx("Log", "Failed to create the writer thread");
+		return false;
+	}
+
+	return true;
+}
+
+void AsyncLog_Stop() {
+	if (!AtomicLoad(&LogSystem.running)) return;
+
+	AtomicStore(&LogSystem.running, 0);
+	Semaphore_Signal(LogSystem.wake);
+	Thread_Wait(LogSystem.writer, -1);
+	Thread_Destroy(LogSystem.writer);
+	LogSystem.writer = nullptr;
+
+	AtomicInc(&LogSystem.generation);
+
+	LogReleaseRetired();
+	LogBatchFlush();
+
+	MemoryFree(LogSystem.batch, LogSystem.batch_capacity, CachingAllocator());
+	Semaphore_Destory(LogSystem.wake);
+	LogSystem.batch = nullptr;
+	LogSystem.wake  = nullptr;
+}
+
+void AsyncLog_Flush() {
+	if (!AtomicLoad(&LogSystem.running)) return;
+
+	int32_t requested = AtomicInc(&LogSystem.flush_requested);
+	AtomicStore(&LogSystem.sleeping, 0);
+	Semaphore_Signal(LogSystem.wake);
+
+	for (;;) {
+		int32_t flushed = AtomicLoadAcquire(&LogSystem.flushed);
+		if (flushed - requested >= 0 || !AtomicLoad(&LogSystem.running)) break;
+		AtomicWait(&LogSystem.flushed, flushed, (int)LogSystem.spec.flush_ms);
+	}
+}
+
+Logger AsyncLog_Logger() {
+	return { AsyncLogProc, nullptr };
+}
+
+void AsyncLog_GetStats(Async_Log_Stats *stats) {
+	stats->written   = AtomicLoadRelaxed(&LogSystem.written);
+	stats->bytes     = AtomicLoadRelaxed(&LogSystem.bytes);
+	stats->dropped   = AtomicLoad(&LogSystem.dropped);
+	stats->blocked   = AtomicLoad(&LogSystem.blocked);
+	stats->truncated = AtomicLoad(&LogSystem.truncated);
+	stats->threads   = 0;
+
+	SpinLock(&LogSystem.lock);
+	for (Log_Ring *ring = LogSystem.rings; ring; ring = ring->next) {
+		stats->dropped   += AtomicLoadRelaxed(&ring->dropped);
+		stats->blocked   += AtomicLoadRelaxed(&ring->blocked);
+		stats->truncated += AtomicLoadRelaxed(&ring->truncated);
+		stats->threads   += 1;
+	}
+	SpinUnlock(&LogSystem.lock);
+}
@@ -0,0 +1,60 @@
+#pragma once
+#include "KrCommon.h"
+
+//
+// Asynchronous logger. AsyncLogProc does not format anything: it copies the format pointer, the source
+// pointer, a timestamp and the arguments (strings by value) into a ring of the calling thread and returns.
+// A writer thread wakes up every few milliseconds (or once a ring is half full), merges what the rings hold
+// by timestamp, formats it and hands it to the sink in batches. Each line gets the wall clock time in
+// nanoseconds and the name of the thread that logged it, set with AsyncLog_SetThreadName or "T<n>" in the
+// order the threads first logged.
+//
+// The format and source strings are kept by pointer, they have to outlive the logger (string literals).
+// Strings that do not fit an entry (a quarter of the ring) are cut short. When a ring is full the entry is
+// dropped or the thread waits for the writer, as the spec says, and both are counted. Dropped entries are
+// reported in the log itself.
+//
+// Supports the conversions of printf except %ls, %lc and %S; the rest of a format after one of them is
+// written as it is. Without AsyncLog_Start (or after AsyncLog_Stop) AsyncLogProc writes to stderr directly.
+//
+
+typedef void(*Log_Sink_Proc)(void *context, const char *text, size_t length);
+
+enum Log_Overflow { LOG_OVERFLOW_DROP, LOG_OVERFLOW_BLOCK };
+
+struct Async_Log_Spec {
+	uint32_t      ring_size;  // bytes per thread, a power of 2
+	Log_Overflow  overflow;   // when the ring of a thread is full
+	uint32_t      flush_ms;   // longest an entry waits for the writer
+	uint32_t      batch_size; // bytes formatted before the sink is called
+	Log_Sink_Proc sink;
+	void *        context;    // of the sink
+};
+
+// Writes to the FILE * in context, stdout if null
+void AsyncLogFileSink(void *context, const char *text, size_t length);
+
+static constexpr Async_Log_Spec AsyncLogDefaultSpec = {
+	KiloBytes(256), LOG_OVERFLOW_DROP, 10, KiloBytes(64), AsyncLogFileSink, nullptr
+};
+
+struct Async_Log_Stats {
+	int64_t written;   // entries formatted by the writer
+	int64_t bytes;     // given to the sink
+	int64_t dropped;   // entries lost to a full ring
+	int64_t blocked;   // times a thread waited for space
+	int64_t truncated; // entries with a string cut short
+	int64_t threads;   // rings alive
+};
+
+bool   AsyncLog_Start(const Async_Log_Spec &spec = AsyncLogDefaultSpec);
+void   AsyncLog_Stop(); // writes out what is left, the rings of threads that are still running are kept until they exit
+void   AsyncLog_Flush(); // returns once everything logged before the call is given to the sink
+Logger AsyncLog_Logger();
+
+// Names the calling thread in the lines it logs, at most 31 characters
+void AsyncLog_SetThreadName(const char *fmt, ...);
+
+void AsyncLog_GetStats(Async_Log_Stats *stats);
+
+void AsyncLogProc(void *context, Log_Level level, const char *source, const char *fmt, va_list args);
@@ -0,0 +1,410 @@
+#include "KrProfile.h"
+#include "KrThread.h"
+#include "KrAllocator.h"
+#include "KrString.h"
+
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+
+//
+// The ring of a thread is single producer: only the owner writes records and moves head, nothing moves a
+// tail. The trace is written from a copy of each ring, taken under the lock of the list. Records that the
+// owner may have written over while they were copied are left out, those that are older than the head read
+// after the copy, less the size of the ring.
+//
+
+constexpr uint32_t ProfileNameLength      = 31;
+constexpr uint32_t ProfileMinRingSize     = 256;
+constexpr size_t   ProfileWriteBufferSize = KiloBytes(64);
+
+struct Profile_Track {
+	Profile_Ring     ring; // first, the thread only knows the ring
+	Profile_Track *  next;
+	void *           memory;
+	size_t           memory_size;
+	uint32_t         id;
+	int32_t volatile retired; // order in which the owner exited, 0 while it runs
+	char             name[ProfileNameLength + 1];
+};
+
+struct Profile_Thread_Exit {
+	char name[ProfileNameLength + 1];
+
+	~Profile_Thread_Exit();
+};
+
+struct Profile_System {
+	int32_t volatile running;
+	Profile_Spec     spec;
+
+	Atomic_Guard     lock; // of the list of tracks
+	Profile_Track *  tracks;
+	uint32_t         next_id;
+	int32_t          next_retired;
+	int32_t          retired;
+
+	uint64_t         start_ticks;
+	uint64_t         start_nanosecs;
+
+	int64_t          zones; // of the tracks that are gone
+	int64_t          overwritten;
+};
+
+static Profile_System                      ProfileSystem;
+static thread_local Profile_Thread_Exit    ProfileThreadExit;
+thread_local Profile_Thread                ProfileThread;
+int32_t volatile                           ProfileGeneration;
+
+//
+//
+//
+
+static void ProfileFreeTrack(Profile_Track *track) {
+	int64_t head                 = track->ring.head;
+	ProfileSystem.zones         += head;
+	ProfileSystem.overwritten   += Maximum(head - (track->ring.mask + 1), (int64_t)0);
+	MemoryFree(track->memory, track->memory_size, CachingAllocator());
+}
+
+// Call with the lock held
+static void ProfileReleaseRetired() {
+	while (ProfileSystem.retired > (int32_t)ProfileSystem.spec.max_retired) {
+		Profile_Track **oldest = nullptr;
+		for (Profile_Track **link = &ProfileSystem.tracks; *link; link = &(*link)->next) {
+			int32_t retired = AtomicLoadAcquire(&(*link)->retired);
+			if (retired && (!oldest || retired < (*oldest)->retired))
+				oldest = link;
+		}
+		if (!oldest) break;
+
+		Profile_Track *track = *oldest;
+		*oldest              = track->next;
+		ProfileSystem.retired -= 1;
+		ProfileFreeTrack(track);
+	}
+}
+
+Profile_Ring *Profile_ThreadRing() {
+	if (!AtomicLoadAcquire(&ProfileSystem.running))
+		return nullptr;
+
+	size_t ring_size   = ProfileSystem.spec.ring_size;
+	size_t memory_size = sizeof(Profile_Track) + alignof(Profile_Track) + ring_size * sizeof(Profile_Record);
+	void * memory      = MemoryAllocate(memory_size, CachingAllocator());
+	if (!memory) return nullptr;
+
+	Profile_Track *track = (Profile_Track *)AlignPower2Up((size_t)memory, alignof(Profile_Track));
+	memset(track, 0, sizeof(*track));
+
+	track->ring.records = (Profile_Record *)(track + 1);
+	track->ring.mask    = (int64_t)ring_size - 1;
+	track->memory       = memory;
+	track->memory_size  = memory_size;
+
+	Profile_Thread_Exit *exit = &ProfileThreadExit;
+
+	SpinLock(&ProfileSystem.lock);
+	// Profile_Stop may have run since the check above
+	if (!ProfileSystem.running) {
+		SpinUnlock(&ProfileSystem.lock);
+		MemoryFree(memory, memory_size, CachingAllocator());
+		return nullptr;
+	}
+
+	ProfileSystem.next_id += 1;
+	track->id = ProfileSystem.next_id;
+	if (exit->name[0])
+		memcpy(track->name, exit->name, sizeof(track->name));
+	else
+		snprintf(track->name, sizeof(track->name), "T%u", track->id);
+	track->next          = ProfileSystem.tracks;
+	ProfileSystem.tracks = track;
+
+	ProfileThread.ring       = &track->ring;
+	ProfileThread.generation = ProfileGeneration;
+	SpinUnlock(&ProfileSystem.lock);
+
+	return &track->ring;
+}
+
+Profile_Thread_Exit::~Profile_Thread_Exit() {
+	Profile_Thread *thread = &ProfileThread;
+	if (!thread->ring) return;
+
+	SpinLock(&ProfileSystem.lock);
+	if (thread->generation == ProfileGeneration && ProfileSystem.running) {
+		Profile_Track *track = (Profile_Track *)thread->ring;
+		ProfileSystem.next_retired += 1;
+		ProfileSystem.retired      += 1;
+		AtomicStoreRelease(&track->retired, ProfileSystem.next_retired);
+		ProfileReleaseRetired();
+	}
+	SpinUnlock(&ProfileSystem.lock);
+
+	thread->ring = nullptr;
+}
+
+void Profile_SetThreadName(const char *fmt, ...) {
+	Profile_Thread_Exit *exit = &ProfileThreadExit;
+
+	va_list args;
+	va_start(args, fmt);
+	vsnprintf(exit->name, sizeof(exit->name), fmt, args);
+	va_end(args);
+
+	// A track made from now on takes the name as it is
+	Profile_Thread *thread = &ProfileThread;
+	if (!thread->ring) return;
+
+	SpinLock(&ProfileSystem.lock);
+	if (thread->generation == ProfileGeneration)
+		memcpy(((Profile_Track *)thread->ring)->name, exit->name, sizeof(exit->name));
+	SpinUnlock(&ProfileSystem.lock);
+}
+
+//
+//
+//
+
+bool Profile_Start(const Profile_Spec &spec) {
+	if (AtomicLoad(&ProfileSystem.running)) {
+		LogErrorEx("Profile", "Profiler is already running");
+		return false;
+	}
+
+	Assert(IsPower2(spec.ring_size));
+
+	SpinLock(&ProfileSystem.lock);
+	ProfileSystem.spec           = spec;
+	ProfileSystem.spec.ring_size = Maximum(spec.ring_size, ProfileMinRingSize);
+	ProfileSystem.next_id        = 0;
+	ProfileSystem.next_retired   = 0;
+	ProfileSystem.retired        = 0;
+	ProfileSystem.zones          = 0;
+	ProfileSystem.overwritten    = 0;
+	ProfileSystem.start_nanosecs = MonotonicNanosecs();
+	ProfileSystem.start_ticks    = ProfileTicks();
+
+	AtomicInc(&ProfileGeneration);
+	AtomicStore(&ProfileSystem.running, 1);
+	SpinUnlock(&ProfileSystem.lock);
+
+	return true;
+}
+
+void Profile_Stop() {
+	if (!AtomicLoad(&ProfileSystem.running)) return;
+
+	SpinLock(&ProfileSystem.lock);
+	AtomicStore(&ProfileSystem.running, 0);
+	AtomicInc(&ProfileGeneration);
+
+	Profile_Track *tracks = ProfileSystem.tracks;
+	ProfileSystem.tracks  = nullptr;
+	ProfileSystem.retired = 0;
+
+	while (tracks) {
+		Profile_Track *track = tracks;
+		tracks               = track->next;
+		ProfileFreeTrack(track);
+	}
+	SpinUnlock(&ProfileSystem.lock);
+}
+
+void Profile_GetStats(Profile_Stats *stats) {
+	SpinLock(&ProfileSystem.lock);
+	stats->zones       = ProfileSystem.zones;
+	stats->overwritten = ProfileSystem.overwritten;
+	stats->threads     = 0;
+	stats->retired     = ProfileSystem.retired;
+
+	for (Profile_Track *track = ProfileSystem.tracks; track; track = track->next) {
+		int64_t head        = AtomicLoadAcquire(&track->ring.head);
+		stats->zones       += head;
+		stats->overwritten += Maximum(head - (track->ring.mask + 1), (int64_t)0);
+		stats->threads     += 1;
+	}
+	SpinUnlock(&ProfileSystem.lock);
+}
+
+//
+//
+//
+
+struct Profile_Writer {
+	FILE *    fp;
+	uint8_t * buffer;
+	ptrdiff_t length;
+};
+
+static void ProfileFlush(Profile_Writer *writer) {
+	fwrite(writer->buffer, 1, writer->length, writer->fp);
+	writer->length = 0;
+}
+
+// The longest piece written at once is an event without its name, the names go a byte at a time
+static uint8_t *ProfileReserve(Profile_Writer *writer, ptrdiff_t size) {
+	if (writer->length + size > (ptrdiff_t)ProfileWriteBufferSize)
+		ProfileFlush(writer);
+	return writer->buffer + writer->length;
+}
+
+// Text longer than the space left goes out in pieces
+static void ProfileWrite(Profile_Writer *writer, const char *text) {
+	ptrdiff_t length = strlen(text);
+	while (length) {
+		if (writer->length == (ptrdiff_t)ProfileWriteBufferSize)
+			ProfileFlush(writer);
+		ptrdiff_t count = Minimum(length, (ptrdiff_t)ProfileWriteBufferSize - writer->length);
+		memcpy(writer->buffer + writer->length, text, count);
+		writer->length += count;
+		text           += count;
+		length         -= count;
+	}
+}
+
+static void ProfileWriteU64(Profile_Writer *writer, uint64_t value) {
+	writer->length += FmtU64(ProfileReserve(writer, FMT_INT_SIZE), value);
+}
+
+// Microseconds with three decimals, what the trace viewers take for nanoseconds
+static void ProfileWriteMicrosecs(Profile_Writer *writer, uint64_t nanosecs) {
+	uint8_t *out = ProfileReserve(writer, FMT_INT_SIZE + 4);
+	int      len = FmtU64(out, nanosecs / 1000);
+	uint32_t rem = (uint32_t)(nanosecs % 1000);
+	out[len + 0] = '.';
+	out[len + 1] = (uint8_t)('0' + rem / 100);
+	out[len + 2] = (uint8_t)('0' + rem / 10 % 10);
+	out[len + 3] = (uint8_t)('0' + rem % 10);
+	writer->length += len + 4;
+}
+
+// Names are string literals of the code, only the characters JSON does not take as they are are escaped
+static void ProfileWriteJsonString(Profile_Writer *writer, const char *str) {
+	static const char Hex[] = "0123456789abcdef";
+
+	*ProfileReserve(writer, 1) = '"';
+	writer->length += 1;
+
+	for (; *str; ++str) {
+		uint8_t  c   = (uint8_t)*str;
+		uint8_t *out = ProfileReserve(writer, 6);
+		if (c == '"' || c == '\\') {
+			out[0] = '\\';
+			out[1] = c;
+			writer->length += 2;
+		} else if (c < 0x20) {
+			memcpy(out, "\\u00", 4);
+			out[4] = Hex[c >> 4];
+			out[5] = Hex[c & 15];
+			writer->length += 6;
+		} else {
+			out[0] = c;
+			writer->length += 1;
+		}
+	}
+
+	*ProfileReserve(writer, 1) = '"';
+	writer->length += 1;
+}
+
+// Copies the records of the track that are not being written over, returns how many
+static ptrdiff_t ProfileCopyTrack(Profile_Track *track, Profile_Record *records) {
+	int64_t capacity = track->ring.mask + 1;
+	int64_t head     = AtomicLoadAcquire(&track->ring.head);
+	int64_t first    = Maximum(head - capacity, (int64_t)0);
+
+	for (int64_t index = first; index < head; ++index)
+		records[index - first] = track->ring.records[index & track->ring.mask];
+
+	// The record at the head of the ring may be half written, it takes the slot of the oldest one. Nothing
+	// writes to the ring of a thread that exited.
+	AtomicFenceAcquire();
+	int64_t current = AtomicLoadRelaxed(&track->ring.head);
+	int64_t valid   = AtomicLoadRelaxed(&track->retired) ? first : Maximum(first, current - capacity + 1);
+	if (valid >= head) return 0;
+
+	memmove(records, records + (valid - first), (head - valid) * sizeof(Profile_Record));
+	return (ptrdiff_t)(head - valid);
+}
+
+bool Profile_WriteChromeTrace(const char *path) {
+	if (!AtomicLoad(&ProfileSystem.running)) {
+		LogErrorEx("Profile", "Profiler is not running");
+		return false;
+	}
+
+	size_t   records_size = ProfileSystem.spec.ring_size * sizeof(Profile_Record);
+	size_t   memory_size  = records_size + ProfileWriteBufferSize;
+	uint8_t *memory       = (uint8_t *)MemoryAllocate(memory_size, CachingAllocator());
+	if (!memory) {
+		LogErrorEx("Profile", "Failed to allocate %zu bytes for the trace", memory_size);
+		return false;
+	}
+
+	FILE *fp = fopen(path, "wb");
+	if (!fp) {
+		MemoryFree(memory, memory_size, CachingAllocator());
+		LogErrorEx("Profile", "Failed to open %s", path);
+		return false;
+	}
+
+	Profile_Record *records = (Profile_Record *)memory;
+	Profile_Writer  writer  = { fp, memory + records_size, 0 };
+
+	// Time stamp counter rate over the whole run, the longer it ran the closer it is
+	uint64_t ticks    = ProfileTicks() - ProfileSystem.start_ticks;
+	uint64_t nanosecs = MonotonicNanosecs() - ProfileSystem.start_nanosecs;
+	double   scale    = ticks ? (double)nanosecs / (double)ticks : 0.0;
+	uint64_t start    = ProfileSystem.start_ticks;
+
+	ProfileWrite(&writer, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n");
+	ProfileWrite(&writer, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"tid\":0,\"args\":{\"name\":\"Katachi\"}}");
+
+	int64_t written = 0;
+
+	SpinLock(&ProfileSystem.lock);
+	for (Profile_Track *track = ProfileSystem.tracks; track; track = track->next) {
+		ptrdiff_t count = ProfileCopyTrack(track, records);
+
+		ProfileWrite(&writer, ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":");
+		ProfileWriteU64(&writer, track->id);
+		ProfileWrite(&writer, ",\"args\":{\"name\":");
+		ProfileWriteJsonString(&writer, track->name);
+		ProfileWrite(&writer, "}}");
+
+		for (ptrdiff_t index = 0; index < count; ++index) {
+			const Profile_Record &record = records[index];
+
+			ProfileWrite(&writer, ",\n{\"name\":");
+			ProfileWriteJsonString(&writer, record.name);
+			ProfileWrite(&writer, ",\"ph\":\"X\",\"pid\":1,\"tid\":");
+			ProfileWriteU64(&writer, track->id);
+			ProfileWrite(&writer, ",\"ts\":");
+			ProfileWriteMicrosecs(&writer, (uint64_t)((double)(record.begin - start) * scale));
+			ProfileWrite(&writer, ",\"dur\":");
+			ProfileWriteMicrosecs(&writer, (uint64_t)((double)(record.end - record.begin) * scale));
+			ProfileWrite(&writer, "}");
+
+		}
+
+		written += count;
+	}
+	SpinUnlock(&ProfileSystem.lock);
+
+	ProfileWrite(&writer, "\n]}\n");
+	ProfileFlush(&writer);
+
+	bool failed = ferror(fp) != 0;
+	fclose(fp);
+	MemoryFree(memory, memory_size, CachingAllocator());
+
+	if (failed) {
+		LogErrorEx("Profile", "Failed to write %s", path);
+		return false;
+	}
+
+	LogInfoEx("Profile", "Wrote %lld zones to %s", (long long)written, path);
+	return true;
+}
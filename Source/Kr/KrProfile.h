@@ -0,0 +1,121 @@
+#pragma once
+#include "KrCommon.h"
+#include "KrAtomic.h"
+
+#if ARCH_X64 == 1 || ARCH_X86 == 1
+#if COMPILER_MSVC == 1
+#include <intrin.h>
+#else
+#include <x86intrin.h>
+#endif
+#endif
+
+//
+// Profiling zones, enabled by defining PROFILE_INSTRUMENTATION. ProfileZone("name") times the rest of the
+// scope it is in with the time stamp counter, and when the scope ends the name pointer with the two stamps
+// goes into a ring of the calling thread. That is all a zone costs, there is no lock and no read-modify-write.
+// A ring keeps the latest zones of its thread, the oldest are overwritten. Without PROFILE_INSTRUMENTATION
+// ProfileZone expands to nothing.
+//
+// Profile_WriteChromeTrace writes what the rings hold as trace event JSON that chrome://tracing and
+// ui.perfetto.dev open: a complete event per zone, one track per thread named with Profile_SetThreadName or
+// "T<n>" in the order the threads first recorded. The stamps are converted to time with the rate measured
+// between Profile_Start and the write.
+//
+// Names are kept by pointer, they have to outlive the profiler (string literals). Zones record nothing
+// before Profile_Start or after Profile_Stop, and Profile_Stop has to be called once the threads that record
+// are done. The rings of threads that exited are kept for the trace, the oldest are freed once there are
+// more than 'max_retired' of them.
+//
+
+struct Profile_Spec {
+	uint32_t ring_size;   // zones kept per thread, a power of 2
+	uint32_t max_retired; // rings of exited threads kept for the trace
+};
+
+static constexpr Profile_Spec ProfileDefaultSpec = { 1 << 16, 8 };
+
+struct Profile_Stats {
+	int64_t zones;       // recorded since Profile_Start
+	int64_t overwritten; // zones lost to a full ring
+	int64_t threads;     // rings alive, with the retired ones
+	int64_t retired;
+};
+
+bool Profile_Start(const Profile_Spec &spec = ProfileDefaultSpec);
+void Profile_Stop();
+
+// Names the track of the calling thread, at most 31 characters
+void Profile_SetThreadName(const char *fmt, ...);
+
+bool Profile_WriteChromeTrace(const char *path);
+
+void Profile_GetStats(Profile_Stats *stats);
+
+//
+//
+//
+
+struct Profile_Record {
+	const char *name;
+	uint64_t    begin;
+	uint64_t    end;
+};
+
+struct Profile_Ring {
+	alignas(64) int64_t volatile head; // written by the owner
+	Profile_Record *             records;
+	int64_t                      mask;
+};
+
+struct Profile_Thread {
+	Profile_Ring *ring;
+	int32_t       generation;
+};
+
+extern thread_local Profile_Thread ProfileThread;
+extern int32_t volatile            ProfileGeneration;
+
+// Makes the ring of the calling thread, null if the profiler is not running
+Profile_Ring *Profile_ThreadRing();
+
+INLINE_PROCEDURE uint64_t ProfileTicks() {
+#if ARCH_X64 == 1 || ARCH_X86 == 1
+	return __rdtsc();
+#else
+	return MonotonicNanosecs();
+#endif
+}
+
+// The ring of the calling thread, made on the first zone, null if the profiler is not running
+INLINE_PROCEDURE Profile_Ring *ProfileActiveRing() {
+	Profile_Ring *ring = ProfileThread.ring;
+	if (ring && ProfileThread.generation == AtomicLoadRelaxed(&ProfileGeneration))
+		return ring;
+	return Profile_ThreadRing();
+}
+
+INLINE_PROCEDURE void ProfileRecord(Profile_Ring *ring, const char *name, uint64_t begin, uint64_t end) {
+	int64_t         head   = ring->head;
+	Profile_Record *record = &ring->records[head & ring->mask];
+	record->name           = name;
+	record->begin          = begin;
+	record->end            = end;
+	AtomicStoreRelease(&ring->head, head + 1);
+}
+
+// The stamps are not read while the profiler is not running
+struct Profile_Zone {
+	Profile_Ring *ring;
+	const char *  name;
+	uint64_t      begin;
+
+	Profile_Zone(const char *name) : ring(ProfileActiveRing()), name(name), begin(ring ? ProfileTicks() : 0) {}
+	~Profile_Zone() { if (ring) ProfileRecord(ring, name, begin, ProfileTicks()); }
+};
+
+#if defined(PROFILE_INSTRUMENTATION)
+#define ProfileZone(name) Profile_Zone _zConcat(profile_zone__, __LINE__)(name)
+#else
+#define ProfileZone(name)
+#endif
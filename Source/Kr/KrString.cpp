@@ -0,0 +1,365 @@
+#include "KrString.h"
+#include "KrBasic.h"
+
+#include <charconv>
+
+//
+// Substring search compares the first and the last byte of the key against a whole block of the string at
+// once (16 bytes with SSE2, 32 with AVX2) and compares the rest of the key only where both match. Case is
+// folded for ASCII letters only, in registers, by setting bit 5 of the bytes in ['A', 'Z'].
+//
+
+static int MemCompareICaseScalar(const uint8_t *a, const uint8_t *b, ptrdiff_t count) {
+	for (ptrdiff_t index = 0; index < count; ++index) {
+		uint8_t x = ToLowerAscii(a[index]);
+		uint8_t y = ToLowerAscii(b[index]);
+		if (x != y) return x - y;
+	}
+	return 0;
+}
+
+static ptrdiff_t MemFindScalar(const uint8_t *haystack, ptrdiff_t length, const uint8_t *needle, ptrdiff_t needle_length, ptrdiff_t index) {
+	uint8_t first = needle[0];
+	uint8_t last  = needle[needle_length - 1];
+	for (; index + needle_length <= length; ++index) {
+		if (haystack[index] == first && haystack[index + needle_length - 1] == last &&
+			(needle_length <= 2 || memcmp(haystack + index + 1, needle + 1, needle_length - 2) == 0))
+			return index;
+	}
+	return -1;
+}
+
+static ptrdiff_t MemFindICaseScalar(const uint8_t *haystack, ptrdiff_t length, const uint8_t *needle, ptrdiff_t needle_length, ptrdiff_t index) {
+	uint8_t first = ToLowerAscii(needle[0]);
+	uint8_t last  = ToLowerAscii(needle[needle_length - 1]);
+	for (; index + needle_length <= length; ++index) {
+		if (ToLowerAscii(haystack[index]) == first && ToLowerAscii(haystack[index + needle_length - 1]) == last &&
+			(needle_length <= 2 || MemCompareICase(haystack + index + 1, needle + 1, needle_length - 2) == 0))
+			return index;
+	}
+	return -1;
+}
+
+#if ARCH_X64 == 1 || ARCH_X86 == 1
+#include <immintrin.h>
+
+#if COMPILER_MSVC == 1
+#include <intrin.h>
+#define MEM_TARGET_AVX2
+#else
+#define MEM_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+
+static bool MemDetectAvx2() {
+#if COMPILER_MSVC == 1
+	int info[4];
+	__cpuid(info, 0);
+	if (info[0] < 7) return false;
+	__cpuid(info, 1);
+	bool osxsave = (info[2] & (1 << 27)) != 0;
+	bool avx     = (info[2] & (1 << 28)) != 0;
+	if (!osxsave || !avx || (_xgetbv(0) & 6) != 6) return false; // the OS has to save the ymm registers
+	__cpuidex(info, 7, 0);
+	return (info[1] & (1 << 5)) != 0;
+#else
+	__builtin_cpu_init();
+	return __builtin_cpu_supports("avx2");
+#endif
+}
+
+static bool MemHasAvx2() {
+	static const bool avx2 = MemDetectAvx2();
+	return avx2;
+}
+
+// v - 'A' + 0x80 is below 0x80 + 26 as a signed byte for the upper case letters only
+INLINE_PROCEDURE __m128i MemLower128(__m128i v) {
+	__m128i shifted = _mm_add_epi8(v, _mm_set1_epi8((char)(0x80 - 'A')));
+	__m128i upper   = _mm_cmplt_epi8(shifted, _mm_set1_epi8((char)(0x80 + 26)));
+	return _mm_or_si128(v, _mm_and_si128(upper, _mm_set1_epi8(0x20)));
+}
+
+MEM_TARGET_AVX2 static inline __m256i MemLower256(__m256i v) {
+	__m256i shifted = _mm256_add_epi8(v, _mm256_set1_epi8((char)(0x80 - 'A')));
+	__m256i upper   = _mm256_cmpgt_epi8(_mm256_set1_epi8((char)(0x80 + 26)), shifted);
+	return _mm256_or_si256(v, _mm256_and_si256(upper, _mm256_set1_epi8(0x20)));
+}
+
+static ptrdiff_t MemFindSse2(const uint8_t *haystack, ptrdiff_t length, const uint8_t *needle, ptrdiff_t needle_length, ptrdiff_t index) {
+	__m128i first = _mm_set1_epi8((char)needle[0]);
+	__m128i last  = _mm_set1_epi8((char)needle[needle_length - 1]);
+
+	// The last block overlaps the one before it instead of leaving a tail to the scalar loop
+	for (ptrdiff_t end = length - needle_length + 1; index < end && end >= 16; index += 16) {
+		ptrdiff_t from = index;
+		index          = Minimum(index, end - 16);
+
+		__m128i  block_first = _mm_loadu_si128((const __m128i *)(haystack + index));
+		__m128i  block_last  = _mm_loadu_si128((const __m128i *)(haystack + index + needle_length - 1));
+		__m128i  matches     = _mm_and_si128(_mm_cmpeq_epi8(block_first, first), _mm_cmpeq_epi8(block_last, last));
+		uint32_t mask        = (uint32_t)_mm_movemask_epi8(matches) & (0xffffu << (from - index));
+		while (mask) {
+			ptrdiff_t at = index + CountTrailingZeros32(mask);
+			if (needle_length <= 2 || memcmp(haystack + at + 1, needle + 1, needle_length - 2) == 0)
+				return at;
+			mask &= mask - 1;
+		}
+	}
+
+	return MemFindScalar(haystack, length, needle, needle_length, index);
+}
+
+MEM_TARGET_AVX2 static ptrdiff_t MemFindAvx2(const uint8_t *haystack, ptrdiff_t length, const uint8_t *needle, ptrdiff_t needle_length) {
+	__m256i   first = _mm256_set1_epi8((char)needle[0]);
+	__m256i   last  = _mm256_set1_epi8((char)needle[needle_length - 1]);
+	ptrdiff_t index = 0;
+
+	for (; index + needle_length - 1 + 32 <= length; index += 32) {
+		__m256i  block_first = _mm256_loadu_si256((const __m256i *)(haystack + index));
+		__m256i  block_last  = _mm256_loadu_si256((const __m256i *)(haystack + index + needle_length - 1));
+		__m256i  matches     = _mm256_and_si256(_mm256_cmpeq_epi8(block_first, first), _mm256_cmpeq_epi8(block_last, last));
+		uint32_t mask        = (uint32_t)_mm256_movemask_epi8(matches);
+		while (mask) {
+			ptrdiff_t at = index + CountTrailingZeros32(mask);
+			if (needle_length <= 2 || memcmp(haystack + at + 1, needle + 1, needle_length - 2) == 0)
+				return at;
+			mask &= mask - 1;
+		}
+	}
+
+	// The compiler may turn the call into a jump without clearing the upper halves, and the legacy SSE code
+	// after it would then pay for the transition on every instruction
+	_mm256_zeroupper();
+	return MemFindSse2(haystack, length, needle, needle_length, index);
+}
+
+static ptrdiff_t MemFindICaseSse2(const uint8_t *haystack, ptrdiff_t length, const uint8_t *needle, ptrdiff_t needle_length, ptrdiff_t index) {
+	__m128i first = _mm_set1_epi8((char)ToLowerAscii(needle[0]));
+	__m128i last  = _mm_set1_epi8((char)ToLowerAscii(needle[needle_length - 1]));
+
+	for (ptrdiff_t end = length - needle_length + 1; index < end && end >= 16; index += 16) {
+		ptrdiff_t from = index;
+		index          = Minimum(index, end - 16);
+
+		__m128i  block_first = MemLower128(_mm_loadu_si128((const __m128i *)(haystack + index)));
+		__m128i  block_last  = MemLower128(_mm_loadu_si128((const __m128i *)(haystack + index + needle_length - 1)));
+		__m128i  matches     = _mm_and_si128(_mm_cmpeq_epi8(block_first, first), _mm_cmpeq_epi8(block_last, last));
+		uint32_t mask        = (uint32_t)_mm_movemask_epi8(matches) & (0xffffu << (from - index));
+		while (mask) {
+			ptrdiff_t at = index + CountTrailingZeros32(mask);
+			if (needle_length <= 2 || MemCompareICase(haystack + at + 1, needle + 1, needle_length - 2) == 0)
+				return at;
+			mask &= mask - 1;
+		}
+	}
+
+	return MemFindICaseScalar(haystack, length, needle, needle_length, index);
+}
+
+MEM_TARGET_AVX2 static ptrdiff_t MemFindICaseAvx2(const uint8_t *haystack, ptrdiff_t length, const uint8_t *needle, ptrdiff_t needle_length) {
+	__m256i   first = _mm256_set1_epi8((char)ToLowerAscii(needle[0]));
+	__m256i   last  = _mm256_set1_epi8((char)ToLowerAscii(needle[needle_length - 1]));
+	ptrdiff_t index = 0;
+
+	for (; index + needle_length - 1 + 32 <= length; index += 32) {
+		__m256i  block_first = MemLower256(_mm256_loadu_si256((const __m256i *)(haystack + index)));
+		__m256i  block_last  = MemLower256(_mm256_loadu_si256((const __m256i *)(haystack + index + needle_length - 1)));
+		__m256i  matches     = _mm256_and_si256(_mm256_cmpeq_epi8(block_first, first), _mm256_cmpeq_epi8(block_last, last));
+		uint32_t mask        = (uint32_t)_mm256_movemask_epi8(matches);
+		while (mask) {
+			ptrdiff_t at = index + CountTrailingZeros32(mask);
+			if (needle_length <= 2 || MemCompareICase(haystack + at + 1, needle + 1, needle_length - 2) == 0)
+				return at;
+			mask &= mask - 1;
+		}
+	}
+
+	_mm256_zeroupper();
+	return MemFindICaseSse2(haystack, length, needle, needle_length, index);
+}
+
+int MemCompareICase(const uint8_t *a, const uint8_t *b, ptrdiff_t count) {
+	ptrdiff_t index = 0;
+	for (; index + 16 <= count; index += 16) {
+		__m128i  x    = MemLower128(_mm_loadu_si128((const __m128i *)(a + index)));
+		__m128i  y    = MemLower128(_mm_loadu_si128((const __m128i *)(b + index)));
+		uint32_t mask = (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(x, y)) ^ 0xffff;
+		if (mask) {
+			ptrdiff_t at = index + CountTrailingZeros32(mask);
+			return ToLowerAscii(a[at]) - ToLowerAscii(b[at]);
+		}
+	}
+	return MemCompareICaseScalar(a + index, b + index, count - index);
+}
+
+ptrdiff_t MemFind(const uint8_t *haystack, ptrdiff_t length, const uint8_t *needle, ptrdiff_t needle_length) {
+	if (needle_length == 0) return 0;
+	if (needle_length > length) return -1;
+	if (needle_length == 1) {
+		const uint8_t *found = (const uint8_t *)memchr(haystack, needle[0], length);
+		return found ? found - haystack : -1;
+	}
+	if (length >= needle_length - 1 + 32 && MemHasAvx2())
+		return MemFindAvx2(haystack, length, needle, needle_length);
+	return MemFindSse2(haystack, length, needle, needle_length, 0);
+}
+
+ptrdiff_t MemFindICase(const uint8_t *haystack, ptrdiff_t length, const uint8_t *needle, ptrdiff_t needle_length) {
+	if (needle_length == 0) return 0;
+	if (needle_length > length) return -1;
+	if (length >= needle_length - 1 + 32 && MemHasAvx2())
+		return MemFindICaseAvx2(haystack, length, needle, needle_length);
+	return MemFindICaseSse2(haystack, length, needle, needle_length, 0);
+}
+
+#else
+
+int MemCompareICase(const uint8_t *a, const uint8_t *b, ptrdiff_t count) {
+	return MemCompareICaseScalar(a, b, count);
+}
+
+ptrdiff_t MemFind(const uint8_t *haystack, ptrdiff_t length, const uint8_t *needle, ptrdiff_t needle_length) {
+	if (needle_length == 0) return 0;
+	if (needle_length > length) return -1;
+	if (needle_length == 1) {
+		const uint8_t *found = (const uint8_t *)memchr(haystack, needle[0], length);
+		return found ? found - haystack : -1;
+	}
+	return MemFindScalar(haystack, length, needle, needle_length, 0);
+}
+
+ptrdiff_t MemFindICase(const uint8_t *haystack, ptrdiff_t length, const uint8_t *needle, ptrdiff_t needle_length) {
+	if (needle_length == 0) return 0;
+	if (needle_length > length) return -1;
+	return MemFindICaseScalar(haystack, length, needle, needle_length, 0);
+}
+
+#endif
+
+//
+// Decimal integers are written two digits at a time from the end, after counting the digits. Floats go
+// through std::to_chars, which is Ryu in both the MSVC and GNU libraries: the shortest text that reads
+// back as the same value, in fixed or exponent form, whichever is shorter.
+//
+
+static const char FmtDigitPairs[] =
+	"00010203040506070809101112131415161718192021222324252627282930313233343536373839"
+	"40414243444546474849505152535455565758596061626364656667686970717273747576777879"
+	"8081828384858687888990919293949596979899";
+
+static int FmtCountDigits(uint64_t value) {
+	int count = 1;
+	for (;;) {
+		if (value < 10) return count;
+		if (value < 100) return count + 1;
+		if (value < 1000) return count + 2;
+		if (value < 10000) return count + 3;
+		value /= 10000;
+		count += 4;
+	}
+}
+
+// Writes value (below 10^8) backwards from end, two digits at a time
+static uint8_t *FmtWriteDigits32(uint8_t *end, uint32_t value) {
+	while (value >= 100) {
+		uint32_t pair = value % 100;
+		value /= 100;
+		end -= 2;
+		memcpy(end, FmtDigitPairs + pair * 2, 2);
+	}
+	if (value >= 10) {
+		end -= 2;
+		memcpy(end, FmtDigitPairs + value * 2, 2);
+	} else {
+		*--end = (uint8_t)('0' + value);
+	}
+	return end;
+}
+
+int FmtU64(uint8_t *out, uint64_t value) {
+	int      length = FmtCountDigits(value);
+	uint8_t *end    = out + length;
+
+	// 64-bit divisions only once per 8 digits
+	while (value >= 100000000) {
+		uint32_t chunk = (uint32_t)(value % 100000000);
+		value /= 100000000;
+		for (int index = 0; index < 4; ++index) {
+			end -= 2;
+			memcpy(end, FmtDigitPairs + (chunk % 100) * 2, 2);
+			chunk /= 100;
+		}
+	}
+	FmtWriteDigits32(end, (uint32_t)value);
+
+	return length;
+}
+
+int FmtI64(uint8_t *out, int64_t value) {
+	if (value >= 0)
+		return FmtU64(out, (uint64_t)value);
+	out[0] = '-';
+	return 1 + FmtU64(out + 1, 0 - (uint64_t)value);
+}
+
+int FmtF32(uint8_t *out, float value) {
+	std::to_chars_result result = std::to_chars((char *)out, (char *)out + FMT_FLOAT_SIZE, value);
+	return result.ec == std::errc() ? (int)(result.ptr - (char *)out) : 0;
+}
+
+int FmtF64(uint8_t *out, double value) {
+	std::to_chars_result result = std::to_chars((char *)out, (char *)out + FMT_FLOAT_SIZE, value);
+	return result.ec == std::errc() ? (int)(result.ptr - (char *)out) : 0;
+}
+
+static uint8_t *FmtWriteArg(uint8_t *out, const Fmt_Arg &arg) {
+	switch (arg.kind) {
+		case FMT_ARG_INT:    return out + FmtI64(out, arg.integer);
+		case FMT_ARG_UINT:   return out + FmtU64(out, arg.uinteger);
+		case FMT_ARG_F32:    return out + FmtF32(out, arg.real32);
+		case FMT_ARG_F64:    return out + FmtF64(out, arg.real);
+		case FMT_ARG_CHAR:   *out = (uint8_t)arg.uinteger; return out + 1;
+		case FMT_ARG_BOOL: {
+			if (arg.uinteger) { memcpy(out, "true", 4); return out + 4; }
+			memcpy(out, "false", 5);
+			return out + 5;
+		}
+		case FMT_ARG_STRING: {
+			if (arg.length) memcpy(out, arg.data, arg.length);
+			return out + arg.length;
+		}
+	}
+	return out;
+}
+
+ptrdiff_t FmtWrite(uint8_t *out, const char *fmt, ptrdiff_t fmt_length, const Fmt_Arg *args, ptrdiff_t count) {
+	uint8_t *   dst   = out;
+	const char *end   = fmt + fmt_length;
+	ptrdiff_t   index = 0;
+
+	while (fmt < end) {
+		const char *brace = fmt;
+		while (brace < end && *brace != '{' && *brace != '}')
+			brace += 1;
+
+		memcpy(dst, fmt, brace - fmt);
+		dst += brace - fmt;
+		if (brace == end) break;
+
+		char next = brace + 1 < end ? brace[1] : 0;
+		if (next == brace[0]) { // "{{" or "}}"
+			*dst++ = (uint8_t)next;
+			fmt    = brace + 2;
+		} else if (brace[0] == '{' && next == '}' && index < count) {
+			dst = FmtWriteArg(dst, args[index++]);
+			fmt = brace + 2;
+		} else {
+			Assert(brace[0] != '{' || next != '}'); // more "{}" than arguments
+			*dst++ = (uint8_t)brace[0];
+			fmt    = brace + 1;
+		}
+	}
+
+	Assert(index == count); // more arguments than "{}"
+	return dst - out;
+}
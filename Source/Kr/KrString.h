@@ -41,12 +41,116 @@ INLINE_PROCEDURE String FmtStr(Memory_Allocator allocator, const char *fmt, ...)
 	return string;
 }
 
+//
+// Fmt writes fmt into the arena with each "{}" replaced by the next argument ("{{" and "}}" for the braces
+// themselves) in one pass: the arguments bound their length first, a constant for everything but strings, that
+// much is pushed and what is left over popped. Integers are written in decimal, floats in the shortest form
+// that reads back as the same value, bools as true or false, chars as themselves. Arguments of other types
+// do not compile. The text is followed by a null byte the length does not count, like with FmtStr.
+//
+
+static constexpr int FMT_INT_SIZE   = 20; // "-9223372036854775808", "18446744073709551615"
+static constexpr int FMT_FLOAT_SIZE = 32;
+
+// Write to out (FMT_INT_SIZE or FMT_FLOAT_SIZE bytes) and return the length
+int FmtU64(uint8_t *out, uint64_t value);
+int FmtI64(uint8_t *out, int64_t value);
+int FmtF32(uint8_t *out, float value);
+int FmtF64(uint8_t *out, double value);
+
+enum Fmt_Arg_Kind : uint8_t {
+	FMT_ARG_INT,
+	FMT_ARG_UINT,
+	FMT_ARG_F32,
+	FMT_ARG_F64,
+	FMT_ARG_CHAR,
+	FMT_ARG_BOOL,
+	FMT_ARG_STRING,
+};
+
+struct Fmt_Arg {
+	Fmt_Arg_Kind kind;
+	ptrdiff_t    length; // of strings
+	union {
+		int64_t        integer;
+		uint64_t       uinteger;
+		float          real32;
+		double         real;
+		const uint8_t *data;
+	};
+
+	Fmt_Arg(char v)               : kind(FMT_ARG_CHAR), length(0), uinteger((uint8_t)v) {}
+	Fmt_Arg(bool v)               : kind(FMT_ARG_BOOL), length(0), uinteger(v) {}
+	Fmt_Arg(signed char v)        : kind(FMT_ARG_INT), length(0), integer(v) {}
+	Fmt_Arg(short v)              : kind(FMT_ARG_INT), length(0), integer(v) {}
+	Fmt_Arg(int v)                : kind(FMT_ARG_INT), length(0), integer(v) {}
+	Fmt_Arg(long v)               : kind(FMT_ARG_INT), length(0), integer(v) {}
+	Fmt_Arg(long long v)          : kind(FMT_ARG_INT), length(0), integer(v) {}
+	Fmt_Arg(unsigned char v)      : kind(FMT_ARG_UINT), length(0), uinteger(v) {}
+	Fmt_Arg(unsigned short v)     : kind(FMT_ARG_UINT), length(0), uinteger(v) {}
+	Fmt_Arg(unsigned int v)       : kind(FMT_ARG_UINT), length(0), uinteger(v) {}
+	Fmt_Arg(unsigned long v)      : kind(FMT_ARG_UINT), length(0), uinteger(v) {}
+	Fmt_Arg(unsigned long long v) : kind(FMT_ARG_UINT), length(0), uinteger(v) {}
+	Fmt_Arg(float v)              : kind(FMT_ARG_F32), length(0), real32(v) {}
+	Fmt_Arg(double v)             : kind(FMT_ARG_F64), length(0), real(v) {}
+	Fmt_Arg(String v)             : kind(FMT_ARG_STRING), length(v.length), data(v.data) {}
+	Fmt_Arg(const char *v)        : kind(FMT_ARG_STRING), length(v ? strlen(v) : 0), data((const uint8_t *)v) {}
+
+	template <typename T> Fmt_Arg(const T *) = delete; // would be a bool otherwise
+};
+
+INLINE_PROCEDURE ptrdiff_t FmtArgSize(const Fmt_Arg &arg) {
+	switch (arg.kind) {
+		case FMT_ARG_INT:
+		case FMT_ARG_UINT:   return FMT_INT_SIZE;
+		case FMT_ARG_F32:
+		case FMT_ARG_F64:    return FMT_FLOAT_SIZE;
+		case FMT_ARG_CHAR:   return 1;
+		case FMT_ARG_BOOL:   return 5;
+		case FMT_ARG_STRING: return arg.length;
+	}
+	return 0;
+}
+
+// Writes at most fmt_length + the sizes of the arguments bytes, returns the length written
+ptrdiff_t FmtWrite(uint8_t *out, const char *fmt, ptrdiff_t fmt_length, const Fmt_Arg *args, ptrdiff_t count);
+
+template <ptrdiff_t _Length, typename... Args>
+String Fmt(Memory_Arena *arena, const char (&fmt)[_Length], const Args &...args) {
+	const Fmt_Arg list[] = { Fmt_Arg(args)..., Fmt_Arg(0) };
+	ptrdiff_t     size   = _Length; // with the null byte
+	for (ptrdiff_t index = 0; index < (ptrdiff_t)sizeof...(Args); ++index)
+		size += FmtArgSize(list[index]);
+
+	uint8_t *buf = (uint8_t *)PushSize(arena, size);
+	if (!buf) return String();
+
+	ptrdiff_t len = FmtWrite(buf, fmt, _Length - 1, list, sizeof...(Args));
+	buf[len]      = 0;
+	PopSize(arena, size - len - 1);
+	return String(buf, len);
+}
+
+//
+// Searches and case insensitive compares of bytes, vectorized in Kr/KrString.cpp (SSE2, and AVX2 where the
+// processor has it). Only ASCII letters are folded. MemFind and MemFindICase return the offset of the first
+// match or -1, an empty needle matches at 0.
+//
+
+ptrdiff_t MemFind(const uint8_t *haystack, ptrdiff_t length, const uint8_t *needle, ptrdiff_t needle_length);
+ptrdiff_t MemFindICase(const uint8_t *haystack, ptrdiff_t length, const uint8_t *needle, ptrdiff_t needle_length);
+int       MemCompareICase(const uint8_t *a, const uint8_t *b, ptrdiff_t count);
+
+INLINE_PROCEDURE uint8_t ToLowerAscii(uint8_t c) {
+	return (uint8_t)(c - 'A') < 26 ? (uint8_t)(c | 0x20) : c;
+}
+
 INLINE_PROCEDURE bool StrIsEmpty(String str) {
 	return str.length == 0;
 }
 
 INLINE_PROCEDURE bool IsSpace(uint32_t ch) {
-	return ch == ' ' || ch == '\f' || ch == '\n' || ch == '\r' || ch == '\t' || ch == '\v';
+	return ch == ' ' || ch - '\t' <= '\r' - '\t'; // \t \n \v \f \r
 }
 
 INLINE_PROCEDURE String StrTrim(String str) {
@@ -138,12 +242,7 @@ INLINE_PROCEDURE int StrCompare(String a, String b) {
 
 INLINE_PROCEDURE int StrCompareICase(String a, String b) {
 	ptrdiff_t count = (ptrdiff_t)Minimum(a.length, b.length);
-	for (ptrdiff_t index = 0; index < count; ++index) {
-		if (a.data[index] != b.data[index] && a.data[index] + 32 != b.data[index] && a.data[index] != b.data[index] + 32) {
-			return a.data[index] - b.data[index];
-		}
-	}
-	return 0;
+	return MemCompareICase(a.data, b.data, count);
 }
 
 INLINE_PROCEDURE bool StrMatch(String a, String b) {
@@ -175,7 +274,7 @@ INLINE_PROCEDURE bool StrStartsWithChar(String str, uint8_t c) {
 }
 
 INLINE_PROCEDURE bool StrStartsWithCharICase(String str, uint8_t c) {
-	return str.length && (str.data[0] == c || str.data[0] + 32 == c || str.data[0] == c + 32);
+	return str.length && ToLowerAscii(str.data[0]) == ToLowerAscii(c);
 }
 
 INLINE_PROCEDURE bool StrEndsWith(String str, String sub) {
@@ -195,8 +294,7 @@ INLINE_PROCEDURE bool StrEndsWithChar(String str, uint8_t c) {
 }
 
 INLINE_PROCEDURE bool StrEndsWithCharICase(String str, uint8_t c) {
-	return str.length &&
-		(str.data[str.length - 1] == c || str.data[str.length - 1] + 32 == c || str.data[str.length - 1] == c + 32);
+	return str.length && ToLowerAscii(str.data[str.length - 1]) == ToLowerAscii(c);
 }
 
 INLINE_PROCEDURE char *StrNullTerminated(char *buffer, String str) {
@@ -210,37 +308,23 @@ INLINE_PROCEDURE char *StrNullTerminatedArena(Memory_Arena *arena, String str) {
 }
 
 INLINE_PROCEDURE ptrdiff_t StrFind(String str, const String key, ptrdiff_t pos = 0) {
-	str = SubStr(str, pos);
-	while (str.length >= key.length) {
-		if (StrCompare(String(str.data, key.length), key) == 0) {
-			return pos;
-		}
-		pos += 1;
-		str = StrRemovePrefix(str, 1);
-	}
-	return -1;
+	Assert(pos <= str.length);
+	ptrdiff_t index = MemFind(str.data + pos, str.length - pos, key.data, key.length);
+	return index >= 0 ? pos + index : -1;
 }
 
 INLINE_PROCEDURE ptrdiff_t StrFindICase(String str, const String key, ptrdiff_t pos = 0) {
-	str = SubStr(str, pos);
-	while (str.length >= key.length) {
-		if (StrCompareICase(String(str.data, key.length), key) == 0) {
-			return pos;
-		}
-		pos += 1;
-		str = StrRemovePrefix(str, 1);
-	}
-	return -1;
+	Assert(pos <= str.length);
+	ptrdiff_t index = MemFindICase(str.data + pos, str.length - pos, key.data, key.length);
+	return index >= 0 ? pos + index : -1;
 }
 
 INLINE_PROCEDURE ptrdiff_t StrFindChar(String str, uint8_t key, ptrdiff_t pos = 0) {
 	ptrdiff_t index = Clamp(0, str.length - 1, pos);
-	if (index >= 0) {
-		for (; index < str.length; ++index)
-			if (str.data[index] == key)
-				return index;
-	}
-	return -1;
+	if (index < 0)
+		return -1;
+	const uint8_t *found = (const uint8_t *)memchr(str.data + index, key, str.length - index);
+	return found ? found - str.data : -1;
 }
 
 INLINE_PROCEDURE ptrdiff_t StrReverseFind(String str, String key, ptrdiff_t pos) {
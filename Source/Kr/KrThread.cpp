@@ -84,4 +84,195 @@ void Thread_Destroy(Thread *thread) {
 	MemoryFree(thread, sizeof(*thread));
 }
 
+uint32_t Thread_ProcessorCount() {
+	DWORD count = GetActiveProcessorCount(ALL_PROCESSOR_GROUPS);
+	return count ? (uint32_t)count : 1;
+}
+
+#endif
+
+#if PLATFORM_LINUX == 1 || PLATFORM_MAC == 1
+#include <pthread.h>
+#include <sched.h>
+#include <time.h>
+#include <errno.h>
+#include <unistd.h>
+
+static void Thread_AbsoluteTimeout(timespec *ts, int millisecs) {
+	clock_gettime(CLOCK_REALTIME, ts);
+	ts->tv_sec  += millisecs / 1000;
+	ts->tv_nsec += (long)(millisecs % 1000) * 1000000;
+	if (ts->tv_nsec >= 1000000000) {
+		ts->tv_sec  += 1;
+		ts->tv_nsec -= 1000000000;
+	}
+}
+
+struct Semaphore {
+	pthread_mutex_t mutex;
+	pthread_cond_t  cond;
+	int             value;
+};
+
+Semaphore *Semaphore_Create(int value) {
+	Semaphore *sem = new Semaphore;
+	if (sem) {
+		pthread_mutex_init(&sem->mutex, nullptr);
+		pthread_cond_init(&sem->cond, nullptr);
+		sem->value = value;
+	}
+	return sem;
+}
+
+void Semaphore_Destory(Semaphore *sem) {
+	pthread_cond_destroy(&sem->cond);
+	pthread_mutex_destroy(&sem->mutex);
+	MemoryFree(sem, sizeof(*sem));
+}
+
+int Semaphore_Wait(Semaphore *sem, int millisecs) {
+	timespec ts;
+	if (millisecs >= 0)
+		Thread_AbsoluteTimeout(&ts, millisecs);
+
+	pthread_mutex_lock(&sem->mutex);
+
+	int error = 0;
+	while (sem->value == 0 && error == 0) {
+		if (millisecs >= 0)
+			error = pthread_cond_timedwait(&sem->cond, &sem->mutex, &ts);
+		else
+			error = pthread_cond_wait(&sem->cond, &sem->mutex);
+	}
+
+	int result;
+	if (sem->value) {
+		sem->value -= 1;
+		result = 1;
+	} else {
+		result = (error == ETIMEDOUT) ? 0 : -1;
+	}
+
+	pthread_mutex_unlock(&sem->mutex);
+	return result;
+}
+
+bool Semaphore_Signal(Semaphore *sem) {
+	pthread_mutex_lock(&sem->mutex);
+	sem->value += 1;
+	pthread_mutex_unlock(&sem->mutex);
+	return pthread_cond_signal(&sem->cond) == 0;
+}
+
+//
+//
+//
+
+struct Thread {
+	pthread_t             handle;
+	pthread_mutex_t       mutex;
+	pthread_cond_t        cond;
+	bool                  finished;
+	Thread_Proc           proc;
+	void *                arg;
+	uint32_t              scratchpad_size;
+	Thread_Context_Params params;
+};
+
+static thread_local Thread *CurrentThread;
+
+static void Thread_Finish(Thread *thrd) {
+	pthread_mutex_lock(&thrd->mutex);
+	thrd->finished = true;
+	pthread_mutex_unlock(&thrd->mutex);
+	pthread_cond_broadcast(&thrd->cond);
+}
+
+static void *Thread_PosixThreadProc(void *arg) {
+	Thread *thrd  = (Thread *)arg;
+	CurrentThread = thrd;
+	InitThreadContext(thrd->scratchpad_size, thrd->params);
+	int result = thrd->proc(thrd->arg);
+	Thread_Finish(thrd);
+	return (void *)(intptr_t)result;
+}
+
+Thread *Thread_Create(Thread_Proc proc, void *arg, uint32_t scratchpad_size, const Thread_Context_Params &params) {
+	Thread *thrd = new Thread;
+	if (thrd) {
+		pthread_mutex_init(&thrd->mutex, nullptr);
+		pthread_cond_init(&thrd->cond, nullptr);
+		thrd->finished        = false;
+		thrd->proc            = proc;
+		thrd->arg             = arg;
+		thrd->scratchpad_size = scratchpad_size;
+		thrd->params          = params;
+		if (pthread_create(&thrd->handle, nullptr, Thread_PosixThreadProc, thrd) != 0) {
+			pthread_cond_destroy(&thrd->cond);
+			pthread_mutex_destroy(&thrd->mutex);
+			MemoryFree(thrd, sizeof(*thrd));
+			return nullptr;
+		}
+	}
+	return thrd;
+}
+
+int Thread_Wait(Thread *thread, int millisecs) {
+	timespec ts;
+	if (millisecs >= 0)
+		Thread_AbsoluteTimeout(&ts, millisecs);
+
+	pthread_mutex_lock(&thread->mutex);
+
+	int error = 0;
+	while (!thread->finished && error == 0) {
+		if (millisecs >= 0)
+			error = pthread_cond_timedwait(&thread->cond, &thread->mutex, &ts);
+		else
+			error = pthread_cond_wait(&thread->cond, &thread->mutex);
+	}
+
+	int result = thread->finished ? 1 : (error == ETIMEDOUT ? 0 : -1);
+	pthread_mutex_unlock(&thread->mutex);
+	return result;
+}
+
+void Thread_Terminate(Thread *thread, int code) {
+	pthread_cancel(thread->handle);
+	Thread_Finish(thread);
+}
+
+void Thread_Yield() {
+	sched_yield();
+}
+
+void Thread_Sleep(int millisecs) {
+	timespec ts;
+	ts.tv_sec  = millisecs / 1000;
+	ts.tv_nsec = (long)(millisecs % 1000) * 1000000;
+	while (nanosleep(&ts, &ts) == -1 && errno == EINTR)
+		;
+}
+
+void Thread_Exit(int code) {
+	if (CurrentThread)
+		Thread_Finish(CurrentThread);
+	pthread_exit((void *)(intptr_t)code);
+}
+
+void Thread_Destroy(Thread *thread) {
+	if (Thread_Wait(thread, 0) == 1)
+		pthread_join(thread->handle, nullptr);
+	else
+		pthread_detach(thread->handle);
+	pthread_cond_destroy(&thread->cond);
+	pthread_mutex_destroy(&thread->mutex);
+	MemoryFree(thread, sizeof(*thread));
+}
+
+uint32_t Thread_ProcessorCount() {
+	long count = sysconf(_SC_NPROCESSORS_ONLN);
+	return count > 0 ? (uint32_t)count : 1;
+}
+
 #endif
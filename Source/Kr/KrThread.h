@@ -23,3 +23,6 @@ void    Thread_Yield();
 void    Thread_Sleep(int millisecs);
 void    Thread_Exit(int code);
 void    Thread_Destroy(Thread *thread);
+
+// Logical processors available to the process, at least 1
+uint32_t Thread_ProcessorCount();
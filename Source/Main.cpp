@@ -1,5 +1,7 @@
 ﻿#include "Discord.h"
 #include "Kr/KrString.h"
+#include "Kr/KrLog.h"
+#include "Kr/KrProfile.h"
 #include "Base64.h"
 
 #include <stdio.h>
@@ -9,13 +11,6 @@
 //
 
 
-void LogProcedure(void *context, Log_Level level, const char *source, const char *fmt, va_list args) {
-	FILE *fp = level == LOG_LEVEL_INFO ? stdout : stderr;
-	fprintf(fp, "[%s] ", source);
-	vfprintf(fp, fmt, args);
-	fprintf(fp, "\n");
-}
-
 static volatile bool Logout = false;
 static String        ImageFile = "";
 
@@ -221,7 +216,21 @@ static String ReadEntireFile(const char *filename) {
 
 int main(int argc, char **argv) {
 	InitThreadContext(0);
-	ThreadContextSetLogger({ LogProcedure, nullptr });
+
+	// Without the writer thread the logger writes on the calling thread, so it is installed either way
+	AsyncLog_Start();
+	ThreadContextSetLogger(AsyncLog_Logger());
+	AsyncLog_SetThreadName("Main");
+	Defer{ AsyncLog_Stop(); };
+
+#if defined(PROFILE_INSTRUMENTATION)
+	Profile_Start();
+	Profile_SetThreadName("Main");
+	Defer{
+		Profile_WriteChromeTrace("Katachi.trace.json");
+		Profile_Stop();
+	};
+#endif
 
 	if (argc != 2) {
 		fprintf(stderr, "USAGE: %s token\n\n", argv[0]);
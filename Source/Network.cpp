@@ -12,6 +12,7 @@
 #ifdef NETWORK_OPENSSL_ENABLE
 #include <openssl/ssl.h>
 #include <openssl/err.h>
+#include <openssl/pem.h>
 #if PLATFORM_WINDOWS
 #pragma comment(lib, "Crypt32.lib")
 #pragma comment(lib, "Winmm.lib")
@@ -37,6 +38,9 @@ struct Net_Socket {
 #endif
 	SOCKET           descriptor;
 	Net_Error        error;
+	uint64_t         deadline;
+	bool             connecting;  // started by Net_StartConnection
+	bool             handshaking; // started by Net_StartSecureChannel
 	int              family;
 	int              type;
 	int              protocol;
@@ -93,7 +97,60 @@ static bool PL_Net_Initialize() {
 	return true;
 }
 
-static SOCKET PL_Net_OpenSocketDescriptor(const String node, const String service, Net_Socket_Type type, char(&hostname)[NET_MAX_CANON_NAME], sockaddr_storage *addr, ptrdiff_t *addrelen, int *pfamily, int *ptype, int *pprotocol) {
+static int PL_Net_Connect(SOCKET descriptor, const sockaddr *addr, int addrlen, uint64_t deadline) {
+	if (!deadline)
+		return connect(descriptor, addr, addrlen);
+
+	u_long mode = 1;
+	ioctlsocket(descriptor, FIONBIO, &mode);
+
+	int error = connect(descriptor, addr, addrlen);
+	if (error && WSAGetLastError() == WSAEWOULDBLOCK) {
+		WSAPOLLFD fds = {};
+		fds.fd     = descriptor;
+		fds.events = POLLWRNORM;
+
+		uint64_t now = MonotonicMillisecs();
+		int presult  = now < deadline ? WSAPoll(&fds, 1, (int)(deadline - now)) : 0;
+		if (presult > 0) {
+			int len = sizeof(error);
+			if (getsockopt(descriptor, SOL_SOCKET, SO_ERROR, (char *)&error, &len) != 0)
+				error = WSAGetLastError();
+			if (error) WSASetLastError(error);
+		} else {
+			error = presult ? WSAGetLastError() : WSAETIMEDOUT;
+			WSASetLastError(error);
+		}
+	}
+
+	mode = 0;
+	ioctlsocket(descriptor, FIONBIO, &mode);
+
+	return error ? SOCKET_ERROR : 0;
+}
+
+// Leaves the socket non-blocking with the connect in progress
+static int PL_Net_StartConnect(SOCKET descriptor, const sockaddr *addr, int addrlen) {
+	u_long mode = 1;
+	ioctlsocket(descriptor, FIONBIO, &mode);
+
+	int error = connect(descriptor, addr, addrlen);
+	if (error && WSAGetLastError() == WSAEWOULDBLOCK)
+		return 0;
+	return error;
+}
+
+// Error of a connect started with PL_Net_StartConnect, 0 when it is done, also set as the last socket error
+static int PL_Net_ConnectResult(SOCKET descriptor) {
+	int error = 0;
+	int len   = sizeof(error);
+	if (getsockopt(descriptor, SOL_SOCKET, SO_ERROR, (char *)&error, &len) != 0)
+		error = WSAGetLastError();
+	if (error) WSASetLastError(error);
+	return error;
+}
+
+static SOCKET PL_Net_OpenSocketDescriptor(const String node, const String service, Net_Socket_Type type, uint64_t deadline, bool wait, char(&hostname)[NET_MAX_CANON_NAME], sockaddr_storage *addr, ptrdiff_t *addrelen, int *pfamily, int *ptype, int *pprotocol) {
 	ADDRINFOW hints;
 	memset(&hints, 0, sizeof(hints));
 	hints.ai_flags    = AI_CANONNAME;
@@ -128,7 +185,8 @@ static SOCKET PL_Net_OpenSocketDescriptor(const String node, const String servic
 			return INVALID_SOCKET;
 		}
 
-		error = connect(descriptor, ptr->ai_addr, (int)ptr->ai_addrlen);
+		error = wait ? PL_Net_Connect(descriptor, ptr->ai_addr, (int)ptr->ai_addrlen, deadline)
+		             : PL_Net_StartConnect(descriptor, ptr->ai_addr, (int)ptr->ai_addrlen);
 		if (error) {
 			closesocket(descriptor);
 			descriptor = INVALID_SOCKET;
@@ -175,8 +233,8 @@ static void PL_Net_ReportError(int error) {
 		msg = gai_strerror(error);
 	LogErrorEx(source, "Code: %d, Message: %s", error, msg);
 }
-#define PL_Net_ReportLastPlatformError(EAI_SYSTEM)
-#define PL_Net_ReportLastSocketError(EAI_SYSTEM)
+#define PL_Net_ReportLastPlatformError() PL_Net_ReportError(EAI_SYSTEM)
+#define PL_Net_ReportLastSocketError() PL_Net_ReportError(EAI_SYSTEM)
 
 static void PL_Net_Shutdown() {}
 
@@ -195,7 +253,59 @@ static bool PL_Net_Initialize() {
 	return true;
 }
 
-static SOCKET PL_Net_OpenSocketDescriptor(const String node, const String service, Net_Socket_Type type, char(&hostname)[NET_MAX_CANON_NAME], sockaddr_storage *addr, ptrdiff_t *addrelen, int *pfamily, int *ptype, int *pprotocol) {
+static int PL_Net_Connect(SOCKET descriptor, const sockaddr *addr, int addrlen, uint64_t deadline) {
+	if (!deadline)
+		return connect(descriptor, addr, (socklen_t)addrlen);
+
+	int flags = fcntl(descriptor, F_GETFL, 0);
+	fcntl(descriptor, F_SETFL, flags | O_NONBLOCK);
+
+	int error = connect(descriptor, addr, (socklen_t)addrlen);
+	if (error && errno == EINPROGRESS) {
+		pollfd fds = {};
+		fds.fd     = descriptor;
+		fds.events = POLLOUT;
+
+		uint64_t now = MonotonicMillisecs();
+		int presult  = now < deadline ? poll(&fds, 1, (int)(deadline - now)) : 0;
+		if (presult > 0) {
+			socklen_t len = sizeof(error);
+			if (getsockopt(descriptor, SOL_SOCKET, SO_ERROR, &error, &len) != 0)
+				error = errno;
+			if (error) errno = error;
+		} else {
+			error = presult ? errno : ETIMEDOUT;
+			errno = error;
+		}
+	}
+
+	fcntl(descriptor, F_SETFL, flags);
+
+	return error ? -1 : 0;
+}
+
+// Leaves the socket non-blocking with the connect in progress
+static int PL_Net_StartConnect(SOCKET descriptor, const sockaddr *addr, int addrlen) {
+	int flags = fcntl(descriptor, F_GETFL, 0);
+	fcntl(descriptor, F_SETFL, flags | O_NONBLOCK);
+
+	int error = connect(descriptor, addr, (socklen_t)addrlen);
+	if (error && errno == EINPROGRESS)
+		return 0;
+	return error;
+}
+
+// Error of a connect started with PL_Net_StartConnect, 0 when it is done, also set as the last socket error
+static int PL_Net_ConnectResult(SOCKET descriptor) {
+	int       error = 0;
+	socklen_t len   = sizeof(error);
+	if (getsockopt(descriptor, SOL_SOCKET, SO_ERROR, &error, &len) != 0)
+		error = errno;
+	if (error) errno = error;
+	return error;
+}
+
+static SOCKET PL_Net_OpenSocketDescriptor(const String node, const String service, Net_Socket_Type type, uint64_t deadline, bool wait, char(&hostname)[NET_MAX_CANON_NAME], sockaddr_storage *addr, ptrdiff_t *addrelen, int *pfamily, int *ptype, int *pprotocol) {
 	static constexpr int SocketTypeMap[] = { SOCK_STREAM, SOCK_DGRAM };
 
 	addrinfo hints;
@@ -241,7 +351,8 @@ static SOCKET PL_Net_OpenSocketDescriptor(const String node, const String servic
 			return INVALID_SOCKET;
 		}
 
-		error = connect(descriptor, ptr->ai_addr, (int)ptr->ai_addrlen);
+		error = wait ? PL_Net_Connect(descriptor, ptr->ai_addr, (int)ptr->ai_addrlen, deadline)
+		             : PL_Net_StartConnect(descriptor, ptr->ai_addr, (int)ptr->ai_addrlen);
 		if (error) {
 			close(descriptor);
 			descriptor = INVALID_SOCKET;
@@ -383,23 +494,80 @@ static int PL_Net_OpenSSLRead(Net_Socket *net, void *buffer, int length) {
 	return read;
 }
 
-static bool PL_Net_OpenSSLOpenChannel(Net_Socket *net, bool verify) {
+static bool PL_Net_OpenSSLHandshake(Net_Socket *net, SSL *ssl) {
+	// Blocking sockets never ask to wait, so the socket is only switched when bounded by a deadline
+	if (net->deadline)
+		Net_SetSocketBlockingMode(net, false);
+
+	bool result = false;
+
+	while (true) {
+		int status = SSL_connect(ssl);
+		if (status == 1) {
+			result = true;
+			break;
+		}
+
+		pollfd fds = {};
+		fds.fd     = net->descriptor;
+
+		int error = SSL_get_error(ssl, status);
+		if (error == SSL_ERROR_WANT_READ) {
+			fds.events = POLLRDNORM;
+		} else if (error == SSL_ERROR_WANT_WRITE) {
+			fds.events = POLLWRNORM;
+		} else {
+			PL_Net_ReportOpenSSLError();
+			break;
+		}
+
+		int timeout = -1;
+		if (net->deadline) {
+			uint64_t now = MonotonicMillisecs();
+			if (now >= net->deadline) {
+				LogErrorEx("Net:OpenSSL", "Handshake timed out");
+				net->error = NET_E_TIMED_OUT;
+				break;
+			}
+			timeout = (int)(net->deadline - now);
+		}
+
+		if (poll(&fds, 1, timeout) < 0) {
+			PL_Net_ReportLastPlatformError();
+			break;
+		}
+	}
+
+	if (net->deadline)
+		Net_SetSocketBlockingMode(net, true);
+
+	return result;
+}
+
+static SSL *PL_Net_OpenSSLCreate(Net_Socket *net, bool verify) {
 	SSL *ssl = SSL_new(verify ? DefaultClientVerifyContext : DefaultClientContext);
 
 	if (!ssl) {
 		PL_Net_ReportOpenSSLError();
-		return false;
+		return nullptr;
 	}
 
 	if (!SSL_set_tlsext_host_name(ssl, net->hostname)) {
 		PL_Net_ReportOpenSSLError();
 		SSL_free(ssl);
-		return false;
+		return nullptr;
 	}
 
 	SSL_set_fd(ssl, (int)net->descriptor);
-	if (SSL_connect(ssl) == -1) {
-		PL_Net_ReportOpenSSLError();
+	return ssl;
+}
+
+static bool PL_Net_OpenSSLOpenChannel(Net_Socket *net, bool verify) {
+	SSL *ssl = PL_Net_OpenSSLCreate(net, verify);
+	if (!ssl)
+		return false;
+
+	if (!PL_Net_OpenSSLHandshake(net, ssl)) {
 		SSL_free(ssl);
 		return false;
 	}
@@ -411,6 +579,36 @@ static bool PL_Net_OpenSSLOpenChannel(Net_Socket *net, bool verify) {
 	return true;
 }
 
+static bool PL_Net_OpenSSLStartChannel(Net_Socket *net, bool verify) {
+	SSL *ssl = PL_Net_OpenSSLCreate(net, verify);
+	if (!ssl)
+		return false;
+
+	net->ssl         = ssl;
+	net->read        = PL_Net_OpenSSLRead;
+	net->write       = PL_Net_OpenSSLWrite;
+	net->handshaking = true;
+
+	return true;
+}
+
+static Net_Connect_Status PL_Net_OpenSSLContinueHandshake(Net_Socket *net) {
+	int status = SSL_connect(net->ssl);
+	if (status == 1) {
+		net->handshaking = false;
+		return NET_CONNECT_DONE;
+	}
+
+	int error = SSL_get_error(net->ssl, status);
+	if (error == SSL_ERROR_WANT_READ)
+		return NET_CONNECT_WAIT_READ;
+	if (error == SSL_ERROR_WANT_WRITE)
+		return NET_CONNECT_WAIT_WRITE;
+
+	PL_Net_ReportOpenSSLError();
+	return NET_CONNECT_FAILED;
+}
+
 static void PL_Net_OpenSSLCloseChannel(Net_Socket *net) {
 	if (net->ssl) {
 		SSL_shutdown(net->ssl);
@@ -418,13 +616,35 @@ static void PL_Net_OpenSSLCloseChannel(Net_Socket *net) {
 	}
 }
 
+static bool PL_Net_OpenSSLAddTrustedCertificate(const String pem) {
+	BIO *bio = BIO_new_mem_buf(pem.data, (int)pem.length);
+	if (!bio) {
+		PL_Net_ReportOpenSSLError();
+		return false;
+	}
+	Defer{ BIO_free(bio); };
+
+	X509 *x509 = PEM_read_bio_X509(bio, nullptr, nullptr, nullptr);
+	if (!x509) {
+		PL_Net_ReportOpenSSLError();
+		return false;
+	}
+	Defer{ X509_free(x509); };
+
+	X509_STORE *store = SSL_CTX_get_cert_store(DefaultClientVerifyContext);
+	if (!store || !X509_STORE_add_cert(store, x509)) {
+		PL_Net_ReportOpenSSLError();
+		return false;
+	}
+	return true;
+}
+
 static bool PL_Net_OpenSSLReconnect(Net_Socket *net) {
 	if (net->ssl) {
+		// Clearing keeps the session, so the new handshake can resume it
+		SSL_clear(net->ssl);
 		SSL_set_fd(net->ssl, (int)net->descriptor);
-		if (SSL_connect(net->ssl) == -1) {
-			PL_Net_ReportOpenSSLError();
-			return false;
-		}
+		return PL_Net_OpenSSLHandshake(net, net->ssl);
 	}
 	return true;
 }
@@ -432,9 +652,12 @@ static bool PL_Net_OpenSSLReconnect(Net_Socket *net) {
 #define PL_Net_OpenSSLInitialize(...) (true)
 #define PL_Net_OpenSSLShutdown(...)
 #define PL_Net_OpenSSLOpenChannel(...) (false)
+#define PL_Net_OpenSSLStartChannel(...) (false)
+#define PL_Net_OpenSSLContinueHandshake(...) (NET_CONNECT_FAILED)
 #define PL_Net_OpenSSLCloseChannel(...)
 #define PL_Net_OpenSSLResetDescriptor(...) (true)
 #define PL_Net_OpenSSLReconnect(...) (true)
+#define PL_Net_OpenSSLAddTrustedCertificate(...) (false)
 #endif
 
 //
@@ -463,16 +686,20 @@ void Net_Shutdown() {
 //
 //
 
-Net_Socket *Net_OpenConnection(const String node, const String service, Net_Socket_Type type, ptrdiff_t user_size, Memory_Allocator allocator) {
-	char hostname[NET_MAX_CANON_NAME];
+// Time left to wait, bounded by both the call's limit and the socket's deadline
+static int Net_WaitTime(Net_Socket *net, uint64_t limit) {
+	uint64_t end = limit;
+	if (net->deadline && net->deadline < end)
+		end = net->deadline;
+	uint64_t now = MonotonicMillisecs();
+	return now < end ? (int)(end - now) : 0;
+}
 
-	sockaddr_storage addr;
-	ptrdiff_t        addr_len;
-	int              family, socktype, protocol;
-	SOCKET descriptor = PL_Net_OpenSocketDescriptor(node, service, type, hostname, &addr, &addr_len, &family, &socktype, &protocol);
-	if (descriptor == INVALID_SOCKET)
-		return nullptr;
+static bool Net_DeadlinePassed(Net_Socket *net) {
+	return net->deadline && MonotonicMillisecs() >= net->deadline;
+}
 
+static Net_Socket *Net_CreateSocket(SOCKET descriptor, const char *hostname, const sockaddr_storage &addr, ptrdiff_t addr_len, int family, int socktype, int protocol, ptrdiff_t user_size, Memory_Allocator allocator) {
 	user_size = Maximum(user_size, NET_DEFAULT_USER_SIZE);
 	ptrdiff_t allocation_size = user_size - NET_DEFAULT_USER_SIZE;
 	allocation_size += sizeof(Net_Socket);
@@ -490,10 +717,10 @@ Net_Socket *Net_OpenConnection(const String node, const String service, Net_Sock
 		net->protocol   = protocol;
 		net->allocator  = allocator;
 		net->addrlen    = (int)addr_len;
-		net->hostlen    = (int)strlen(hostname);
+		net->hostlen    = (int)Minimum(strlen(hostname), NET_MAX_CANON_NAME - 1);
 		net->allocated  = allocation_size;
 
-		memcpy(net->hostname, hostname, sizeof(hostname));
+		memcpy(net->hostname, hostname, net->hostlen);
 		memcpy(&net->address, &addr, sizeof(addr));
 
 		memset(net->user, 0, user_size);
@@ -508,14 +735,233 @@ Net_Socket *Net_OpenConnection(const String node, const String service, Net_Sock
 	return nullptr;
 }
 
-Net_Socket *Net_OpenConnection(const String node, const String service, Net_Socket_Type type, Memory_Allocator allocator) {
-	return Net_OpenConnection(node, service, type, NET_DEFAULT_USER_SIZE, allocator);
+Net_Socket *Net_OpenConnection(const String node, const String service, Net_Socket_Type type, ptrdiff_t user_size, Memory_Allocator allocator, uint64_t deadline) {
+	char hostname[NET_MAX_CANON_NAME];
+
+	sockaddr_storage addr;
+	ptrdiff_t        addr_len;
+	int              family, socktype, protocol;
+	SOCKET descriptor = PL_Net_OpenSocketDescriptor(node, service, type, deadline, true, hostname, &addr, &addr_len, &family, &socktype, &protocol);
+	if (descriptor == INVALID_SOCKET)
+		return nullptr;
+
+	Net_Socket *net = Net_CreateSocket(descriptor, hostname, addr, addr_len, family, socktype, protocol, user_size, allocator);
+	if (net)
+		net->deadline = deadline;
+	return net;
+}
+
+Net_Socket *Net_OpenConnection(const String node, const String service, Net_Socket_Type type, Memory_Allocator allocator, uint64_t deadline) {
+	return Net_OpenConnection(node, service, type, NET_DEFAULT_USER_SIZE, allocator, deadline);
+}
+
+Net_Socket *Net_StartConnection(const String node, const String service, Net_Socket_Type type, Memory_Allocator allocator) {
+	char hostname[NET_MAX_CANON_NAME];
+
+	sockaddr_storage addr;
+	ptrdiff_t        addr_len;
+	int              family, socktype, protocol;
+	SOCKET descriptor = PL_Net_OpenSocketDescriptor(node, service, type, 0, false, hostname, &addr, &addr_len, &family, &socktype, &protocol);
+	if (descriptor == INVALID_SOCKET)
+		return nullptr;
+
+	Net_Socket *net = Net_CreateSocket(descriptor, hostname, addr, addr_len, family, socktype, protocol, NET_DEFAULT_USER_SIZE, allocator);
+	if (net)
+		net->connecting = true;
+	return net;
+}
+
+Net_Connect_Status Net_ContinueConnection(Net_Socket *net) {
+	if (net->connecting) {
+		pollfd fds = {};
+		fds.fd     = net->descriptor;
+		fds.events = POLLWRNORM;
+
+		int presult = poll(&fds, 1, 0);
+		if (presult == 0)
+			return NET_CONNECT_WAIT_WRITE;
+		if (presult < 0) {
+			PL_Net_ReportLastPlatformError();
+			return NET_CONNECT_FAILED;
+		}
+
+		if (PL_Net_ConnectResult(net->descriptor)) {
+			PL_Net_ReportLastSocketError();
+			return NET_CONNECT_FAILED;
+		}
+		net->connecting = false;
+	}
+
+	if (net->handshaking)
+		return PL_Net_OpenSSLContinueHandshake(net);
+	return NET_CONNECT_DONE;
+}
+
+bool Net_CanReusePort() {
+#ifdef SO_REUSEPORT
+	return true;
+#else
+	return false;
+#endif
+}
+
+Net_Socket *Net_Listen(const String node, const String service, Net_Socket_Type type, int backlog, bool reuse_port, Memory_Allocator allocator) {
+	addrinfo hints;
+	memset(&hints, 0, sizeof(hints));
+	hints.ai_flags    = AI_PASSIVE;
+	hints.ai_family   = AF_UNSPEC;
+	hints.ai_socktype = SocketTypeMap[type];
+
+	char nodename[NET_MAX_CANON_NAME];
+	char servicename[512];
+
+	if (node.length + 1 >= (ptrdiff_t)ArrayCount(nodename) || service.length + 1 >= (ptrdiff_t)ArrayCount(servicename)) {
+		LogErrorEx("Net", "Could not create socket: Out of memory");
+		return nullptr;
+	}
+
+	memcpy(nodename, node.data, node.length);
+	memcpy(servicename, service.data, service.length);
+
+	nodename[node.length]       = 0;
+	servicename[service.length] = 0;
+
+	addrinfo *address = nullptr;
+	int error = getaddrinfo(node.length ? nodename : nullptr, servicename, &hints, &address);
+	if (error) {
+		PL_Net_ReportError(error);
+		return nullptr;
+	}
+
+	SOCKET descriptor = INVALID_SOCKET;
+	int    family = 0, socktype = 0, protocol = 0;
+
+	for (auto ptr = address; ptr; ptr = ptr->ai_next) {
+		descriptor = socket(ptr->ai_family, ptr->ai_socktype, ptr->ai_protocol);
+		if (descriptor == INVALID_SOCKET)
+			continue;
+
+		int enable = 1;
+#if !PLATFORM_WINDOWS
+		// On Windows this would let other sockets steal the port
+		setsockopt(descriptor, SOL_SOCKET, SO_REUSEADDR, (char *)&enable, sizeof(enable));
+#endif
+#ifdef SO_REUSEPORT
+		if (reuse_port)
+			setsockopt(descriptor, SOL_SOCKET, SO_REUSEPORT, (char *)&enable, sizeof(enable));
+#endif
+
+		if (bind(descriptor, ptr->ai_addr, (int)ptr->ai_addrlen) == 0 && listen(descriptor, backlog) == 0) {
+			family   = ptr->ai_family;
+			socktype = ptr->ai_socktype;
+			protocol = ptr->ai_protocol;
+			break;
+		}
+
+		PL_Net_ReportLastSocketError();
+		PL_Net_CloseSocketDescriptor(descriptor);
+		descriptor = INVALID_SOCKET;
+	}
+
+	freeaddrinfo(address);
+
+	if (descriptor == INVALID_SOCKET) {
+		LogErrorEx("Net", "Could not listen on " StrFmt ":" StrFmt, StrArg(node), StrArg(service));
+		return nullptr;
+	}
+
+	// The bound address has the actual port when the service is "0"
+	sockaddr_storage addr;
+	socklen_t        addr_len = sizeof(addr);
+	memset(&addr, 0, sizeof(addr));
+	getsockname(descriptor, (sockaddr *)&addr, &addr_len);
+
+	return Net_CreateSocket(descriptor, nodename, addr, addr_len, family, socktype, protocol, NET_DEFAULT_USER_SIZE, allocator);
+}
+
+Net_Socket *Net_Accept(Net_Socket *listener, Memory_Allocator allocator) {
+	sockaddr_storage addr;
+	socklen_t        addr_len = sizeof(addr);
+
+	SOCKET descriptor = accept(listener->descriptor, (sockaddr *)&addr, &addr_len);
+	if (descriptor == INVALID_SOCKET) {
+#if PLATFORM_WINDOWS
+		bool would_block = WSAGetLastError() == WSAEWOULDBLOCK;
+#else
+		bool would_block = errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+#endif
+		if (would_block) {
+			listener->error = NET_E_WOULD_BLOCK;
+		} else {
+			PL_Net_ReportLastSocketError();
+			listener->error = NET_E_CONNECTION_LOST;
+		}
+		return nullptr;
+	}
+
+	listener->error = NET_E_NONE;
+
+	char hostname[NET_MAX_CANON_NAME];
+	if (getnameinfo((sockaddr *)&addr, addr_len, hostname, sizeof(hostname), nullptr, 0, NI_NUMERICHOST) != 0)
+		hostname[0] = 0;
+
+	return Net_CreateSocket(descriptor, hostname, addr, addr_len, listener->family, listener->type, listener->protocol, NET_DEFAULT_USER_SIZE, allocator);
+}
+
+Net_Socket *Net_OpenWakeup(Memory_Allocator allocator) {
+	SOCKET descriptor = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+	if (descriptor == INVALID_SOCKET) {
+		PL_Net_ReportLastSocketError();
+		return nullptr;
+	}
+
+	sockaddr_in addr     = {};
+	addr.sin_family      = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+	// Bound to a port picked by the system and connected to itself
+	socklen_t addr_len = sizeof(addr);
+	if (bind(descriptor, (sockaddr *)&addr, sizeof(addr)) != 0 ||
+		getsockname(descriptor, (sockaddr *)&addr, &addr_len) != 0 ||
+		connect(descriptor, (sockaddr *)&addr, sizeof(addr)) != 0) {
+		PL_Net_ReportLastSocketError();
+		PL_Net_CloseSocketDescriptor(descriptor);
+		return nullptr;
+	}
+
+	sockaddr_storage storage = {};
+	memcpy(&storage, &addr, sizeof(addr));
+
+	Net_Socket *net = Net_CreateSocket(descriptor, "127.0.0.1", storage, sizeof(addr), AF_INET, SOCK_DGRAM, IPPROTO_UDP, NET_DEFAULT_USER_SIZE, allocator);
+	if (net)
+		Net_SetSocketBlockingMode(net, false);
+	return net;
+}
+
+void Net_Wake(Net_Socket *net) {
+	// Fails only when the buffer is full, which wakes the poll already
+	uint8_t signal = 1;
+	send(net->descriptor, (char *)&signal, 1, 0);
+}
+
+void Net_ClearWake(Net_Socket *net) {
+	uint8_t buffer[64];
+	while (recv(net->descriptor, (char *)buffer, sizeof(buffer), 0) > 0) {}
 }
 
 bool Net_OpenSecureChannel(Net_Socket *net, bool verify) {
 	return PL_Net_OpenSSLOpenChannel(net, verify);
 }
 
+bool Net_StartSecureChannel(Net_Socket *net, bool verify) {
+	return PL_Net_OpenSSLStartChannel(net, verify);
+}
+
+bool Net_AddTrustedCertificate(const String pem) {
+	Assert(IsInitialized);
+	return PL_Net_OpenSSLAddTrustedCertificate(pem);
+}
+
 void Net_CloseConnection(Net_Socket *net) {
 	PL_Net_OpenSSLCloseChannel(net);
 	PL_Net_CloseSocketDescriptor(net->descriptor);
@@ -539,6 +985,11 @@ void Net_SetSocketSendBufferSize(Net_Socket *net, int size) {
 	setsockopt(net->descriptor, SOL_SOCKET, SO_SNDBUF, (char *)&size, sizeof(size));
 }
 
+void Net_SetSocketNoDelay(Net_Socket *net, bool no_delay) {
+	int enable = no_delay ? 1 : 0;
+	setsockopt(net->descriptor, IPPROTO_TCP, TCP_NODELAY, (char *)&enable, sizeof(enable));
+}
+
 void *Net_GetUserBuffer(Net_Socket *net) {
 	return net->user;
 }
@@ -551,6 +1002,14 @@ void Net_SetError(Net_Socket *net, Net_Error error) {
 	net->error = error;
 }
 
+void Net_SetDeadline(Net_Socket *net, uint64_t deadline) {
+	net->deadline = deadline;
+}
+
+uint64_t Net_GetDeadline(Net_Socket *net) {
+	return net->deadline;
+}
+
 bool Net_TryReconnect(Net_Socket *net) {
 	PL_Net_CloseSocketDescriptor(net->descriptor);
 
@@ -562,9 +1021,11 @@ bool Net_TryReconnect(Net_Socket *net) {
 	}
 
 	sockaddr *addr = (sockaddr *)&net->address;
-	int error      = connect(net->descriptor, addr, (int)net->addrlen);
+	int error      = PL_Net_Connect(net->descriptor, addr, (int)net->addrlen, net->deadline);
 	if (error) {
 		PL_Net_ReportLastSocketError();
+		if (Net_DeadlinePassed(net))
+			net->error = NET_E_TIMED_OUT;
 		return false;
 	}
 	return PL_Net_OpenSSLReconnect(net);
@@ -613,10 +1074,15 @@ int Net_SendBlocked(Net_Socket *net, void *buffer, int length, int timeout) {
 	fds.fd = net->descriptor;
 	fds.events = POLLWRNORM;
 
-	time_t counter = clock();
+	uint64_t limit = MonotonicMillisecs() + Maximum(timeout, 0);
 
-	while (timeout >= 0) {
-		int presult = poll(&fds, 1, timeout);
+	while (true) {
+		if (Net_DeadlinePassed(net)) {
+			net->error = NET_E_TIMED_OUT;
+			return -1;
+		}
+
+		int presult = poll(&fds, 1, Net_WaitTime(net, limit));
 
 		if (presult > 0) {
 			if (fds.revents & POLLWRNORM) {
@@ -625,10 +1091,10 @@ int Net_SendBlocked(Net_Socket *net, void *buffer, int length, int timeout) {
 #ifdef NETWORK_OPENSSL_ENABLE
 				if (net->ssl) {
 					if (SSL_get_error(net->ssl, written) == SSL_ERROR_WANT_WRITE) {
-						time_t current = clock();
-						int time_passed = (1000 * (int)(current - counter)) / CLOCKS_PER_SEC;
-						timeout -= time_passed;
-						counter = current;
+						if (MonotonicMillisecs() >= limit) {
+							net->error = NET_E_TIMED_OUT;
+							return -1;
+						}
 						continue;
 					}
 				}
@@ -667,10 +1133,24 @@ int Net_ReceiveBlocked(Net_Socket *net, void *buffer, int length, int timeout) {
 	fds.fd = net->descriptor;
 	fds.events = POLLRDNORM;
 
-	time_t counter = clock();
+	uint64_t limit = MonotonicMillisecs() + Maximum(timeout, 0);
+
+	while (true) {
+		if (Net_DeadlinePassed(net)) {
+			net->error = NET_E_TIMED_OUT;
+			return -1;
+		}
+
+#ifdef NETWORK_OPENSSL_ENABLE
+		// Decrypted bytes left from an earlier record are not seen by poll
+		if (net->ssl && SSL_pending(net->ssl) > 0) {
+			int read = net->read(net, buffer, length);
+			if (read > 0)
+				return read;
+		}
+#endif
 
-	while (timeout >= 0) {
-		int presult = poll(&fds, 1, timeout);
+		int presult = poll(&fds, 1, Net_WaitTime(net, limit));
 
 		if (presult > 0) {
 			if (fds.revents & POLLRDNORM) {
@@ -679,10 +1159,10 @@ int Net_ReceiveBlocked(Net_Socket *net, void *buffer, int length, int timeout) {
 #ifdef NETWORK_OPENSSL_ENABLE
 				if (net->ssl) {
 					if (SSL_get_error(net->ssl, read) == SSL_ERROR_WANT_READ) {
-						time_t current  = clock();
-						int time_passed = (1000 * (int)(current - counter)) / CLOCKS_PER_SEC;
-						timeout -= time_passed;
-						counter = current;
+						if (MonotonicMillisecs() >= limit) {
+							net->error = NET_E_WOULD_BLOCK;
+							return 0;
+						}
 						continue;
 					}
 				}
@@ -706,6 +1186,10 @@ int Net_ReceiveBlocked(Net_Socket *net, void *buffer, int length, int timeout) {
 			net->error = NET_E_WOULD_BLOCK;
 			return 0;
 		} else if (presult == 0) {
+			if (Net_DeadlinePassed(net)) {
+				net->error = NET_E_TIMED_OUT;
+				return -1;
+			}
 			net->error = NET_E_WOULD_BLOCK;
 			return 0;
 		} else {
@@ -761,6 +1245,13 @@ int Net_Receive(Net_Socket *net, void *buffer, int length) {
 		}
 #endif
 
+		// Orderly shutdown by the peer, whether it was expected is up to the caller.
+		// The error code is stale in this case so it is checked first
+		if (read == 0) {
+			net->error = NET_E_CONNECTION_CLOSED;
+			return -1;
+		}
+
 #if PLATFORM_WINDOWS
 		if (WSAGetLastError() == WSAEWOULDBLOCK) {
 			net->error = NET_E_WOULD_BLOCK;
@@ -772,7 +1263,6 @@ int Net_Receive(Net_Socket *net, void *buffer, int length) {
 			return 0;
 		}
 #endif
-		if (read == 0) LogErrorEx("Net", "Lost connection unexpectedly");
 
 		Net_ReportError(net);
 		net->error = NET_E_CONNECTION_LOST;
@@ -8,11 +8,19 @@ enum Net_Error {
 	NET_E_TIMED_OUT = 1,
 	NET_E_WOULD_BLOCK,
 	NET_E_CONNECTION_LOST,
-	NET_E_OUT_OF_MEMORY
+	NET_E_OUT_OF_MEMORY,
+	NET_E_CONNECTION_CLOSED
 };
 
 constexpr int NET_MAX_CANON_NAME = 2048;
 
+enum Net_Connect_Status {
+	NET_CONNECT_FAILED,
+	NET_CONNECT_DONE,
+	NET_CONNECT_WAIT_READ,
+	NET_CONNECT_WAIT_WRITE
+};
+
 enum Net_Socket_Type {
 	NET_SOCKET_TCP,
 	NET_SOCKET_UDP
@@ -26,18 +34,45 @@ void   Net_Shutdown();
 /*
 * Send: -ve means error, +ve means number of bytes sent, 0 means success or wait
 * Receive: -ve means error, +ve means number of bytes received, 0 means wait
+* Net_Receive fails with NET_E_CONNECTION_CLOSED when the peer has shut down the connection
+*
+* Accept: null with NET_E_WOULD_BLOCK when the listener is non-blocking and no connection is pending
+*
+* Deadline: absolute time in MonotonicMillisecs(), 0 for none. It bounds the connect, the TLS handshake
+* and the blocked calls, which fail with NET_E_TIMED_OUT once it has passed. Name resolution is not bounded.
+*
+* Non-blocking connect: Net_StartConnection resolves the name, which still blocks, and starts connecting a
+* non-blocking socket. Net_StartSecureChannel queues a TLS handshake behind the connect. Net_ContinueConnection
+* is called again once the descriptor is ready for what it waits on, until it is done or fails. Only a connect
+* that fails right away moves on to the next resolved address.
+*
+* Wakeup: a loopback socket to put in a poll set, Net_Wake makes it readable from any thread and Net_ClearWake
+* reads what the wakes sent.
 */
 
-Net_Socket * Net_OpenConnection(const String node, const String service, Net_Socket_Type type, ptrdiff_t user_size, Memory_Allocator allocator = ThreadContext.allocator);
-Net_Socket  *Net_OpenConnection(const String node, const String service, Net_Socket_Type type, Memory_Allocator allocator = ThreadContext.allocator);
+Net_Socket * Net_OpenConnection(const String node, const String service, Net_Socket_Type type, ptrdiff_t user_size, Memory_Allocator allocator = ThreadContext.allocator, uint64_t deadline = 0);
+Net_Socket  *Net_OpenConnection(const String node, const String service, Net_Socket_Type type, Memory_Allocator allocator = ThreadContext.allocator, uint64_t deadline = 0);
 bool         Net_OpenSecureChannel(Net_Socket *net, bool verify = true);
+Net_Socket * Net_StartConnection(const String node, const String service, Net_Socket_Type type, Memory_Allocator allocator = ThreadContext.allocator);
+bool         Net_StartSecureChannel(Net_Socket *net, bool verify = true);
+Net_Connect_Status Net_ContinueConnection(Net_Socket *net);
+Net_Socket * Net_OpenWakeup(Memory_Allocator allocator = ThreadContext.allocator);
+void         Net_Wake(Net_Socket *net);
+void         Net_ClearWake(Net_Socket *net);
+bool         Net_AddTrustedCertificate(const String pem); // PEM encoded, trusted by the verified secure channels
+bool         Net_CanReusePort();
+Net_Socket * Net_Listen(const String node, const String service, Net_Socket_Type type, int backlog, bool reuse_port = false, Memory_Allocator allocator = ThreadContext.allocator);
+Net_Socket * Net_Accept(Net_Socket *listener, Memory_Allocator allocator = ThreadContext.allocator);
 void         Net_CloseConnection(Net_Socket *net);
 void         Net_Shutdown(Net_Socket *net);
 void         Net_SetSocketReceiveBufferSize(Net_Socket *net, int size);
 void         Net_SetSocketSendBufferSize(Net_Socket *net, int size);
+void         Net_SetSocketNoDelay(Net_Socket *net, bool no_delay);
 void *       Net_GetUserBuffer(Net_Socket *net);
 Net_Error    Net_GetLastError(Net_Socket *net);
 void         Net_SetError(Net_Socket *net, Net_Error error);
+void         Net_SetDeadline(Net_Socket *net, uint64_t deadline);
+uint64_t     Net_GetDeadline(Net_Socket *net);
 bool         Net_TryReconnect(Net_Socket *net);
 String       Net_GetHostname(Net_Socket *net);
 int          Net_GetPort(Net_Socket *net);
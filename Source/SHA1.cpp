@@ -23,7 +23,7 @@ A million repetitions of "a"
 /* for uint32_t */
 #include <stdint.h>
 
-#include "sha1.h"
+#include "SHA1.h"
 
 
 #define rol(value, bits) (((value) << (bits)) | ((value) >> (32 - (bits))))
@@ -1,8 +1,10 @@
 #include "Websocket.h"
 #include "NetworkNative.h"
+#include "Kr/KrBasic.h"
 #include "Kr/KrString.h"
 #include "Kr/KrAtomic.h"
 #include "Kr/KrThread.h"
+#include "Kr/KrProfile.h"
 #include "Base64.h"
 #include "SHA1.h"
 
@@ -165,13 +167,14 @@ struct Websocket_Frame_Parser {
 	ptrdiff_t                    payload_parsed;
 };
 
+// Frames are parsed and their payloads used where they are received, the ring is mapped twice so a frame
+// is contiguous even where it wraps. Only the fragments of a message are copied, to join them.
 struct Websocket_Read_Stream {
-	ptrdiff_t start;
-	ptrdiff_t stop;
-	ptrdiff_t p2cap;
-	uint8_t * buffer;
-	ptrdiff_t seriallen;
-	uint8_t * serialized;
+	Ring_Buffer ring;
+	ptrdiff_t   p2cap;
+	ptrdiff_t   seriallen;
+	uint8_t *   serialized;
+	int32_t     serialheader; // of the first fragment, control frames can come in between
 };
 
 struct Websocket_Reader {
@@ -205,7 +208,7 @@ struct Websocket_Context {
 
 static ptrdiff_t Websocket_GetReaderSize(uint32_t p2buff_size) {
 	Assert(IsPower2(p2buff_size));
-	return p2buff_size * 2; // circular + serial buffer
+	return p2buff_size; // serial buffer, the ring is mapped on its own
 }
 
 static ptrdiff_t Websocket_GetQueueNodeSize(uint32_t p2buff_size) {
@@ -227,10 +230,11 @@ static ptrdiff_t Websocket_GetContextSize(Websocket_Spec spec) {
 }
 
 static uint8_t *Websocket_InitReader(Websocket_Reader *reader, uint32_t p2buff_size, uint8_t *mem) {
-	reader->stream.p2cap      = p2buff_size;
-	reader->stream.buffer     = mem;
-	reader->stream.serialized = mem + p2buff_size;
-	return mem + 2 * p2buff_size;
+	reader->stream.p2cap        = p2buff_size;
+	reader->stream.seriallen    = 0;
+	reader->stream.serialized   = mem;
+	reader->stream.serialheader = 0;
+	return mem + p2buff_size;
 }
 
 static uint8_t *Websocket_InitQueue(Websocket_Queue *queue, uint32_t p2buff_size, uint32_t count, uint8_t *mem) {
@@ -256,7 +260,10 @@ static uint8_t *Websocket_InitQueue(Websocket_Queue *queue, uint32_t p2buff_size
 	return mem;
 }
 
-static void Websocket_InitContextClient(Websocket_Context *context, Websocket_Spec spec, uint8_t *mem) {
+static bool Websocket_InitContextClient(Websocket_Context *context, Websocket_Spec spec, uint8_t *mem) {
+	if (!RingBuffer_Create(&context->reader.stream.ring, spec.read_size))
+		return false;
+
 	mem = Websocket_InitReader(&context->reader, spec.read_size, mem);
 	mem = Websocket_InitQueue(&context->readq, spec.read_size, spec.queue_size, mem);
 	mem = Websocket_InitQueue(&context->writeq, spec.write_size, spec.queue_size, mem);
@@ -265,6 +272,8 @@ static void Websocket_InitContextClient(Websocket_Context *context, Websocket_Sp
 	context->role       = WEBSOCKET_ROLE_CLIENT;
 	context->readsem    = Semaphore_Create(0);
 	context->writesem   = Semaphore_Create(spec.queue_size);
+
+	return true;
 }
 
 //
@@ -441,7 +450,11 @@ Websocket *Websocket_Connect(String uri, Http_Response *res, Websocket_Header *h
 
 		uint8_t *user = (uint8_t *)Net_GetUserBuffer(socket);;
 		Websocket_Context *context = (Websocket_Context *)user;
-		Websocket_InitContextClient(context, spec, user + sizeof(Websocket_Context));
+		if (!Websocket_InitContextClient(context, spec, user + sizeof(Websocket_Context))) {
+			LogErrorEx("Websocket", "Failed to map the read buffer");
+			Http_Disconnect(http);
+			return nullptr;
+		}
 
 		Thread_Context_Params params = ThreadContextDefaultParams;
 		params.logger = ThreadContext.logger;
@@ -456,7 +469,17 @@ Websocket *Websocket_Connect(String uri, Http_Response *res, Websocket_Header *h
 }
 
 void Websocket_Disconnect(Websocket *websocket) {
-	Net_CloseConnection((Net_Socket *)websocket);
+	Net_Socket *socket     = (Net_Socket *)websocket;
+	Websocket_Context *ctx = (Websocket_Context *)Net_GetUserBuffer(socket);
+
+	// The thread reads out of the ring, it has to be done before the ring is unmapped
+	ctx->connection = WEBSOCKET_CLOSED;
+	Net_Shutdown(socket);
+	Thread_Wait(ctx->thread, -1);
+	Thread_Destroy(ctx->thread);
+
+	RingBuffer_Destroy(&ctx->reader.stream.ring);
+	Net_CloseConnection(socket);
 }
 
 //
@@ -493,8 +516,11 @@ static void Websocket_QueueFree(Websocket_Queue *q, Websocket_Queue::Node *node)
 static void Websocket_QueuePush(Websocket_Queue *q, Websocket_Queue::Node *node) {
 	SpinLock(&q->wguard);
 	Assert(!node->next);
+	SpinLock(&q->rguard);
 	q->tail->next = node;
-	node->next = &q->head;
+	node->next    = &q->head;
+	q->tail       = node;
+	SpinUnlock(&q->rguard);
 #if defined(WEBSOCKET_ENABLE_DEBUG_INFO)
 	AtomicDec(&q->debug_info.allocated);
 	AtomicInc(&q->debug_info.in_queue);
@@ -510,6 +536,8 @@ static Websocket_Queue::Node *Websocket_QueuePop(Websocket_Queue *q) {
 		auto next    = node->next;
 		q->head.next = next;
 		node->next   = nullptr;
+		if (q->tail == node)
+			q->tail = &q->head;
 #if defined(WEBSOCKET_ENABLE_DEBUG_INFO)
 		AtomicInc(&q->debug_info.allocated);
 		AtomicDec(&q->debug_info.in_queue);
@@ -523,53 +551,6 @@ static Websocket_Queue::Node *Websocket_QueuePop(Websocket_Queue *q) {
 //
 //
 
-static ptrdiff_t Websocket_StreamReadableSize(Websocket_Read_Stream *stream) {
-	ptrdiff_t size;
-	if (stream->stop >= stream->start) {
-		size = stream->stop - stream->start;
-	} else {
-		size = stream->p2cap - stream->start;
-		size += stream->stop;
-	}
-	return size;
-}
-
-static ptrdiff_t Websocket_StreamDrop(Websocket_Read_Stream *stream, ptrdiff_t size) {
-	ptrdiff_t read = 0;
-	if (stream->start > stream->stop) {
-		ptrdiff_t read_size = Minimum(size, stream->p2cap - stream->start);
-		read += read_size;
-		stream->start = (stream->start + read_size) & (stream->p2cap - 1);
-	}
-	if (read != size) {
-		ptrdiff_t read_size = Minimum(size - read, stream->stop - stream->start);
-		read += read_size;
-		stream->start = (stream->start + read_size) & (stream->p2cap - 1);
-	}
-	return read;
-}
-
-static ptrdiff_t Websocket_StreamRead(Websocket_Read_Stream *stream, uint8_t *buff, ptrdiff_t size) {
-	ptrdiff_t read = 0;
-	if (stream->start > stream->stop) {
-		ptrdiff_t read_size = Minimum(size, stream->p2cap - stream->start);
-		memcpy(buff, stream->buffer + stream->start, read_size);
-		read += read_size;
-		stream->start = (stream->start + read_size) & (stream->p2cap - 1);
-	}
-	if (read != size) {
-		ptrdiff_t read_size = Minimum(size - read, stream->stop - stream->start);
-		memcpy(buff, stream->buffer + stream->start, read_size);
-		read += read_size;
-		stream->start = (stream->start + read_size) & (stream->p2cap - 1);
-	}
-	return read;
-}
-
-//
-//
-//
-
 static void Websocket_MaskPayload(uint8_t *dst, uint8_t *src, uint64_t length, uint8_t mask[4]) {
 	for (uint64_t i = 0; i < length; ++i)
 		dst[i] = src[i] ^ mask[i & 3];
@@ -734,30 +715,30 @@ static void Websocket_ImmediatePong(Websocket_Context *ctx, String message) {
 }
 
 static inline void Websocket_ResetParser(Websocket_Context *ctx) {
-	// Pop back the payload of the current frame
-	// This will make sure that the fragmented frames are serially joined
-	// in the cases where a control frames is received in between fragmented frames
-	ctx->reader.stream.seriallen -= ctx->reader.parser.payload_parsed;
-	memset(&ctx->reader.parser, 0, sizeof(ctx->reader.parser));
+	// The payload was used in place, the ring can take new bytes over it now
+	Websocket_Frame_Parser &parser = ctx->reader.parser;
+	if (parser.frame.payload.data)
+		RingBuffer_Consume(&ctx->reader.stream.ring, parser.frame.payload.length);
+	memset(&parser, 0, sizeof(parser));
 }
 
 static bool Websocket_ParseFrame(Websocket_Context *ctx) {
 	Websocket_Reader &reader       = ctx->reader;
-	Websocket_Read_Stream &stream  = reader.stream;
+	Ring_Buffer &ring              = reader.stream.ring;
 	Websocket_Frame_Parser &parser = reader.parser;
 
-	uint8_t scratch[14];
-
 	if (parser.state == PARSING_HEADER) {
-		if (Websocket_StreamReadableSize(&stream) < 2) return false;
+		if (RingBuffer_ReadableSize(&ring) < 2) return false;
 
-		Websocket_StreamRead(&stream, scratch, 2);
-		parser.frame.header = scratch[0];
-		parser.frame.fin    = (scratch[0] & 0x80) >> 7;
-		parser.frame.rsv    = (scratch[0] & 0x70) >> 4;
-		parser.frame.opcode = (scratch[0] & 0x0f) >> 0;
-		parser.frame.masked = (scratch[1] & 0x80) >> 7;
-		int payload_len = (scratch[1] & 0x7f);
+		uint8_t *header = RingBuffer_ReadPointer(&ring);
+		RingBuffer_Consume(&ring, 2);
+
+		parser.frame.header = header[0];
+		parser.frame.fin    = (header[0] & 0x80) >> 7;
+		parser.frame.rsv    = (header[0] & 0x70) >> 4;
+		parser.frame.opcode = (header[0] & 0x0f) >> 0;
+		parser.frame.masked = (header[1] & 0x80) >> 7;
+		int payload_len = (header[1] & 0x7f);
 
 		if (payload_len <= 125) {
 			parser.frame.payload.length = payload_len;
@@ -776,39 +757,45 @@ static bool Websocket_ParseFrame(Websocket_Context *ctx) {
 	}
 
 	if (parser.state == PARSING_LEN2) {
-		if (Websocket_StreamReadableSize(&stream) < 2) return false;
+		if (RingBuffer_ReadableSize(&ring) < 2) return false;
+
+		uint8_t *len = RingBuffer_ReadPointer(&ring);
+		RingBuffer_Consume(&ring, 2);
 
-		Websocket_StreamRead(&stream, scratch, 2);
-		ptrdiff_t payload_len = (((uint16_t)scratch[0] << 8) | (uint16_t)scratch[1]);
+		ptrdiff_t payload_len = (((uint16_t)len[0] << 8) | (uint16_t)len[1]);
 		parser.state = parser.frame.masked ? PARSING_MASK : PARSING_PAYLOAD_PRECHECK;
 		parser.frame.payload.length = payload_len;
 	}
 
 	if (parser.state == PARSING_LEN8) {
-		if (Websocket_StreamReadableSize(&stream) < 8) return false;
+		if (RingBuffer_ReadableSize(&ring) < 8) return false;
+
+		uint8_t *len = RingBuffer_ReadPointer(&ring);
+		RingBuffer_Consume(&ring, 8);
 
-		Websocket_StreamRead(&stream, scratch, 8);
 		ptrdiff_t payload_len = (
-			((uint64_t)scratch[0] << 56) | ((uint64_t)scratch[1] << 48) |
-			((uint64_t)scratch[2] << 40) | ((uint64_t)scratch[3] << 32) |
-			((uint64_t)scratch[4] << 24) | ((uint64_t)scratch[5] << 16) |
-			((uint64_t)scratch[6] << 8) | ((uint64_t)scratch[7] << 0));
+			((uint64_t)len[0] << 56) | ((uint64_t)len[1] << 48) |
+			((uint64_t)len[2] << 40) | ((uint64_t)len[3] << 32) |
+			((uint64_t)len[4] << 24) | ((uint64_t)len[5] << 16) |
+			((uint64_t)len[6] << 8) | ((uint64_t)len[7] << 0));
 		parser.state = parser.frame.masked ? PARSING_MASK : PARSING_PAYLOAD_PRECHECK;
 		parser.frame.payload.length = payload_len;
 	}
 
 	if (parser.state == PARSING_MASK) {
-		if (Websocket_StreamReadableSize(&stream) < 4) return false;
+		if (RingBuffer_ReadableSize(&ring) < 4) return false;
 
-		Websocket_StreamRead(&stream, parser.frame.mask, 4);
+		memcpy(parser.frame.mask, RingBuffer_ReadPointer(&ring), 4);
+		RingBuffer_Consume(&ring, 4);
 		parser.state = PARSING_PAYLOAD_PRECHECK;
 	}
 
 	if (parser.state == PARSING_PAYLOAD_PRECHECK) {
 		Assert(parser.frame.payload.data == nullptr);
 
+		// The payload has to fit the ring whole and the message the serial buffer
 		ptrdiff_t remaining_cap = reader.stream.p2cap - reader.stream.seriallen;
-		if (parser.frame.payload.length > remaining_cap) {
+		if (parser.frame.payload.length < 0 || parser.frame.payload.length > remaining_cap) {
 			parser.state = PARSING_DROPPED;
 			LogWarningEx("Websocket", "Dropped %d bytes. Frame payload too big. Skipped frame", (int)parser.frame.payload.length);
 			Websocket_SendImmediateClose(ctx, WEBSOCKET_CLOSE_MESSAGE_TOO_BIG);
@@ -818,28 +805,21 @@ static bool Websocket_ParseFrame(Websocket_Context *ctx) {
 	}
 
 	if (parser.state == PARSING_PAYLOAD) {
-		// Append at the end of serial buffer
-		ptrdiff_t remaining = parser.frame.payload.length - parser.payload_parsed;
-		ptrdiff_t read      = Websocket_StreamRead(&stream, reader.stream.serialized + reader.stream.seriallen, remaining);
-
-		parser.payload_parsed += read;
-		reader.stream.seriallen += read;
-		remaining -= read;
-
-		if (!remaining) {
-			// Correctly point the payload data at the position of just this frame payload
-			parser.frame.payload.data = reader.stream.serialized + reader.stream.seriallen - parser.payload_parsed;
-			return true;
-		}
-		return false;
+		// Used in place once all of it is received, consumed by Websocket_ResetParser
+		if (RingBuffer_ReadableSize(&ring) < parser.frame.payload.length)
+			return false;
+
+		parser.frame.payload.data = RingBuffer_ReadPointer(&ring);
+		parser.payload_parsed     = parser.frame.payload.length;
+		return true;
 	}
 
 	if (parser.state == PARSING_DROPPED) {
-		ptrdiff_t remaining = parser.frame.payload.length - reader.stream.seriallen;
-		ptrdiff_t dropped   = Websocket_StreamDrop(&stream, remaining);
-		reader.stream.seriallen += dropped;
-		remaining -= dropped;
-		if (!remaining)
+		ptrdiff_t remaining = Maximum(parser.frame.payload.length - parser.payload_parsed, (ptrdiff_t)0);
+		ptrdiff_t dropped   = Minimum(remaining, RingBuffer_ReadableSize(&ring));
+		RingBuffer_Consume(&ring, dropped);
+		parser.payload_parsed += dropped;
+		if (dropped == remaining)
 			Websocket_ResetParser(ctx);
 	}
 
@@ -859,8 +839,9 @@ static void Websocket_PushEventAndReadNext(Websocket_Context *ctx, Buffer buffer
 }
 
 static bool Websocket_HandleMessage(Websocket_Context *ctx) {
-	Websocket_Frame &frame = ctx->reader.parser.frame;
-	Buffer msg             = Buffer(ctx->reader.stream.serialized, ctx->reader.stream.seriallen);
+	Websocket_Frame &frame        = ctx->reader.parser.frame;
+	Websocket_Read_Stream &stream = ctx->reader.stream;
+	Buffer msg                    = frame.payload;
 
 	if (frame.rsv) {
 		Websocket_ResetParser(ctx);
@@ -924,6 +905,7 @@ static bool Websocket_HandleMessage(Websocket_Context *ctx) {
 			} break;
 
 			default: {
+				Websocket_ResetParser(ctx);
 				Websocket_SendImmediateClose(ctx, WEBSOCKET_CLOSE_PROTOCOL_ERROR);
 				return false;
 			}
@@ -933,36 +915,39 @@ static bool Websocket_HandleMessage(Websocket_Context *ctx) {
 		return true;
 	}
 
-	if (frame.fin) {
-		if (frame.opcode != WEBSOCKET_OP_CONTINUATION_FRAME) {
-			// single frame
-			Websocket_PushEventAndReadNext(ctx, msg, frame.header);
-		} else {
-			// final frame of fragmented frame
-			Websocket_PushEventAndReadNext(ctx, msg, ctx->reader.curr_node->header);
-		}
+	int prev_opcode = (stream.serialheader & 0x0f) >> 0;
+
+	if (frame.opcode && prev_opcode) {
+		LogErrorEx("Websocket", "Expected next fragment with 0x0 opcode, but got %d. Closing...", frame.opcode);
+		Websocket_SendImmediateClose(ctx, WEBSOCKET_CLOSE_PROTOCOL_ERROR);
+		Websocket_ResetParser(ctx);
+		return false;
+	}
+
+	if (!frame.opcode && !prev_opcode) {
+		LogErrorEx("Websocket", "Got continuation frame without a fragmented frame before it. Closing...");
+		Websocket_SendImmediateClose(ctx, WEBSOCKET_CLOSE_PROTOCOL_ERROR);
+		Websocket_ResetParser(ctx);
+		return false;
+	}
+
+	if (frame.fin && frame.opcode) {
+		// single frame, given from the ring
+		Websocket_PushEventAndReadNext(ctx, msg, frame.header);
 	} else {
-		int header      = ctx->reader.curr_node->header;
-		int prev_fin    = (header & 0x80) >> 7;
-		int prev_opcode = (header & 0x0f) >> 0;
-
-		if (prev_opcode) {
-			// continuation of fragmented frame
-			if (frame.opcode) {
-				LogErrorEx("Websocket", "Expected next fragment with 0x0 opcode, but got %d. Closing...", frame.opcode);
-				Websocket_SendImmediateClose(ctx, WEBSOCKET_CLOSE_PROTOCOL_ERROR);
-				Websocket_ResetParser(ctx);
-				return false;
-			}
-		} else {
+		if (frame.opcode) {
 			// first part of fragmented frame
-			if (!frame.opcode) {
-				LogErrorEx("Websocket", "Expected next fragment with 0x0 opcode, but got %d. Closing...", frame.opcode);
-				Websocket_SendImmediateClose(ctx, WEBSOCKET_CLOSE_PROTOCOL_ERROR);
-				Websocket_ResetParser(ctx);
-				return false;
-			}
-			ctx->reader.curr_node->header = frame.header;
+			stream.serialheader = frame.header;
+		}
+
+		memcpy(stream.serialized + stream.seriallen, msg.data, msg.length);
+		stream.seriallen += msg.length;
+
+		if (frame.fin) {
+			// final frame of fragmented frame, given joined with the ones before
+			Websocket_PushEventAndReadNext(ctx, Buffer(stream.serialized, stream.seriallen), stream.serialheader);
+			stream.seriallen    = 0;
+			stream.serialheader = 0;
 		}
 	}
 
@@ -970,22 +955,22 @@ static bool Websocket_HandleMessage(Websocket_Context *ctx) {
 	return true;
 }
 
-static bool Websocket_NetReceiveStream(Net_Socket *socket, Websocket_Read_Stream *stream) {
-	const ptrdiff_t buffer_size = stream->p2cap;
-	while (true) {
-		if (stream->stop >= stream->start) {
-			ptrdiff_t read_size = buffer_size - stream->stop;
-			ptrdiff_t read = Net_Receive(socket, stream->buffer + stream->stop, (int)read_size);
-			if (read == 0) return true;
-			if (read < 0) return false;
-			stream->stop = (stream->stop + read) & (buffer_size - 1);
-		} else {
-			ptrdiff_t read_size = stream->start - stream->stop - 1;
-			ptrdiff_t read = Net_Receive(socket, stream->buffer + stream->stop, (int)read_size);
-			if (read == 0) return true;
-			if (read < 0) return false;
-			stream->stop = (stream->stop + read) & (buffer_size - 1);
+static void Websocket_ParseFrames(Websocket_Context *ctx) {
+	// Stops when the read queue is full, the frames stay in the ring until a node is free
+	while (ctx->reader.curr_node && Websocket_ParseFrame(ctx))
+		Websocket_HandleMessage(ctx);
+}
+
+static bool Websocket_NetReceiveStream(Net_Socket *socket, Ring_Buffer *ring) {
+	while (RingBuffer_WritableSize(ring)) {
+		ptrdiff_t read = Net_Receive(socket, RingBuffer_WritePointer(ring), (int)RingBuffer_WritableSize(ring));
+		if (read == 0) return true;
+		if (read < 0) {
+			if (Net_GetLastError(socket) == NET_E_CONNECTION_CLOSED)
+				LogErrorEx("Websocket", "Lost connection unexpectedly");
+			return false;
 		}
+		RingBuffer_Commit(ring, read);
 	}
 	return true;
 }
@@ -994,6 +979,8 @@ static int Websocket_ThreadProc(void *arg) {
 	Net_Socket *websocket  = (Net_Socket *)arg;
 	Websocket_Context *ctx = (Websocket_Context *)Net_GetUserBuffer(websocket);
 
+	Profile_SetThreadName("Websocket");
+
 	pollfd fd;
 	fd.fd = Net_GetSocketDescriptor(websocket);
 
@@ -1004,13 +991,19 @@ static int Websocket_ThreadProc(void *arg) {
 		if (Websocket_HasWrite(ctx))
 			fd.events |= POLLWRNORM;
 
-		if (Websocket_HasRead(ctx))
+		if (Websocket_HasRead(ctx)) {
+			// Frames left in the ring while the read queue was full
+			Websocket_ParseFrames(ctx);
 			fd.events |= POLLRDNORM;
+		}
 
 		int presult = poll(&fd, 1, WEBSOCKET_MAX_WAIT_MS);
 
 		if (presult <= 0) continue;
 
+		// A zone for each wake up, the thread lives as long as the connection
+		ProfileZone("Websocket_ThreadProc");
+
 		if (fd.revents & POLLWRNORM) {
 			if (ctx->writer.control.length && !ctx->writer.normal.written) {
 				// Send control frames all at once since they will be replaced with another control frame
@@ -1054,16 +1047,13 @@ static int Websocket_ThreadProc(void *arg) {
 		}
 
 		if (fd.revents & POLLRDNORM) {
-			if (!Websocket_NetReceiveStream(websocket, &ctx->reader.stream)) {
+			if (!Websocket_NetReceiveStream(websocket, &ctx->reader.stream.ring)) {
 				LogErrorEx("Websocket", "Connection lost abrubtly while reading");
 				ctx->connection = WEBSOCKET_CLOSED;
 				return 1;
 			}
 
-			while (Websocket_ParseFrame(ctx)) {
-				if (Websocket_HandleMessage(ctx) && ctx->reader.curr_node)
-					continue;
-			}
+			Websocket_ParseFrames(ctx);
 		}
 
 		if (fd.revents & (POLLHUP | POLLERR) && ctx->connection == WEBSOCKET_CONNECTED) {
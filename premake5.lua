@@ -43,3 +43,44 @@ project "Katachi"
       files { "Kr/**.natvis" }
       defines { "_CRT_SECURE_NO_WARNINGS" }
       includedirs { "OpenSSL/include" }
+
+project "Benchmark"
+   kind "ConsoleApp"
+   language "C++"
+   cppdialect "C++17"
+
+   targetdir ("%{wks.location}/bin/%{cfg.buildcfg}-%{cfg.system}-%{cfg.architecture}")
+   objdir ("%{wks.location}/bin/int/%{cfg.buildcfg}-%{cfg.system}-%{cfg.architecture}/%{prj.name}")
+
+   files { "Benchmark/*.h", "Benchmark/*.cpp", "Source/Kr/**.h", "Source/Kr/**.cpp", "Source/Http.*", "Source/Network*", "Source/Json.*",
+           "Source/Discord.*", "Source/Websocket.*", "Source/Base64.h", "Source/SHA1.*" }
+   includedirs { "Source" }
+
+   ignoredefaultlibraries { "MSVCRT" }
+   defines { "NETWORK_OPENSSL_ENABLE" }
+
+   filter "configurations:Debug"
+      defines { "DEBUG", "BUILD_DEBUG" }
+      symbols "On"
+      runtime "Debug"
+
+   filter "configurations:Developer"
+      defines { "NDEBUG", "BUILD_DEVELOPER" }
+      optimize "On"
+      runtime "Release"
+
+   filter "configurations:Release"
+      defines { "NDEBUG", "BUILD_RELEASE" }
+      optimize "On"
+      runtime "Release"
+
+   filter "system:linux"
+   		links { "ssl", "crypto", "pthread" }
+
+   filter "system:macosx"
+   		links { "ssl", "crypto" }
+
+   filter "system:windows"
+      systemversion "latest"
+      defines { "_CRT_SECURE_NO_WARNINGS" }
+      includedirs { "OpenSSL/include" }